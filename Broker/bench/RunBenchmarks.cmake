@@ -0,0 +1,23 @@
+# runs every benchmark program and collects their results in one file
+# invoked by the run_benchmarks target with:
+#   BENCH_DIR   directory holding the bench_<name> programs
+#   BENCHMARKS  the names, separated by commas
+#   OUTPUT      file to write, one JSON object per line
+
+string(REPLACE "," ";" BENCH_LIST "${BENCHMARKS}")
+file(WRITE "${OUTPUT}" "")
+
+foreach(bench ${BENCH_LIST})
+    message(STATUS "Running bench_${bench}")
+    execute_process(
+        COMMAND "${BENCH_DIR}/bench_${bench}"
+        OUTPUT_VARIABLE bench_output
+        RESULT_VARIABLE bench_result
+    )
+    if(NOT bench_result EQUAL 0)
+        message(FATAL_ERROR "bench_${bench} failed: ${bench_result}")
+    endif(NOT bench_result EQUAL 0)
+    file(APPEND "${OUTPUT}" "${bench_output}")
+endforeach(bench)
+
+message(STATUS "Results written to ${OUTPUT}")
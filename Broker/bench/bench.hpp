@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Timing and reporting helpers shared by the benchmarks.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <time.h>
+
+#include <iostream>
+#include <string>
+
+#include "CLogger.hpp"
+
+namespace freedm {
+    namespace bench {
+
+/// Seconds of CPU time used by the calling thread.
+inline double ThreadSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Seconds on the monotonic wall clock.
+inline double WallSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Calls p_op in batches until at least p_seconds of thread CPU time has
+/// been spent and returns the operations per CPU second. Measuring CPU time
+/// rather than wall time gives a per-core figure that is stable on a
+/// loaded machine.
+template <typename Op>
+double OpsPerCpuSecond(Op p_op, double p_seconds = 1.0,
+    unsigned int p_batch = 100)
+{
+    unsigned long ops = 0;
+    // Warm caches and lazily built statics before timing.
+    for(unsigned int i = 0; i < p_batch; i++)
+        p_op();
+    double start = ThreadSeconds(), elapsed = 0;
+    do
+    {
+        for(unsigned int i = 0; i < p_batch; i++)
+            p_op();
+        ops += p_batch;
+        elapsed = ThreadSeconds() - start;
+    } while(elapsed < p_seconds);
+    return ops / elapsed;
+}
+
+/// Writes a single result as one line of JSON.
+inline void Report(const std::string &p_name, double p_value,
+    const std::string &p_unit, std::ostream &p_os = std::cout)
+{
+    p_os << "{\"benchmark\": \"" << p_name << "\", \"value\": " << p_value
+         << ", \"unit\": \"" << p_unit << "\"}" << std::endl;
+}
+
+/// Silences the broker loggers so that they don't dominate the timings.
+inline void QuietLogs()
+{
+    CGlobalLogger::instance().SetGlobalLevel(0);
+}
+
+    } // namespace bench
+} // namespace freedm
+
+#endif // BENCH_HPP
@@ -0,0 +1,235 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_ackdelay.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Counts the datagrams two brokers exchange while each sends
+///   a stream of sequenced reliable messages to the other, as group
+///   management and load balancing do. With ack-delay 0 every accepted
+///   message costs a separate ACK datagram. A longer delay lets ACKs be
+///   combined and carried by the data going the other way. The relays in
+///   between count the datagrams and can drop a share of them.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "IHandler.hpp"
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Sequenced messages each node sends per run.
+const unsigned int MESSAGES = 256;
+
+/// Forwards datagrams from one port to another, counting them and dropping
+/// a share of them.
+class Relay
+{
+public:
+    Relay(boost::asio::io_service &p_ios, unsigned short p_port,
+        unsigned short p_target, int p_loss)
+        : m_socket(p_ios, udp::endpoint(
+              boost::asio::ip::address_v4::loopback(), p_port)),
+          m_target(boost::asio::ip::address_v4::loopback(), p_target),
+          m_loss(p_loss), m_count(0) { }
+    void Start()
+    {
+        m_socket.async_receive_from(boost::asio::buffer(m_buffer), m_from,
+            boost::bind(&Relay::HandleRead, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+    }
+    unsigned long GetCount() const { return m_count; }
+private:
+    void HandleRead(const boost::system::error_code &e, std::size_t n)
+    {
+        if(e)
+            return;
+        m_count++;
+        if((rand()%100) >= m_loss)
+        {
+            boost::system::error_code ignored;
+            m_socket.send_to(boost::asio::buffer(m_buffer.data(), n),
+                m_target, 0, ignored);
+        }
+        Start();
+    }
+    udp::socket m_socket;
+    udp::endpoint m_target;
+    udp::endpoint m_from;
+    boost::array<char, 8192> m_buffer;
+    int m_loss;
+    unsigned long m_count;
+};
+
+/// Tells the broker to stop once both nodes have all their messages.
+struct Finish
+{
+    Finish(CBroker &p_broker) : m_broker(p_broker), m_nodes(0), m_done(0) { }
+    void NodeDone()
+    {
+        if(++m_nodes == 2)
+        {
+            m_done = bench::WallSeconds();
+            m_broker.Stop();
+        }
+    }
+    CBroker &m_broker;
+    unsigned int m_nodes;
+    double m_done;
+};
+
+/// A module that counts the messages it is given.
+class CountingModule : public IReadHandler
+{
+public:
+    CountingModule(boost::asio::io_service &p_ios, Finish &p_finish)
+        : m_strand(p_ios), m_finish(p_finish), m_count(0) { }
+    void HandleRead(const CMessage &)
+    {
+        if(++m_count == MESSAGES)
+            m_finish.NodeDone();
+    }
+    boost::asio::io_service::strand m_strand;
+    Finish &m_finish;
+    unsigned int m_count;
+};
+
+/// A port nobody is using right now.
+unsigned short FreePort(boost::asio::io_service &p_ios)
+{
+    udp::socket s(p_ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    return s.local_endpoint().port();
+}
+
+/// Has node A and node B each send MESSAGES to the other through lossy
+/// relays. Returns the messages delivered per second and sets p_datagrams
+/// to the datagrams written by both nodes.
+double Run(unsigned int p_delay, int p_loss, const std::string &p_tag,
+    unsigned long &p_datagrams)
+{
+    boost::asio::io_service ios_;
+    std::string realA_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    std::string realB_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    unsigned short relayA_ = FreePort(ios_), relayB_ = FreePort(ios_);
+    Relay toA_(ios_, relayA_, boost::lexical_cast<unsigned short>(realA_),
+        p_loss);
+    Relay toB_(ios_, relayB_, boost::lexical_cast<unsigned short>(realB_),
+        p_loss);
+    std::string uuidA_ = "node-a-" + p_tag, uuidB_ = "node-b-" + p_tag;
+
+    CGlobalConfiguration &config_ = CGlobalConfiguration::instance();
+    config_.SetAckDelay(p_delay);
+    config_.SetUUID(uuidA_);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayA_));
+    CConnectionManager managerA_;
+    config_.SetUUID(uuidB_);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayB_));
+    CConnectionManager managerB_;
+
+    CDispatcher dispatchA_, dispatchB_;
+    CBroker brokerA_("127.0.0.1", realA_, dispatchA_, ios_, managerA_);
+    CBroker brokerB_("127.0.0.1", realB_, dispatchB_, ios_, managerB_);
+    Finish finish_(brokerB_);
+    CountingModule moduleA_(ios_, finish_), moduleB_(ios_, finish_);
+    dispatchA_.RegisterReadHandler("bench", &moduleA_, &moduleA_.m_strand);
+    dispatchB_.RegisterReadHandler("bench", &moduleB_, &moduleB_.m_strand);
+    toA_.Start();
+    toB_.Start();
+
+    managerA_.PutHostname(uuidB_, "127.0.0.1",
+        boost::lexical_cast<std::string>(relayB_));
+    managerB_.PutHostname(uuidA_, "127.0.0.1",
+        boost::lexical_cast<std::string>(relayA_));
+    ConnectionPtr connAB_ = managerA_.GetConnectionByUUID(uuidB_, ios_,
+        dispatchA_);
+    ConnectionPtr connBA_ = managerB_.GetConnectionByUUID(uuidA_, ios_,
+        dispatchB_);
+
+    double start_ = bench::WallSeconds();
+    for(unsigned int i = 1; i <= MESSAGES; i++)
+    {
+        CMessage m_;
+        m_.GetSubMessages().put("bench.value", i);
+        m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+        connAB_->Send(m_);
+        connBA_->Send(m_);
+    }
+    brokerB_.Run();
+    managerA_.StopAll();
+    managerB_.StopAll();
+    p_datagrams = toA_.GetCount() + toB_.GetCount();
+    return (moduleA_.m_count + moduleB_.m_count) / (finish_.m_done - start_);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    srand(1);
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+
+    unsigned int delays[] = { 0, 2, 5 };
+    int losses[] = { 0, 5 };
+    for(std::size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++)
+    {
+        for(std::size_t d = 0; d < sizeof(delays) / sizeof(delays[0]); d++)
+        {
+            std::string tag = boost::lexical_cast<std::string>(l) + "-" +
+                boost::lexical_cast<std::string>(d);
+            std::string prefix = "ackdelay.loss_" +
+                boost::lexical_cast<std::string>(losses[l]) + ".delay_" +
+                boost::lexical_cast<std::string>(delays[d]);
+            unsigned long datagrams = 0;
+            double rate = Run(delays[d], losses[l], tag, datagrams);
+            bench::Report(prefix + ".rate", rate, "msgs/s");
+            bench::Report(prefix + ".datagrams_per_msg",
+                double(datagrams) / (2 * MESSAGES), "datagrams");
+        }
+    }
+    return 0;
+}
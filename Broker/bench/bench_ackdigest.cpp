@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_ackdigest.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures the hashing done to acknowledge one sequenced
+///   message: the receiver hashing what it received to build the ACK, and
+///   the sender hashing its copy to match the ACK. The XML hash brokers used
+///   before wire version 2 is compared with the cached 64-bit digests, and
+///   each is shown as the share of one core it takes at 1000 messages per
+///   second from a peer.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+
+namespace {
+
+/// Messages per second from one peer the CPU share is given for.
+const double PEER_RATE = 1000;
+
+/// A group management peer list, representative of election traffic.
+CMessage MakePeerList()
+{
+    CMessage m_;
+    m_.SetSourceUUID("36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.SetSequenceNumber(417);
+    m_.SetProtocol("SRC");
+    m_.SetSendTimestampNow();
+    m_.SetExpireTimeFromNow(boost::posix_time::milliseconds(3000));
+    m_.GetSubMessages().put("gm", "PeerList");
+    m_.GetSubMessages().put("gm.source", "36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.GetSubMessages().put("gm.groupid", 12);
+    for(int i = 0; i < 8; i++)
+    {
+        m_.GetSubMessages().add("gm.peers.peer.uuid",
+            "dgi-node-0" + std::string(1, '0' + i) + ".example.org:1870");
+    }
+    return m_;
+}
+
+/// One ACK with the hash brokers before wire version 2 use. Neither side
+/// can keep it: the receiver has to decode and serialize the submessages,
+/// and the sender serializes its copy again for every ACK it checks.
+struct LegacyAck
+{
+    LegacyAck(const CMessage &p_received, const CMessage &p_sent)
+        : m_received(p_received), m_sent(p_sent), m_matched(0) { }
+    void operator()()
+    {
+        CMessage received_ = m_received;
+        if(received_.GetLegacyHash() == m_sent.GetLegacyHash())
+            m_matched++;
+    }
+    const CMessage &m_received;
+    const CMessage &m_sent;
+    unsigned long m_matched;
+};
+
+/// One ACK with the digest. The receiver digests the bytes it was sent; the
+/// sender's copy keeps the digest from the first ACK it checked.
+struct DigestAck
+{
+    DigestAck(const CMessage &p_received, const CMessage &p_sent)
+        : m_received(p_received), m_sent(p_sent), m_matched(0) { }
+    void operator()()
+    {
+        CMessage received_ = m_received;
+        if(received_.GetHash() == m_sent.GetHash())
+            m_matched++;
+    }
+    const CMessage &m_received;
+    const CMessage &m_sent;
+    unsigned long m_matched;
+};
+
+/// Reports a rate and the share of a core it implies at PEER_RATE.
+void ReportRate(const std::string &p_name, double p_rate)
+{
+    bench::Report("ackdigest." + p_name + ".rate", p_rate, "acks/s");
+    bench::Report("ackdigest." + p_name + ".cpu_at_1k",
+        100 * PEER_RATE / p_rate, "%");
+}
+
+/// Copying the received message is part of every case; measure it alone so
+/// it can be told apart from the hashing.
+struct CopyOnly
+{
+    CopyOnly(const CMessage &p_received) : m_received(p_received) { }
+    void operator()()
+    {
+        CMessage received_ = m_received;
+        (void)received_;
+    }
+    const CMessage &m_received;
+};
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CMessage sent_ = MakePeerList(), received_;
+    std::string datagram_;
+    CWireCodec::Encode(sent_, datagram_);
+    CWireCodec::Decode(datagram_.data(), datagram_.size(), received_);
+
+    ReportRate("copy_only", bench::OpsPerCpuSecond(CopyOnly(received_)));
+
+    LegacyAck legacy_(received_, sent_);
+    ReportRate("legacy_xml", bench::OpsPerCpuSecond(legacy_));
+
+    DigestAck xxhash_(received_, sent_);
+    ReportRate("xxhash64", bench::OpsPerCpuSecond(xxhash_));
+
+    CGlobalConfiguration::instance().SetStrongDigest(true);
+    CMessage strongSent_ = sent_;
+    strongSent_.SetSendTimestamp(sent_.GetSendTimestamp());
+    DigestAck siphash_(received_, strongSent_);
+    ReportRate("siphash24", bench::OpsPerCpuSecond(siphash_));
+    return 0;
+}
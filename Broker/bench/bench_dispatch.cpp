@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_dispatch.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures the cost of CDispatcher::HandleRequest as more
+///   modules are registered, with handlers called directly so the figure is
+///   the routing alone, and the cost of passing messages through a module's
+///   queue to its strand.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CDispatcher.hpp"
+#include "CMessage.hpp"
+#include "IHandler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+
+namespace {
+
+/// Messages queued before the module's strand gets to run.
+const std::size_t BURST = 64;
+
+/// A module that only counts what it is given.
+struct CountingModule : public IReadHandler
+{
+    CountingModule() : count(0) { }
+    void HandleRead(const CMessage &) { count++; }
+    unsigned long count;
+};
+
+struct DispatchOp
+{
+    DispatchOp(CDispatcher &d, const CMessage &m) : dispatch(&d), msg(&m) { }
+    void operator()() { dispatch->HandleRequest(*msg); }
+    CDispatcher *dispatch;
+    const CMessage *msg;
+};
+
+/// Queues a burst of messages for a module on a strand, then lets the
+/// io_service drain them, as a busy connection strand and the module's
+/// strand would.
+struct QueuedOp
+{
+    QueuedOp(CDispatcher &d, const CMessage &m, boost::asio::io_service &i)
+        : dispatch(&d), msg(&m), ios(&i) { }
+    void operator()()
+    {
+        for(std::size_t i = 0; i < BURST; i++)
+            dispatch->HandleRequest(*msg);
+        ios->poll();
+        ios->reset();
+    }
+    CDispatcher *dispatch;
+    const CMessage *msg;
+    boost::asio::io_service *ios;
+};
+
+/// Dispatches a message for the last of p_modules registered modules.
+void Run(unsigned int p_modules)
+{
+    CDispatcher dispatch_;
+    std::vector<CountingModule> modules_(p_modules);
+    std::string key_;
+    for(unsigned int i = 0; i < p_modules; i++)
+    {
+        key_ = "module" + boost::lexical_cast<std::string>(i);
+        dispatch_.RegisterReadHandler(key_, &modules_[i]);
+    }
+    CMessage msg_;
+    msg_.GetSubMessages().put(key_ + ".value", 1);
+
+    double rate_ = bench::OpsPerCpuSecond(DispatchOp(dispatch_, msg_), 1.0,
+        1000);
+    bench::Report("dispatch.modules_" +
+        boost::lexical_cast<std::string>(p_modules) + ".latency",
+        1e9 / rate_, "ns/msg");
+}
+
+/// Dispatches bursts through a module's queue and reports the queue's
+/// counters alongside the cost per message.
+void RunQueued()
+{
+    boost::asio::io_service ios_;
+    boost::asio::io_service::strand strand_(ios_);
+    CDispatcher dispatch_;
+    CountingModule module_;
+    dispatch_.RegisterReadHandler("module", &module_, &strand_);
+    CMessage msg_;
+    msg_.GetSubMessages().put("module.value", 1);
+
+    double rate_ = BURST * bench::OpsPerCpuSecond(
+        QueuedOp(dispatch_, msg_, ios_), 1.0, 10);
+    CReadQueue::Stats stats_ = dispatch_.GetQueueStats()["module"];
+    bench::Report("dispatch.queued.latency", 1e9 / rate_, "ns/msg");
+    bench::Report("dispatch.queued.max_depth", stats_.maxDepth, "msgs");
+    bench::Report("dispatch.queued.handler", 1e3 * stats_.handlerMicros /
+        std::max(stats_.handled, 1ul), "ns/msg");
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    Run(1);
+    Run(4);
+    Run(16);
+    RunQueued();
+    return 0;
+}
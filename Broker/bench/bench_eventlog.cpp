@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_eventlog.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures what recording an event costs per call, with no
+///   event log started and with one writing to a file, next to a Notice
+///   log line written to a discarding stream for scale.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CEventLog.hpp"
+#include "CLogger.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <streambuf>
+
+namespace bench = freedm::bench;
+using freedm::broker::CEventLog;
+
+namespace {
+
+CLocalLogger Logger("bench_eventlog");
+
+/// A stream buffer that throws everything away.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) { return n; }
+};
+
+/// What CSRConnection records for each message it writes.
+void Record()
+{
+    static boost::int64_t seq = 0;
+    CEventLog::Record(CEventLog::SR_SEND, 3, ++seq, 8);
+}
+
+/// The same facts as a text log line.
+void Line()
+{
+    static int seq = 0;
+    Logger.Notice << "Sent " << ++seq << " in flight " << 8 << std::endl;
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    Logger.SetOutputLevel(5);
+    const char *path = "bench_eventlog.bin";
+
+    bench::Report("eventlog.idle",
+        1e9 / bench::OpsPerCpuSecond(&Record, 1.0, 1000), "ns/call");
+
+    std::remove(path);
+    {
+        CEventLog log_(path);
+        log_.Start();
+        bench::Report("eventlog.recording",
+            1e9 / bench::OpsPerCpuSecond(&Record, 1.0, 1000), "ns/call");
+        log_.Stop();
+    }
+    std::remove(path);
+
+    NullBuffer null_;
+    std::streambuf *old_ = std::clog.rdbuf(&null_);
+    double line_ = 1e9 / bench::OpsPerCpuSecond(&Line, 1.0, 1000);
+    std::clog.rdbuf(old_);
+    bench::Report("eventlog.logline", line_, "ns/call");
+    return 0;
+}
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_fanout.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Opens connections from one broker to a growing number of
+///   peers, with and without shared-socket, and reports the file
+///   descriptors the broker holds and the CPU spent per peer. The peers are
+///   all one socket that never reads, so only the sending side is measured.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <dirent.h>
+
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Messages sent to each peer.
+const unsigned int MESSAGES = 4;
+
+/// File descriptors this process has open.
+unsigned int OpenFiles()
+{
+    unsigned int count_ = 0;
+    DIR *dir_ = opendir("/proc/self/fd");
+    if(!dir_)
+        return 0;
+    while(readdir(dir_))
+        count_++;
+    closedir(dir_);
+    // ".", ".." and the directory itself
+    return count_ - 3;
+}
+
+/// Connects to p_peers peers and sends each of them MESSAGES messages.
+/// Reports the descriptors added and the CPU time per peer.
+void Run(unsigned int p_peers, bool p_shared)
+{
+    boost::asio::io_service ios_;
+    udp::socket sink_(ios_, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    std::string sinkPort_ =
+        boost::lexical_cast<std::string>(sink_.local_endpoint().port());
+    std::string tag_ = std::string(p_shared ? "shared" : "connected") +
+        ".peers_" + boost::lexical_cast<std::string>(p_peers);
+
+    CGlobalConfiguration &config_ = CGlobalConfiguration::instance();
+    config_.SetSharedSocket(p_shared);
+    config_.SetUUID("fanout-" + tag_);
+    CConnectionManager manager_;
+    CDispatcher dispatch_;
+    CBroker broker_("127.0.0.1", "0", dispatch_, ios_, manager_);
+
+    unsigned int before_ = OpenFiles();
+    double start_ = bench::ThreadSeconds();
+    for(unsigned int i = 0; i < p_peers; i++)
+    {
+        std::string peer_ = "peer-" + boost::lexical_cast<std::string>(i);
+        manager_.PutHostname(peer_, "127.0.0.1", sinkPort_);
+        ConnectionPtr conn_ = manager_.GetConnectionByUUID(peer_, ios_,
+            dispatch_);
+        for(unsigned int j = 0; j < MESSAGES; j++)
+        {
+            CMessage m_;
+            m_.GetSubMessages().put("bench.value", j);
+            m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+            conn_->Send(m_);
+        }
+    }
+    // Hand out the work queued above: lookups, sends and flushes.
+    while(ios_.poll() > 0)
+        ;
+    double cpu_ = bench::ThreadSeconds() - start_;
+    unsigned int after_ = OpenFiles();
+    manager_.StopAll();
+    ios_.poll();
+
+    bench::Report("fanout." + tag_ + ".fds", after_ - before_, "fds");
+    bench::Report("fanout." + tag_ + ".cpu_per_peer", cpu_ * 1e6 / p_peers,
+        "us");
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetListenPort("0");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+
+    unsigned int peers[] = { 16, 128, 512 };
+    for(std::size_t p = 0; p < sizeof(peers) / sizeof(peers[0]); p++)
+    {
+        Run(peers[p], false);
+        Run(peers[p], true);
+    }
+    return 0;
+}
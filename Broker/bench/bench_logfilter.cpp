@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_logfilter.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures what a log statement costs per call when its level
+///   is filtered out, and when it is written to a discarding stream. The
+///   filtered case is what Debug lines cost in a normal run; configure with
+///   -DMAX_LOG_LEVEL=5 to see it with Debug and Info compiled out.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CLogger.hpp"
+
+#include <iostream>
+#include <streambuf>
+
+namespace bench = freedm::bench;
+
+namespace {
+
+CLocalLogger Logger("bench_logfilter");
+
+/// A stream buffer that throws everything away.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) { return n; }
+};
+
+/// The shape of most broker log lines: a literal and a flush.
+void Literal()
+{
+    Logger.Debug << "Sending message" << std::endl;
+}
+
+/// The function trace at the top of most broker functions.
+void Trace()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+}
+
+/// A line with numbers to format.
+void Values()
+{
+    static int count = 0;
+    Logger.Debug << "Window " << ++count << " rtt " << 0.125 * count
+                 << std::endl;
+}
+
+/// The same line at a level that is enabled.
+void Written()
+{
+    static int count = 0;
+    Logger.Notice << "Window " << ++count << " rtt " << 0.125 * count
+                  << std::endl;
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    Logger.SetOutputLevel(5);
+
+    bench::Report("logfilter.filtered.literal",
+        1e9 / bench::OpsPerCpuSecond(&Literal, 1.0, 1000), "ns/call");
+    bench::Report("logfilter.filtered.trace",
+        1e9 / bench::OpsPerCpuSecond(&Trace, 1.0, 1000), "ns/call");
+    bench::Report("logfilter.filtered.values",
+        1e9 / bench::OpsPerCpuSecond(&Values, 1.0, 1000), "ns/call");
+
+    NullBuffer null_;
+    std::streambuf *old_ = std::clog.rdbuf(&null_);
+    double written_ = 1e9 / bench::OpsPerCpuSecond(&Written, 1.0, 1000);
+    std::clog.rdbuf(old_);
+    bench::Report("logfilter.written.values", written_, "ns/call");
+    return 0;
+}
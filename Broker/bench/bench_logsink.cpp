@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_logsink.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures how long a log line holds up the thread that logs
+///   it, written synchronously and through the background writer. Output
+///   goes to a stream that discards it, and to one that takes a millisecond
+///   per write like a slow terminal or a busy disk.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CLogger.hpp"
+#include "CLogSink.hpp"
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <streambuf>
+
+namespace bench = freedm::bench;
+
+namespace {
+
+CLocalLogger Logger("bench_logsink");
+
+/// Lines logged per run against the slow stream.
+const unsigned int SLOW_LINES = 200;
+
+/// A stream buffer that throws everything away, optionally after a delay.
+class NullBuffer : public std::streambuf
+{
+public:
+    NullBuffer(long p_delay) : m_delay(p_delay) { }
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n)
+    {
+        if(m_delay > 0)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(m_delay));
+        return n;
+    }
+private:
+    long m_delay;
+};
+
+/// A line shaped like the per-message Notice lines.
+void Line()
+{
+    static int count = 0;
+    Logger.Notice << "Accepted message " << ++count << " from peer"
+                  << std::endl;
+}
+
+/// Logs to a stream with the given delay per write, through a sink if
+/// p_sink is set, and reports the caller's cost per line.
+void Run(const std::string &p_prefix, long p_delay, bool p_sink)
+{
+    NullBuffer null_(p_delay);
+    std::streambuf *old_ = std::clog.rdbuf(&null_);
+    CLogSink sink_(4096, CLogSink::DROP, &std::clog);
+    if(p_sink)
+        sink_.Start();
+
+    if(p_delay == 0)
+    {
+        bench::Report(p_prefix + ".cpu", 1e9 / bench::OpsPerCpuSecond(&Line),
+            "ns/line");
+    }
+    else
+    {
+        double start_ = bench::WallSeconds();
+        for(unsigned int i = 0; i < SLOW_LINES; i++)
+            Line();
+        bench::Report(p_prefix + ".wall",
+            1e9 * (bench::WallSeconds() - start_) / SLOW_LINES, "ns/line");
+    }
+
+    sink_.Stop();
+    std::clog.rdbuf(old_);
+    if(p_sink)
+    {
+        CLogSink::Stats stats_ = sink_.GetStats();
+        bench::Report(p_prefix + ".lines_per_write",
+            double(stats_.written) / std::max(stats_.batches, 1UL), "lines");
+        bench::Report(p_prefix + ".dropped", stats_.dropped, "lines");
+    }
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    Logger.SetOutputLevel(5);
+
+    Run("logsink.null.sync", 0, false);
+    Run("logsink.null.async", 0, true);
+    Run("logsink.slow.sync", 1, false);
+    Run("logsink.slow.async", 1, true);
+    return 0;
+}
@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_loopback.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures end-to-end throughput between several brokers in
+///   one process. Every broker sends a stream of sequenced reliable messages
+///   to every other over loopback UDP, so the figure covers encoding, the
+///   sockets, the listener, the protocols and the dispatcher together.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "IHandler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Sequenced messages each broker sends to each other broker per run.
+const unsigned int MESSAGES = 64;
+
+/// Seconds a run may take before it is given up on.
+const unsigned int DEADLINE = 60;
+
+/// Counts what every broker's module receives and stops the brokers once
+/// all of it has arrived.
+class Tally
+{
+public:
+    Tally(CBroker &p_broker, unsigned long p_expected)
+        : m_broker(p_broker), m_expected(p_expected), m_count(0),
+          m_done(0) { }
+    void Add()
+    {
+        if(++m_count == m_expected)
+        {
+            m_done = bench::WallSeconds();
+            m_broker.Stop();
+        }
+    }
+    CBroker &m_broker;
+    unsigned long m_expected;
+    unsigned long m_count;
+    double m_done;
+};
+
+/// A module that hands each message it is given to the tally.
+class CountingModule : public IReadHandler
+{
+public:
+    CountingModule(boost::asio::io_service &p_ios)
+        : m_strand(p_ios), m_tally(0) { }
+    void HandleRead(const CMessage &)
+    {
+        m_tally->Add();
+    }
+    boost::asio::io_service::strand m_strand;
+    Tally *m_tally;
+};
+
+/// One broker and what it needs. The manager takes its identity from the
+/// configuration when it is built.
+struct Node
+{
+    Node(boost::asio::io_service &p_ios, const std::string &p_uuid,
+        const std::string &p_port)
+        : uuid(p_uuid), port(p_port), module(p_ios)
+    {
+        CGlobalConfiguration::instance().SetUUID(p_uuid);
+        CGlobalConfiguration::instance().SetListenPort(p_port);
+        manager.reset(new CConnectionManager());
+        broker.reset(new CBroker("127.0.0.1", p_port, dispatch, p_ios,
+            *manager));
+        dispatch.RegisterReadHandler("bench", &module, &module.m_strand);
+    }
+    std::string uuid;
+    std::string port;
+    boost::scoped_ptr<CConnectionManager> manager;
+    CDispatcher dispatch;
+    boost::scoped_ptr<CBroker> broker;
+    CountingModule module;
+};
+
+/// A port nobody is using right now.
+std::string FreePort(boost::asio::io_service &p_ios)
+{
+    udp::socket s(p_ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    return boost::lexical_cast<std::string>(s.local_endpoint().port());
+}
+
+/// Stops the brokers if the run takes too long.
+void GiveUp(const boost::system::error_code &p_error, CBroker *p_broker)
+{
+    if(!p_error)
+        p_broker->Stop();
+}
+
+/// Has p_nodes brokers send to each other and returns the messages
+/// delivered per wall clock second.
+double Run(unsigned int p_nodes, unsigned long &p_delivered)
+{
+    boost::asio::io_service ios_;
+    std::vector< boost::shared_ptr<Node> > nodes_;
+    for(unsigned int i = 0; i < p_nodes; i++)
+    {
+        std::string uuid_ = "node-" + boost::lexical_cast<std::string>(p_nodes)
+            + "-" + boost::lexical_cast<std::string>(i);
+        nodes_.push_back(boost::shared_ptr<Node>(
+            new Node(ios_, uuid_, FreePort(ios_))));
+    }
+    Tally tally_(*nodes_[0]->broker,
+        static_cast<unsigned long>(p_nodes) * (p_nodes - 1) * MESSAGES);
+    for(unsigned int i = 0; i < p_nodes; i++)
+    {
+        nodes_[i]->module.m_tally = &tally_;
+    }
+    boost::asio::deadline_timer deadline_(ios_,
+        boost::posix_time::seconds(DEADLINE));
+    deadline_.async_wait(boost::bind(&GiveUp,
+        boost::asio::placeholders::error, nodes_[0]->broker.get()));
+
+    double start_ = bench::WallSeconds();
+    for(unsigned int i = 0; i < p_nodes; i++)
+    {
+        for(unsigned int j = 0; j < p_nodes; j++)
+        {
+            if(i == j)
+                continue;
+            nodes_[i]->manager->PutHostname(nodes_[j]->uuid, "127.0.0.1",
+                nodes_[j]->port);
+            ConnectionPtr conn_ = nodes_[i]->manager->GetConnectionByUUID(
+                nodes_[j]->uuid, ios_, nodes_[i]->dispatch);
+            for(unsigned int k = 1; k <= MESSAGES; k++)
+            {
+                CMessage m_;
+                m_.GetSubMessages().put("bench.value", k);
+                m_.SetExpireTimeFromNow(boost::posix_time::seconds(DEADLINE));
+                conn_->Send(m_);
+            }
+        }
+    }
+    // The brokers share one io_service, so running one runs them all.
+    nodes_[0]->broker->Run();
+    if(tally_.m_done == 0)
+        tally_.m_done = bench::WallSeconds();
+    deadline_.cancel();
+    for(unsigned int i = 0; i < p_nodes; i++)
+    {
+        nodes_[i]->manager->StopAll();
+    }
+    p_delivered = tally_.m_count;
+    return tally_.m_count / (tally_.m_done - start_);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+
+    unsigned int counts[] = { 2, 4, 8 };
+    for(std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        std::string prefix = "loopback.nodes_" +
+            boost::lexical_cast<std::string>(counts[c]);
+        unsigned long delivered = 0;
+        double rate = Run(counts[c], delivered);
+        bench::Report(prefix + ".rate", rate, "msgs/s");
+        bench::Report(prefix + ".delivered", delivered, "msgs");
+    }
+    return 0;
+}
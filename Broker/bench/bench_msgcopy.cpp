@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_msgcopy.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Counts the heap allocations made copying a message, sending
+///   one message to many peers and dispatching a received message to
+///   several modules, for a small and a large set of submessages. The
+///   allocations are counted by replacing the global operator new.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "IHandler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <pthread.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Allocations made by the main thread while counting is on.
+unsigned long g_allocs = 0;
+bool g_counting = false;
+pthread_t g_main;
+
+} // unnamed namespace
+
+void * operator new(std::size_t p_size) throw(std::bad_alloc)
+{
+    if(g_counting && pthread_equal(pthread_self(), g_main))
+        g_allocs++;
+    void *p_ = std::malloc(p_size ? p_size : 1);
+    if(!p_)
+        throw std::bad_alloc();
+    return p_;
+}
+
+void operator delete(void *p_) throw()
+{
+    std::free(p_);
+}
+
+void * operator new[](std::size_t p_size) throw(std::bad_alloc)
+{
+    return operator new(p_size);
+}
+
+void operator delete[](void *p_) throw()
+{
+    operator delete(p_);
+}
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Peers a message is sent to, as an lbAgent broadcast to a large group.
+const unsigned int PEERS = 50;
+
+/// Modules a received message is dispatched to.
+const unsigned int MODULES = 3;
+
+/// Starts counting allocations.
+void StartCounting()
+{
+    g_allocs = 0;
+    g_counting = true;
+}
+
+/// Stops counting and returns the allocations made since StartCounting.
+unsigned long StopCounting()
+{
+    g_counting = false;
+    return g_allocs;
+}
+
+/// A module that only counts what it is given.
+struct CountingModule : public IReadHandler
+{
+    CountingModule() : count(0) { }
+    void HandleRead(const CMessage &) { count++; }
+    unsigned long count;
+};
+
+/// Builds a message as a module would, with p_fields submessage entries.
+CMessage MakeMessage(unsigned int p_fields)
+{
+    CMessage m_;
+    m_.SetSourceUUID("msgcopy-source.example.org:51870");
+    m_.SetProtocol("SRC");
+    m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+    m_.GetSubMessages().put("lb", "demand");
+    for(unsigned int i = 0; i < p_fields; i++)
+    {
+        m_.GetSubMessages().add("lb.peers.peer",
+            "peer-" + boost::lexical_cast<std::string>(i) + ".example.org");
+    }
+    return m_;
+}
+
+/// Copies a message and reports the allocations per copy.
+void RunCopy(const std::string &p_tag, const CMessage &p_msg)
+{
+    const unsigned int COPIES = 100;
+    std::vector<CMessage> copies_;
+    copies_.reserve(COPIES);
+    StartCounting();
+    for(unsigned int i = 0; i < COPIES; i++)
+        copies_.push_back(p_msg);
+    unsigned long allocs_ = StopCounting();
+    bench::Report("msgcopy." + p_tag + ".copy.allocs",
+        double(allocs_) / COPIES, "allocs");
+}
+
+/// Sends a message to PEERS peers through their connections and reports
+/// the allocations per peer, from the send call to the datagram being
+/// handed to the socket.
+void RunFanout(const std::string &p_tag, const CMessage &p_msg)
+{
+    boost::asio::io_service ios_;
+    udp::socket sink_(ios_, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    std::string sinkPort_ =
+        boost::lexical_cast<std::string>(sink_.local_endpoint().port());
+
+    CGlobalConfiguration::instance().SetUUID("msgcopy-" + p_tag);
+    CConnectionManager manager_;
+    CDispatcher dispatch_;
+    CBroker broker_("127.0.0.1", "0", dispatch_, ios_, manager_);
+    std::vector<ConnectionPtr> conns_;
+    for(unsigned int i = 0; i < PEERS; i++)
+    {
+        std::string peer_ = "peer-" + boost::lexical_cast<std::string>(i);
+        manager_.PutHostname(peer_, "127.0.0.1", sinkPort_);
+        conns_.push_back(manager_.GetConnectionByUUID(peer_, ios_,
+            dispatch_));
+        // As if the peer had answered in the binary encoding
+        conns_.back()->SetPeerWireVersion(CWireCodec::VERSION);
+    }
+    // Synchronize every connection first, so only the message is counted.
+    for(unsigned int i = 0; i < PEERS; i++)
+        conns_[i]->Send(p_msg);
+    while(ios_.poll() > 0)
+        ;
+
+    StartCounting();
+    for(unsigned int i = 0; i < PEERS; i++)
+        conns_[i]->Send(p_msg);
+    while(ios_.poll() > 0)
+        ;
+    unsigned long allocs_ = StopCounting();
+    manager_.StopAll();
+    ios_.poll();
+
+    bench::Report("msgcopy." + p_tag + ".fanout.allocs_per_peer",
+        double(allocs_) / PEERS, "allocs");
+}
+
+/// Dispatches a message received in the binary encoding to MODULES queued
+/// modules and reports the allocations per module.
+void RunDispatch(const std::string &p_tag, const CMessage &p_msg)
+{
+    boost::asio::io_service ios_;
+    boost::asio::io_service::strand strand_(ios_);
+    CDispatcher dispatch_;
+    std::vector<CountingModule> modules_(MODULES);
+    for(unsigned int i = 0; i < MODULES; i++)
+    {
+        dispatch_.RegisterReadHandler("lb", &modules_[i], &strand_);
+    }
+    std::string datagram_;
+    CWireCodec::Encode(p_msg, datagram_, CWireCodec::VERSION);
+    CMessage received_;
+    CWireCodec::Decode(datagram_.data(), datagram_.size(), received_);
+
+    StartCounting();
+    dispatch_.HandleRequest(received_);
+    ios_.poll();
+    unsigned long allocs_ = StopCounting();
+
+    bench::Report("msgcopy." + p_tag + ".dispatch.allocs_per_module",
+        double(allocs_) / MODULES, "allocs");
+}
+
+} // unnamed namespace
+
+int main()
+{
+    g_main = pthread_self();
+    bench::QuietLogs();
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetListenPort("0");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+
+    unsigned int fields[] = { 4, 64 };
+    for(std::size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        std::string tag_ = "fields_" +
+            boost::lexical_cast<std::string>(fields[f]);
+        CMessage msg_ = MakeMessage(fields[f]);
+        RunCopy(tag_, msg_);
+        RunFanout(tag_, msg_);
+        RunDispatch(tag_, msg_);
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_peerlookup.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures how fast modules find the connection to a peer
+///   among many: by UUID, as GetConnectionByUUID does, and by the interned
+///   peer ID IPeerNode now keeps. Runs with one thread and with several
+///   looking up at once, as modules on different strands do.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+
+namespace {
+
+/// Peers registered with the manager.
+const unsigned int PEERS = 256;
+
+/// Lookups each thread makes per timed run.
+const unsigned int LOOKUPS = 200000;
+
+/// The manager and the names of its peers.
+struct Fixture
+{
+    Fixture()
+        : broker(CGlobalConfiguration::instance().GetListenAddress(), "0",
+              dispatch, ios, manager)
+    {
+        for(unsigned int i = 0; i < PEERS; i++)
+        {
+            // Same shape and length as a real UUID.
+            std::string uuid_ = "6ba7b810-9dad-11d1-80b4-" +
+                std::string(12 - boost::lexical_cast<std::string>(i).size(),
+                '0') + boost::lexical_cast<std::string>(i);
+            manager.PutHostname(uuid_, "127.0.0.1", "1870");
+            uuids.push_back(uuid_);
+            ids.push_back(manager.GetPeerId(uuid_));
+            manager.GetConnectionByPeerId(ids.back(), ios, dispatch);
+        }
+        // Let every lookup finish so the connections are not stale.
+        while(ios.poll() > 0)
+            ;
+    }
+    boost::asio::io_service ios;
+    CConnectionManager manager;
+    CDispatcher dispatch;
+    CBroker broker;
+    std::vector<std::string> uuids;
+    std::vector<PeerId> ids;
+};
+
+void ByUUID(Fixture *p_fixture, unsigned int p_seed)
+{
+    for(unsigned int i = 0; i < LOOKUPS; i++)
+    {
+        p_fixture->manager.GetConnectionByUUID(
+            p_fixture->uuids[(i * 7 + p_seed) % PEERS], p_fixture->ios,
+            p_fixture->dispatch);
+    }
+}
+
+void ByPeerId(Fixture *p_fixture, unsigned int p_seed)
+{
+    for(unsigned int i = 0; i < LOOKUPS; i++)
+    {
+        p_fixture->manager.GetConnectionByPeerId(
+            p_fixture->ids[(i * 7 + p_seed) % PEERS], p_fixture->ios,
+            p_fixture->dispatch);
+    }
+}
+
+/// Runs p_lookup on p_threads threads at once and returns lookups per
+/// second of wall time.
+double Rate(void (*p_lookup)(Fixture *, unsigned int), Fixture &p_fixture,
+    unsigned int p_threads)
+{
+    boost::thread_group threads_;
+    double start_ = bench::WallSeconds();
+    for(unsigned int t = 0; t < p_threads; t++)
+    {
+        threads_.create_thread(boost::bind(p_lookup, &p_fixture, t));
+    }
+    threads_.join_all();
+    return p_threads * double(LOOKUPS) / (bench::WallSeconds() - start_);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetListenAddress("127.0.0.1");
+    CGlobalConfiguration::instance().SetListenPort("0");
+    CGlobalConfiguration::instance().SetUUID("peerlookup");
+    Fixture fixture_;
+
+    unsigned int threads[] = { 1, 4 };
+    for(std::size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        std::string prefix = "peerlookup.threads_" +
+            boost::lexical_cast<std::string>(threads[t]);
+        bench::Report(prefix + ".by_uuid",
+            Rate(&ByUUID, fixture_, threads[t]), "lookups/s");
+        bench::Report(prefix + ".by_peer_id",
+            Rate(&ByPeerId, fixture_, threads[t]), "lookups/s");
+    }
+    fixture_.manager.StopAll();
+    return 0;
+}
@@ -0,0 +1,257 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_protocol.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures the sequenced reliable and sequenced unreliable
+///   protocols alone. Two instances of a protocol write to in-memory queues
+///   instead of a socket and are handed each other's datagrams the way
+///   CListener hands them over, so the figures are the encoding, decoding
+///   and protocol state machines with no system calls.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "bench.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "CSRConnection.hpp"
+#include "CSUConnection.hpp"
+#include "CWireCodec.hpp"
+#include "CDatagramBatch.hpp"
+#include "RequestParser.hpp"
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <deque>
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+
+namespace {
+
+/// A protocol whose datagrams go to a queue in memory instead of the
+/// connection's socket.
+template <typename Protocol>
+class Captured : public Protocol
+{
+public:
+    Captured(CConnection *p_conn, std::deque<std::string> &p_out)
+        : Protocol(p_conn), m_out(p_out) { }
+protected:
+    /// Encodes the message as IProtocol::Write does and queues the bytes.
+    void Write(CMessage msg)
+    {
+        boost::array<char, CDatagramBatch::MAX_DATAGRAM> buffer_;
+        boost::array<char, CDatagramBatch::MAX_DATAGRAM>::iterator it_;
+        it_ = buffer_.begin();
+        boost::tie(boost::tuples::ignore, it_) = Synthesize(msg, it_,
+            buffer_.end() - it_, this->GetConnection()->GetWireVersion());
+        m_out.push_back(std::string(buffer_.begin(), it_));
+    }
+private:
+    std::deque<std::string> &m_out;
+};
+
+/// One side of the exchange: a connection for the protocol to belong to,
+/// the protocol, and the datagrams it has written.
+template <typename Protocol>
+struct Node
+{
+    Node(boost::asio::io_service &p_ios, const std::string &p_uuid,
+        const std::string &p_peer, unsigned int p_wire)
+        : manager(CreateManager(p_uuid)),
+          conn(new CConnection(p_ios, *manager, dispatch, p_peer)),
+          protocol(conn.get(), out), delivered(0)
+    {
+        conn->SetPeerWireVersion(p_wire);
+    }
+    /// The manager takes its UUID from the configuration when it is built.
+    static CConnectionManager * CreateManager(const std::string &p_uuid)
+    {
+        CGlobalConfiguration::instance().SetUUID(p_uuid);
+        return new CConnectionManager();
+    }
+    boost::scoped_ptr<CConnectionManager> manager;
+    CDispatcher dispatch;
+    ConnectionPtr conn;
+    std::deque<std::string> out;
+    Captured<Protocol> protocol;
+    unsigned long delivered;
+};
+
+/// Decodes a datagram and passes it to the protocol as
+/// CListener::HandleMessage would, counting what is delivered.
+template <typename Protocol>
+void Deliver(const std::string &p_datagram, Node<Protocol> &p_node)
+{
+    CMessage msg_;
+    const char *data_ = p_datagram.data();
+    if(CWireCodec::IsBinary(data_, p_datagram.size()))
+    {
+        CWireCodec::Decode(data_, p_datagram.size(), msg_);
+    }
+    else
+    {
+        Parse(msg_, data_, data_ + p_datagram.size());
+    }
+    CMessage ack_;
+    if(IProtocol::DetachACK(msg_, ack_))
+    {
+        p_node.protocol.RecieveACK(ack_);
+    }
+    if(msg_.GetStatus() == CMessage::Accepted)
+    {
+        p_node.protocol.RecieveACK(msg_);
+    }
+    else if(p_node.protocol.Recieve(msg_))
+    {
+        p_node.protocol.SendACK(msg_);
+        p_node.delivered++;
+    }
+    CMessage ready_;
+    while(p_node.protocol.TakeReady(ready_))
+    {
+        p_node.delivered++;
+    }
+}
+
+/// Sends p_burst messages from one node to the other and passes datagrams
+/// back and forth until neither has anything left to say.
+template <typename Protocol>
+class Exchange
+{
+public:
+    Exchange(unsigned int p_burst, unsigned int p_wire)
+        : m_burst(p_burst),
+          m_sender(m_ios, "bench-sender", "bench-receiver", p_wire),
+          m_receiver(m_ios, "bench-receiver", "bench-sender", p_wire),
+          m_datagrams(0), m_messages(0)
+    {
+        m_message.GetSubMessages().put("bench.value", 42);
+        m_message.GetSubMessages().put("bench.text", "a typical payload");
+    }
+    void operator()()
+    {
+        for(unsigned int i = 0; i < m_burst; i++)
+        {
+            CMessage m_ = m_message;
+            m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+            m_sender.protocol.Send(m_);
+        }
+        m_messages += m_burst;
+        while(!m_sender.out.empty() || !m_receiver.out.empty())
+        {
+            if(!m_sender.out.empty())
+            {
+                Deliver(m_sender.out.front(), m_receiver);
+                m_sender.out.pop_front();
+            }
+            else
+            {
+                Deliver(m_receiver.out.front(), m_sender);
+                m_receiver.out.pop_front();
+            }
+            m_datagrams++;
+        }
+        // Resend timers were cancelled or moved; let their handlers finish
+        // rather than pile up.
+        m_ios.reset();
+        m_ios.poll();
+    }
+    /// Datagrams written per message sent
+    double GetDatagramsPerMessage() const
+        { return m_messages ? double(m_datagrams) / m_messages : 0; }
+    /// Messages the receiver delivered per message sent
+    double GetDeliveredRatio() const
+        { return m_messages ? double(m_receiver.delivered) / m_messages : 0; }
+private:
+    unsigned int m_burst;
+    boost::asio::io_service m_ios;
+    Node<Protocol> m_sender;
+    Node<Protocol> m_receiver;
+    CMessage m_message;
+    unsigned long m_datagrams;
+    unsigned long m_messages;
+};
+
+/// Calls an exchange by pointer, since OpsPerCpuSecond copies what it is
+/// given.
+template <typename Protocol>
+struct Step
+{
+    Exchange<Protocol> *exchange;
+    void operator()() { (*exchange)(); }
+};
+
+/// Runs one protocol at one burst size over XML and binary datagrams.
+template <typename Protocol>
+void Measure(const std::string &p_name, unsigned int p_burst)
+{
+    const char *wires[] = { "xml", "binary" };
+    for(unsigned int w = 0; w < 2; w++)
+    {
+        CGlobalConfiguration::instance().SetBinaryWire(w == 1);
+        Exchange<Protocol> exchange(p_burst, w == 1 ? CWireCodec::VERSION : 0);
+        std::string prefix = "protocol." + p_name + "." + wires[w] +
+            ".burst_" + boost::lexical_cast<std::string>(p_burst);
+        Step<Protocol> step = { &exchange };
+        double rate = bench::OpsPerCpuSecond(step, 1.0, 1);
+        bench::Report(prefix + ".rate", rate * p_burst, "msgs/s");
+        bench::Report(prefix + ".datagrams_per_msg",
+            exchange.GetDatagramsPerMessage(), "datagrams");
+        bench::Report(prefix + ".delivered", exchange.GetDeliveredRatio(),
+            "msgs/msg");
+    }
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CGlobalConfiguration &config = CGlobalConfiguration::instance();
+    config.SetHostname("127.0.0.1");
+    config.SetListenPort("0");
+    config.SetAckDelay(0);
+    config.SetSRWindow(32);
+
+    unsigned int bursts[] = { 1, 32 };
+    for(std::size_t b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++)
+    {
+        Measure<CSRConnection>("src", bursts[b]);
+        Measure<CSUConnection>("suc", bursts[b]);
+    }
+    return 0;
+}
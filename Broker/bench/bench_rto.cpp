@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_rto.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Compares a fixed 25 ms resend timeout, as the sequenced
+///   reliable protocol used before, with the adaptive one on paths of LAN
+///   and WAN latency, with and without loss. The relays between the nodes
+///   delay each datagram by the one way latency, give or take a fifth, and
+///   drop a share of them. Duplicates are the copies of a message that
+///   reached the receiver after the first; each one is a wasted resend.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "IHandler.hpp"
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdlib>
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Sequenced messages sent per run.
+const unsigned int MESSAGES = 128;
+
+/// Forwards datagrams from one port to another after a delay, dropping a
+/// share of them and counting the ones it forwards.
+class DelayRelay
+{
+public:
+    DelayRelay(boost::asio::io_service &p_ios, unsigned short p_port,
+        unsigned short p_target, int p_loss, unsigned int p_latency)
+        : m_ios(p_ios),
+          m_socket(p_ios, udp::endpoint(
+              boost::asio::ip::address_v4::loopback(), p_port)),
+          m_target(boost::asio::ip::address_v4::loopback(), p_target),
+          m_loss(p_loss), m_latency(p_latency), m_forwarded(0) { }
+    void Start()
+    {
+        m_socket.async_receive_from(boost::asio::buffer(m_buffer), m_from,
+            boost::bind(&DelayRelay::HandleRead, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+    }
+    unsigned long GetForwarded() const { return m_forwarded; }
+private:
+    typedef boost::shared_ptr<boost::asio::deadline_timer> TimerPtr;
+    typedef boost::shared_ptr<std::string> DatagramPtr;
+    void HandleRead(const boost::system::error_code &e, std::size_t n)
+    {
+        if(e)
+            return;
+        if((rand()%100) >= m_loss)
+        {
+            // Latency in microseconds, within a fifth either way.
+            long spread = m_latency * 400 + 1;
+            long delay = m_latency * 800 + rand() % spread;
+            TimerPtr timer(new boost::asio::deadline_timer(m_ios));
+            DatagramPtr datagram = boost::make_shared<std::string>(
+                m_buffer.data(), n);
+            timer->expires_from_now(boost::posix_time::microseconds(delay));
+            timer->async_wait(boost::bind(&DelayRelay::Forward, this,
+                timer, datagram));
+        }
+        Start();
+    }
+    void Forward(TimerPtr, DatagramPtr p_datagram)
+    {
+        boost::system::error_code ignored;
+        m_socket.send_to(boost::asio::buffer(*p_datagram), m_target, 0,
+            ignored);
+        m_forwarded++;
+    }
+    boost::asio::io_service &m_ios;
+    udp::socket m_socket;
+    udp::endpoint m_target;
+    udp::endpoint m_from;
+    boost::array<char, 8192> m_buffer;
+    int m_loss;
+    unsigned int m_latency;
+    unsigned long m_forwarded;
+};
+
+/// A module that stops the broker once it has every message.
+class CountingModule : public IReadHandler
+{
+public:
+    CountingModule(boost::asio::io_service &p_ios, CBroker &p_broker)
+        : m_strand(p_ios), m_broker(p_broker), m_count(0), m_done(0) { }
+    void HandleRead(const CMessage &)
+    {
+        if(++m_count == MESSAGES)
+        {
+            m_done = bench::WallSeconds();
+            m_broker.Stop();
+        }
+    }
+    boost::asio::io_service::strand m_strand;
+    CBroker &m_broker;
+    unsigned int m_count;
+    double m_done;
+};
+
+/// A port nobody is using right now.
+unsigned short FreePort(boost::asio::io_service &p_ios)
+{
+    udp::socket s(p_ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    return s.local_endpoint().port();
+}
+
+/// What one run measured
+struct Result
+{
+    double rate;
+    double duplicates;
+    double retransmits;
+    double rto;
+};
+
+/// Sends MESSAGES from node A to node B through delaying, lossy relays.
+/// A fixed timeout is had by setting both bounds to the same value.
+Result Run(unsigned int p_minRTO, unsigned int p_maxRTO, unsigned int p_latency,
+    int p_loss, const std::string &p_tag)
+{
+    boost::asio::io_service ios_;
+    std::string realA_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    std::string realB_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    unsigned short relayA_ = FreePort(ios_), relayB_ = FreePort(ios_);
+    DelayRelay toA_(ios_, relayA_, boost::lexical_cast<unsigned short>(realA_),
+        p_loss, p_latency);
+    DelayRelay toB_(ios_, relayB_, boost::lexical_cast<unsigned short>(realB_),
+        p_loss, p_latency);
+
+    CGlobalConfiguration &config_ = CGlobalConfiguration::instance();
+    config_.SetMinRTO(p_minRTO);
+    config_.SetMaxRTO(p_maxRTO);
+    config_.SetUUID("node-a-" + p_tag);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayA_));
+    CConnectionManager managerA_;
+    config_.SetUUID("node-b-" + p_tag);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayB_));
+    CConnectionManager managerB_;
+
+    CDispatcher dispatchA_, dispatchB_;
+    CBroker brokerA_("127.0.0.1", realA_, dispatchA_, ios_, managerA_);
+    CBroker brokerB_("127.0.0.1", realB_, dispatchB_, ios_, managerB_);
+    CountingModule module_(ios_, brokerB_);
+    dispatchB_.RegisterReadHandler("bench", &module_, &module_.m_strand);
+    toA_.Start();
+    toB_.Start();
+
+    managerA_.PutHostname("node-b-" + p_tag, "127.0.0.1",
+        boost::lexical_cast<std::string>(relayB_));
+    ConnectionPtr conn_ = managerA_.GetConnectionByUUID("node-b-" + p_tag,
+        ios_, dispatchA_);
+
+    double start_ = bench::WallSeconds();
+    for(unsigned int i = 1; i <= MESSAGES; i++)
+    {
+        CMessage m_;
+        m_.GetSubMessages().put("bench.value", i);
+        m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+        conn_->Send(m_);
+    }
+    brokerB_.Run();
+    CRttEstimator::Stats stats_ = conn_->GetRttStats()["SRC"];
+    managerA_.StopAll();
+
+    Result result_;
+    result_.rate = module_.m_count / (module_.m_done - start_);
+    // Everything B got beyond one copy of each message and the SYN.
+    result_.duplicates = (double(toB_.GetForwarded()) - MESSAGES - 1) /
+        MESSAGES;
+    result_.retransmits = double(stats_.retransmits) / MESSAGES;
+    result_.rto = stats_.rto / 1000.0;
+    return result_;
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    srand(1);
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+    CGlobalConfiguration::instance().SetAckDelay(2);
+
+    // 23 ms plus the 2 ms ack-delay is the old fixed REFIRE_TIME.
+    const char * modes[] = { "fixed_25ms", "adaptive" };
+    unsigned int minRTO[] = { 23, 10 };
+    unsigned int maxRTO[] = { 23, 1000 };
+    unsigned int latencies[] = { 2, 40 };
+    int losses[] = { 0, 5 };
+    for(std::size_t t = 0; t < sizeof(latencies) / sizeof(latencies[0]); t++)
+    {
+        for(std::size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++)
+        {
+            for(std::size_t m = 0; m < 2; m++)
+            {
+                std::string tag = boost::lexical_cast<std::string>(t) + "-" +
+                    boost::lexical_cast<std::string>(l) + "-" +
+                    boost::lexical_cast<std::string>(m);
+                std::string prefix = std::string("rto.") + modes[m] +
+                    ".latency_" + boost::lexical_cast<std::string>(
+                    latencies[t]) + "ms.loss_" +
+                    boost::lexical_cast<std::string>(losses[l]);
+                Result r = Run(minRTO[m], maxRTO[m], latencies[t], losses[l],
+                    tag);
+                bench::Report(prefix + ".rate", r.rate, "msgs/s");
+                bench::Report(prefix + ".retransmits", r.retransmits,
+                    "per msg");
+                bench::Report(prefix + ".duplicates", r.duplicates,
+                    "per msg");
+                bench::Report(prefix + ".final_rto", r.rto, "ms");
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_srwindow.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures sequenced reliable throughput between two brokers
+///   in one process for several send windows and loss rates. A window of 1
+///   is the old stop-and-wait behavior. Loss is added by relays between the
+///   nodes that drop datagrams with the same rand()%100 rule CUSTOMNETWORK
+///   uses, so no special build is needed.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "IHandler.hpp"
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Sequenced messages sent per run.
+const unsigned int MESSAGES = 256;
+
+/// Forwards datagrams from one port to another, dropping a share of them.
+class Relay
+{
+public:
+    Relay(boost::asio::io_service &p_ios, unsigned short p_port,
+        unsigned short p_target, int p_loss)
+        : m_socket(p_ios, udp::endpoint(
+              boost::asio::ip::address_v4::loopback(), p_port)),
+          m_target(boost::asio::ip::address_v4::loopback(), p_target),
+          m_loss(p_loss) { }
+    void Start()
+    {
+        m_socket.async_receive_from(boost::asio::buffer(m_buffer), m_from,
+            boost::bind(&Relay::HandleRead, this,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+    }
+private:
+    void HandleRead(const boost::system::error_code &e, std::size_t n)
+    {
+        if(e)
+            return;
+        if((rand()%100) >= m_loss)
+        {
+            boost::system::error_code ignored;
+            m_socket.send_to(boost::asio::buffer(m_buffer.data(), n),
+                m_target, 0, ignored);
+        }
+        Start();
+    }
+    udp::socket m_socket;
+    udp::endpoint m_target;
+    udp::endpoint m_from;
+    boost::array<char, 8192> m_buffer;
+    int m_loss;
+};
+
+/// A module that checks its messages arrive in order and stops the broker
+/// once it has all of them.
+class OrderedModule : public IReadHandler
+{
+public:
+    OrderedModule(boost::asio::io_service &p_ios, CBroker &p_broker)
+        : m_strand(p_ios), m_broker(p_broker), m_count(0), m_misordered(0),
+          m_last(0), m_done(0) { }
+    void HandleRead(const CMessage &msg)
+    {
+        unsigned int value = msg.GetSubMessages().get<unsigned int>(
+            "bench.value");
+        if(value <= m_last)
+            m_misordered++;
+        m_last = value;
+        if(++m_count == MESSAGES)
+        {
+            m_done = bench::WallSeconds();
+            m_broker.Stop();
+        }
+    }
+    boost::asio::io_service::strand m_strand;
+    CBroker &m_broker;
+    unsigned int m_count;
+    unsigned int m_misordered;
+    unsigned int m_last;
+    double m_done;
+};
+
+/// A port nobody is using right now.
+unsigned short FreePort(boost::asio::io_service &p_ios)
+{
+    udp::socket s(p_ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    return s.local_endpoint().port();
+}
+
+/// Sends MESSAGES from node A to node B through lossy relays in both
+/// directions and returns the messages delivered per second.
+double Run(unsigned int p_window, int p_loss, const std::string &p_tag,
+    unsigned int &p_misordered)
+{
+    boost::asio::io_service ios_;
+    std::string realA_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    std::string realB_ = boost::lexical_cast<std::string>(FreePort(ios_));
+    unsigned short relayA_ = FreePort(ios_), relayB_ = FreePort(ios_);
+    Relay toA_(ios_, relayA_, boost::lexical_cast<unsigned short>(realA_),
+        p_loss);
+    Relay toB_(ios_, relayB_, boost::lexical_cast<unsigned short>(realB_),
+        p_loss);
+
+    // Each manager takes its identity from the configuration when it is
+    // built; the advertised port is the relay in front of the node.
+    CGlobalConfiguration &config_ = CGlobalConfiguration::instance();
+    config_.SetSRWindow(p_window);
+    config_.SetUUID("node-a-" + p_tag);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayA_));
+    CConnectionManager managerA_;
+    config_.SetUUID("node-b-" + p_tag);
+    config_.SetListenPort(boost::lexical_cast<std::string>(relayB_));
+    CConnectionManager managerB_;
+
+    CDispatcher dispatchA_, dispatchB_;
+    CBroker brokerA_("127.0.0.1", realA_, dispatchA_, ios_, managerA_);
+    CBroker brokerB_("127.0.0.1", realB_, dispatchB_, ios_, managerB_);
+    OrderedModule module_(ios_, brokerB_);
+    dispatchB_.RegisterReadHandler("bench", &module_, &module_.m_strand);
+    toA_.Start();
+    toB_.Start();
+
+    managerA_.PutHostname("node-b-" + p_tag, "127.0.0.1",
+        boost::lexical_cast<std::string>(relayB_));
+    ConnectionPtr conn_ = managerA_.GetConnectionByUUID("node-b-" + p_tag,
+        ios_, dispatchA_);
+
+    double start_ = bench::WallSeconds();
+    for(unsigned int i = 1; i <= MESSAGES; i++)
+    {
+        CMessage m_;
+        m_.GetSubMessages().put("bench.value", i);
+        m_.SetExpireTimeFromNow(boost::posix_time::seconds(60));
+        conn_->Send(m_);
+    }
+    brokerB_.Run();
+    managerA_.StopAll();
+    p_misordered = module_.m_misordered;
+    return module_.m_count / (module_.m_done - start_);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    srand(1);
+    CGlobalConfiguration::instance().SetHostname("127.0.0.1");
+    CGlobalConfiguration::instance().SetThreadCount(1);
+
+    unsigned int windows[] = { 1, 8, 32 };
+    int losses[] = { 0, 5, 20 };
+    for(std::size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++)
+    {
+        for(std::size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+        {
+            std::string tag = boost::lexical_cast<std::string>(l) + "-" +
+                boost::lexical_cast<std::string>(w);
+            std::string prefix = "srwindow.loss_" +
+                boost::lexical_cast<std::string>(losses[l]) + ".window_" +
+                boost::lexical_cast<std::string>(windows[w]);
+            unsigned int misordered = 0;
+            double rate = Run(windows[w], losses[l], tag, misordered);
+            bench::Report(prefix + ".rate", rate, "msgs/s");
+            bench::Report(prefix + ".misordered", misordered, "msgs");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_threadpool.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Measures how inbound message throughput scales with the
+///   number of threads CBroker::Run uses. Simulated peers hand binary
+///   datagrams to their connection strands exactly as CListener does; each
+///   one is accepted by the sequenced protocol, acknowledged, and dispatched
+///   to a module running on its own strand.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CBroker.hpp"
+#include "CConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "IHandler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using freedm::CGlobalConfiguration;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Remote nodes sending to this one at the same time.
+const std::size_t PEERS = 64;
+/// Sequenced messages each peer sends per run, after its SYN.
+const std::size_t MESSAGES = 256;
+/// Datagrams a peer hands over per strand handler, like one drained batch.
+const std::size_t BURST = 8;
+
+/// A module that reads one field from each message it is given.
+class CountingModule : public IReadHandler
+{
+public:
+    CountingModule(boost::asio::io_service &p_ios, CBroker &p_broker,
+        std::size_t p_expected)
+        : m_strand(p_ios), m_broker(p_broker), m_expected(p_expected),
+          m_count(0), m_sum(0), m_done(0) { }
+    void HandleRead(const CMessage &msg)
+    {
+        m_sum += msg.GetSubMessages().get<unsigned int>("bench.value");
+        if(++m_count == m_expected)
+        {
+            m_done = bench::WallSeconds();
+            m_broker.Stop();
+        }
+    }
+    boost::asio::io_service::strand m_strand;
+    CBroker &m_broker;
+    std::size_t m_expected;
+    std::size_t m_count;
+    unsigned long m_sum;
+    double m_done;
+};
+
+/// One simulated peer: its datagrams, in the order it would send them.
+struct Peer
+{
+    ConnectionPtr conn;
+    std::vector<std::string> datagrams;
+    std::size_t next;
+};
+
+/// The SYN and sequenced messages a peer sends. Every message is already
+/// expired so the acknowledgements are written once and never refired.
+std::vector<std::string> MakeDatagrams(const std::string &p_uuid)
+{
+    std::vector<std::string> result_;
+    std::string buf_;
+    CMessage syn_(CMessage::Created);
+    syn_.SetSourceUUID(p_uuid);
+    syn_.SetSourceHostname(remotehost());
+    syn_.SetSequenceNumber(0);
+    syn_.SetProtocol("SRC");
+    syn_.SetSendTimestampNow();
+    syn_.SetExpireTimeFromNow(boost::posix_time::milliseconds(0));
+    CWireCodec::Encode(syn_, buf_);
+    result_.push_back(buf_);
+    for(std::size_t i = 1; i <= MESSAGES; i++)
+    {
+        CMessage m_ = syn_;
+        m_.SetStatus(CMessage::OK);
+        m_.SetSequenceNumber(i);
+        m_.GetSubMessages().put("bench.value", i);
+        buf_.clear();
+        CWireCodec::Encode(m_, buf_);
+        result_.push_back(buf_);
+    }
+    return result_;
+}
+
+/// What CListener::HandleMessage does for each datagram, run on the peer's
+/// connection strand a burst at a time.
+void Feed(Peer *p_peer, CDispatcher *p_dispatch)
+{
+    for(std::size_t i = 0; i < BURST &&
+        p_peer->next < p_peer->datagrams.size(); i++, p_peer->next++)
+    {
+        const std::string &d_ = p_peer->datagrams[p_peer->next];
+        CMessage msg_;
+        CWireCodec::Decode(d_.data(), d_.size(), msg_);
+        if(p_peer->conn->Recieve(msg_))
+        {
+            p_dispatch->HandleRequest(msg_);
+        }
+    }
+    if(p_peer->next < p_peer->datagrams.size())
+    {
+        p_peer->conn->GetStrand().post(boost::bind(&Feed, p_peer, p_dispatch));
+    }
+}
+
+/// Runs every peer's messages through a broker using p_threads threads and
+/// returns the messages delivered per wall clock second.
+double Run(unsigned int p_threads, const std::vector<std::string> &p_uuids,
+    const std::vector< std::vector<std::string> > &p_datagrams,
+    unsigned short p_sinkPort)
+{
+    CGlobalConfiguration::instance().SetThreadCount(p_threads);
+    boost::asio::io_service ios_;
+    CConnectionManager manager_;
+    CDispatcher dispatch_;
+    CBroker broker_("127.0.0.1", "0", dispatch_, ios_, manager_);
+    CountingModule module_(ios_, broker_, PEERS * MESSAGES);
+    dispatch_.RegisterReadHandler("bench", &module_, &module_.m_strand);
+
+    std::vector<Peer> peers_(p_uuids.size());
+    std::string port_ = boost::lexical_cast<std::string>(p_sinkPort);
+    for(std::size_t i = 0; i < peers_.size(); i++)
+    {
+        manager_.PutHostname(p_uuids[i], "127.0.0.1", port_);
+        peers_[i].conn = manager_.GetConnectionByUUID(p_uuids[i], ios_,
+            dispatch_);
+        peers_[i].datagrams = p_datagrams[i];
+        peers_[i].next = 0;
+    }
+
+    double start_ = bench::WallSeconds();
+    for(std::size_t i = 0; i < peers_.size(); i++)
+    {
+        peers_[i].conn->GetStrand().post(
+            boost::bind(&Feed, &peers_[i], &dispatch_));
+    }
+    broker_.Run();
+    return module_.m_count / (module_.m_done - start_);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    CGlobalConfiguration::instance().SetUUID("bench-node");
+    CGlobalConfiguration::instance().SetHostname("localhost");
+    CGlobalConfiguration::instance().SetListenPort("0");
+
+    // Acknowledgements go to a socket nobody reads; once its buffer is full
+    // the kernel drops them, which costs the sender the same either way.
+    boost::asio::io_service ios;
+    udp::socket sink(ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+
+    // Peers are given fresh UUIDs per run so every run starts unsynced.
+    unsigned int counts[] = { 1, 2, 4, 8 };
+    for(std::size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        std::vector<std::string> uuids;
+        std::vector< std::vector<std::string> > datagrams;
+        for(std::size_t i = 0; i < PEERS; i++)
+        {
+            uuids.push_back("peer-" + boost::lexical_cast<std::string>(c) +
+                "-" + boost::lexical_cast<std::string>(i));
+            datagrams.push_back(MakeDatagrams(uuids.back()));
+        }
+        double rate = Run(counts[c], uuids, datagrams,
+            sink.local_endpoint().port());
+        bench::Report("threadpool.threads_" +
+            boost::lexical_cast<std::string>(counts[c]) + ".rate", rate,
+            "msgs/s");
+    }
+    bench::Report("threadpool.cores", boost::thread::hardware_concurrency(),
+        "cores");
+    return 0;
+}
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_udpbatch.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Compares one system call per datagram against the batched
+///   recvmmsg/sendmmsg path on a loopback socket pair.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CDatagramBatch.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+using boost::asio::ip::udp;
+
+namespace {
+
+/// Datagrams sent back to back in one burst, like an election round.
+const std::size_t BURST = 64;
+/// Typical binary encoded group management message.
+const std::size_t DATAGRAM_SIZE = 200;
+
+/// System calls and datagrams seen by an op, kept outside the op because
+/// OpsPerCpuSecond works on a copy.
+struct Counters
+{
+    Counters() : syscalls(0), messages(0) { }
+    unsigned long syscalls;
+    unsigned long messages;
+};
+
+/// One burst through the old path: a send and a recv per datagram.
+struct PerDatagramOp
+{
+    PerDatagramOp(int s, int r, const std::vector<std::string> &d, Counters &c)
+        : tx(s), rx(r), burst(&d), count(&c) { }
+    void operator()()
+    {
+        char buf[CDatagramBatch::MAX_DATAGRAM];
+        for(std::size_t i = 0; i < burst->size(); i++)
+            send(tx, (*burst)[i].data(), (*burst)[i].size(), 0);
+        for(std::size_t i = 0; i < burst->size(); i++)
+            recv(rx, buf, sizeof(buf), 0);
+        count->syscalls += 2 * burst->size();
+        count->messages += burst->size();
+    }
+    int tx, rx;
+    const std::vector<std::string> *burst;
+    Counters *count;
+};
+
+/// One burst through CDatagramBatch with a given batch size.
+struct BatchedOp
+{
+    BatchedOp(int s, int r, const std::vector<std::string> &d,
+        CDatagramBatch &b, Counters &c)
+        : tx(s), rx(r), burst(&d), batch(&b), count(&c) { }
+    void operator()()
+    {
+        std::size_t size = batch->GetSlots();
+        CDatagramBatch::Send(tx, *burst, size);
+        count->syscalls += (burst->size() + size - 1) / size;
+        std::size_t received = 0;
+        while(received < burst->size())
+        {
+            received += batch->Receive(rx);
+            count->syscalls++;
+        }
+        count->messages += burst->size();
+    }
+    int tx, rx;
+    const std::vector<std::string> *burst;
+    CDatagramBatch *batch;
+    Counters *count;
+};
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    boost::asio::io_service ios;
+    udp::socket rx(ios, udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0));
+    udp::socket tx(ios, udp::v4());
+    rx.set_option(boost::asio::socket_base::receive_buffer_size(1 << 20));
+    tx.connect(rx.local_endpoint());
+
+    std::vector<std::string> burst(BURST, std::string(DATAGRAM_SIZE, 'x'));
+    int txfd = tx.native_handle(), rxfd = rx.native_handle();
+
+    Counters single;
+    double rate = BURST * bench::OpsPerCpuSecond(
+        PerDatagramOp(txfd, rxfd, burst, single), 1.0, 10);
+    bench::Report("udpbatch.per_datagram.rate", rate, "msgs/cpu-s");
+    bench::Report("udpbatch.per_datagram.syscalls",
+        double(single.syscalls) / single.messages, "syscalls/msg");
+
+    std::size_t sizes[] = { 1, 8, 32, 64 };
+    for(std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        CDatagramBatch batch(sizes[i]);
+        Counters batched;
+        std::string prefix = "udpbatch.batch_" +
+            boost::lexical_cast<std::string>(sizes[i]);
+        rate = BURST * bench::OpsPerCpuSecond(
+            BatchedOp(txfd, rxfd, burst, batch, batched), 1.0, 10);
+        bench::Report(prefix + ".rate", rate, "msgs/cpu-s");
+        bench::Report(prefix + ".syscalls",
+            double(batched.syscalls) / batched.messages, "syscalls/msg");
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      bench_wirecodec.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Compares the XML and binary datagram encodings through the
+///   same Synthesize/Parse calls used by IProtocol::Write and
+///   CListener::HandleRead.
+///
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "RequestParser.hpp"
+
+#include <boost/array.hpp>
+#include <boost/logic/tribool.hpp>
+#include <boost/tuple/tuple.hpp>
+
+#include <string>
+
+using namespace freedm::broker;
+namespace bench = freedm::bench;
+
+namespace {
+
+typedef boost::array<char, 8192> Buffer;
+
+/// A group management invite, representative of election traffic.
+CMessage MakeInvite()
+{
+    CMessage m_;
+    remotehost host_;
+    host_.hostname = "dgi-node-03.example.org";
+    host_.port = "1870";
+    m_.SetSourceUUID("36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.SetSourceHostname(host_);
+    m_.SetSequenceNumber(417);
+    m_.SetProtocol("SRC");
+    m_.SetSendTimestampNow();
+    m_.SetExpireTimeFromNow(boost::posix_time::milliseconds(3000));
+    m_.GetSubMessages().put("gm", "Invite");
+    m_.GetSubMessages().put("gm.source", "36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.GetSubMessages().put("gm.groupid", 12);
+    m_.GetSubMessages().put("gm.groupleader",
+        "36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    return m_;
+}
+
+/// A CSR acknowledgement, the most frequent datagram on the wire.
+CMessage MakeAck()
+{
+    CMessage m_ = MakeInvite();
+    m_.SetStatus(CMessage::Accepted);
+    m_.GetSubMessages().clear();
+    ptree pp_;
+    pp_.put("src.hash", 1234567890123ul);
+    m_.SetProtocolProperties(pp_);
+    return m_;
+}
+
+struct EncodeOp
+{
+    EncodeOp(CMessage &m, Buffer &b, unsigned int w)
+        : msg(m), buf(b), wire(w), size(0) { }
+    void operator()()
+    {
+        Buffer::iterator it_;
+        boost::tie(boost::tuples::ignore, it_) =
+            Synthesize(msg, buf.begin(), buf.size(), wire);
+        size = it_ - buf.begin();
+    }
+    CMessage &msg;
+    Buffer &buf;
+    unsigned int wire;
+    std::size_t size;
+};
+
+struct DecodeOp
+{
+    DecodeOp(const Buffer &b, std::size_t s) : buf(b), size(s) { }
+    void operator()()
+    {
+        CMessage out_;
+        Parse(out_, buf.data(), buf.data() + size);
+    }
+    const Buffer &buf;
+    std::size_t size;
+};
+
+/// The listener's path for binary datagrams: decode straight out of the
+/// receive buffer, optionally followed by building the submessage tree as
+/// the dispatcher does when a module handles the message.
+struct InPlaceDecodeOp
+{
+    InPlaceDecodeOp(const Buffer &b, std::size_t s, bool f)
+        : buf(b), size(s), full(f) { }
+    void operator()()
+    {
+        CWireCodec::Decode(buf.data(), size, msg);
+        if(full)
+            msg.GetSubMessages();
+    }
+    const Buffer &buf;
+    std::size_t size;
+    bool full;
+    CMessage msg;
+};
+
+void Run(const std::string &p_name, CMessage p_msg)
+{
+    const char * formats[] = { "xml", "binary" };
+    for(unsigned int wire = 0; wire <= 1; wire++)
+    {
+        std::string prefix = "wirecodec." + p_name + "." + formats[wire];
+        Buffer buf_;
+        EncodeOp enc_(p_msg, buf_, wire);
+        enc_();
+        DecodeOp dec_(buf_, enc_.size);
+
+        bench::Report(prefix + ".size", enc_.size, "bytes");
+        bench::Report(prefix + ".encode", bench::OpsPerCpuSecond(enc_),
+            "msgs/cpu-s");
+        bench::Report(prefix + ".decode", bench::OpsPerCpuSecond(dec_),
+            "msgs/cpu-s");
+        if(wire != 0)
+        {
+            bench::Report(prefix + ".decode_header", bench::OpsPerCpuSecond(
+                InPlaceDecodeOp(buf_, enc_.size, false)), "msgs/cpu-s");
+            bench::Report(prefix + ".decode_full", bench::OpsPerCpuSecond(
+                InPlaceDecodeOp(buf_, enc_.size, true)), "msgs/cpu-s");
+        }
+    }
+}
+
+} // unnamed namespace
+
+int main()
+{
+    bench::QuietLogs();
+    Run("invite", MakeInvite());
+    Run("ack", MakeAck());
+    return 0;
+}
@@ -65,7 +65,7 @@ public:
                    CDispatcher& p_dispatch, boost::asio::io_service &m_ios,
                    freedm::broker::CConnectionManager &m_conMan);
 
-    /// Run the Server's io_service loop.
+    /// Run the Server's io_service loop on the configured number of threads.
     void Run();
  
     /// Return a reference to the IO Service
@@ -78,6 +78,9 @@ public:
     void HandleStop();
     
  private:
+    /// Runs the io_service on the calling thread.
+    void RunWorker();
+
     /// Handle completion of an asynchronous accept operation.
     void HandleAccept(const boost::system::error_code& e);
 
@@ -53,6 +53,7 @@
 #include <boost/thread/thread.hpp>
 
 #include "CTableRTDS.hpp"
+#include "CMetrics.hpp"
 
 namespace freedm
 {
@@ -139,6 +140,9 @@ class CClientRTDS : private boost::noncopyable
         
         /// timer object to set communication cycle pace
         boost::asio::deadline_timer m_GlobalTimer;
+        
+        /// time each exchange with the FPGA takes, in the metrics registry
+        CMetrics::Histogram & m_cycleTime;
 };
 
 }//namespace broker
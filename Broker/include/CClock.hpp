@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CClock.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the clock the broker's timers and message
+///   timestamps go by, which a simulation can switch to virtual time
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CCLOCK_HPP
+#define CCLOCK_HPP
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+/// The time as the broker sees it. This is the system clock unless a
+/// simulation switches to virtual time, which stands still until the
+/// simulation moves it. Timers made as CClock::Timer then fire by virtual
+/// time, and tell the clock when they are due so the simulation can jump
+/// straight to the next one instead of waiting.
+class CClock
+    : private boost::noncopyable
+{
+public:
+    /// Time traits for asio timers that go by CClock::Now
+    struct TimeTraits
+    {
+        typedef boost::posix_time::ptime time_type;
+        typedef boost::posix_time::time_duration duration_type;
+        static time_type now()
+            { return CClock::Now(); }
+        static time_type add(const time_type &p_time,
+            const duration_type &p_duration)
+            { return p_time + p_duration; }
+        static duration_type subtract(const time_type &p_lhs,
+            const time_type &p_rhs)
+            { return p_lhs - p_rhs; }
+        static bool less_than(const time_type &p_lhs, const time_type &p_rhs)
+            { return p_lhs < p_rhs; }
+        /// How long the reactor may sleep waiting for a timer. Under virtual
+        /// time it must not sleep at all, since the wait is not real.
+        static boost::posix_time::time_duration to_posix_duration(
+            const duration_type &p_duration)
+            { return CClock::IsVirtual() ? duration_type() : p_duration; }
+    };
+
+    /// A deadline_timer that goes by CClock::Now
+    class Timer
+        : public boost::asio::basic_deadline_timer<boost::posix_time::ptime,
+              TimeTraits>
+    {
+    public:
+        typedef boost::asio::basic_deadline_timer<boost::posix_time::ptime,
+            TimeTraits> Base;
+        explicit Timer(boost::asio::io_service &p_ios)
+            : Base(p_ios), m_ios(p_ios) { }
+        using Base::expires_at;
+        using Base::expires_from_now;
+        /// Sets the time the timer is due, cancelling any wait
+        std::size_t expires_at(const time_type &p_time)
+        {
+            CClock::Schedule(m_ios, p_time);
+            return Base::expires_at(p_time);
+        }
+        /// Sets the timer to be due after p_duration, cancelling any wait
+        std::size_t expires_from_now(const duration_type &p_duration)
+            { return expires_at(CClock::Now() + p_duration); }
+    private:
+        /// The io_service the timer's handlers run on
+        boost::asio::io_service &m_ios;
+    };
+
+    /// The current time, in UTC
+    static boost::posix_time::ptime Now();
+
+    /// True while time is virtual
+    static bool IsVirtual();
+
+    /// Switches to virtual time, starting at p_start
+    static void StartVirtual(const boost::posix_time::ptime &p_start);
+
+    /// Returns to the system clock and forgets the timers that were due
+    static void StopVirtual();
+
+    /// Moves virtual time forward to p_time
+    static void AdvanceTo(const boost::posix_time::ptime &p_time);
+
+    /// The earliest time a timer is due, under virtual time
+    static bool GetNextDeadline(boost::posix_time::ptime &p_time);
+
+    /// Takes the io_services that have a timer due by now
+    static void TakeDue(std::vector<boost::asio::io_service *> &p_due);
+
+private:
+    /// Notes that a timer on p_ios is due at p_time, under virtual time
+    static void Schedule(boost::asio::io_service &p_ios,
+        const boost::posix_time::ptime &p_time);
+
+    /// Virtual time and the timers due by it
+    struct State;
+
+    /// The state, built on first use
+    static State & GetState();
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CCLOCK_HPP
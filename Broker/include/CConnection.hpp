@@ -39,6 +39,7 @@
 
 #include "types/remotehost.hpp"
 #include "SlidingWindow.hpp"
+#include "CRttEstimator.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -49,6 +50,8 @@
 #include <iomanip>
 #include <set>
 #include <deque>
+#include <map>
+#include <string>
 
 namespace freedm {
     namespace broker {
@@ -76,14 +79,35 @@ public:
     void Stop();
 
     /// Puts a CMessage into the channel.
-    void Send(CMessage p_mesg);
+    void Send(const CMessage &p_mesg);
 
     /// Handles Notification of an acknowledment being recieved
     void RecieveACK(const CMessage &msg);
 
     /// Handler that calls the correct protocol for accept logic
     bool Recieve(const CMessage &msg);
+
+    /// Takes a message a protocol made deliverable after the last Recieve
+    bool TakeReady(const std::string &p_protocol, CMessage &p_msg);
+
+    /// Records the wire version the remote node last advertised
+    void SetPeerWireVersion(unsigned int version);
+
+    /// The wire version to write with, 0 for XML
+    unsigned int GetWireVersion();
+
+    /// Round trip estimates and resend counters, by protocol
+    std::map<std::string, CRttEstimator::Stats> GetRttStats() const;
 private:
+    /// Stops the protocols and closes the socket, on the strand
+    void HandleStop();
+
+    /// Hands a message to its protocol, on the strand
+    void HandleSend(const CMessage &p_mesg);
+
+    /// A pointer to this connection as its most derived type
+    ConnectionPtr GetSelf();
+
     typedef boost::shared_ptr<IProtocol> ProtocolPtr;
     typedef std::map<std::string,ProtocolPtr> ProtocolMap;
     /// Protocol Handler Map
@@ -91,6 +115,9 @@ private:
     
     /// Default protocol
     std::string m_defaultprotocol;
+
+    /// Highest binary wire version the remote node accepts
+    unsigned int m_peerwire;
 };
 
 typedef boost::shared_ptr<CConnection> ConnectionPtr;
@@ -36,20 +36,26 @@
 #define CONNECTIONMANAGER_HPP
 
 #include "CConnection.hpp"
+#include "CGroupChannel.hpp"
 #include "CListener.hpp"
 #include "CReliableConnection.hpp"
+#include "CResolver.hpp"
+#include "IFabric.hpp"
+#include "types/peerid.hpp"
 #include "types/remotehost.hpp"
 #include "CGlobalConfiguration.hpp"
 
 #include <set>
 #include <string>
 #include <map>
+#include <vector>
 #include <boost/foreach.hpp>
-#include <boost/bimap.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/atomic.hpp>
 #include "uuid.hpp"
 #include "IHandler.hpp"
 
@@ -61,26 +67,35 @@ class CConnectionManager
     : private boost::noncopyable
 {
 public:
-    /// Typedef for the map which handles uuid to hostname
-    typedef std::map<std::string, remotehost> hostnamemap;
-    
-    /// Typedef for the map which handles uuid to connection 
-    typedef boost::bimap<std::string, ConnectionPtr> connectionmap;
-
     /// Initialize the connection manager with the uuid from global configuation
     CConnectionManager();
 
     /// Connection manager teardown.
-    ~CConnectionManager() {  };
+    ~CConnectionManager();
+
+    /// Most peers one manager can register
+    static const std::size_t MAX_PEERS = 65536;
 
     /// Add the specified connection to the manager and start it.
     void Start(CListener::ConnectionPtr c);
+
+    /// The peer ID of a UUID, registering the UUID if it is new
+    PeerId GetPeerId(const std::string &uuid);
+
+    /// Number of peer IDs handed out; IDs run from 0 to one less than this
+    std::size_t GetPeerCount() const;
+
+    /// The UUID a peer ID was registered for
+    std::string GetUUIDByPeerId(PeerId p_peer) const;
  
     /// Place a hostname and uuid into the hostname / uuid map.
     void PutHostname(std::string u_, std::string host_, std::string port);
    
     /// Place a hostname and uuid into the hostname / uuid map.
     void PutHostname(std::string u_, remotehost host_);
+
+    /// Record the hostname of a peer, unless it already has one
+    void PutHostname(PeerId p_peer, const remotehost &p_host);
  
     /// Register a connection with the manager once it has been built.
     void PutConnection(std::string uuid, ConnectionPtr c);
@@ -103,41 +118,90 @@ public:
     /// Get the hostname from the UUID.
     remotehost GetHostnameByUUID( std::string uuid ) const; 
 
+    /// Get the hostname of a peer, empty if it has none
+    remotehost GetHostnameByPeerId( PeerId p_peer ) const;
+
     /// Fetch a connection pointer via UUID
     ConnectionPtr GetConnectionByUUID( std::string uuid_,  boost::asio::io_service& ios,  CDispatcher &dispatch_ );
 
-    /// An iterator to the beginning of the hostname map
-    hostnamemap::iterator GetHostnamesBegin() { return m_hostnames.begin(); };
+    /// Fetch a connection pointer via peer ID, without a lock once it exists
+    ConnectionPtr GetConnectionByPeerId( PeerId p_peer,
+        boost::asio::io_service& ios, CDispatcher &dispatch_ );
 
-    /// An iterator to the end of the hostname map.
-    hostnamemap::iterator GetHostnamesEnd() { return m_hostnames.end(); };
+    /// Carry every connection's datagrams through a fabric instead of sockets
+    void SetFabric(IFabric *p_fabric) { m_fabric = p_fabric; };
 
-    /// An iterator to the specified hostname.
-    hostnamemap::iterator GetHostname(std::string uuid) { return m_hostnames.find(uuid); };
+    /// Open the group channel, if multicast-group is set
+    void OpenGroupChannel(CListener &p_listener);
 
-    /// Iterator to the beginning of the connection map.
-    connectionmap::iterator GetConnectionsBegin() { return m_connections.begin(); };
+    /// The channel messages for several peers are multicast on
+    CGroupChannel & GetGroupChannel() { return m_group; };
 
-    /// Iterator to the end of the connections map.
-    connectionmap::iterator GetConnectionsEnd() { return m_connections.end(); };
+    /// Send one message to several peers, through the group channel if open
+    void SendToGroup(const std::vector<PeerId> &p_peers, const CMessage &p_msg,
+        boost::asio::io_service& ios, CDispatcher &dispatch_);
+
+    /// Counters of the lookups made for new connections
+    CResolver::Stats GetResolverStats() const { return m_resolver.GetStats(); };
     
     // Transient Network Simulation
     /// Load a network configuration & apply it.
     void LoadNetworkConfig();
 
 private:
-    /// Mapping from uuid to hostname.
-    hostnamemap m_hostnames;
+    /// Everything known about one peer. The UUID never changes; the other
+    /// fields are replaced with atomic_store so they can be read unlocked.
+    struct Peer
+    {
+        /// The peer's UUID
+        std::string uuid;
+        /// Where the peer listens, null until it is known
+        boost::shared_ptr<const remotehost> host;
+        /// The connection to the peer, null until one is made
+        ConnectionPtr connection;
+        /// Share of datagrams delivered, for -DCUSTOMNETWORK
+        int reliability;
+    };
+
+    /// Peers per block of the peer table
+    static const std::size_t BLOCK_SIZE = 64;
+
+    /// Peer IDs by UUID. A map is never changed once it has been published;
+    /// registering a peer publishes a copy.
+    typedef boost::unordered_map<std::string, PeerId> PeerIdMap;
+
+    /// A published UUID map
+    typedef boost::shared_ptr<const PeerIdMap> PeerIdMapPtr;
+
+    /// The peer with an ID, or null if no such ID was handed out
+    Peer * GetPeer(PeerId p_peer) const;
+
+    /// Gives a peer a working connection, if it can be reached
+    ConnectionPtr ReplaceConnection(Peer &p_peer,
+        boost::asio::io_service& ios, CDispatcher &dispatch_);
+
     /// Hostname of this node.
     remotehost m_hostname;
-    /// Forward map (UUID->Connection)
-    connectionmap   m_connections;
+    /// Every peer, indexed by peer ID, in blocks of BLOCK_SIZE. Blocks are
+    /// only added, so an entry never moves once it has been published.
+    std::vector<Peer *> m_blocks;
+    /// Peer IDs handed out; entries below this may be read without a lock
+    boost::atomic<std::size_t> m_peerCount;
+    /// The current UUID map, swapped whole with atomic_store.
+    PeerIdMapPtr m_peerIds;
     /// Incoming messages channel
     CListener::ConnectionPtr m_inchannel;
     /// Node UUID
     std::string m_uuid;
-    /// Mutex for protecting the handler maps above
-    boost::mutex m_Mutex;       
+    /// Carries the datagrams instead of sockets, if set
+    IFabric *m_fabric;
+    /// Looks up and caches the addresses of peers
+    CResolver m_resolver;
+    /// Multicasts messages meant for several peers
+    CGroupChannel m_group;
+    /// Serializes registrations and replacing connections; readers of the
+    /// peer table never take it
+    mutable boost::mutex m_Mutex;       
 };
 
 } // namespace broker
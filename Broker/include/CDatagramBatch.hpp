@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CDatagramBatch.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the batched datagram socket helpers
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CDATAGRAMBATCH_HPP
+#define CDATAGRAMBATCH_HPP
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace freedm {
+    namespace broker {
+
+/// Moves several datagrams per system call on a native socket. On Linux
+/// this uses recvmmsg and sendmmsg; elsewhere it falls back to one
+/// non-blocking recv or send per datagram behind the same interface.
+class CDatagramBatch
+    : private boost::noncopyable
+{
+public:
+    /// Largest datagram the broker sends or receives
+    static const std::size_t MAX_DATAGRAM = 8192;
+
+    /// Prepares receive space for up to p_slots datagrams
+    explicit CDatagramBatch(std::size_t p_slots);
+
+    /// Reads the datagrams that are already waiting, without blocking
+    std::size_t Receive(int p_fd);
+
+    /// The contents of the i-th datagram read by Receive
+    const char * GetData(std::size_t i) const;
+
+    /// The length of the i-th datagram read by Receive
+    std::size_t GetLength(std::size_t i) const;
+
+    /// Number of datagrams one Receive call can return
+    std::size_t GetSlots() const { return m_lengths.size(); };
+
+    /// Writes datagrams to a connected socket, or to p_address through an
+    /// unconnected one, up to p_batch per call
+    static std::size_t Send(int p_fd, const std::vector<std::string> &p_datagrams,
+        std::size_t p_batch, const sockaddr * p_address = 0,
+        socklen_t p_addressLength = 0);
+
+private:
+    /// Receive space, MAX_DATAGRAM bytes per slot
+    std::vector<char> m_storage;
+
+    /// Length of the datagram in each slot after Receive
+    std::vector<std::size_t> m_lengths;
+
+#ifdef __linux__
+    /// Message headers handed to recvmmsg, one per slot
+    std::vector<mmsghdr> m_headers;
+
+    /// Scatter vectors pointing into m_storage, one per slot
+    std::vector<iovec> m_iovecs;
+#endif
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CDATAGRAMBATCH_HPP
@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CDigest.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the 64-bit message digest functions
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CDIGEST_HPP
+#define CDIGEST_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+
+namespace freedm {
+    namespace broker {
+
+/// 64-bit digests of byte strings, used to match acknowledgements to the
+/// messages they acknowledge. XXH64 is the fast default. SipHash-2-4 is
+/// slower but keyed, so collisions cannot be aimed at from outside.
+class CDigest
+    : private boost::noncopyable
+{
+public:
+    /// The digest functions a node may be configured to use
+    enum Algorithm
+    {
+        /// xxHash XXH64
+        XXHASH64,
+        /// SipHash-2-4 with a fixed key
+        SIPHASH24
+    };
+
+    /// XXH64 of a buffer with a seed
+    static boost::uint64_t XXHash64(const void * p_data, std::size_t p_length,
+        boost::uint64_t p_seed);
+
+    /// SipHash-2-4 of a buffer with a 128-bit key
+    static boost::uint64_t SipHash24(const void * p_data, std::size_t p_length,
+        boost::uint64_t p_k0, boost::uint64_t p_k1);
+
+    /// Digest of a buffer with the given algorithm, salted with p_salt
+    static boost::uint64_t Compute(Algorithm p_algorithm, const void * p_data,
+        std::size_t p_length, boost::uint64_t p_salt);
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CDIGEST_HPP
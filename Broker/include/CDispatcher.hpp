@@ -46,11 +46,16 @@
 #define CDISPATCHER_HPP
 
 #include "IHandler.hpp"
+#include "CReadQueue.hpp"
 
 #include <map>
 #include <string>
+#include <vector>
+#include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <boost/property_tree/ptree.hpp>
 using boost::property_tree::ptree;
@@ -69,27 +74,70 @@ public:
     CDispatcher();
 
     /// Called upon incoming message
-    void HandleRequest( CMessage msg );
+    void HandleRequest( const CMessage &msg );
 
     /// Called prior to sending a message
     void HandleWrite( ptree &p_mesg );
 
     /// Registers a handler that will be called with HandleRequest
     void RegisterReadHandler( const std::string &p_type,
-            IReadHandler *p_handler );
+            IReadHandler *p_handler,
+            boost::asio::io_service::strand *p_strand = 0 );
+
+    /// True while any module's queue asks the listener to stop reading
+    bool IsCongested() const;
+
+    /// Counters for each module's queue, by the first key it registered
+    std::map<std::string, CReadQueue::Stats> GetQueueStats() const;
 
     /// Registers a handler that will be called with HandleWrite
     void RegisterWriteHandler( const std::string &p_type,
             IWriteHandler *p_handler );
 private:
-    /// All the registered read handlers.
-    std::map< const std::string, IReadHandler *> m_readHandlers;
+    /// A read handler and the queue on its module's strand, if it has one
+    struct ReadRoute
+    {
+        IReadHandler *handler;
+        CReadQueue::QueuePtr queue;
+    };
+
+    /// The handlers for one key, in the order they were registered
+    typedef std::vector<ReadRoute> ReadRoutes;
+
+    /// Every read handler, arranged for dispatch. A table is never changed
+    /// once it has been published.
+    struct ReadTable
+    {
+        /// Handlers by submessage key
+        typedef boost::unordered_map<std::string, ReadRoutes> KeyMap;
+        /// Handlers registered for a specific submessage
+        KeyMap keys;
+        /// Handlers registered for "any", which see every message
+        ReadRoutes any;
+        /// Every handler, for messages with a submessage named "any"
+        ReadRoutes all;
+        /// One queue per module, by the first key it registered
+        std::map<std::string, CReadQueue::QueuePtr> queues;
+    };
+
+    /// A published routing table
+    typedef boost::shared_ptr<const ReadTable> ReadTablePtr;
+
+    /// Gives a message to each handler, directly or through its queue
+    void Deliver( const ReadRoutes &p_routes, const CMessage &msg );
+
+    /// Calls a read handler, logging a message it could not read
+    static void CallReadHandler( IReadHandler *p_handler,
+        const CMessage &msg );
+
+    /// The current routing table, swapped whole with atomic_store.
+    ReadTablePtr m_readTable;
 
     /// All the registered write handlers.
     std::map< const std::string, IWriteHandler *> m_writeHandlers;
  
 
-    /// Mutexes for protecting the handler maps above
+    /// Mutexes serializing changes to the handler tables above
     boost::mutex m_rMutex,
                  m_wMutex;
 
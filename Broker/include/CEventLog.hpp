@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CEventLog.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the binary log of protocol and agent events
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+#ifndef CEVENTLOG_HPP
+#define CEVENTLOG_HPP
+
+#include "types/peerid.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+/// An append-only file of fixed-size event records, cheap enough to leave
+/// on in production. Each thread fills a buffer of its own without locking
+/// and writes it to the file when it is full, so recording an event is a
+/// clock read and a few stores. Nothing is recorded until a log is started.
+///
+/// The file is a 16 byte header, "FREEDMEV" then the format version and the
+/// record size as little endian 32-bit numbers, followed by records:
+///
+///   offset  size  field
+///        0     8  microseconds since the epoch
+///        8     2  event type
+///       10     2  number of the thread that recorded it
+///       12     4  peer ID
+///       16     8  a, signed
+///       24     8  b, signed
+///
+/// The meaning of a and b depends on the type. Peer IDs are named by
+/// PEER_NAME records as they are handed out.
+class CEventLog
+    : private boost::noncopyable
+{
+public:
+    /// What an event record describes
+    enum EventType
+    {
+        /// 8 bytes of a peer's UUID: a is the chunk number, b the bytes
+        PEER_NAME = 1,
+        /// A sequenced message was written for the first time: a is the
+        /// sequence number, b the messages then in flight
+        SR_SEND = 16,
+        /// A sequenced message was acknowledged: a is the sequence number,
+        /// b the round trip sample in microseconds or 0 if there was none
+        SR_ACK,
+        /// A sequenced message was written again: a is the sequence number,
+        /// b the retransmission timeout in microseconds
+        SR_RESEND,
+        /// A sequenced message expired unacknowledged: a is the sequence
+        /// number
+        SR_EXPIRE,
+        /// AreYouCoordinator sent: a is this node's group
+        GM_AYC_SENT = 32,
+        /// AreYouCoordinator received: a is this node's group, b is 1 if
+        /// the answer was yes
+        GM_AYC_RECEIVED,
+        /// Answer to an AreYouCoordinator: b is 1 for yes
+        GM_AYC_RESPONSE,
+        /// AreYouThere sent to the coordinator: a is this node's group
+        GM_AYT_SENT,
+        /// AreYouThere received: a is the asker's group, b is 1 if the
+        /// answer was yes
+        GM_AYT_RECEIVED,
+        /// Answer to an AreYouThere: b is 1 for yes
+        GM_AYT_RESPONSE,
+        /// Invitation sent: a is the group offered
+        GM_INVITE_SENT,
+        /// Invitation received: a is the group offered, b is 1 if it was
+        /// accepted
+        GM_INVITE_RECEIVED,
+        /// Accept sent to a group leader: a is the group joined
+        GM_ACCEPT_SENT,
+        /// Accept received: a is the group, b is 1 if the peer was added
+        GM_ACCEPT_RECEIVED,
+        /// This node's load state was computed: a is the state, b the
+        /// previous state (see LPeerNode)
+        LB_STATE = 48,
+        /// Demand message received
+        LB_DEMAND,
+        /// Supply message received
+        LB_SUPPLY,
+        /// Draft request received: b is 1 if this node answered yes
+        LB_DRAFT_REQUEST,
+        /// Answer to this node's draft request: b is 1 for yes
+        LB_DRAFT_RESPONSE,
+        /// Drafting message received: b is 1 if this node accepted
+        LB_DRAFTING,
+        /// Draft accept received: a is the demand in thousandths, b is 1 if
+        /// power was migrated
+        LB_DRAFT_ACCEPT
+    };
+
+    /// One record, as read back from a file
+    struct Event
+    {
+        /// Microseconds since the epoch
+        boost::uint64_t time;
+        /// An EventType
+        boost::uint16_t type;
+        /// Which thread recorded it, numbered in the order they first did
+        boost::uint16_t thread;
+        /// The peer the event concerns
+        boost::uint32_t peer;
+        /// First value, meaning depends on the type
+        boost::int64_t a;
+        /// Second value, meaning depends on the type
+        boost::int64_t b;
+    };
+
+    /// Version written in the file header
+    static const boost::uint32_t VERSION;
+
+    /// Bytes in one record
+    static const std::size_t RECORD_SIZE = 32;
+
+    /// Bytes in the file header
+    static const std::size_t HEADER_SIZE = 16;
+
+    /// Opens p_path for appending, writing a header if it is empty
+    explicit CEventLog(const std::string &p_path);
+
+    /// Stops the log and closes the file
+    ~CEventLog();
+
+    /// Records events into this log from now on
+    void Start();
+
+    /// Writes every thread's buffered events and stops recording
+    void Stop();
+
+    /// Records an event in the started log, if there is one
+    static void Record(EventType p_type, PeerId p_peer, boost::int64_t p_a = 0,
+        boost::int64_t p_b = 0)
+    {
+        if(s_current.load(boost::memory_order_relaxed))
+            Append(p_type, p_peer, p_a, p_b);
+    }
+
+    /// Records the UUID a peer ID stands for
+    static void RecordName(PeerId p_peer, const std::string &p_uuid);
+
+    /// The name of an event type, as the decoder prints it
+    static const char * GetTypeName(boost::uint16_t p_type);
+
+    /// Reads and checks a file header
+    static bool ReadHeader(std::istream &p_in);
+
+    /// Reads the next record
+    static bool ReadEvent(std::istream &p_in, Event &p_event);
+
+private:
+    /// A thread's records waiting to be written
+    struct Buffer;
+
+    /// Every thread's buffer
+    struct Registry;
+
+    /// The registry, built on first use so that it outlives every thread
+    static Registry & GetRegistry();
+
+    /// Encodes an event into the calling thread's buffer
+    static void Append(EventType p_type, PeerId p_peer, boost::int64_t p_a,
+        boost::int64_t p_b);
+
+    /// Writes a buffer's records; the caller holds the buffer lock
+    static void Spill(Buffer &p_buffer);
+
+    /// The file records are appended to
+    std::FILE *m_file;
+
+    /// Set from Start until Stop
+    bool m_running;
+
+    /// The started log
+    static boost::atomic<CEventLog *> s_current;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CEVENTLOG_HPP
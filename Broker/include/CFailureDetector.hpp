@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CFailureDetector.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the phi accrual failure detector that judges peers
+///   by the heartbeats they send
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CFAILUREDETECTOR_HPP
+#define CFAILUREDETECTOR_HPP
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+/// Phi accrual failure detection (Hayashibara et al., 2004). Rather than a
+/// fixed timeout, each peer's heartbeat gaps are kept and the time since
+/// its last heartbeat is turned into phi, the -log10 of the chance that a
+/// live peer would have been that late given the gaps seen so far. A peer
+/// is suspected once phi passes the threshold, so a threshold of 8 means
+/// a one in 10^8 chance of suspecting a peer that is still there. Until a
+/// peer has sent a few heartbeats its gaps are taken to be the interval
+/// they are sent at. Not thread safe: the owner serializes the calls.
+class CFailureDetector
+    : private boost::noncopyable
+{
+public:
+    /// Gaps kept per peer
+    static const std::size_t WINDOW = 100;
+
+    /// Creates a detector for heartbeats sent every p_interval
+    CFailureDetector(boost::posix_time::time_duration p_interval,
+        double p_threshold);
+
+    /// Records a heartbeat from a peer that arrived at p_time
+    void Heartbeat(const std::string &p_peer,
+        const boost::posix_time::ptime &p_time);
+
+    /// Starts watching a peer as if it had sent a heartbeat at p_time,
+    /// unless it is already watched
+    void Watch(const std::string &p_peer,
+        const boost::posix_time::ptime &p_time);
+
+    /// Stops watching a peer
+    void Forget(const std::string &p_peer);
+
+    /// Stops watching every peer
+    void Clear();
+
+    /// True if the peer is being watched
+    bool IsWatching(const std::string &p_peer) const;
+
+    /// The suspicion of a watched peer at p_now; 0 for one not watched
+    double Phi(const std::string &p_peer,
+        const boost::posix_time::ptime &p_now) const;
+
+    /// True unless the peer is watched and its phi is past the threshold
+    bool IsAvailable(const std::string &p_peer,
+        const boost::posix_time::ptime &p_now) const;
+
+    /// How long after its last heartbeat a peer that sent them like
+    /// clockwork is suspected
+    boost::posix_time::time_duration GetDetectionTime() const;
+
+private:
+    /// The heartbeats from one peer
+    struct History
+    {
+        /// When the last heartbeat arrived
+        boost::posix_time::ptime last;
+        /// The latest gaps between heartbeats, in microseconds
+        std::deque<double> gaps;
+        /// The sum of the gaps and of their squares
+        double sum;
+        double squares;
+    };
+
+    /// Phi for a peer whose gaps have the mean and deviation given
+    static double Phi(double p_elapsed, double p_mean, double p_deviation);
+
+    /// Adds a gap to a history, dropping the oldest past WINDOW
+    static void AddGap(History &p_history, double p_gap);
+
+    /// The heartbeat interval, in microseconds
+    double m_interval;
+
+    /// The least deviation of the gaps, in microseconds
+    double m_mindeviation;
+
+    /// Suspicion past which a peer is taken to have failed
+    double m_threshold;
+
+    /// The watched peers by UUID
+    std::map<std::string, History> m_peers;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CFAILUREDETECTOR_HPP
@@ -53,7 +53,14 @@ class CGlobalConfiguration : public Templates::Singleton<CGlobalConfiguration>
 {
     public:
         /// Initialize the global configuration
-        CGlobalConfiguration() { };
+        CGlobalConfiguration() : m_binarywire(true), m_batchsize(32),
+            m_threads(1), m_queuesize(1024), m_queueoverflow("backpressure"),
+            m_srwindow(8), m_strongdigest(false),
+            m_ackdelay(2), m_minrto(10), m_maxrto(1000), m_resolvettl(300),
+            m_sharedsocket(false), m_failuredetector("phi"),
+            m_heartbeat(2000), m_phithreshold(8), m_checkinterval(10000),
+            m_responsetimeout(5000), m_mergebackoff(250),
+            m_maxmergebackoff(4000) { };
         /// Set the hostname
         void SetHostname(std::string h) { m_hostname = h; };
         /// Set the port
@@ -62,6 +69,46 @@ class CGlobalConfiguration : public Templates::Singleton<CGlobalConfiguration>
         void SetUUID(std::string u) { m_uuid = u; };
         /// Set the address to on
         void SetListenAddress(std::string a) { m_address = a; };
+        /// Set if the binary wire encoding may be negotiated
+        void SetBinaryWire(bool b) { m_binarywire = b; };
+        /// Set the most datagrams moved per socket system call
+        void SetBatchSize(unsigned int b) { m_batchsize = b; };
+        /// Set the number of threads that run the io_service
+        void SetThreadCount(unsigned int t) { m_threads = t; };
+        /// Set the most messages waiting for a module, 0 for no limit
+        void SetQueueSize(unsigned int q) { m_queuesize = q; };
+        /// Set what happens to a module's messages once its queue is full
+        void SetQueueOverflow(std::string o) { m_queueoverflow = o; };
+        /// Set the most sequenced reliable messages in flight to a peer
+        void SetSRWindow(unsigned int w) { m_srwindow = w; };
+        /// Set if messages are digested with SipHash rather than XXH64
+        void SetStrongDigest(bool s) { m_strongdigest = s; };
+        /// Set how long an ACK may wait for data to ride on, in ms
+        void SetAckDelay(unsigned int d) { m_ackdelay = d; };
+        /// Set the least resend timeout of the reliable protocols, in ms
+        void SetMinRTO(unsigned int r) { m_minrto = r; };
+        /// Set the greatest resend timeout of the reliable protocols, in ms
+        void SetMaxRTO(unsigned int r) { m_maxrto = r; };
+        /// Set how long a peer's resolved address is kept, in seconds
+        void SetResolveTTL(unsigned int t) { m_resolvettl = t; };
+        /// Set if every peer is written to through the listening socket
+        void SetSharedSocket(bool s) { m_sharedsocket = s; };
+        /// Set the multicast group for group messages, empty for none
+        void SetMulticastGroup(std::string g) { m_multicastgroup = g; };
+        /// Set how group management finds failed nodes: phi or poll
+        void SetFailureDetector(std::string f) { m_failuredetector = f; };
+        /// Set how often group members send heartbeats, in ms
+        void SetHeartbeatInterval(unsigned int h) { m_heartbeat = h; };
+        /// Set the suspicion past which a silent node is taken to have failed
+        void SetPhiThreshold(double t) { m_phithreshold = t; };
+        /// Set how often a group leader looks for other groups, in ms
+        void SetCheckInterval(unsigned int c) { m_checkinterval = c; };
+        /// Set how long group management waits on replies, in ms
+        void SetResponseTimeout(unsigned int r) { m_responsetimeout = r; };
+        /// Set how long a leader defers per higher one before merging, in ms
+        void SetMergeBackoff(unsigned int b) { m_mergebackoff = b; };
+        /// Set the longest a leader defers before merging, in ms
+        void SetMaxMergeBackoff(unsigned int b) { m_maxmergebackoff = b; };
         /// Get the hostname
         std::string GetHostname() { return m_hostname; };
         /// Get the port
@@ -70,11 +117,71 @@ class CGlobalConfiguration : public Templates::Singleton<CGlobalConfiguration>
         std::string GetUUID() { return m_uuid; };
         /// Get the address
         std::string GetListenAddress() { return m_address; };
+        /// Get if the binary wire encoding may be negotiated
+        bool GetBinaryWire() { return m_binarywire; };
+        /// Get the most datagrams moved per socket system call
+        unsigned int GetBatchSize() { return m_batchsize; };
+        /// Get the number of threads that run the io_service
+        unsigned int GetThreadCount() { return m_threads; };
+        /// Get the most messages waiting for a module, 0 for no limit
+        unsigned int GetQueueSize() { return m_queuesize; };
+        /// Get what happens to a module's messages once its queue is full
+        std::string GetQueueOverflow() { return m_queueoverflow; };
+        /// Get the most sequenced reliable messages in flight to a peer
+        unsigned int GetSRWindow() { return m_srwindow; };
+        /// Get if messages are digested with SipHash rather than XXH64
+        bool GetStrongDigest() { return m_strongdigest; };
+        /// Get how long an ACK may wait for data to ride on, in ms
+        unsigned int GetAckDelay() { return m_ackdelay; };
+        /// Get the least resend timeout of the reliable protocols, in ms
+        unsigned int GetMinRTO() { return m_minrto; };
+        /// Get the greatest resend timeout of the reliable protocols, in ms
+        unsigned int GetMaxRTO() { return m_maxrto; };
+        /// Get how long a peer's resolved address is kept, in seconds
+        unsigned int GetResolveTTL() { return m_resolvettl; };
+        /// Get if every peer is written to through the listening socket
+        bool GetSharedSocket() { return m_sharedsocket; };
+        /// Get the multicast group for group messages, empty for none
+        std::string GetMulticastGroup() { return m_multicastgroup; };
+        /// Get how group management finds failed nodes: phi or poll
+        std::string GetFailureDetector() { return m_failuredetector; };
+        /// Get how often group members send heartbeats, in ms
+        unsigned int GetHeartbeatInterval() { return m_heartbeat; };
+        /// Get the suspicion past which a silent node is taken to have failed
+        double GetPhiThreshold() { return m_phithreshold; };
+        /// Get how often a group leader looks for other groups, in ms
+        unsigned int GetCheckInterval() { return m_checkinterval; };
+        /// Get how long group management waits on replies, in ms
+        unsigned int GetResponseTimeout() { return m_responsetimeout; };
+        /// Get how long a leader defers per higher one before merging, in ms
+        unsigned int GetMergeBackoff() { return m_mergebackoff; };
+        /// Get the longest a leader defers before merging, in ms
+        unsigned int GetMaxMergeBackoff() { return m_maxmergebackoff; };
     private:
         std::string m_hostname; /// Node hostname
         std::string m_port; /// Port number
         std::string m_uuid; /// The node uuid
         std::string m_address; /// The listening address.
+        bool m_binarywire; /// Offer the binary wire encoding to peers
+        unsigned int m_batchsize; /// Datagrams per recvmmsg/sendmmsg call
+        unsigned int m_threads; /// Size of the broker's io_service pool
+        unsigned int m_queuesize; /// Capacity of each module's read queue
+        std::string m_queueoverflow; /// Policy for a full module queue
+        unsigned int m_srwindow; /// Send window of the SRC protocol
+        bool m_strongdigest; /// Digest messages with SipHash-2-4
+        unsigned int m_ackdelay; /// Hold time of a reliable protocol ACK
+        unsigned int m_minrto; /// Least resend timeout, before ack-delay
+        unsigned int m_maxrto; /// Greatest resend timeout, with backoff
+        unsigned int m_resolvettl; /// Lifetime of a cached peer address
+        bool m_sharedsocket; /// Send to peers from the listening socket
+        std::string m_multicastgroup; /// address:port group messages use
+        std::string m_failuredetector; /// Heartbeats or AYC/AYT polling
+        unsigned int m_heartbeat; /// Interval between group heartbeats
+        double m_phithreshold; /// Phi at which a node is suspected
+        unsigned int m_checkinterval; /// Time between AYC rounds
+        unsigned int m_responsetimeout; /// Wait for AYC replies and Accepts
+        unsigned int m_mergebackoff; /// Merge deferral per higher leader
+        unsigned int m_maxmergebackoff; /// Longest merge deferral
 };
 
 } // namespace freedm
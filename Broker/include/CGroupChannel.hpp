@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CGroupChannel.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the multicast channel that carries one copy of a
+///   message meant for several peers
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CGROUPCHANNEL_HPP
+#define CGROUPCHANNEL_HPP
+
+#include "CClock.hpp"
+#include "CDatagramBatch.hpp"
+#include "CMessage.hpp"
+#include "CMetrics.hpp"
+#include "IFabric.hpp"
+#include "types/peerid.hpp"
+
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+class CConnectionManager;
+class CListener;
+
+/// Writes a message meant for several peers once, to the multicast group
+/// every node joins, instead of once per peer. The message names its
+/// recipients by a hash of their UUIDs and carries a sequence number of the
+/// channel's own; each receiver's CSMConnection delivers the messages for
+/// it in order and asks the sender for any it missed, which are resent
+/// unicast from the channel's history. A few sync datagrams repeating the
+/// last sequence number follow a burst of sends, so losing the end of a
+/// burst is noticed too.
+class CGroupChannel
+    : private boost::noncopyable
+{
+public:
+    /// Sent messages kept to be resent on request
+    static const std::size_t HISTORY = 256;
+
+    /// Milliseconds of quiet after a send before the sync is written
+    static const unsigned int SYNC_DELAY = 20;
+
+    /// Syncs written after a burst, each after twice the wait of the last
+    static const unsigned int SYNC_REPEATS = 4;
+
+    /// Hex digits per recipient hash
+    static const std::size_t HASH_DIGITS = 8;
+
+    /// A closed channel for the manager's node
+    explicit CGroupChannel(CConnectionManager &p_manager);
+
+    /// Leaves the group
+    ~CGroupChannel();
+
+    /// Joins the configured group, or sends through p_fabric if it is set
+    void Open(CListener &p_listener, IFabric *p_fabric);
+
+    /// Leaves the group; later sends fall back to unicast
+    void Close();
+
+    /// True if messages can be sent to the group
+    bool IsOpen() const;
+
+    /// Writes one message to several peers in a single datagram
+    bool Send(const std::vector<PeerId> &p_peers, const CMessage &p_msg);
+
+    /// Copies a datagram still in the history, to resend it to one peer
+    bool GetDatagram(unsigned int p_seq, std::string &p_out) const;
+
+    /// Identifies this run of the channel; its sequence restarts with it
+    boost::uint32_t GetEpoch() const { return m_epoch; };
+
+    /// Records how far a peer's group messages were delivered
+    void SaveCursor(PeerId p_peer, boost::uint32_t p_epoch,
+        unsigned int p_next);
+
+    /// Finds how far a peer's group messages were delivered before
+    bool GetCursor(PeerId p_peer, boost::uint32_t p_epoch,
+        unsigned int &p_next) const;
+
+    /// The hash a UUID is listed under in a message's recipients
+    static std::string HashUUID(const std::string &p_uuid);
+
+    /// True if p_hash is one of the hashes in a recipient list
+    static bool IsAddressedTo(const std::string &p_list,
+        const std::string &p_hash);
+
+private:
+    /// Writes a datagram to the group
+    void Write(const std::string &p_datagram);
+
+    /// Starts the next receive from the group socket
+    void Receive();
+
+    /// Hands a datagram from the group to the listener
+    void HandleReceive(const boost::system::error_code &p_error,
+        std::size_t p_bytes);
+
+    /// Writes the sync once the sends have stopped for SYNC_DELAY
+    void HandleSync(const boost::system::error_code &p_error);
+
+    /// Builds the datagram that repeats the last sequence number sent
+    void EncodeSync(std::string &p_out);
+
+    /// The manager the channel sends for
+    CConnectionManager &m_manager;
+
+    /// Decodes what the group socket receives
+    CListener *m_listener;
+
+    /// Carries the datagrams instead of the group socket, if set
+    IFabric *m_fabric;
+
+    /// Joined to the group, unless a fabric is used
+    boost::scoped_ptr<boost::asio::ip::udp::socket> m_socket;
+
+    /// The group's address and port
+    boost::asio::ip::udp::endpoint m_group;
+
+    /// Where the last received datagram came from
+    boost::asio::ip::udp::endpoint m_sender;
+
+    /// Receive space for the group socket
+    boost::array<char, CDatagramBatch::MAX_DATAGRAM> m_buffer;
+
+    /// Fires when the next sync is due
+    boost::scoped_ptr<CClock::Timer> m_sync;
+
+    /// Set while the channel may be sent to
+    bool m_open;
+
+    /// Syncs still to write for the last message
+    unsigned int m_syncs;
+
+    /// Identifies this run of the channel
+    boost::uint32_t m_epoch;
+
+    /// The sequence number of the next message
+    unsigned int m_outseq;
+
+    /// The last HISTORY datagrams sent, the newest at the back
+    std::deque<std::string> m_history;
+
+    /// The epoch and next sequence number of each peer's messages, kept
+    /// by the connections that were stopped
+    std::map<PeerId, std::pair<boost::uint32_t, unsigned int> > m_cursors;
+
+    /// Messages written to the group
+    CMetrics::Counter &m_sent;
+
+    /// Recipients of the messages written to the group
+    CMetrics::Counter &m_recipients;
+
+    /// Serializes sends, the history, the sync timer and the cursors
+    mutable boost::mutex m_mutex;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CGROUPCHANNEL_HPP
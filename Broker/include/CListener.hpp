@@ -39,6 +39,7 @@
 #include "types/remotehost.hpp"
 #include "CConnection.hpp"
 #include "RequestParser.hpp"
+#include "CDatagramBatch.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -75,19 +76,34 @@ public:
 
     /// Get Remote UUID
     std::string GetUUID() { return m_uuid; };
+    /// Decode a single datagram and post it to its connection's strand.
+    void HandleDatagram(const char * p_data, std::size_t p_length);
 private:
+    /// Milliseconds between checks while a module's queue is full
+    static const unsigned int PAUSE_MS = 1;
+
+    /// Start the next receive once no module's queue is full.
+    void Resume(const boost::system::error_code& e);
+
     /// Handle completion of a read operation.
     void HandleRead(const boost::system::error_code& e, std::size_t bytes_transferred);
 
+
+    /// Deliver a decoded message on its connection's strand.
+    void HandleMessage(CConnection::ConnectionPtr p_conn, CMessage p_message);
+
     /// Variable used for tracking the remote endpoint of incoming messages.
     boost::asio::ip::udp::endpoint m_endpoint;
 
     /// Buffer for incoming data.
     boost::array<char, 8192> m_buffer;
-    
-    /// The incoming request.
-    CMessage m_message;
 
+    /// Receive slots for the datagrams drained after each completed read.
+    CDatagramBatch m_batch;
+
+    /// Waits out a full module queue before reading again.
+    boost::asio::deadline_timer m_pauseTimer;
+    
     /// The UUID of the remote endpoint for the connection
     std::string m_uuid;
 };
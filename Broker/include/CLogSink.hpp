@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CLogSink.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the background writer for log output
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+#ifndef CLOGSINK_HPP
+#define CLOGSINK_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+#include <string>
+
+/// Writes log lines on a thread of its own. Logging threads put each line
+/// in a bounded ring without taking a lock; the writer takes them out in
+/// batches, formats the timestamp and writes the batch with one call. While
+/// a sink is started every CLog goes through it, so a slow terminal or file
+/// never holds up the thread that logged.
+class CLogSink
+    : private boost::noncopyable
+{
+public:
+    /// What Push does once the ring is full
+    enum OverflowPolicy
+    {
+        /// Discard the line and count it; the writer reports the count.
+        DROP,
+        /// Wait for the writer to make room.
+        BLOCK
+    };
+
+    /// Counters describing a sink since it was created
+    struct Stats
+    {
+        /// Lines written out
+        unsigned long written;
+        /// Lines discarded because the ring was full
+        unsigned long dropped;
+        /// Writes made to the output stream
+        unsigned long batches;
+    };
+
+    /// The most lines a ring may hold
+    static const std::size_t MAX_CAPACITY;
+
+    /// Creates a stopped sink with room for p_capacity lines
+    CLogSink(std::size_t p_capacity, OverflowPolicy p_policy,
+        std::ostream *p_out = &std::clog);
+
+    /// Stops the sink, writing whatever is left
+    ~CLogSink();
+
+    /// Starts the writer and sends every CLog through this sink
+    void Start();
+
+    /// Waits until every line pushed so far has been written
+    void Flush();
+
+    /// Writes what is left, stops the writer and logs synchronously again
+    void Stop();
+
+    /// Queues a line for the writer
+    bool Push(const boost::posix_time::ptime &p_time, const std::string *p_name,
+        int p_level, const char *p_text, std::streamsize p_length);
+
+    /// A copy of the counters
+    Stats GetStats() const;
+
+    /// The started sink, or null if log lines are written synchronously
+    static CLogSink * Current()
+        { return s_current.load(boost::memory_order_acquire); };
+
+    /// Reads an overflow policy name as given in the configuration
+    static bool ParsePolicy(const std::string &p_name, OverflowPolicy &p_policy);
+
+private:
+    /// One line waiting in the ring
+    struct Slot
+    {
+        /// Equal to the ticket of the push that may fill the slot, or one
+        /// more than that once it has been filled
+        boost::atomic<std::size_t> sequence;
+        /// When the line was logged
+        boost::posix_time::ptime time;
+        /// Name of the level, owned by the CLog that logged the line
+        const std::string *name;
+        /// The level number
+        int level;
+        /// The text of the line
+        std::string text;
+    };
+
+    /// Takes lines out of the ring and writes them until stopped
+    void Run();
+
+    /// Writes every line in the ring; returns how many there were
+    std::size_t Drain(std::string &p_batch);
+
+    /// Wakes the writer if it is waiting for lines
+    void Wake();
+
+    /// The smallest power of two that holds p_capacity lines
+    static std::size_t RoundCapacity(std::size_t p_capacity);
+
+    /// The ring of lines
+    boost::scoped_array<Slot> m_slots;
+
+    /// Number of slots, a power of two
+    const std::size_t m_capacity;
+
+    /// What happens once the ring is full
+    const OverflowPolicy m_policy;
+
+    /// Where the lines are written
+    std::ostream *m_out;
+
+    /// Ticket of the next push
+    boost::atomic<std::size_t> m_head;
+
+    /// Ticket of the next line the writer takes; only the writer changes it
+    std::size_t m_tail;
+
+    /// Lines discarded by the DROP policy
+    boost::atomic<unsigned long> m_dropped;
+
+    /// Drops the writer has already reported; only the writer changes it
+    unsigned long m_reported;
+
+    /// Set while the writer is waiting on m_wake
+    boost::atomic<bool> m_sleeping;
+
+    /// Set from Start until Stop
+    bool m_running;
+
+    /// Lines written out, up to which Flush waits
+    std::size_t m_written;
+
+    /// Writes made to the output stream
+    unsigned long m_batches;
+
+    /// Guards m_running, m_written and m_batches, and the waits below
+    mutable boost::mutex m_mutex;
+
+    /// Signalled when there are lines to write or the sink is stopping
+    boost::condition_variable m_wake;
+
+    /// Signalled each time the writer finishes a batch
+    boost::condition_variable m_done;
+
+    /// The writer
+    boost::scoped_ptr<boost::thread> m_thread;
+
+    /// The started sink
+    static boost::atomic<CLogSink *> s_current;
+};
+
+#endif // CLOGSINK_HPP
@@ -1,6 +1,7 @@
 #ifndef CLOGGER_HPP
 #define CLOGGER_HPP
 
+#include <boost/atomic.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -9,8 +10,14 @@
 #include <iostream>
 #include <string>
 
+#include "config.hpp"
 #include "Utility.hpp"
 
+/// The most verbose level compiled in; set with -DMAX_LOG_LEVEL
+#ifndef MAX_LOG_LEVEL
+#define MAX_LOG_LEVEL 7
+#endif
+
 using namespace boost::posix_time;
 
 class CLocalLogger;
@@ -23,7 +30,9 @@ class CGlobalLogger : public Templates::Singleton<CGlobalLogger>
     ///////////////////////////////////////////////////////////////////////////
     /// @description The GlobalLogger is responsible for tracking a table which
     ///     lists the names of the different loggers and their current output
-    ///     levels.
+    ///     levels. Every local logger keeps a copy of its level, which the
+    ///     global logger updates whenever a level is set, so that checking
+    ///     whether to log needs no lookup or lock.
     /// @limitations: Singleton. Should not be copied.
     ///////////////////////////////////////////////////////////////////////////
     public:
@@ -35,13 +44,16 @@ class CGlobalLogger : public Templates::Singleton<CGlobalLogger>
         void SetOutputLevel(std::string logger,int level);
         /// Fetch the logging level of a specific logger.
         int GetOutputLevel(std::string logger);
+        /// Records a local logger so that its copy of the level is kept
+        static void Register(CLocalLogger *logger);
+        /// Forgets a local logger that is being destroyed
+        static void Unregister(CLocalLogger *logger);
     private:
-        /// What the output level is if not set specifically.
-        int m_default;
-        /// Type of containter for the output levels.
-        typedef std::map< std::string, int > OutputMap;
-        /// The map of loggers to logger levels.
-        OutputMap m_loggers;
+        /// The level tables and the registered local loggers.
+        struct Table;
+        /// The tables, built on first use so that loggers constructed during
+        ///     static initialization can register in any order.
+        static Table & GetTable();
 };
 
 /// Logging Output Software
@@ -71,6 +83,53 @@ class CLog : public boost::iostreams::sink
         std::ostream *m_ostream;
 };
 
+template <int Level>
+class CLogStream : private boost::noncopyable
+{
+    ///////////////////////////////////////////////////////////////////////////
+    /// @description: The front end of one log level. Each insertion first
+    ///     compares the level with the parent's cached output level and does
+    ///     no formatting at all when the message would be filtered. Levels
+    ///     above MAX_LOG_LEVEL are never written, so the compiler drops the
+    ///     insertions entirely.
+    /// @limitations: The operands are still evaluated; keep expensive calls
+    ///     out of Debug lines or test IsEnabled first.
+    ///////////////////////////////////////////////////////////////////////////
+    public:
+        /// Constructor; prepares the stream for a level.
+        CLogStream(CLoggerPointer p, const char * name_)
+            : m_parent(p), m_stream(p, Level, name_) { }
+        /// True if a message at this level would be written.
+        bool IsEnabled() const;
+        /// Formats a value into the log, if the level is enabled
+        template <typename T>
+        CLogStream & operator<<(const T &value)
+        {
+            if(IsEnabled())
+                m_stream << value;
+            return *this;
+        }
+        /// Applies a manipulator such as std::endl, if the level is enabled
+        CLogStream & operator<<(std::ostream & (*manip)(std::ostream &))
+        {
+            if(IsEnabled())
+                m_stream << manip;
+            return *this;
+        }
+        /// Applies a manipulator such as std::hex, if the level is enabled
+        CLogStream & operator<<(std::ios_base & (*manip)(std::ios_base &))
+        {
+            if(IsEnabled())
+                m_stream << manip;
+            return *this;
+        }
+    private:
+        /// The local logger managing this stream
+        CLoggerPointer m_parent;
+        /// The stream formatting into the log
+        boost::iostreams::stream<CLog> m_stream;
+};
+
 class CLocalLogger : private boost::noncopyable
 {
     ///////////////////////////////////////////////////////////////////////////
@@ -85,33 +144,46 @@ class CLocalLogger : private boost::noncopyable
     public:
         ///Intializes the local statics
         CLocalLogger(std::string loggername);
+        /// Stops the global logger from updating this logger
+        ~CLocalLogger();
         ///Logger
-	    boost::iostreams::stream<CLog> Debug;
+	    CLogStream<7> Debug;
         ///Logger
-        boost::iostreams::stream<CLog> Info;
+        CLogStream<6> Info;
         ///Logger
-        boost::iostreams::stream<CLog> Notice;
+        CLogStream<5> Notice;
         ///Logger
-        boost::iostreams::stream<CLog> Status;
+        CLogStream<4> Status;
         ///Logger
-        boost::iostreams::stream<CLog> Warn;
+        CLogStream<3> Warn;
         ///Logger
-        boost::iostreams::stream<CLog> Error;
+        CLogStream<2> Error;
         ///Logger
-        boost::iostreams::stream<CLog> Alert;
+        CLogStream<1> Alert;
         ///Logger
-        boost::iostreams::stream<CLog> Fatal;
+        CLogStream<0> Fatal;
         /// Returns the name of this logger
         std::string GetName();
         /// Returns the filtering level for this set of loggers.
-        int GetOutputLevel();
+        int GetOutputLevel() const
+            { return m_level.load(boost::memory_order_relaxed); };
         /// Sets the output level for this set of loggers. 
         void SetOutputLevel(int level);
         /// Load the logger settings
         
     private:
+        friend class CGlobalLogger;
         /// The name of this logger
         std::string m_name;
+        /// Copy of the output level kept by the global logger
+        boost::atomic<int> m_level;
 };
 
+/// True if a message at this level would be written.
+template <int Level>
+inline bool CLogStream<Level>::IsEnabled() const
+{
+    return Level <= MAX_LOG_LEVEL && m_parent->GetOutputLevel() >= Level;
+}
+
 #endif
@@ -38,20 +38,30 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "types/remotehost.hpp"
 
 using boost::property_tree::ptree;
 
+#include <boost/cstdint.hpp>
+
 #include <string>
 #include <set>
+#include <vector>
 
 namespace freedm {
 namespace broker {
 
-/// A request received from a client.
+class CWireCodec;
+
+/// A request received from a client. A copy shares the submessages, the
+/// protocol properties and the source fields with the original and only
+/// copies the fixed size fields, so copying a message allocates nothing;
+/// whichever copy is changed first takes a private copy of what it changes.
 class CMessage
 {
+    friend class CWireCodec;
 public:
     /// Status codes are modeled after HTTP/1.0 will add/remove as necessary.
     /// The status of the reply.
@@ -87,9 +97,15 @@ public:
     /// Accessor for status
     StatusType GetStatus() const;
     
-    /// Accessor for submessages
+    /// Accessor for submessages, which unshares them
     ptree& GetSubMessages();
 
+    /// Read-only accessor for submessages
+    const ptree& GetSubMessages() const;
+
+    /// The top level submessage keys, without building the submessage tree
+    std::vector<std::string> GetSubMessageKeys() const;
+
     /// Setter for uuid
     void SetSourceUUID(std::string uuid);
     
@@ -139,14 +155,23 @@ public:
     void SetProtocolProperties(ptree x);
 
     /// Get the protocol properties
-    ptree GetProtocolProperties() const;
+    const ptree& GetProtocolProperties() const;
 
     /// Test to see if the message is expired
     bool IsExpired() const;
 
-    /// Get hash of the message contents salted with send time?
+    /// Digest of the message contents salted with the send time
     size_t GetHash() const;
 
+    /// The hash brokers before wire version 2 use to match ACKs
+    size_t GetLegacyHash() const;
+
+    /// Binary wire version the sender understands, 0 for XML only
+    unsigned int GetWireVersion() const;
+
+    /// Setter for the advertised binary wire version
+    void SetWireVersion(unsigned int version);
+
     /// Deconstruct the CMessage
     virtual ~CMessage() { };
 
@@ -172,27 +197,49 @@ public:
     /// A way to load a CMessage from a property tree.
     explicit CMessage( const ptree &pt );
 
-    /// Contains all the submessages as handled by client algorithms
-    ptree       m_submessages;
-   
 private: 
-    /// Contains the source node's hostname
-    remotehost m_remotehost;
+    /// The source fields, which are the same in every copy of a message
+    /// until one of them is stamped for a connection.
+    struct Header
+    {
+        /// Contains the source node's information
+        std::string srcUUID;
+        /// Contains the source node's hostname
+        remotehost host;
+        /// The protocol this message is using.
+        std::string protocol;
+    };
+
+    /// The submessages and their binary encoding, defined in CMessage.cpp
+    struct Payload;
+
+    /// The source fields, with the empty header for a new message
+    const Header & GetHeader() const;
+
+    /// The source fields, copied first if another message shares them
+    Header & EditHeader();
+
+    /// The binary encoding of the submessages, encoded on first use
+    const std::string & GetEncodedSubMessages() const;
+
+    /// Sets the submessages to a received encoding, decoded on first use
+    void SetEncodedSubMessages(const char * p_data, std::size_t p_length);
+
+    /// Shared source fields; null until one is set
+    boost::shared_ptr<Header> m_header;
+
+    /// Shared submessages; null while there are none
+    boost::shared_ptr<Payload> m_payload;
 
     /// Contains the sequence number for the sending node
     unsigned int m_sequenceno;
 
-    /// Contains the source node's information
-    std::string m_srcUUID;
-
     /// Status of the message
     StatusType  m_status;
 
-    /// Container for all the protocol properties
-    ptree       m_properties;
-
-    /// The protocol this message is using.
-    std::string m_protocol;
+    /// Shared protocol properties, replaced rather than changed; null while
+    /// there are none
+    boost::shared_ptr<const ptree> m_properties;
 
     /// Sets if the expiration should actually be never
     bool m_never_expires;
@@ -202,6 +249,16 @@ private:
     
     /// The time the message will expire
     boost::posix_time::ptime m_expiretime;
+
+    /// Binary wire version advertised by (or used by) the sender
+    unsigned int m_wireversion;
+
+    /// Digest returned by GetHash, once it has been computed. Anything
+    /// that can change the submessages or send time clears it.
+    mutable boost::uint64_t m_digest;
+
+    /// Set when m_digest is current
+    mutable bool m_hasdigest;
 };
 
 } // namespace broker
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CMetrics.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the registry of runtime counters, gauges and
+///   latency histograms
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CMETRICS_HPP
+#define CMETRICS_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <iosfwd>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+/// Process-wide metrics, written out in the Prometheus text format. A metric
+/// is looked up once by name and labels, usually when the object it
+/// describes is built; updating it afterwards is a relaxed atomic add with
+/// no lock. Metrics live until the process exits, so a peer that reconnects
+/// keeps counting where it left off.
+class CMetrics
+    : private boost::noncopyable
+{
+public:
+    /// A count that only goes up
+    class Counter
+        : private boost::noncopyable
+    {
+    public:
+        Counter() : m_value(0) { }
+        /// Adds to the count
+        void Add(unsigned long p_n = 1)
+            { m_value.fetch_add(p_n, boost::memory_order_relaxed); }
+        /// The count so far
+        unsigned long Get() const
+            { return m_value.load(boost::memory_order_relaxed); }
+    private:
+        boost::atomic<unsigned long> m_value;
+    };
+
+    /// A value that is set to the current level of something
+    class Gauge
+        : private boost::noncopyable
+    {
+    public:
+        Gauge() : m_value(0) { }
+        /// Sets the level
+        void Set(long p_value)
+            { m_value.store(p_value, boost::memory_order_relaxed); }
+        /// The last level set
+        long Get() const
+            { return m_value.load(boost::memory_order_relaxed); }
+    private:
+        boost::atomic<long> m_value;
+    };
+
+    /// A distribution of microsecond values in log-linear buckets: each
+    /// power of two is split into SUB_BUCKETS, so a quantile is within
+    /// 1/SUB_BUCKETS of the true value whatever its size.
+    class Histogram
+        : private boost::noncopyable
+    {
+    public:
+        /// Buckets per power of two
+        static const unsigned int SUB_BUCKETS = 8;
+        /// Buckets covering every 64-bit value
+        static const unsigned int BUCKETS = (64 - 2) * SUB_BUCKETS;
+
+        Histogram();
+        /// Adds a value in microseconds
+        void Record(boost::uint64_t p_micros);
+        /// Adds a duration; negative ones count as 0
+        void Record(const boost::posix_time::time_duration &p_duration);
+        /// Values recorded
+        boost::uint64_t GetCount() const;
+        /// Sum of the values recorded
+        boost::uint64_t GetSum() const;
+        /// Largest value recorded
+        boost::uint64_t GetMax() const;
+        /// The value p_quantile of the recorded values are at or below
+        boost::uint64_t GetQuantile(double p_quantile) const;
+        /// The bucket a value is counted in
+        static unsigned int GetBucket(boost::uint64_t p_micros);
+        /// The largest value counted in a bucket
+        static boost::uint64_t GetBucketLimit(unsigned int p_bucket);
+    private:
+        boost::atomic<boost::uint64_t> m_buckets[BUCKETS];
+        boost::atomic<boost::uint64_t> m_count;
+        boost::atomic<boost::uint64_t> m_sum;
+        boost::atomic<boost::uint64_t> m_max;
+    };
+
+    /// The counter with a name and labels, made the first time it is asked
+    static Counter & GetCounter(const std::string &p_name,
+        const std::string &p_labels = "");
+
+    /// The gauge with a name and labels, made the first time it is asked
+    static Gauge & GetGauge(const std::string &p_name,
+        const std::string &p_labels = "");
+
+    /// The histogram with a name and labels, made the first time it is asked
+    static Histogram & GetHistogram(const std::string &p_name,
+        const std::string &p_labels = "");
+
+    /// A label for the p_labels arguments, as name="value"
+    static std::string Label(const std::string &p_name,
+        const std::string &p_value);
+
+    /// Writes every metric in the Prometheus text format
+    static void Write(std::ostream &p_out);
+
+private:
+    /// Every metric, by name and then labels
+    struct Registry;
+
+    /// The registry, built on first use
+    static Registry & GetRegistry();
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CMETRICS_HPP
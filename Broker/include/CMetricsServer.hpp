@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CMetricsServer.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the loopback endpoint metrics are scraped from
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CMETRICSSERVER_HPP
+#define CMETRICSSERVER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace freedm {
+    namespace broker {
+
+/// Answers HTTP requests on a loopback TCP port with CMetrics::Write, so a
+/// scraper on the same host can poll the broker. Every request gets the
+/// full text whatever its path, and the connection is closed after it.
+class CMetricsServer
+    : private boost::noncopyable
+{
+public:
+    /// Listens on 127.0.0.1:p_port, or a free port if p_port is 0
+    CMetricsServer(boost::asio::io_service &p_ios, unsigned short p_port);
+
+    /// Starts accepting scrapes
+    void Start();
+
+    /// Stops accepting; scrapes in progress finish on their own. Safe to
+    /// call from any thread.
+    void Stop();
+
+    /// The port being listened on
+    unsigned short GetPort() const;
+
+    /// Longest a scraper may take to send its request
+    static const unsigned int REQUEST_TIMEOUT_MS = 5000;
+
+private:
+    /// One scrape connection
+    class Session;
+    typedef boost::shared_ptr<Session> SessionPtr;
+
+    /// Waits for the next scraper
+    void Accept();
+
+    /// Starts a session and waits for the next one
+    void HandleAccept(SessionPtr p_session,
+        const boost::system::error_code &p_error);
+
+    /// Closes the listening socket, on the strand
+    void HandleStop();
+
+    /// The io_service the sessions run on
+    boost::asio::io_service &m_ios;
+
+    /// The loopback listening socket
+    boost::asio::ip::tcp::acceptor m_acceptor;
+
+    /// Keeps Stop from closing the socket while an accept is being started
+    boost::asio::io_service::strand m_strand;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CMETRICSSERVER_HPP
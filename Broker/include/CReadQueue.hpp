@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CReadQueue.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the bounded queue of messages waiting for a module
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CREADQUEUE_HPP
+#define CREADQUEUE_HPP
+
+#include "CMessage.hpp"
+#include "CMetrics.hpp"
+#include "IHandler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+/// Messages waiting for one module. Any number of connection strands push
+/// into the queue; the module's own strand drains it and calls the read
+/// handler, so a slow module never holds up the thread that received the
+/// message.
+class CReadQueue
+    : public boost::enable_shared_from_this<CReadQueue>,
+      private boost::noncopyable
+{
+public:
+    /// What Push does once the queue holds its capacity
+    enum OverflowPolicy
+    {
+        /// Keep the message and report the queue full so that the listener
+        /// stops reading until the module catches up.
+        BACKPRESSURE,
+        /// Discard the longest waiting message to make room.
+        DROP_OLDEST,
+        /// Discard the message being pushed.
+        DROP_NEWEST
+    };
+
+    /// Counters describing a queue since it was created
+    struct Stats
+    {
+        /// Messages waiting now
+        std::size_t depth;
+        /// The most messages that were ever waiting at once
+        std::size_t maxDepth;
+        /// Messages handed to the read handler
+        unsigned long handled;
+        /// Messages discarded by the overflow policy
+        unsigned long dropped;
+        /// Total time spent in the read handler, in microseconds
+        unsigned long handlerMicros;
+        /// Longest single call to the read handler, in microseconds
+        unsigned long maxHandlerMicros;
+    };
+
+    /// Pointer type the dispatcher keeps its queues in
+    typedef boost::shared_ptr<CReadQueue> QueuePtr;
+
+    /// Creates a queue for p_handler drained on p_strand
+    CReadQueue(const std::string &p_module, IReadHandler *p_handler,
+        boost::asio::io_service::strand &p_strand, std::size_t p_capacity,
+        OverflowPolicy p_policy);
+
+    /// Adds a message and schedules a drain if none is pending
+    bool Push(const CMessage &p_msg);
+
+    /// True while a backpressure queue holds its capacity or more
+    bool IsFull() const;
+
+    /// The module this queue feeds
+    IReadHandler * GetHandler() const { return m_handler; };
+
+    /// A copy of the counters
+    Stats GetStats() const;
+
+    /// Reads an overflow policy name as given in the configuration
+    static bool ParsePolicy(const std::string &p_name, OverflowPolicy &p_policy);
+
+private:
+    /// A message and when it was queued
+    struct Waiting
+    {
+        CMessage msg;
+        boost::posix_time::ptime queued;
+    };
+
+    /// Calls the read handler for waiting messages on the module's strand
+    void Drain();
+
+    /// The module the messages are for
+    IReadHandler *m_handler;
+
+    /// The strand the module runs on
+    boost::asio::io_service::strand &m_strand;
+
+    /// Messages at which the overflow policy applies, 0 for no limit
+    std::size_t m_capacity;
+
+    /// What happens once the capacity is reached
+    OverflowPolicy m_policy;
+
+    /// Messages waiting for the module
+    std::deque<Waiting> m_messages;
+
+    /// Set while a drain is posted to the strand or running
+    bool m_scheduled;
+
+    /// Counters reported by GetStats
+    Stats m_stats;
+
+    /// Time from Push to the read handler, in the metrics registry
+    CMetrics::Histogram &m_waitTime;
+
+    /// Time in the read handler, in the metrics registry
+    CMetrics::Histogram &m_handlerTime;
+
+    /// Messages discarded by the overflow policy, in the metrics registry
+    CMetrics::Counter &m_dropped;
+
+    /// Guards everything above that changes after construction
+    mutable boost::mutex m_mutex;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CREADQUEUE_HPP
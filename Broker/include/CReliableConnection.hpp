@@ -35,14 +35,20 @@
 
 #include "CMessage.hpp"
 #include "CDispatcher.hpp"
+#include "CResolver.hpp"
+#include "IFabric.hpp"
+#include "types/peerid.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <iomanip>
+#include <string>
+#include <vector>
 
 namespace freedm {
     namespace broker {
@@ -66,6 +72,9 @@ public:
     /// Get the socket associated with the CConnection.
     boost::asio::ip::udp::socket& GetSocket();
 
+    /// Get the strand that serializes this connection's handlers.
+    boost::asio::io_service::strand& GetStrand() { return m_strand; };
+
     /// Start the first asynchronous operation for the CConnection.
     virtual void Start() = 0;
 
@@ -75,6 +84,9 @@ public:
     /// Get associated UUID
     std::string GetUUID() { return m_uuid; };
 
+    /// Get the associated UUID as interned by the connection manager
+    PeerId GetPeerId() const { return m_peerid; };
+
     /// Get Connection Manager
     CConnectionManager& GetConnectionManager() { return m_connManager; };
 
@@ -87,10 +99,49 @@ public:
     /// Get the connection reliability for DCUSTOMNETWORK
     int GetReliability() { return m_reliability; };
 
+    /// Queue a datagram to be written on the next flush
+    void QueueDatagram(const std::string &p_datagram);
+
+    /// Send through an unconnected socket shared with other connections
+    void ShareSocket(boost::asio::ip::udp::socket &p_socket);
+
+    /// Send through a fabric rather than a socket
+    void UseFabric(IFabric &p_fabric);
+
+    /// Look the peer up and connect the socket once its address is known
+    void Resolve(CResolver &p_resolver, const std::string &p_host,
+        const std::string &p_port);
+
+    /// True once the peer can't be written to and no lookup will fix that
+    bool IsStale();
+
+protected:
+    /// Forgets the peer's address and everything waiting to be sent to it
+    void Disconnect();
+
 private:
+    /// Connects the socket and writes the datagrams held for the lookup
+    void HandleResolve(const boost::system::error_code &p_error,
+        const boost::asio::ip::udp::endpoint &p_endpoint);
+
+    /// Writes every queued datagram to the socket
+    void FlushDatagrams();
+
     /// Socket for the CConnection.
     boost::asio::ip::udp::socket m_socket;
 
+    /// The socket written to instead of m_socket, if it is shared
+    boost::asio::ip::udp::socket *m_shared;
+
+    /// The fabric written to instead of any socket, if one is used
+    IFabric *m_fabric;
+
+    /// The peer's address when m_shared is used, unset until it is known
+    boost::asio::ip::udp::endpoint m_remote;
+
+    /// Protocol state for this peer is only touched from this strand.
+    boost::asio::io_service::strand m_strand;
+
     /// The manager for this CConnection.
     CConnectionManager& m_connManager;
 
@@ -100,8 +151,23 @@ private:
     /// The UUID of the remote endpoint for the connection
     std::string m_uuid;
 
+    /// m_uuid as interned by m_connManager
+    PeerId m_peerid;
+
     /// The reliability of the connection (FOR -DCUSTOMNETWORK)
     int m_reliability;
+
+    /// Datagrams waiting for the next flush
+    std::vector<std::string> m_outbox;
+
+    /// Set while a flush is posted but has not yet run
+    bool m_flushQueued;
+
+    /// Set while the peer's address is being looked up; the outbox is held
+    bool m_resolving;
+
+    /// Protects the outbox and the flags
+    boost::mutex m_outboxMutex;
 };
 
 
@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CResolver.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the asynchronous, caching peer name resolver
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+#ifndef CRESOLVER_HPP
+#define CRESOLVER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+/// Turns peer hostnames into endpoints without blocking the thread that
+/// asks. Answers are kept for resolve-ttl seconds, keyed by hostname:port,
+/// and callers asking for a name already being looked up wait on the same
+/// lookup. Numeric addresses never reach the system resolver.
+class CResolver
+    : private boost::noncopyable
+{
+public:
+    /// Called once a lookup finishes, with an error if it failed
+    typedef boost::function<void (const boost::system::error_code &,
+        const boost::asio::ip::udp::endpoint &)> Callback;
+
+    /// Counters describing the lookups made since the resolver was created
+    struct Stats
+    {
+        /// Calls to Resolve
+        unsigned long lookups;
+        /// Calls answered from the cache or a numeric address
+        unsigned long hits;
+        /// Lookups the system resolver could not answer
+        unsigned long failures;
+        /// Lookups waiting on the system resolver now
+        std::size_t pending;
+        /// Total time spent waiting on the system resolver, in microseconds
+        unsigned long resolveMicros;
+        /// Longest single wait on the system resolver, in microseconds
+        unsigned long maxResolveMicros;
+    };
+
+    /// Seconds a failed lookup is remembered before it is tried again
+    static const unsigned int NEGATIVE_TTL = 5;
+
+    /// Creates a resolver whose answers are kept for p_ttl seconds
+    explicit CResolver(unsigned int p_ttl);
+
+    /// Looks up p_host:p_port and calls p_callback with the endpoint
+    void Resolve(boost::asio::io_service &p_ios, const std::string &p_host,
+        const std::string &p_port, Callback p_callback);
+
+    /// Forgets every cached answer
+    void Clear();
+
+    /// A copy of the counters
+    Stats GetStats() const;
+
+private:
+    /// A cached answer, or a lookup still in progress
+    struct Entry
+    {
+        /// An entry that has never been looked up
+        Entry() : expires(boost::posix_time::min_date_time), pending(false) { }
+        /// The address the name resolved to
+        boost::asio::ip::udp::endpoint endpoint;
+        /// The error the last lookup failed with
+        boost::system::error_code error;
+        /// When the answer stops being used
+        boost::posix_time::ptime expires;
+        /// When the lookup in progress was started
+        boost::posix_time::ptime started;
+        /// Set while the system resolver is working on the name
+        bool pending;
+        /// Callers waiting for the lookup in progress
+        std::vector<Callback> waiting;
+    };
+
+    /// Pointer type kept alive by an outstanding lookup
+    typedef boost::shared_ptr<boost::asio::ip::udp::resolver> ResolverPtr;
+
+    /// Stores the result of a lookup and answers everyone waiting on it
+    void HandleResolve(const std::string &p_key, ResolverPtr p_resolver,
+        const boost::system::error_code &p_error,
+        boost::asio::ip::udp::resolver::iterator p_it);
+
+    /// Seconds a good answer is kept, 0 to look the name up every time
+    unsigned int m_ttl;
+
+    /// Answers and lookups in progress, keyed by hostname:port
+    std::map<std::string, Entry> m_cache;
+
+    /// Counters reported by GetStats
+    Stats m_stats;
+
+    /// Guards the cache and the counters
+    mutable boost::mutex m_mutex;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CRESOLVER_HPP
@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CRttEstimator.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the per-peer round trip time estimator
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+#ifndef CRTTESTIMATOR_HPP
+#define CRTTESTIMATOR_HPP
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace freedm {
+    namespace broker {
+
+/// Smoothed round trip time and retransmission timeout for one peer, as in
+/// Jacobson and Karels' algorithm (RFC 6298). The protocol feeds it samples
+/// only from messages written once (Karn's rule) and reports each timeout,
+/// which doubles the RTO until the next sample.
+class CRttEstimator
+    : private boost::noncopyable
+{
+public:
+    /// A snapshot of the estimator, all times in microseconds
+    struct Stats
+    {
+        /// Smoothed round trip time, 0 before the first sample
+        long srtt;
+        /// Smoothed mean deviation of the round trip time
+        long rttvar;
+        /// The timeout in force now, backoff included
+        long rto;
+        /// Round trip times measured
+        unsigned long samples;
+        /// Timeouts reported
+        unsigned long timeouts;
+        /// Messages written again
+        unsigned long retransmits;
+    };
+
+    /// Creates an estimator with no samples
+    CRttEstimator(boost::posix_time::time_duration p_initial,
+        boost::posix_time::time_duration p_min,
+        boost::posix_time::time_duration p_max);
+
+    /// Folds a measured round trip time into the estimate
+    void Sample(boost::posix_time::time_duration p_rtt);
+
+    /// Doubles the timeout after a retransmission timer expired
+    void Backoff();
+
+    /// Counts messages written again
+    void CountRetransmits(unsigned long p_count);
+
+    /// How long to wait for an ACK before writing a message again
+    boost::posix_time::time_duration GetRTO() const;
+
+    /// A copy of the estimate and counters
+    Stats GetStats() const;
+
+private:
+    /// Recomputes m_rto from the estimate and backoff
+    void UpdateRTO();
+
+    /// Timeout before the first sample, in microseconds
+    long m_initial;
+
+    /// Bounds on the timeout, in microseconds
+    long m_min;
+    long m_max;
+
+    /// The estimate and counters
+    Stats m_stats;
+
+    /// Times the timeout has been doubled since the last sample
+    unsigned int m_backoff;
+
+    /// Guards everything above, since GetStats is called off the strand
+    mutable boost::mutex m_mutex;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CRTTESTIMATOR_HPP
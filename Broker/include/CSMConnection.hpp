@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CSMConnection.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the sequenced multicast protocol, which delivers
+///   the group messages one peer writes to its CGroupChannel
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CSMCONNECTION_HPP
+#define CSMCONNECTION_HPP
+
+#include "IProtocol.hpp"
+#include "CMessage.hpp"
+#include "CConnection.hpp"
+#include "CClock.hpp"
+
+#include <boost/cstdint.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+/// The receiving end of a peer's group channel, and the sending end of the
+/// resends it asks for. There is no window and no ACK: the peer numbers
+/// everything it writes to the group, and a gap in the numbers is asked for
+/// again with a NACK. Messages after a gap are held so they are delivered
+/// in order; those for other members only fill their place in the sequence.
+/// The place in the sequence outlives the connection: the group channel
+/// keeps it for the connection that replaces this one.
+class CSMConnection : public IProtocol
+{
+    public:
+        /// Initializes the protocol with the underlying connection
+        CSMConnection(CConnection * conn);
+        /// Destructor
+        virtual ~CSMConnection() { };
+        /// Writes a message to the peer alone through the group channel
+        void Send(const CMessage &msg);
+        /// Resends the group messages a NACK from the peer names
+        void RecieveACK(const CMessage &msg);
+        /// Determines if a group message should be given to the dispatcher
+        bool Recieve(const CMessage &msg);
+        /// Takes a held message that the last Recieve made deliverable
+        bool TakeReady(CMessage &msg);
+        /// Group messages are never acknowledged
+        void SendACK(const CMessage &) { };
+        /// Stops the timers and keeps the place in the peer's sequence
+        void Stop();
+        /// Returns the identifier
+        std::string GetIdentifier() { return Identifier(); };
+        /// Returns the identifier for this protocol.
+        static std::string Identifier() { return "SMC"; };
+    private:
+        /// Moves held messages that are next in sequence to the ready queue
+        void Advance();
+        /// Writes a NACK for the gap, and sets the timer to write it again
+        void RequestMissing();
+        /// Asks again, or gives up on the gap, once the NACK goes unanswered
+        void HandleNackTimeout(const boost::system::error_code& err);
+        /// True if a message the peer has sent has not been received
+        bool HasGap() const;
+        /// True if a message in sequence should be handed on
+        bool IsDeliverable(const CMessage &msg) const;
+        /// Repeats a NACK this many times before skipping the gap
+        const static unsigned int MAX_NACKS = 5;
+        /// Most messages held behind a gap
+        const static std::size_t MAX_HELD = 256;
+        /// Most sequence numbers one NACK asks for
+        const static unsigned int MAX_NACK_RANGE = 64;
+        /// Wait in MS before the first NACK is repeated, before a round trip
+        /// has been measured
+        const static unsigned int NACK_TIME = 50;
+        /// The hash this node is listed under in smc.to
+        std::string m_selfhash;
+        /// Set once a message from the peer has fixed the sequence
+        bool m_synced;
+        /// The run of the peer's channel the sequence belongs to
+        boost::uint32_t m_epoch;
+        /// The next sequence number to deliver
+        unsigned int m_inseq;
+        /// The highest sequence number the peer is known to have sent
+        unsigned int m_highest;
+        /// Messages that arrived after a gap, by sequence number
+        std::map<unsigned int, CMessage> m_held;
+        /// Held messages that are now deliverable
+        std::deque<CMessage> m_ready;
+        /// NACKs written for the current gap
+        unsigned int m_nacks;
+        /// When the first NACK for the current gap was written
+        boost::posix_time::ptime m_nacksent;
+        /// Set while a NACK is waiting to be answered
+        bool m_nackpending;
+        /// Fires when a NACK goes unanswered
+        CClock::Timer m_nacktimer;
+};
+
+    }
+}
+#endif
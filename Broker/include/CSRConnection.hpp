@@ -45,6 +45,7 @@
 
 #include <iomanip>
 #include <deque>
+#include <map>
 
 namespace freedm {
     namespace broker {
@@ -59,27 +60,50 @@ class CSRConnection : public IProtocol
         /// Destructor
         virtual ~CSRConnection() { };
         /// Public facing send function that sends a message
-        void Send(CMessage msg);
+        void Send(const CMessage &msg);
         /// Public facing function that handles marking down ACKs for sent messages
         void RecieveACK(const CMessage &msg);
         /// deterimines if a  messageshould be given to the dispatcher
         bool Recieve(const CMessage &msg);
+        /// Takes the next message that became deliverable out of order
+        bool TakeReady(CMessage &msg);
         /// Handles Writing an ack for the input message to the channel
         void SendACK(const CMessage &msg);
         /// Sends a synchronizer
         void SendSYN();
         /// Stops the timers
-        void Stop() { m_timeout.cancel(); };
+        void Stop() { m_timeout.cancel(); CancelHeldACK(); };
         /// Returns the identifier
         std::string GetIdentifier() { return Identifier(); };
         /// Returns the identifier for this protocol.
         static std::string Identifier() { return "SRC"; };
+        /// Largest window allowed, well under half the sequence space
+        static const unsigned int MAX_WINDOW = 256;
     private:
+        /// A message in the send window and its retransmit state
+        struct QueueItem {
+            CMessage msg; //the message in queue
+            boost::posix_time::ptime refire; //when to write it again
+            boost::posix_time::ptime written; //when it was first written
+            bool sent; //it has been written at least once
+            bool resent; //it has been written more than once
+            bool sacked; //the receiver is holding it out of order
+            bool delivered; //the receiver has delivered it in order
+        };
         /// Resend outstanding messages
         void Resend(const boost::system::error_code& err);
+        /// Sets the timer for the earliest pending refire
+        void ScheduleResend();
+        /// Number of messages allowed in flight right now
+        unsigned int GetFlightSize();
+        /// Moves buffered messages that are now in order to the ready queue
+        void PromoteBuffered();
+        /// Sequence numbers from p_from forward to p_to
+        static unsigned int Distance(unsigned int p_from, unsigned int p_to)
+            { return (p_to + SEQUENCE_MODULO - p_from) % SEQUENCE_MODULO; };
         /// Timeout for resends
-        boost::asio::deadline_timer m_timeout;
-        /// The current ack to flood with
+        CClock::Timer m_timeout;
+        /// The last ack composed, written again if the sender missed it
         CMessage m_currentack;
         /// The expected next in sequence number
         unsigned int m_inseq;
@@ -100,10 +124,16 @@ class CSRConnection : public IProtocol
         /// The hash to... MURDER.
         unsigned int  m_sendkill;
         /// The window
-        std::deque<CMessage> m_window;
+        std::deque<QueueItem> m_window;
+        /// Most messages in flight at once
+        unsigned int m_windowsize;
+        /// Messages received ahead of a gap, by sequence number
+        std::map<unsigned int, CMessage> m_inbuffer;
+        /// Messages delivered in order behind the one Recieve accepted
+        std::deque<CMessage> m_ready;
         /// Sequence modulo
         static const unsigned int SEQUENCE_MODULO = 1024;
-        /// Refire time in MS
+        /// Resend timeout in MS before a round trip has been measured
         static const unsigned int REFIRE_TIME = 25;
 };
 
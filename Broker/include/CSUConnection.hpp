@@ -58,7 +58,7 @@ class CSUConnection : public IProtocol
         /// Destructor
         virtual ~CSUConnection() { };
         /// Public facing send function that sends a message
-        void Send(CMessage msg);
+        void Send(const CMessage &msg);
         /// Public facing function that handles marking down ACKs for sent messages
         void RecieveACK(const CMessage &msg);
         /// deterimines if a  messageshould be given to the dispatcher
@@ -66,16 +66,18 @@ class CSUConnection : public IProtocol
         /// Handles Writing an ack for the input message to the channel
         void SendACK(const CMessage &msg);
         /// Stops the timers
-        void Stop() { m_timeout.cancel(); };
+        void Stop() { m_timeout.cancel(); CancelHeldACK(); };
         /// Returns the identifier
         std::string GetIdentifier() { return Identifier(); };
         /// Returns the identifier for this protocol.
         static std::string Identifier() { return "SUC"; };
     private:
-        /// Resend outstanding messages
+        /// Resend outstanding messages once the timeout passes
         void Resend(const boost::system::error_code& err);
+        /// Writes the window and sets the resend timer
+        void WriteWindow();
         /// Timeout for resends
-        boost::asio::deadline_timer m_timeout;
+        CClock::Timer m_timeout;
         /// The expected next in sequence number
         unsigned int m_inseq;
         /// The next number to assign to an outgoing message
@@ -88,10 +90,13 @@ class CSUConnection : public IProtocol
         const static unsigned int WINDOW_SIZE = 8;
         /// The sequence modulo
         const static unsigned int SEQUENCE_MODULO = 1024;
+        /// Resend timeout in MS before a round trip has been measured
+        const static unsigned int RESEND_TIME = 50;
         /// Queue item
         struct QueueItem {
             int ret; //The retries remaining
             CMessage msg; //the message in queue
+            boost::posix_time::ptime written; //when it was first written
         };
         /// The window
         std::deque<QueueItem> m_window;
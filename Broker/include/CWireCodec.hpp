@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CWireCodec.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the compact binary datagram encoding for CMessage
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CWIRECODEC_HPP
+#define CWIRECODEC_HPP
+
+#include "CMessage.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <string>
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+/// Encodes and decodes CMessages in the compact binary datagram format.
+///
+/// Layout of a datagram (all integers little endian):
+///   magic      u8    always MAGIC, never a legal first byte of XML
+///   version    u8    encoding version, at most VERSION
+///   length     u32   total datagram length including this preamble
+///   flags      u8    FLAG_* bits below
+///   protocol   u8    index into the protocol table, 0 = inline string
+///   status     u16   CMessage::StatusType
+///   sequenceno u32
+///   sendtime   i64   microseconds since the unix epoch
+///   expiretime i64   (only when FLAG_EXPIRES is set)
+///   source     16 raw bytes (FLAG_RAW_UUID) or a string
+///   hostname, port, [protocol] strings
+///   properties, submessages ptrees
+/// Strings are a varint length followed by the bytes. A ptree node is its
+/// data string, a varint child count, and then each child as a key string
+/// followed by the child node. Child order and duplicate keys are kept.
+class CWireCodec
+    : private boost::noncopyable
+{
+public:
+    /// First byte of every binary datagram. XML starts with '<' or space.
+    static const unsigned char MAGIC = 0xFD;
+    /// Highest encoding version this node reads and writes.
+    static const unsigned char VERSION = 3;
+    /// First version whose nodes match SRC ACKs by CMessage::GetHash.
+    /// The layout is the same as version 1.
+    static const unsigned char DIGEST_VERSION = 2;
+    /// First version whose nodes read ACKs carried by data messages and
+    /// hold their own ACKs. The layout is the same as version 1.
+    static const unsigned char PIGGYBACK_VERSION = 3;
+    /// Bytes of magic, version and length at the start of a datagram.
+    static const std::size_t PREAMBLE_SIZE = 6;
+
+    /// Checks if a buffer holds a binary datagram rather than XML
+    static bool IsBinary(const char * p_data, std::size_t p_length);
+
+    /// Appends the binary encoding of a message to a buffer
+    static void Encode(const CMessage &p_msg, std::string &p_out,
+        unsigned char p_version = VERSION);
+
+    /// Decodes a complete binary datagram into a message, in place
+    static bool Decode(const char * p_data, std::size_t p_length,
+        CMessage &p_msg);
+
+    /// Appends the binary encoding of a property tree to a buffer
+    static void EncodeTree(const ptree &p_tree, std::string &p_out);
+
+    /// Reads a property tree, advancing the cursor past it
+    static bool DecodeTree(const char *&p_cursor, const char * p_end,
+        ptree &p_tree);
+
+    /// Validates an encoded property tree and advances the cursor past it
+    static bool SkipTree(const char *&p_cursor, const char * p_end);
+
+    /// Lists the top level keys of an encoded property tree
+    static bool TreeKeys(const char * p_data, std::size_t p_length,
+        std::vector<std::string> &p_keys);
+
+    /// Converts a timestamp to microseconds since the epoch
+    static boost::int64_t ToMicroseconds(const boost::posix_time::ptime &p_t);
+
+private:
+    /// Bit set when the message never expires
+    static const unsigned char FLAG_NEVER_EXPIRES = 0x01;
+    /// Bit set when an expire time follows the send time
+    static const unsigned char FLAG_EXPIRES = 0x02;
+    /// Bit set when the source is sent as 16 raw bytes
+    static const unsigned char FLAG_RAW_UUID = 0x04;
+
+    /// Converts microseconds since the epoch to a timestamp
+    static boost::posix_time::ptime FromMicroseconds(boost::int64_t p_us);
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // CWIRECODEC_HPP
@@ -1,5 +1,11 @@
 #include <map>
 #include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "CMessage.hpp"
+#include "types/peerid.hpp"
 
 #ifndef IAGENT_HPP_
 #define IAGENT_HPP_
@@ -9,6 +15,10 @@ template<class T>
 class IAgent
 {
     public:
+        /// Creates the strand the module's handlers and timers run on
+        explicit IAgent(boost::asio::io_service &ios) : m_strand(ios) { };
+        /// The strand that serializes this module's handlers
+        boost::asio::io_service::strand& GetStrand() { return m_strand; };
         /// Provides a PeerSet type for a module templated on T
         typedef std::map<std::string, T> PeerSet;
         /// Provides a PeerNodePtr templated on T
@@ -27,6 +37,24 @@ class IAgent
         /// Provides insert() for a PeerSet
         void InsertInPeerSet(PeerSet& ps, T m)
             { ps.insert(std::pair<std::string,T>(m->GetUUID(),m)); };
+        /// Sends one message to every peer in a PeerSet, multicast once
+        /// when the group channel is open
+        void SendToPeerSet(PeerSet& ps, const freedm::broker::CMessage& m)
+        {
+            if(ps.empty())
+                return;
+            std::vector<freedm::broker::PeerId> peers_;
+            peers_.reserve(ps.size());
+            for(PeerSetIterator it_ = ps.begin(); it_ != ps.end(); ++it_)
+                peers_.push_back(it_->second->GetPeerId());
+            T first_ = ps.begin()->second;
+            first_->GetConnectionManager().SendToGroup(peers_, m,
+                first_->GetIOService(), first_->GetDispatcher());
+        };
+    private:
+        /// Read handlers and timer callbacks for the module run here, so a
+        /// module never runs on two threads at once.
+        boost::asio::io_service::strand m_strand;
 };
 
 #endif
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////
+/// @file      IFabric.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare the interface for carrying datagrams between
+///   brokers in place of their sockets
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef IFABRIC_HPP
+#define IFABRIC_HPP
+
+#include <string>
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+///////////////////////////////////////////////////////////////////////////////
+/// @class IFabric
+///
+/// @description Carries the datagrams a broker writes to its peers instead
+/// of its sockets, e.g. a simulated network joining several brokers in one
+/// process. A connection manager given a fabric opens no sockets and looks
+/// no addresses up; each connection hands its flushed datagrams to Send,
+/// and the fabric delivers them to the receiving broker's listener. Group
+/// channel datagrams go to Broadcast instead.
+///
+///////////////////////////////////////////////////////////////////////////////
+class IFabric
+{
+public:
+    virtual ~IFabric() { }
+
+    /// Takes the datagrams one broker flushed to a peer, in order
+    virtual void Send(const std::string &p_from, const std::string &p_to,
+        const std::vector<std::string> &p_datagrams) = 0;
+
+    /// Takes the datagrams one broker wrote to the multicast group, for
+    /// every other broker
+    virtual void Broadcast(const std::string &p_from,
+        const std::vector<std::string> &p_datagrams) = 0;
+};
+
+    } // namespace broker
+} // namespace freedm
+
+#endif // IFABRIC_HPP
@@ -28,7 +28,7 @@ public:
     virtual ~IReadHandler(){}
 
     /// Handle completion of a read operation.
-    virtual void HandleRead(freedm::broker::CMessage msg) = 0;
+    virtual void HandleRead(const freedm::broker::CMessage &msg) = 0;
 };
 
 /// An interface for an object which writes on outgoing messages
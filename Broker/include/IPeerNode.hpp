@@ -85,12 +85,18 @@ class IPeerNode
         ///              string.
         /////////////////////////////////////////////////////////////
         std::string GetUUID() const { return m_uuid; };
+        ////////////////////////////////////////////////////////////
+        /// @fn IPeerNode::GetPeerId
+        /// @description Returns the ID the connection manager
+        ///              interned this peer's uuid as.
+        /////////////////////////////////////////////////////////////
+        broker::PeerId GetPeerId() const { return m_peerid; };
         /////////////////////////////////////////////////////////////
         /// @fn IPeerNode::GetHostname
         /// @description Returns the hostname of this peer node as a
         ///              string
         /////////////////////////////////////////////////////////////
-        std::string GetHostname() const { return m_connmgr.GetHostnameByUUID(GetUUID()).hostname; };
+        std::string GetHostname() const { return m_connmgr.GetHostnameByPeerId(m_peerid).hostname; };
         /// Gives a connection ptr to this peer
         broker::ConnectionPtr GetConnection();
         /////////////////////////////////////////////////////////////
@@ -112,13 +118,14 @@ class IPeerNode
         /////////////////////////////////////////////////////////////
         freedm::broker::CDispatcher& GetDispatcher() { return m_dispatch; };
         ///Sends a message to peer
-        bool Send(freedm::broker::CMessage msg);
+        bool Send(const freedm::broker::CMessage &msg);
         ///Depreciated.
-        void AsyncSend(freedm::broker::CMessage msg);
+        void AsyncSend(const freedm::broker::CMessage &msg);
     protected:
         friend class CAgent;
     private:
         std::string m_uuid; /// This node's uuid.
+        broker::PeerId m_peerid; /// The uuid as interned by m_connmgr.
         ConnManagerPtr m_connmgr; /// The connection manager to use
         boost::asio::io_service& m_ios; /// io_service to connect with
         freedm::broker::CDispatcher& m_dispatch; /// Message handling dispatcher.
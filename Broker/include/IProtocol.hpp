@@ -37,6 +37,9 @@
 #include "CMessage.hpp"
 #include "RequestParser.hpp"
 #include "CConnection.hpp"
+#include "CRttEstimator.hpp"
+#include "CMetrics.hpp"
+#include "CClock.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -56,16 +59,36 @@ class IProtocol
     : private boost::noncopyable
 {
     public:
+        /// Counters for the protocol's traffic with one peer, labelled with
+        /// the peer and the protocol
+        struct Metrics
+        {
+            /// Looks up the counters for p_labels
+            explicit Metrics(const std::string &p_labels);
+            /// Messages given to the protocol to send
+            CMetrics::Counter &sent;
+            /// Messages accepted from the peer
+            CMetrics::Counter &received;
+            /// Messages written again after their timeout
+            CMetrics::Counter &resent;
+            /// Messages dropped unacknowledged
+            CMetrics::Counter &expired;
+            /// Messages in the send window now
+            CMetrics::Gauge &window;
+        };
         /// Initializes the protocol with the underlying connection
-        IProtocol(CConnection * conn) : m_conn(conn) { };
+        IProtocol(CConnection * conn, const std::string &p_identifier,
+            boost::posix_time::time_duration p_initialRTO);
         /// Destroy all humans
         virtual ~IProtocol() { };
         /// Public write to channel function
-        virtual void Send(CMessage msg) = 0;
+        virtual void Send(const CMessage &msg) = 0;
         /// Public facing function that handles marking ACKS
         virtual void RecieveACK(const CMessage &msg) = 0;
         /// Function that determines if a message should dispatched
         virtual bool Recieve(const CMessage &msg) = 0;
+        /// Takes a message that became deliverable after the last Recieve
+        virtual bool TakeReady(CMessage &) { return false; };
         /// Handles Writing an ack for the input message to the channel
         virtual void SendACK(const CMessage &msg) = 0;
         /// Handles Stopping the timers etc
@@ -74,18 +97,40 @@ class IProtocol
         virtual std::string GetIdentifier() = 0;
         /// Returns a pointer to the underlying connection.
         CConnection* GetConnection() { return m_conn; };
+        /// The round trip estimate and retransmission counters for the peer
+        CRttEstimator::Stats GetRttStats() const { return m_rtt.GetStats(); };
+        /// The traffic counters for the peer
+        Metrics & GetMetrics() { return m_metrics; };
+        /// Takes an ACK carried by a data message out of it
+        static bool DetachACK(const CMessage &p_carrier, CMessage &p_ack);
+        /// Longest ack-delay allowed, in milliseconds
+        static const unsigned int MAX_ACK_DELAY = 20;
     protected:
-        /// Callback for when a write completes.
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-        virtual void WriteCallback(const boost::system::error_code& e) { }
-#pragma GCC diagnostic warning "-Wunused-parameter"
         /// Handles writing the message to the underlying connection
         virtual void Write(CMessage msg);
+        /// Writes an ACK after the ack-delay, or with the next data message
+        void HoldACK(const CMessage &p_ack, bool p_now = false);
+        /// Drops the held ACK and stops its timer
+        void CancelHeldACK();
+        /// The round trip estimate the protocol times its resends by
+        CRttEstimator & GetRtt() { return m_rtt; };
     private:
-        /// Write buffer
-        boost::array<char, 8192> m_buffer;
+        /// Writes the held ACK on its own once the delay is up
+        void FlushACK(const boost::system::error_code &p_err);
         /// The underlying and related connection object.
         CConnection * m_conn;
+        /// Fires when the held ACK has to go out alone
+        CClock::Timer m_acktimer;
+        /// The ACK waiting for a data message to ride on
+        CMessage m_heldack;
+        /// Set while m_heldack has not been written
+        bool m_ackheld;
+        /// How long an ACK may wait, from the ack-delay setting
+        unsigned int m_ackdelay;
+        /// Round trip estimate for the peer
+        CRttEstimator m_rtt;
+        /// Traffic counters for the peer
+        Metrics m_metrics;
 };
 
     }
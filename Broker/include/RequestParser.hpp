@@ -12,6 +12,7 @@
 #define HTTP_CRequestParser_HPP
 
 #include "CMessage.hpp"
+#include "CWireCodec.hpp"
 
 #include <algorithm>
 #include <stdexcept>
@@ -31,7 +32,8 @@ namespace broker {
 /// Parse some data. The tribool return value is true when a complete request
 /// has been parsed, false if the data is invalid, indeterminate when more
 /// data is required. The InputIterator return value indicates how much of the
-/// input has been consumed.
+/// input has been consumed. Binary datagrams (see CWireCodec) are detected by
+/// their first byte; anything else is treated as XML.
 template <typename InputIterator>
 boost::tuple<boost::tribool, InputIterator> Parse(CMessage &req,
         InputIterator begin, InputIterator end)
@@ -44,6 +46,13 @@ boost::tuple<boost::tribool, InputIterator> Parse(CMessage &req,
     std::copy( begin, end, ss_buf );
     boost::tribool result = boost::tribool::indeterminate_value;
 
+    const std::string &raw_ = ss_.str();
+    if( CWireCodec::IsBinary( raw_.data(), raw_.size() ) )
+    {
+        result = CWireCodec::Decode( raw_.data(), raw_.size(), req );
+        return boost::make_tuple(result, begin);
+    }
+
     try 
     {
         RPLogger.Debug << "Loading xml: " << std::endl
@@ -59,9 +68,12 @@ boost::tuple<boost::tribool, InputIterator> Parse(CMessage &req,
     return boost::make_tuple(result, begin);
 }
 
+/// Write a message to an output buffer. When p_wireVersion is non-zero the
+/// compact binary encoding is used, otherwise the message is written as XML.
 template <typename OutputIterator>
 boost::tuple< boost::tribool, OutputIterator> Synthesize( CMessage &msg,
-    OutputIterator begin, size_t p_outMaxLength )
+    OutputIterator begin, size_t p_outMaxLength,
+    unsigned int p_wireVersion = 0 )
 {
     static CLocalLogger RPLogger(__PRETTY_FUNCTION__);
     RPLogger.Debug << __PRETTY_FUNCTION__ << std::endl;
@@ -70,21 +82,29 @@ boost::tuple< boost::tribool, OutputIterator> Synthesize( CMessage &msg,
     boost::tribool result = boost::indeterminate;
     OutputIterator last;
 
-    try
+    if( p_wireVersion != 0 )
     {
-        msg.Save( ss_ );
-        RPLogger.Debug << "Saved xml: " << std::endl
-                << ss_.str() << std::endl;
+        CWireCodec::Encode( msg, str_, p_wireVersion );
         result = true;
     }
-    catch( std::exception &e )
+    else
     {
-        RPLogger.Error
-            << "Exception: " << e.what() << std::endl;
+        try
+        {
+            msg.Save( ss_ );
+            RPLogger.Debug << "Saved xml: " << std::endl
+                    << ss_.str() << std::endl;
+            result = true;
+        }
+        catch( std::exception &e )
+        {
+            RPLogger.Error
+                << "Exception: " << e.what() << std::endl;
+        }
+
+        str_ = ss_.str();
     }
 
-    str_ = ss_.str();
-
     if( str_.length() <= p_outMaxLength )
     {
         last = std::copy( str_.begin(), str_.end(), begin  );
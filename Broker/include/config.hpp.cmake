@@ -34,5 +34,8 @@
 #cmakedefine USE_DEVICE_PSCAD
 #cmakedefine USE_DEVICE_RTDS
 
+// log levels above this are removed by the compiler
+#define MAX_LOG_LEVEL @MAX_LOG_LEVEL@
+
 #endif // CONFIG_HPP
 
@@ -0,0 +1,13 @@
+#ifndef PEERID_HPP
+#define PEERID_HPP
+
+namespace freedm {
+namespace broker {
+
+/// Dense number a peer's UUID is interned as, an index into the peer table
+typedef unsigned int PeerId;
+
+}
+}
+
+#endif
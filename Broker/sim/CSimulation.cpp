@@ -0,0 +1,560 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CSimulation.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Runs many brokers in one process on virtual time, joined by
+///   an in-memory network with loss, latency and partitions
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CSimulation.hpp"
+#include "bench.hpp"
+#include "CClock.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CLogger.hpp"
+#include "gm/GroupManagement.hpp"
+#include "lb/LoadBalance.hpp"
+#include "sc/CStateCollection.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+
+namespace freedm {
+    namespace sim {
+
+static CLocalLogger Logger(__FILE__);
+
+namespace {
+
+/// Makes p_uuid the identity the next connection manager is built with.
+const std::string & Identify(const std::string &p_uuid)
+{
+    CGlobalConfiguration::instance().SetUUID(p_uuid);
+    return p_uuid;
+}
+
+} // unnamed namespace
+
+NetworkSettings::NetworkSettings()
+    : loss(0), latency(boost::posix_time::milliseconds(1)), jitter(), seed(1)
+{
+}
+
+NodeCounters::NodeCounters()
+    : sent(0), sentBytes(0), received(0), receivedBytes(0), dropped(0),
+      cpuSeconds(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::CNode
+/// @description Builds a broker the way PosixMain does, except that its
+///   connections and group channel send through p_fabric and its listener
+///   is never started.
+/// @pre Time is virtual, so the modules' timers report their deadlines.
+/// @post The modules are registered with the dispatcher but not running.
+/// @param p_uuid The node's identity.
+/// @param p_fabric The network to send through.
+///////////////////////////////////////////////////////////////////////////////
+CNode::CNode(const std::string &p_uuid, broker::IFabric &p_fabric)
+    : m_uuid(Identify(p_uuid))
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_manager.SetFabric(&p_fabric);
+    m_listener.reset(new broker::CListener(m_ios, m_manager, m_dispatch,
+        m_uuid));
+    m_manager.OpenGroupChannel(*m_listener);
+    m_gm = new GMAgent(m_uuid, m_ios, m_dispatch, m_manager);
+    m_dispatch.RegisterReadHandler("gm", m_gm, &m_gm->GetStrand());
+    m_lb = new lbAgent(m_uuid, m_ios, m_dispatch, m_manager, m_phyManager);
+    m_dispatch.RegisterReadHandler("lb", m_lb, &m_lb->GetStrand());
+    m_sc = new SCAgent(m_uuid, m_ios, m_dispatch, m_manager, m_phyManager);
+    m_dispatch.RegisterReadHandler("any", m_sc, &m_sc->GetStrand());
+    AddPeer(m_uuid);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::~CNode
+/// @description Releases the node. Handlers still queued are destroyed
+///   without running.
+/// @pre The node is not being polled.
+/// @post The group management module and the connections are released.
+/// @limitations The load balancing and state collection modules are not
+///   deleted: each holds a shared pointer to itself in its own peer set,
+///   so deleting one frees it twice. PosixMain has the same problem at
+///   exit. They stay allocated until the process ends, and since the
+///   io_service their timers used is gone they never run again.
+///////////////////////////////////////////////////////////////////////////////
+CNode::~CNode()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    delete m_gm;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::AddPeer
+/// @description Adds a peer to the list of known hosts, as --add-host
+///   does. The fabric finds peers by UUID, so the address is a placeholder.
+/// @pre None
+/// @post The modules may contact p_uuid.
+/// @param p_uuid The peer's identity.
+///////////////////////////////////////////////////////////////////////////////
+void CNode::AddPeer(const std::string &p_uuid)
+{
+    m_manager.PutHostname(p_uuid, "sim", "0");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::Start
+/// @description Posts the load balancing and group management main loops
+///   to their strands; they run on the next Poll.
+/// @pre Start has not been called.
+/// @post The modules will start.
+///////////////////////////////////////////////////////////////////////////////
+void CNode::Start()
+{
+    m_lb->GetStrand().post(boost::bind(&lbAgent::LB, m_lb));
+    m_gm->GetStrand().post(boost::bind(&GMAgent::Run, m_gm));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::Poll
+/// @description Runs the node's ready handlers, including timers due by
+///   the current virtual time, without waiting for more.
+/// @pre Called from the simulation's thread.
+/// @post The CPU time taken is added to the node's counters.
+///////////////////////////////////////////////////////////////////////////////
+void CNode::Poll()
+{
+    double start_ = bench::ThreadSeconds();
+    m_ios.reset();
+    m_ios.poll();
+    m_counters.cpuSeconds += bench::ThreadSeconds() - start_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CNode::Receive
+/// @description Queues a datagram as if it had arrived on the listener's
+///   socket.
+/// @pre None
+/// @post The datagram is decoded on the next Poll.
+/// @param p_datagram The datagram.
+///////////////////////////////////////////////////////////////////////////////
+void CNode::Receive(const std::string &p_datagram)
+{
+    m_counters.received++;
+    m_counters.receivedBytes += p_datagram.size();
+    m_ios.post(boost::bind(&CNode::HandleDatagram, this, p_datagram));
+}
+
+/// Hands a received datagram to the listener
+void CNode::HandleDatagram(const std::string &p_datagram)
+{
+    m_listener->HandleDatagram(p_datagram.data(), p_datagram.size());
+}
+
+/// The group leader this node follows, or itself
+std::string CNode::GetLeader() const
+{
+    return m_gm->Coordinator();
+}
+
+/// True if group management is neither electing nor recovering
+bool CNode::IsSettled() const
+{
+    return m_gm->GetStatus() == GMPeerNode::NORMAL;
+}
+
+/// True if this node leads a group p_uuid is a member of
+bool CNode::HasMember(const std::string &p_uuid) const
+{
+    return m_gm->IsCoordinator() && m_gm->IsGroupMember(p_uuid);
+}
+
+CFabric::CFabric(const NetworkSettings &p_settings)
+    : m_settings(p_settings), m_sequence(0), m_random(p_settings.seed)
+{
+}
+
+/// Connects a node so datagrams can be sent to it
+void CFabric::Attach(CNode &p_node)
+{
+    m_nodes[p_node.GetUUID()] = &p_node;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFabric::Send
+/// @description Puts a connection's datagrams in flight, or drops them.
+///   Each datagram is dropped or delayed on its own, like UDP.
+/// @pre Both nodes are attached.
+/// @post The datagrams not dropped arrive after the latency.
+/// @param p_from The sending node.
+/// @param p_to The receiving node.
+/// @param p_datagrams The datagrams, in the order they were flushed.
+///////////////////////////////////////////////////////////////////////////////
+void CFabric::Send(const std::string &p_from, const std::string &p_to,
+    const std::vector<std::string> &p_datagrams)
+{
+    std::map<std::string, CNode *>::iterator from_ = m_nodes.find(p_from);
+    std::map<std::string, CNode *>::iterator to_ = m_nodes.find(p_to);
+    if(from_ == m_nodes.end() || to_ == m_nodes.end())
+    {
+        Logger.Warn << "No node " << p_from << " or " << p_to << std::endl;
+        return;
+    }
+    NodeCounters &counters_ = from_->second->GetCounters();
+    bool reachable_ = Reachable(p_from, p_to);
+
+    for(std::size_t i = 0; i < p_datagrams.size(); i++)
+    {
+        counters_.sent++;
+        counters_.sentBytes += p_datagrams[i].size();
+        if(!reachable_ || !Launch(to_->second, p_datagrams[i]))
+        {
+            counters_.dropped++;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFabric::Broadcast
+/// @description Puts a copy of each datagram in flight to every other node
+///   on the sender's side of any partition, as a multicast would. Each
+///   datagram counts once as sent; each copy lost at random counts as
+///   dropped.
+/// @pre The sender is attached.
+/// @post The copies not dropped arrive after the latency.
+/// @param p_from The sending node.
+/// @param p_datagrams The datagrams, in the order they were written.
+///////////////////////////////////////////////////////////////////////////////
+void CFabric::Broadcast(const std::string &p_from,
+    const std::vector<std::string> &p_datagrams)
+{
+    std::map<std::string, CNode *>::iterator from_ = m_nodes.find(p_from);
+    if(from_ == m_nodes.end())
+    {
+        Logger.Warn << "No node " << p_from << std::endl;
+        return;
+    }
+    NodeCounters &counters_ = from_->second->GetCounters();
+    std::map<std::string, CNode *>::iterator to_;
+
+    for(std::size_t i = 0; i < p_datagrams.size(); i++)
+    {
+        counters_.sent++;
+        counters_.sentBytes += p_datagrams[i].size();
+        for(to_ = m_nodes.begin(); to_ != m_nodes.end(); to_++)
+        {
+            if(to_ == from_ || !Reachable(p_from, to_->first))
+            {
+                continue;
+            }
+            if(!Launch(to_->second, p_datagrams[i]))
+            {
+                counters_.dropped++;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFabric::Launch
+/// @description Drops a datagram at the loss rate, or schedules it to
+///   arrive after the latency and jitter.
+/// @pre The ends can reach each other.
+/// @post The datagram is in flight unless it was dropped.
+/// @param p_to The receiving node.
+/// @param p_datagram The datagram.
+/// @return False if the datagram was dropped.
+///////////////////////////////////////////////////////////////////////////////
+bool CFabric::Launch(CNode *p_to, const std::string &p_datagram)
+{
+    if(m_random() % 1000000 < m_settings.loss * 10000)
+    {
+        return false;
+    }
+    long jitter_ = m_settings.jitter.total_microseconds();
+    boost::posix_time::time_duration delay_ = m_settings.latency;
+    if(jitter_ > 0)
+    {
+        delay_ += boost::posix_time::microseconds(
+            static_cast<long>(m_random() % (2 * jitter_ + 1)) - jitter_);
+    }
+    Flight flight_;
+    flight_.arrival = broker::CClock::Now() + std::max(delay_,
+        boost::posix_time::time_duration());
+    flight_.sequence = m_sequence++;
+    flight_.to = p_to;
+    flight_.datagram = p_datagram;
+    m_inflight.push(flight_);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFabric::SetPartition
+/// @description Cuts the network into sides. Datagrams already in flight
+///   still arrive.
+/// @pre None
+/// @post Datagrams between nodes on different sides are dropped.
+/// @param p_sides The side of each node; nodes not listed are on side 0.
+///////////////////////////////////////////////////////////////////////////////
+void CFabric::SetPartition(const std::map<std::string, int> &p_sides)
+{
+    m_sides = p_sides;
+}
+
+/// Joins the network back together
+void CFabric::Heal()
+{
+    m_sides.clear();
+}
+
+/// The side of the partition a node is on; 0 when there is none
+int CFabric::GetSide(const std::string &p_uuid) const
+{
+    std::map<std::string, int>::const_iterator it_ = m_sides.find(p_uuid);
+    return it_ == m_sides.end() ? 0 : it_->second;
+}
+
+/// True if the ends of a datagram are on the same side
+bool CFabric::Reachable(const std::string &p_from,
+    const std::string &p_to) const
+{
+    return GetSide(p_from) == GetSide(p_to);
+}
+
+/// When the next datagram arrives, if any are in flight
+bool CFabric::GetNextArrival(boost::posix_time::ptime &p_time) const
+{
+    if(m_inflight.empty())
+    {
+        return false;
+    }
+    p_time = m_inflight.top().arrival;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFabric::Deliver
+/// @description Hands each datagram due by the current virtual time to its
+///   node.
+/// @pre None
+/// @post No datagram due by now is left in flight.
+/// @param p_ready The nodes that were handed a datagram are added to this.
+///////////////////////////////////////////////////////////////////////////////
+void CFabric::Deliver(std::set<CNode *> &p_ready)
+{
+    boost::posix_time::ptime now_ = broker::CClock::Now();
+    while(!m_inflight.empty() && m_inflight.top().arrival <= now_)
+    {
+        const Flight &flight_ = m_inflight.top();
+        flight_.to->Receive(flight_.datagram);
+        p_ready.insert(flight_.to);
+        m_inflight.pop();
+    }
+}
+
+/// Orders the queue so the earliest arrival is on top
+bool CFabric::Flight::operator<(const Flight &p_other) const
+{
+    if(arrival != p_other.arrival)
+    {
+        return arrival > p_other.arrival;
+    }
+    return sequence > p_other.sequence;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSimulation::CSimulation
+/// @description Builds the nodes and tells each about all the others, as
+///   if every broker had been started with the same --add-host list.
+/// @pre Time is virtual.
+/// @post The nodes exist but their modules have not started.
+/// @param p_count The number of nodes.
+/// @param p_settings How the network treats datagrams.
+///////////////////////////////////////////////////////////////////////////////
+CSimulation::CSimulation(unsigned int p_count,
+    const NetworkSettings &p_settings)
+    : m_fabric(p_settings)
+{
+    CGlobalConfiguration::instance().SetHostname("sim");
+    CGlobalConfiguration::instance().SetListenPort("0");
+    for(unsigned int i = 0; i < p_count; i++)
+    {
+        std::string uuid_ = "node-" + boost::lexical_cast<std::string>(i);
+        CNode *node_ = new CNode(uuid_, m_fabric);
+        m_nodes.push_back(node_);
+        m_byService[&node_->GetIOService()] = node_;
+        m_fabric.Attach(*node_);
+    }
+    for(unsigned int i = 0; i < p_count; i++)
+    {
+        for(unsigned int j = 0; j < p_count; j++)
+        {
+            if(i != j)
+            {
+                m_nodes[i]->AddPeer(m_nodes[j]->GetUUID());
+            }
+        }
+    }
+}
+
+/// Releases the nodes
+CSimulation::~CSimulation()
+{
+    for(std::size_t i = 0; i < m_nodes.size(); i++)
+    {
+        delete m_nodes[i];
+    }
+}
+
+/// Starts every node's modules
+void CSimulation::Start()
+{
+    for(std::size_t i = 0; i < m_nodes.size(); i++)
+    {
+        m_nodes[i]->Start();
+        m_ready.insert(m_nodes[i]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSimulation::RunUntil
+/// @description Runs every node until nothing is left to do at the current
+///   time, then moves the clock to the next timer or arrival, until the
+///   next one is after p_time.
+/// @pre Time is virtual.
+/// @post Now returns p_time.
+/// @param p_time The virtual time to stop at.
+///////////////////////////////////////////////////////////////////////////////
+void CSimulation::RunUntil(const boost::posix_time::ptime &p_time)
+{
+    std::vector<boost::asio::io_service *> due_;
+    while(true)
+    {
+        broker::CClock::TakeDue(due_);
+        for(std::size_t i = 0; i < due_.size(); i++)
+        {
+            m_ready.insert(m_byService[due_[i]]);
+        }
+        due_.clear();
+        m_fabric.Deliver(m_ready);
+
+        if(!m_ready.empty())
+        {
+            std::set<CNode *> ready_;
+            ready_.swap(m_ready);
+            for(std::set<CNode *>::iterator it_ = ready_.begin();
+                it_ != ready_.end(); it_++)
+            {
+                (*it_)->Poll();
+            }
+            continue;
+        }
+
+        // Nothing can happen until the next timer or arrival
+        boost::posix_time::ptime next_, arrival_;
+        bool found_ = broker::CClock::GetNextDeadline(next_);
+        if(m_fabric.GetNextArrival(arrival_) && (!found_ || arrival_ < next_))
+        {
+            next_ = arrival_;
+            found_ = true;
+        }
+        if(!found_ || next_ > p_time)
+        {
+            break;
+        }
+        broker::CClock::AdvanceTo(next_);
+    }
+    broker::CClock::AdvanceTo(p_time);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSimulation::IsConverged
+/// @description Checks that group management has settled: on each side of
+///   the network every node follows the same leader, the leader is on
+///   that side, and no node is electing or recovering.
+/// @pre None
+/// @post None
+/// @return True if the groups match the sides of the network.
+///////////////////////////////////////////////////////////////////////////////
+bool CSimulation::IsConverged() const
+{
+    std::map<int, std::string> leaders_;
+    for(std::size_t i = 0; i < m_nodes.size(); i++)
+    {
+        const CNode &node_ = *m_nodes[i];
+        int side_ = m_fabric.GetSide(node_.GetUUID());
+        std::string leader_ = node_.GetLeader();
+        if(!node_.IsSettled() || m_fabric.GetSide(leader_) != side_)
+        {
+            return false;
+        }
+        std::map<int, std::string>::iterator it_ = leaders_.find(side_);
+        if(it_ == leaders_.end())
+        {
+            leaders_[side_] = leader_;
+        }
+        else if(it_->second != leader_)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSimulation::IsForgotten
+/// @description Checks that the failure of a node has been noticed: none of
+///   the others follows it as leader, and no leader still counts it as a
+///   member of its group.
+/// @pre None
+/// @post None
+/// @param p_uuid The node that failed.
+/// @return True if every other node has let the failed one go.
+///////////////////////////////////////////////////////////////////////////////
+bool CSimulation::IsForgotten(const std::string &p_uuid) const
+{
+    for(std::size_t i = 0; i < m_nodes.size(); i++)
+    {
+        const CNode &node_ = *m_nodes[i];
+        if(node_.GetUUID() == p_uuid)
+        {
+            continue;
+        }
+        if(node_.GetLeader() == p_uuid || node_.HasMember(p_uuid))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+    } // namespace sim
+} // namespace freedm
@@ -0,0 +1,259 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CSimulation.hpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Declare a simulation of many brokers in one process, joined
+///   by an in-memory network and run on virtual time
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#ifndef CSIMULATION_HPP
+#define CSIMULATION_HPP
+
+#include "CConnectionManager.hpp"
+#include "CDispatcher.hpp"
+#include "CListener.hpp"
+#include "IFabric.hpp"
+#include "device/CPhysicalDeviceManager.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace freedm {
+
+class GMAgent;
+class lbAgent;
+class SCAgent;
+
+    namespace sim {
+
+/// How the simulated network treats datagrams
+struct NetworkSettings
+{
+    NetworkSettings();
+    /// Percent of datagrams dropped, 0 to 100
+    double loss;
+    /// One-way delay of every datagram
+    boost::posix_time::time_duration latency;
+    /// Up to this much is added to or taken from the delay at random
+    boost::posix_time::time_duration jitter;
+    /// Seed for the loss and jitter draws
+    boost::uint32_t seed;
+};
+
+/// Datagram and CPU counts for one node
+struct NodeCounters
+{
+    NodeCounters();
+    boost::uint64_t sent;
+    boost::uint64_t sentBytes;
+    boost::uint64_t received;
+    boost::uint64_t receivedBytes;
+    boost::uint64_t dropped;
+    /// Thread CPU time spent running the node's handlers
+    double cpuSeconds;
+};
+
+/// One broker: the connection manager, dispatcher and the three modules, as
+/// PosixMain puts them together, with its own io_service so the time spent
+/// running it can be measured. The listener is never started; datagrams
+/// from the network are handed to it directly.
+class CNode
+    : private boost::noncopyable
+{
+public:
+    /// Builds the stack for p_uuid, sending through p_fabric
+    CNode(const std::string &p_uuid, broker::IFabric &p_fabric);
+    /// Tears down the stack; see the limitations on the destructor
+    ~CNode();
+
+    /// Tells the manager where a peer is, so its modules will contact it
+    void AddPeer(const std::string &p_uuid);
+
+    /// Posts the modules' main loops, as PosixMain does
+    void Start();
+
+    /// Runs every handler that is ready, charging the CPU time to the node
+    void Poll();
+
+    /// Queues a datagram from the network to be read on the next Poll
+    void Receive(const std::string &p_datagram);
+
+    /// The node's identity
+    const std::string & GetUUID() const { return m_uuid; }
+
+    /// The group leader this node follows, or itself
+    std::string GetLeader() const;
+
+    /// True if group management is neither electing nor recovering
+    bool IsSettled() const;
+
+    /// True if this node leads a group p_uuid is a member of
+    bool HasMember(const std::string &p_uuid) const;
+
+    /// The io_service the node's handlers run on
+    boost::asio::io_service & GetIOService() { return m_ios; }
+
+    /// The node's counts so far
+    NodeCounters & GetCounters() { return m_counters; }
+
+private:
+    /// Hands a received datagram to the listener
+    void HandleDatagram(const std::string &p_datagram);
+
+    /// Declared first so it outlives everything that posts to it
+    boost::asio::io_service m_ios;
+    /// Set before the manager is built, which reads it from the
+    /// configuration
+    std::string m_uuid;
+    broker::CConnectionManager m_manager;
+    broker::CDispatcher m_dispatch;
+    broker::device::CPhysicalDeviceManager m_phyManager;
+    boost::shared_ptr<broker::CListener> m_listener;
+    GMAgent *m_gm;
+    lbAgent *m_lb;
+    SCAgent *m_sc;
+    NodeCounters m_counters;
+};
+
+/// The in-memory network between the nodes. A datagram is dropped at
+/// random, or because a partition separates its ends, when it is sent;
+/// otherwise it arrives after the latency, in send order unless jitter
+/// reorders it. A broadcast is counted as one datagram sent, like a
+/// multicast, and each copy is dropped or delayed on its own.
+class CFabric
+    : public broker::IFabric
+{
+public:
+    explicit CFabric(const NetworkSettings &p_settings);
+
+    /// Connects a node so datagrams can be sent to it
+    void Attach(CNode &p_node);
+
+    /// Sends the datagrams from one node to another
+    virtual void Send(const std::string &p_from, const std::string &p_to,
+        const std::vector<std::string> &p_datagrams);
+
+    /// Sends the datagrams from one node to every other
+    virtual void Broadcast(const std::string &p_from,
+        const std::vector<std::string> &p_datagrams);
+
+    /// Splits the nodes; only nodes on the same side can reach each other
+    void SetPartition(const std::map<std::string, int> &p_sides);
+
+    /// Joins the network back together
+    void Heal();
+
+    /// The side of the partition a node is on; 0 when there is none
+    int GetSide(const std::string &p_uuid) const;
+
+    /// When the next datagram arrives, if any are in flight
+    bool GetNextArrival(boost::posix_time::ptime &p_time) const;
+
+    /// Hands over the datagrams that have arrived by now and lists the
+    /// nodes that received one
+    void Deliver(std::set<CNode *> &p_ready);
+
+private:
+    /// A datagram in flight
+    struct Flight
+    {
+        boost::posix_time::ptime arrival;
+        /// Breaks ties, so datagrams due together arrive in send order
+        boost::uint64_t sequence;
+        CNode *to;
+        std::string datagram;
+        /// Orders the queue so the earliest arrival is on top
+        bool operator<(const Flight &p_other) const;
+    };
+
+    /// True if the ends of a datagram are on the same side
+    bool Reachable(const std::string &p_from, const std::string &p_to) const;
+
+    /// Puts one copy of a datagram in flight to a node, or drops it
+    bool Launch(CNode *p_to, const std::string &p_datagram);
+
+    NetworkSettings m_settings;
+    std::map<std::string, CNode *> m_nodes;
+    std::map<std::string, int> m_sides;
+    std::priority_queue<Flight> m_inflight;
+    boost::uint64_t m_sequence;
+    boost::mt19937 m_random;
+};
+
+/// Runs a set of nodes on virtual time. Each step moves the clock to the
+/// next timer or arrival and polls only the nodes with something to do, so
+/// quiet minutes of simulated time pass in microseconds.
+class CSimulation
+    : private boost::noncopyable
+{
+public:
+    /// Builds p_count nodes that all know each other
+    CSimulation(unsigned int p_count, const NetworkSettings &p_settings);
+    ~CSimulation();
+
+    /// Starts every node's modules
+    void Start();
+
+    /// Runs until virtual time reaches p_time
+    void RunUntil(const boost::posix_time::ptime &p_time);
+
+    /// True if every side of the network has one leader, on that side,
+    /// which every node there follows and none is mid-election
+    bool IsConverged() const;
+
+    /// True if no other node follows p_uuid or keeps it in its group
+    bool IsForgotten(const std::string &p_uuid) const;
+
+    /// The network
+    CFabric & GetFabric() { return m_fabric; }
+
+    /// The nodes
+    const std::vector<CNode *> & GetNodes() const { return m_nodes; }
+
+private:
+    CFabric m_fabric;
+    std::vector<CNode *> m_nodes;
+    std::map<boost::asio::io_service *, CNode *> m_byService;
+    /// Nodes with handlers to run at the current time
+    std::set<CNode *> m_ready;
+};
+
+    } // namespace sim
+} // namespace freedm
+
+#endif // CSIMULATION_HPP
@@ -0,0 +1,384 @@
+////////////////////////////////////////////////////////////////////
+/// @file      Simulation.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Runs groups of brokers on virtual time through an election,
+///   an optional partition and its healing or the crash of a node, and
+///   reports how long group management took to notice and settle and what
+///   it cost, as JSON lines
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CSimulation.hpp"
+#include "bench.hpp"
+#include "CClock.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CLogger.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace bench = freedm::bench;
+using freedm::broker::CClock;
+using freedm::sim::CSimulation;
+using freedm::sim::NetworkSettings;
+using freedm::sim::NodeCounters;
+
+namespace {
+
+/// What happens to the network and when, in virtual seconds
+struct Scenario
+{
+    double duration;
+    double partitionAt;
+    double healAt;
+    /// Percent of the nodes cut off by the partition
+    double partitionSize;
+    double crashAt;
+    /// Which node crashes: a leader or a member
+    std::string crashRole;
+    double sample;
+};
+
+/// A stretch of the run during which the network does not change
+struct Phase
+{
+    std::string name;
+    double start;
+    double end;
+    /// The node that crashed at the start, if any
+    std::string victim;
+};
+
+/// Runs one phase and returns how long after its start the groups settled
+/// for good, or -1 if they had not settled by its end. If a node crashed,
+/// p_detected is set to how long it took the rest to let it go, or -1.
+double RunPhase(CSimulation &p_sim, const Phase &p_phase,
+    const boost::posix_time::ptime &p_epoch, double p_sample,
+    double &p_detected)
+{
+    double settled_ = -1;
+    p_detected = -1;
+    for(double t_ = p_phase.start + p_sample; t_ < p_phase.end + p_sample / 2;
+        t_ += p_sample)
+    {
+        t_ = std::min(t_, p_phase.end);
+        p_sim.RunUntil(p_epoch + boost::posix_time::microseconds(
+            static_cast<long>(t_ * 1e6)));
+        if(!p_sim.IsConverged())
+            settled_ = -1;
+        else if(settled_ < 0)
+            settled_ = t_ - p_phase.start;
+        if(!p_phase.victim.empty() && p_detected < 0 &&
+            p_sim.IsForgotten(p_phase.victim))
+        {
+            p_detected = t_ - p_phase.start;
+        }
+    }
+    return settled_;
+}
+
+/// Picks the node to crash: the leader the first node follows, or the
+/// first node that follows another. Empty if there is no such member.
+std::string PickVictim(CSimulation &p_sim, const std::string &p_role)
+{
+    const std::vector<freedm::sim::CNode *> &nodes_ = p_sim.GetNodes();
+    if(p_role == "leader")
+    {
+        return nodes_[0]->GetLeader();
+    }
+    for(std::size_t i = 0; i < nodes_.size(); i++)
+    {
+        if(nodes_[i]->GetLeader() != nodes_[i]->GetUUID())
+        {
+            return nodes_[i]->GetUUID();
+        }
+    }
+    return "";
+}
+
+/// Simulates p_count nodes through the scenario and reports the results.
+void Run(unsigned int p_count, const NetworkSettings &p_settings,
+    const Scenario &p_scenario)
+{
+    freedm::CGlobalConfiguration &config_ =
+        freedm::CGlobalConfiguration::instance();
+    std::string prefix_ = "sim.";
+    if(!config_.GetMulticastGroup().empty())
+    {
+        prefix_ += "multicast.";
+    }
+    if(config_.GetFailureDetector() == "poll")
+    {
+        prefix_ += "poll.";
+    }
+    prefix_ += "nodes_" + boost::lexical_cast<std::string>(p_count);
+    boost::posix_time::ptime epoch_(boost::gregorian::date(2000, 1, 1));
+    double wall_ = bench::WallSeconds();
+
+    // Timers must be made on virtual time, so the clock starts first.
+    CClock::StartVirtual(epoch_);
+    {
+        CSimulation sim_(p_count, p_settings);
+        sim_.Start();
+
+        std::vector<Phase> phases_;
+        Phase phase_;
+        phase_.name = "elect";
+        phase_.start = 0;
+        phase_.end = p_scenario.duration;
+        if(p_scenario.crashAt > 0)
+        {
+            phase_.end = p_scenario.crashAt;
+            phases_.push_back(phase_);
+            phase_.name = "crash";
+            phase_.start = p_scenario.crashAt;
+            phase_.end = p_scenario.duration;
+        }
+        else if(p_scenario.partitionAt > 0)
+        {
+            phase_.end = p_scenario.partitionAt;
+            phases_.push_back(phase_);
+            phase_.name = "partition";
+            phase_.start = p_scenario.partitionAt;
+            phase_.end = p_scenario.duration;
+            if(p_scenario.healAt > p_scenario.partitionAt)
+            {
+                phase_.end = p_scenario.healAt;
+                phases_.push_back(phase_);
+                phase_.name = "heal";
+                phase_.start = p_scenario.healAt;
+                phase_.end = p_scenario.duration;
+            }
+        }
+        phases_.push_back(phase_);
+
+        for(std::size_t i = 0; i < phases_.size(); i++)
+        {
+            if(phases_[i].name == "partition")
+            {
+                // The first nodes are cut off from the rest
+                std::map<std::string, int> sides_;
+                std::size_t cut_ = static_cast<std::size_t>(
+                    p_count * p_scenario.partitionSize / 100 + 0.5);
+                for(std::size_t j = 0; j < cut_; j++)
+                {
+                    sides_[sim_.GetNodes()[j]->GetUUID()] = 1;
+                }
+                sim_.GetFabric().SetPartition(sides_);
+            }
+            else if(phases_[i].name == "heal")
+            {
+                sim_.GetFabric().Heal();
+            }
+            else if(phases_[i].name == "crash")
+            {
+                // Cut off alone, the node is gone as far as the rest know
+                phases_[i].victim = PickVictim(sim_, p_scenario.crashRole);
+                std::map<std::string, int> sides_;
+                if(!phases_[i].victim.empty())
+                {
+                    sides_[phases_[i].victim] = 1;
+                }
+                sim_.GetFabric().SetPartition(sides_);
+            }
+            double detected_;
+            double settled_ = RunPhase(sim_, phases_[i], epoch_,
+                p_scenario.sample, detected_);
+            if(phases_[i].name == "crash")
+            {
+                bench::Report(prefix_ + ".crash_" + p_scenario.crashRole +
+                    ".detect_seconds", detected_, "s");
+            }
+            bench::Report(prefix_ + "." + phases_[i].name +
+                ".converge_seconds", settled_, "s");
+        }
+        wall_ = bench::WallSeconds() - wall_;
+
+        NodeCounters total_;
+        double maxCpu_ = 0;
+        for(std::size_t i = 0; i < sim_.GetNodes().size(); i++)
+        {
+            const NodeCounters &c_ = sim_.GetNodes()[i]->GetCounters();
+            total_.sent += c_.sent;
+            total_.sentBytes += c_.sentBytes;
+            total_.dropped += c_.dropped;
+            total_.cpuSeconds += c_.cpuSeconds;
+            maxCpu_ = std::max(maxCpu_, c_.cpuSeconds);
+        }
+        bench::Report(prefix_ + ".datagrams", total_.sent, "datagrams");
+        bench::Report(prefix_ + ".datagrams_dropped", total_.dropped,
+            "datagrams");
+        bench::Report(prefix_ + ".bytes", total_.sentBytes, "bytes");
+        bench::Report(prefix_ + ".datagrams_per_node_second",
+            total_.sent / (p_count * p_scenario.duration),
+            "datagrams/s");
+        bench::Report(prefix_ + ".cpu_per_node.mean",
+            total_.cpuSeconds / p_count, "s");
+        bench::Report(prefix_ + ".cpu_per_node.max", maxCpu_, "s");
+        bench::Report(prefix_ + ".wall_seconds", wall_, "s");
+        bench::Report(prefix_ + ".speedup", p_scenario.duration / wall_,
+            "x");
+    }
+    CClock::StopVirtual();
+}
+
+} // unnamed namespace
+
+/// Simulation entry point
+int main(int argc, char* argv[])
+{
+    po::options_description opts_("Options");
+    po::variables_map vm_;
+    std::vector<unsigned int> nodes_;
+    NetworkSettings settings_;
+    Scenario scenario_;
+    double latency_, jitter_;
+    std::string detector_;
+    unsigned int heartbeat_;
+    double phiThreshold_;
+    unsigned int checkInterval_, responseTimeout_;
+    unsigned int mergeBackoff_, maxMergeBackoff_;
+    int verbose_;
+
+    opts_.add_options()
+        ("help,h", "print usage help (this screen)")
+        ("nodes,n", po::value<std::vector<unsigned int> >(&nodes_),
+         "number of brokers; repeat to run several sizes (default 10)")
+        ("duration,d", po::value<double>(&scenario_.duration)->
+         default_value(600), "virtual seconds to run each size for")
+        ("loss", po::value<double>(&settings_.loss)->default_value(0),
+         "percent of datagrams dropped")
+        ("latency", po::value<double>(&latency_)->default_value(1),
+         "one-way delay in milliseconds")
+        ("jitter", po::value<double>(&jitter_)->default_value(0),
+         "milliseconds added to or taken from the delay at random")
+        ("partition-at", po::value<double>(&scenario_.partitionAt)->
+         default_value(0), "virtual second to partition the network at; "
+         "0 for never")
+        ("heal-at", po::value<double>(&scenario_.healAt)->default_value(0),
+         "virtual second to heal the partition at; 0 for never")
+        ("partition-size", po::value<double>(&scenario_.partitionSize)->
+         default_value(50), "percent of the nodes cut off by the partition")
+        ("crash-at", po::value<double>(&scenario_.crashAt)->
+         default_value(0), "virtual second a node crashes at; 0 for never. "
+         "Not used with a partition")
+        ("crash-role", po::value<std::string>(&scenario_.crashRole)->
+         default_value("leader"), "which node crashes: the leader of the "
+         "first node's group, or a member")
+        ("seed", po::value<boost::uint32_t>(&settings_.seed)->
+         default_value(1), "seed for the loss and jitter draws")
+        ("sample", po::value<double>(&scenario_.sample)->default_value(0.1),
+         "virtual seconds between convergence checks")
+        ("multicast", "send group management and load balancing messages "
+         "for several peers through the group channel")
+        ("failure-detector", po::value<std::string>(&detector_)->
+         default_value("phi"), "how group management finds failed nodes: "
+         "phi or poll")
+        ("heartbeat-interval", po::value<unsigned int>(&heartbeat_)->
+         default_value(2000), "milliseconds between heartbeats")
+        ("phi-threshold", po::value<double>(&phiThreshold_)->
+         default_value(8), "suspicion at which a node is taken to have failed")
+        ("check-interval", po::value<unsigned int>(&checkInterval_)->
+         default_value(10000), "milliseconds between searches for groups")
+        ("response-timeout", po::value<unsigned int>(&responseTimeout_)->
+         default_value(5000), "milliseconds to wait on nodes that do not "
+         "answer a search or an invitation")
+        ("merge-backoff", po::value<unsigned int>(&mergeBackoff_)->
+         default_value(250), "milliseconds a leader defers a merge for each "
+         "higher ranked leader")
+        ("merge-backoff-max", po::value<unsigned int>(&maxMergeBackoff_)->
+         default_value(4000), "the longest a leader defers a merge, in "
+         "milliseconds")
+        ("verbose,v", po::value<int>(&verbose_)->default_value(0),
+         "broker log level");
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, opts_), vm_);
+        po::notify(vm_);
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if(vm_.count("help") || scenario_.duration <= 0 ||
+        scenario_.sample <= 0 || settings_.loss < 0 || settings_.loss > 100 ||
+        latency_ < 0 || jitter_ < 0 || scenario_.partitionSize < 0 ||
+        scenario_.partitionSize > 100 || (scenario_.crashAt > 0 &&
+        scenario_.partitionAt > 0) || (scenario_.crashRole != "leader" &&
+        scenario_.crashRole != "member") || (detector_ != "phi" &&
+        detector_ != "poll") || heartbeat_ < 10 || phiThreshold_ <= 0 ||
+        checkInterval_ < 10 || responseTimeout_ < 10 ||
+        mergeBackoff_ > maxMergeBackoff_)
+    {
+        std::cerr << "Usage: " << argv[0] << " [options]" << std::endl
+                  << opts_ << std::endl;
+        return vm_.count("help") ? 0 : 1;
+    }
+    if(nodes_.empty())
+    {
+        nodes_.push_back(10);
+    }
+    settings_.latency = boost::posix_time::microseconds(
+        static_cast<long>(latency_ * 1000));
+    settings_.jitter = boost::posix_time::microseconds(
+        static_cast<long>(jitter_ * 1000));
+    CGlobalLogger::instance().SetGlobalLevel(verbose_);
+    freedm::CGlobalConfiguration::instance().SetFailureDetector(detector_);
+    freedm::CGlobalConfiguration::instance().SetHeartbeatInterval(heartbeat_);
+    freedm::CGlobalConfiguration::instance().SetPhiThreshold(phiThreshold_);
+    freedm::CGlobalConfiguration::instance().SetCheckInterval(checkInterval_);
+    freedm::CGlobalConfiguration::instance().SetResponseTimeout(
+        responseTimeout_);
+    freedm::CGlobalConfiguration::instance().SetMergeBackoff(mergeBackoff_);
+    freedm::CGlobalConfiguration::instance().SetMaxMergeBackoff(
+        maxMergeBackoff_);
+    if(vm_.count("multicast"))
+    {
+        // The fabric carries the group's datagrams; the name is not used.
+        freedm::CGlobalConfiguration::instance().SetMulticastGroup("sim");
+    }
+
+    for(std::size_t i = 0; i < nodes_.size(); i++)
+    {
+        if(nodes_[i] > 0)
+        {
+            Run(nodes_[i], settings_, scenario_);
+        }
+    }
+    return 0;
+}
@@ -41,12 +41,17 @@
 ////////////////////////////////////////////////////////////////////
 
 #include "CBroker.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
 
 /// General FREEDM Namespace
 namespace freedm {
@@ -79,10 +84,33 @@ CBroker::CBroker(const std::string& p_address, const std::string& p_port,
       m_newConnection(new CListener(m_ioService, m_connManager, m_dispatch, m_conMan.GetUUID()))
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
-    // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-    boost::asio::ip::udp::resolver resolver(m_ioService);
-    boost::asio::ip::udp::resolver::query query( p_address, p_port);
-    boost::asio::ip::udp::endpoint endpoint = *resolver.resolve( query );
+    // The listen address is nearly always numeric, so it is parsed rather
+    // than looked up. A hostname is still resolved here, before any thread
+    // runs the ioservice, so nothing else can be held up by it.
+    boost::asio::ip::udp::endpoint endpoint;
+    boost::system::error_code error_;
+    boost::asio::ip::address address_ =
+        boost::asio::ip::address::from_string(p_address, error_);
+    bool numeric_ = !error_;
+    unsigned short port_ = 0;
+    try
+    {
+        port_ = boost::lexical_cast<unsigned short>(p_port);
+    }
+    catch(boost::bad_lexical_cast &e)
+    {
+        numeric_ = false;
+    }
+    if(numeric_)
+    {
+        endpoint = boost::asio::ip::udp::endpoint(address_, port_);
+    }
+    else
+    {
+        boost::asio::ip::udp::resolver resolver(m_ioService);
+        boost::asio::ip::udp::resolver::query query( p_address, p_port);
+        endpoint = *resolver.resolve( query );
+    }
     
     // Listen for connections and create an event to spawn a new connection
     m_newConnection->GetSocket().open(endpoint.protocol());
@@ -91,21 +119,47 @@ CBroker::CBroker(const std::string& p_address, const std::string& p_port,
 }
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CBroker::Run()
-/// @description Calls the ioservice run (initializing the ioservice thread)
-///               and then blocks until the ioservice runs out of work.
+/// @description Runs the ioservice on a pool of threads, the calling thread
+///               being one of them, and then blocks until the ioservice runs
+///               out of work. Handlers for a single connection or a single
+///               module are kept in order by their strands, so the size of
+///               the pool only changes how many of them run at once.
 /// @pre  The ioservice has not been allocated a thread to operate on and has
 ///       some schedule of jobs waiting to be performed (so it doesn't exit
 ///       immediately.)
-/// @post The ioservice has terminated.
+/// @post The ioservice has terminated and every pool thread has been joined.
 /// @return none
 ///////////////////////////////////////////////////////////////////////////////
 void CBroker::Run()
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    unsigned int threads_ = CGlobalConfiguration::instance().GetThreadCount();
+    boost::thread_group pool_;
+
+    Logger.Info << "Running the io_service on " << std::max(threads_, 1u)
+                << " thread(s)" << std::endl;
+    for(unsigned int i = 1; i < threads_; i++)
+    {
+        pool_.create_thread(boost::bind(&CBroker::RunWorker, this));
+    }
     // The io_service::run() call will block until all asynchronous operations
     // have finished. While the server is running, there is always at least one
     // asynchronous operation outstanding: the asynchronous accept call waiting
     // for new incoming connections.
+    RunWorker();
+    pool_.join_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CBroker::RunWorker
+/// @description Body of one pool thread: runs handlers until the ioservice
+///               is stopped.
+/// @pre None
+/// @post The ioservice has been stopped or has run out of work.
+///////////////////////////////////////////////////////////////////////////////
+void CBroker::RunWorker()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     m_ioService.run();
 }
 
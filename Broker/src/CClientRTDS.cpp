@@ -137,7 +137,8 @@ CClientRTDS::RTDSPointer CClientRTDS::Create( boost::asio::io_service & p_servic
 CClientRTDS::CClientRTDS( boost::asio::io_service & p_service,
                           const std::string p_xml )
         : m_socket(p_service), m_cmdTable(p_xml, "command"),
-        m_stateTable(p_xml, "state"), m_GlobalTimer(p_service)
+        m_stateTable(p_xml, "state"), m_GlobalTimer(p_service),
+        m_cycleTime(CMetrics::GetHistogram("freedm_rtds_cycle_microseconds"))
 {
     m_rxCount = m_stateTable.m_length;
     m_txCount = m_cmdTable.m_length;
@@ -240,6 +241,8 @@ void CClientRTDS::Run()
     //to io_service, so it can schedule Run() with other callback functions 
     //under its watch.
     const int TIMESTEP=1; //in microseconds. NEEDS MORE TESTING TO SET COORECTLY.
+    boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
 
     //**********************************
     //* Always send data to FPGA first *
@@ -305,6 +308,8 @@ void CClientRTDS::Run()
         
         Logger.Debug << "Client_RTDS - released writer mutex" << std::endl;
     } //scope is needed for mutex to auto release
+    m_cycleTime.Record(boost::posix_time::microsec_clock::universal_time() -
+        start);
     
     //Start the timer; on timeout, this function is called again
     m_GlobalTimer.expires_from_now( boost::posix_time::microseconds(TIMESTEP) );
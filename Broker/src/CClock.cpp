@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CClock.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the broker clock and its virtual time
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CClock.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+
+namespace freedm {
+    namespace broker {
+
+struct CClock::State
+{
+    State() : isvirtual(false) { }
+    /// Read on every call to Now, so the system clock path takes no lock
+    boost::atomic<bool> isvirtual;
+    /// Guards the virtual time and the deadlines
+    boost::mutex mutex;
+    /// The virtual time
+    boost::posix_time::ptime now;
+    /// When timers are due and the io_services they run on. A timer that
+    /// was cancelled or set again leaves its old entry, which costs the
+    /// simulation one step that finds nothing to run.
+    std::multimap<boost::posix_time::ptime, boost::asio::io_service *> due;
+};
+
+/// The state, built on first use
+CClock::State & CClock::GetState()
+{
+    static State state;
+    return state;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CClock::Now
+/// @description Reads the system clock, or the virtual time if a simulation
+///   has switched to it.
+/// @pre None
+/// @post None
+/// @return The current time in UTC.
+///////////////////////////////////////////////////////////////////////////////
+boost::posix_time::ptime CClock::Now()
+{
+    State &state_ = GetState();
+    if(!state_.isvirtual.load(boost::memory_order_acquire))
+    {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    return state_.now;
+}
+
+/// True while time is virtual
+bool CClock::IsVirtual()
+{
+    return GetState().isvirtual.load(boost::memory_order_acquire);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CClock::StartVirtual
+/// @description Stops the clock at p_start. From here on time only moves
+///   when AdvanceTo is called.
+/// @pre No timer is waiting on the system clock; they would fire by
+///   virtual time and never be reported as due.
+/// @post Now returns p_start.
+/// @param p_start The virtual time to start at.
+///////////////////////////////////////////////////////////////////////////////
+void CClock::StartVirtual(const boost::posix_time::ptime &p_start)
+{
+    State &state_ = GetState();
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    state_.now = p_start;
+    state_.due.clear();
+    state_.isvirtual.store(true, boost::memory_order_release);
+}
+
+/// Returns to the system clock and forgets the timers that were due
+void CClock::StopVirtual()
+{
+    State &state_ = GetState();
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    state_.isvirtual.store(false, boost::memory_order_release);
+    state_.due.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CClock::AdvanceTo
+/// @description Moves virtual time forward. Timers due by the new time fire
+///   the next time their io_service is polled.
+/// @pre Time is virtual.
+/// @post Now returns p_time, unless it was earlier than the current time.
+/// @param p_time The new virtual time.
+///////////////////////////////////////////////////////////////////////////////
+void CClock::AdvanceTo(const boost::posix_time::ptime &p_time)
+{
+    State &state_ = GetState();
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    if(state_.now < p_time)
+    {
+        state_.now = p_time;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CClock::GetNextDeadline
+/// @description Finds when the next timer is due, so a simulation can
+///   advance straight to it.
+/// @pre None
+/// @post None
+/// @param p_time Set to the earliest time a timer is due.
+/// @return False if no timer is due at any time.
+///////////////////////////////////////////////////////////////////////////////
+bool CClock::GetNextDeadline(boost::posix_time::ptime &p_time)
+{
+    State &state_ = GetState();
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    if(state_.due.empty())
+    {
+        return false;
+    }
+    p_time = state_.due.begin()->first;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CClock::TakeDue
+/// @description Lists the io_services with a timer due by the current
+///   virtual time and forgets those deadlines.
+/// @pre None
+/// @post No deadline at or before Now is left.
+/// @param p_due The io_services are appended to this; one may appear more
+///   than once.
+///////////////////////////////////////////////////////////////////////////////
+void CClock::TakeDue(std::vector<boost::asio::io_service *> &p_due)
+{
+    State &state_ = GetState();
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    while(!state_.due.empty() && state_.due.begin()->first <= state_.now)
+    {
+        p_due.push_back(state_.due.begin()->second);
+        state_.due.erase(state_.due.begin());
+    }
+}
+
+/// Notes that a timer on p_ios is due at p_time, under virtual time
+void CClock::Schedule(boost::asio::io_service &p_ios,
+    const boost::posix_time::ptime &p_time)
+{
+    State &state_ = GetState();
+    if(!state_.isvirtual.load(boost::memory_order_acquire))
+    {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock_(state_.mutex);
+    state_.due.insert(std::make_pair(p_time, &p_ios));
+}
+
+    } // namespace broker
+} // namespace freedm
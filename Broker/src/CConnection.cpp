@@ -39,12 +39,16 @@
 #include "RequestParser.hpp"
 #include "CSRConnection.hpp"
 #include "CSUConnection.hpp"
+#include "CSMConnection.hpp"
+#include "CWireCodec.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "config.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
 #include <vector>
+#include <algorithm>
 
 #include <boost/bind.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -67,13 +71,16 @@ namespace freedm {
 ///////////////////////////////////////////////////////////////////////////////
 CConnection::CConnection(boost::asio::io_service& p_ioService,
   CConnectionManager& p_manager, CDispatcher& p_dispatch, std::string uuid)
-  : CReliableConnection(p_ioService,p_manager,p_dispatch,uuid)
+  : CReliableConnection(p_ioService,p_manager,p_dispatch,uuid),
+    m_peerwire(0)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     m_protocols.insert(ProtocolMap::value_type(CSUConnection::Identifier(),
         ProtocolPtr(new CSUConnection(this))));
     m_protocols.insert(ProtocolMap::value_type(CSRConnection::Identifier(),
         ProtocolPtr(new CSRConnection(this))));
+    m_protocols.insert(ProtocolMap::value_type(CSMConnection::Identifier(),
+        ProtocolPtr(new CSMConnection(this))));
     m_defaultprotocol = CSRConnection::Identifier();
 }
 
@@ -93,12 +100,25 @@ void CConnection::Start()
 /// @fn CConnection::Stop
 /// @description Stops the socket and cancels the timeout timer. Does not
 ///   need to be called on a listening connection (ie one that has had
-///   Start() called on it.
+///   Start() called on it. Safe to call from any thread: the work is done on
+///   the connection's strand.
 /// @pre Any initialized CConnection object.
-/// @post The underlying socket is closed and the message timeout timer is
-///        cancelled.
+/// @post The underlying socket will be closed and the message timeout timer
+///        cancelled once the strand runs the stop.
 ///////////////////////////////////////////////////////////////////////////////
 void CConnection::Stop()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    GetStrand().dispatch(boost::bind(&CConnection::HandleStop, GetSelf()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::HandleStop
+/// @description Stops every protocol and closes the socket.
+/// @pre Called on the connection's strand.
+/// @post The protocols are stopped and released and the socket is closed.
+///////////////////////////////////////////////////////////////////////////////
+void CConnection::HandleStop()
 {
     ProtocolMap::iterator sit;
     for(sit = m_protocols.begin(); sit != m_protocols.end(); sit++)
@@ -107,22 +127,39 @@ void CConnection::Stop()
     }   
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     m_protocols.clear();
-    GetSocket().close();
+    Disconnect();
 }
  
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnection::Send
 /// @description Given a message and wether or not it should be sequenced,
-///   write that message to the channel.
+///   write that message to the channel. Modules call this from their own
+///   strands, so the message is handed to the connection's strand before any
+///   protocol state is touched.
 /// @pre The CConnection object is initialized.
+/// @post The message will be passed to its protocol on the connection's
+///   strand. Before being sent the message is signed with the UUID, source
+///   hostname and sequence number (if it is being sequenced).
+/// @param p_mesg A CMessage to write to the channel.
+///////////////////////////////////////////////////////////////////////////////
+void CConnection::Send(const CMessage &p_mesg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    GetStrand().post(boost::bind(&CConnection::HandleSend, GetSelf(), p_mesg));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::HandleSend
+/// @description Passes a message to the protocol named in it, or to the
+///   default protocol.
+/// @pre Called on the connection's strand.
 /// @post If the window is in not full, the message will have been written to
-///   to the channel. Before being sent the message has been signed with the
-///   UUID, source hostname and sequence number (if it is being sequenced).
-///   If the message is being sequenced  and the window is not already full,
-///   the timeout timer is cancelled and reset.
+///   to the channel. If the message is being sequenced and the window is not
+///   already full, the timeout timer is cancelled and reset. A message sent
+///   after the connection was stopped is dropped.
 /// @param p_mesg A CMessage to write to the channel.
 ///////////////////////////////////////////////////////////////////////////////
-void CConnection::Send(CMessage p_mesg)
+void CConnection::HandleSend(const CMessage &p_mesg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 
@@ -132,13 +169,20 @@ void CConnection::Send(CMessage p_mesg)
     {
         sit = m_protocols.find(m_defaultprotocol);
     }
+    if(sit == m_protocols.end())
+    {
+        Logger.Notice << "Dropped message for stopped connection to "
+                      << GetUUID() << std::endl;
+        return;
+    }
+    (*sit).second->GetMetrics().sent.Add();
     (*sit).second->Send(p_mesg);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnection::RecieveACK
 /// @description Handler for recieving acknowledgments from a sender.
-/// @pre Initialized connection.
+/// @pre Initialized connection. Called on the connection's strand.
 /// @post The message with sequence number has been acknowledged and all
 ///   messages sent before that message have been considered acknowledged as
 ///   well.
@@ -158,7 +202,7 @@ void CConnection::RecieveACK(const CMessage &msg)
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnection::Recieve
 /// @description Handler for determineing if a recieved message should be ACKd
-/// @pre Initialized connection.
+/// @pre Initialized connection. Called on the connection's strand.
 /// @post The message with sequence number has been acknowledged and all
 ///   messages sent before that message have been considered acknowledged as
 ///   well.
@@ -173,6 +217,7 @@ bool CConnection::Recieve(const CMessage &msg)
         bool x = (*sit).second->Recieve(msg);
         if(x)
         {
+            (*sit).second->GetMetrics().received.Add();
             (*sit).second->SendACK(msg);
             return true;
         }
@@ -180,5 +225,98 @@ bool CConnection::Recieve(const CMessage &msg)
     return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::TakeReady
+/// @description Collects messages that a protocol held back and can now
+///   deliver, such as the ones that arrived ahead of a gap that Recieve just
+///   filled.
+/// @pre Called on the connection's strand after Recieve.
+/// @post The returned message is no longer held by the protocol.
+/// @param p_protocol The protocol of the message passed to Recieve.
+/// @param p_msg Set to the next deliverable message.
+/// @return True if a message was returned.
+///////////////////////////////////////////////////////////////////////////////
+bool CConnection::TakeReady(const std::string &p_protocol, CMessage &p_msg)
+{
+    ProtocolMap::iterator sit = m_protocols.find(p_protocol);
+    if(sit != m_protocols.end())
+    {
+        return (*sit).second->TakeReady(p_msg);
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::GetSelf
+/// @description Casts the shared pointer held by CReliableConnection back to
+///   this class, so member handlers can keep the connection alive.
+/// @pre The connection is owned by a shared pointer.
+/// @post None
+/// @return A shared pointer to this connection.
+///////////////////////////////////////////////////////////////////////////////
+CConnection::ConnectionPtr CConnection::GetSelf()
+{
+    return boost::static_pointer_cast<CConnection>(shared_from_this());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::SetPeerWireVersion
+/// @description Records the binary wire version carried by the most recent
+///   message from the remote node. A plain XML message without an
+///   advertisement sets it back to 0, so a peer that restarts as an XML-only
+///   node is written to in XML again.
+/// @pre None
+/// @post The negotiated wire version is updated.
+/// @param version The version advertised by the remote node.
+///////////////////////////////////////////////////////////////////////////////
+void CConnection::SetPeerWireVersion(unsigned int version)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(version != m_peerwire)
+    {
+        Logger.Info << "Peer " << GetUUID() << " wire version " << m_peerwire
+                    << " -> " << version << std::endl;
+    }
+    m_peerwire = version;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::GetWireVersion
+/// @description Selects the encoding for outgoing messages: the highest
+///   binary version both sides understand, or XML if either side has the
+///   binary encoding disabled.
+/// @pre None
+/// @post None
+/// @return The binary wire version to write with, or 0 for XML.
+///////////////////////////////////////////////////////////////////////////////
+unsigned int CConnection::GetWireVersion()
+{
+    if(!CGlobalConfiguration::instance().GetBinaryWire())
+    {
+        return 0;
+    }
+    return std::min<unsigned int>(m_peerwire, CWireCodec::VERSION);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnection::GetRttStats
+/// @description Collects the round trip estimate, RTO and resend counters
+///   of each protocol on this connection.
+/// @pre None
+/// @post None
+/// @return The counters, keyed by protocol identifier.
+///////////////////////////////////////////////////////////////////////////////
+std::map<std::string, CRttEstimator::Stats> CConnection::GetRttStats() const
+{
+    std::map<std::string, CRttEstimator::Stats> result_;
+    ProtocolMap::const_iterator it_;
+
+    for(it_ = m_protocols.begin(); it_ != m_protocols.end(); ++it_)
+    {
+        result_[it_->first] = it_->second->GetRttStats();
+    }
+    return result_;
+}
+
     } // namespace broker
 } // namespace freedm
@@ -35,6 +35,7 @@
 #include "CConnectionManager.hpp"
 #include "CConnection.hpp"
 #include "CBroker.hpp"
+#include "CEventLog.hpp"
 #include <boost/thread/locks.hpp>
 
 #include "config.hpp"
@@ -43,11 +44,16 @@
 static CLocalLogger Logger(__FILE__);
 
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 #include <boost/bind.hpp>
 
 namespace freedm {
 namespace broker {
 
+const std::size_t CConnectionManager::MAX_PEERS;
+const std::size_t CConnectionManager::BLOCK_SIZE;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::CConnectionManager
 /// @description: Initializes the connection manager object
@@ -55,18 +61,40 @@ namespace broker {
 /// @post Connection manager is ready for use
 ///////////////////////////////////////////////////////////////////////////////
 CConnectionManager::CConnectionManager()
+    : m_peerCount(0),
+      m_peerIds(new PeerIdMap),
+      m_fabric(0),
+      m_resolver(CGlobalConfiguration::instance().GetResolveTTL()),
+      m_group(*this)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    // Reserved up front so the block list itself never moves either.
+    m_blocks.reserve(MAX_PEERS / BLOCK_SIZE);
     m_uuid = CGlobalConfiguration::instance().GetUUID();
     m_hostname.hostname = CGlobalConfiguration::instance().GetHostname();
     m_hostname.port = CGlobalConfiguration::instance().GetListenPort();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::~CConnectionManager
+/// @description Releases the peer table.
+/// @pre No other thread is using the manager.
+/// @post The peers and their connections are released.
+///////////////////////////////////////////////////////////////////////////////
+CConnectionManager::~CConnectionManager()
+{
+    for(std::size_t i = 0; i < m_blocks.size(); i++)
+    {
+        delete [] m_blocks[i];
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::Start
 /// @description Performs initialization of a connection.
 /// @pre The connection c has not been started.
-/// @post The connection c has been started.
+/// @post The connection c has been started, and the group channel opened
+///   if one is configured.
 /// @param c A connection pointer that has not been started.
 ///////////////////////////////////////////////////////////////////////////////
 void CConnectionManager::Start (CListener::ConnectionPtr c)
@@ -74,22 +102,200 @@ void CConnectionManager::Start (CListener::ConnectionPtr c)
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     c->Start();
     m_inchannel = c; 
+    OpenGroupChannel(*c);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::OpenGroupChannel
+/// @description Opens the group channel on the listener's io_service. Its
+///   datagrams are decoded by the listener; with a fabric set, they are
+///   carried by the fabric as well.
+/// @pre SetFabric has been called, if a fabric is used.
+/// @post The channel is open if multicast-group is set and it could be
+///   joined.
+/// @param p_listener The listener that decodes the group's datagrams.
+///////////////////////////////////////////////////////////////////////////////
+void CConnectionManager::OpenGroupChannel(CListener &p_listener)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_group.Open(p_listener, m_fabric);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::SendToGroup
+/// @description Sends one message to several peers. With the group channel
+///   open it is written to the group once for all of them; this node, if
+///   listed, and a lone peer are sent to over their connections, as is
+///   everyone if the channel is closed or the message does not fit in one
+///   datagram.
+/// @pre None
+/// @post The message has been handed to the group channel or to each
+///   peer's connection. A peer that cannot be connected to is logged and
+///   skipped.
+/// @param p_peers The peers to send to.
+/// @param p_msg The message.
+/// @param ios The ioservice new connections will use.
+/// @param dispatch_ The dispatcher new connections will use.
+///////////////////////////////////////////////////////////////////////////////
+void CConnectionManager::SendToGroup(const std::vector<PeerId> &p_peers,
+    const CMessage &p_msg, boost::asio::io_service& ios,
+    CDispatcher &dispatch_)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    PeerId self_ = GetPeerId(m_uuid);
+    std::vector<PeerId> unicast_;
+    std::vector<PeerId> group_;
+    group_.reserve(p_peers.size());
+    for(std::size_t i = 0; i < p_peers.size(); i++)
+    {
+        if(p_peers[i] == self_)
+            unicast_.push_back(p_peers[i]);
+        else
+            group_.push_back(p_peers[i]);
+    }
+    if(group_.size() < 2 || !m_group.Send(group_, p_msg))
+    {
+        unicast_.insert(unicast_.end(), group_.begin(), group_.end());
+    }
+    for(std::size_t i = 0; i < unicast_.size(); i++)
+    {
+        try
+        {
+            ConnectionPtr c_ = GetConnectionByPeerId(unicast_[i], ios,
+                dispatch_);
+            if(c_)
+            {
+                c_->Send(p_msg);
+                continue;
+            }
+        }
+        catch(boost::system::system_error &)
+        {
+        }
+        Logger.Warn << "Couldn't Send Message To Peer "
+                    << GetUUIDByPeerId(unicast_[i]) << std::endl;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetPeerId
+/// @description Interns a UUID. The first call for a UUID fills in the next
+///   entry of the peer table, publishes it by raising the peer count and
+///   publishes a UUID map that includes it, and names the ID in the event
+///   log; later calls only look the UUID up in the published map.
+/// @pre None
+/// @post The UUID has a peer ID.
+/// @param uuid The UUID to look up.
+/// @return The peer ID of the UUID.
+/// @limitations Throws std::length_error once MAX_PEERS UUIDs are known.
+///////////////////////////////////////////////////////////////////////////////
+PeerId CConnectionManager::GetPeerId(const std::string &uuid)
+{
+    PeerIdMapPtr ids_ = boost::atomic_load( &m_peerIds );
+    PeerIdMap::const_iterator it_ = ids_->find(uuid);
+
+    if(it_ != ids_->end())
+    {
+        return it_->second;
+    }
+
+    boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+    // Another thread may have registered it while we waited.
+    ids_ = boost::atomic_load( &m_peerIds );
+    it_ = ids_->find(uuid);
+    if(it_ != ids_->end())
+    {
+        return it_->second;
+    }
+
+    std::size_t id_ = m_peerCount.load(boost::memory_order_relaxed);
+    if(id_ >= MAX_PEERS)
+    {
+        Logger.Error << "Cannot register " << uuid << ": already "
+                     << MAX_PEERS << " peers" << std::endl;
+        throw std::length_error("CConnectionManager: too many peers");
+    }
+    if(id_ % BLOCK_SIZE == 0)
+    {
+        m_blocks.push_back(new Peer[BLOCK_SIZE]);
+    }
+    Peer &peer_ = m_blocks[id_ / BLOCK_SIZE][id_ % BLOCK_SIZE];
+    peer_.uuid = uuid;
+    peer_.reliability = 100;
+    // The entry is complete before readers can see its ID.
+    m_peerCount.store(id_ + 1, boost::memory_order_release);
+
+    boost::shared_ptr<PeerIdMap> next_( new PeerIdMap( *ids_ ) );
+    (*next_)[uuid] = id_;
+    boost::atomic_store( &m_peerIds, PeerIdMapPtr( next_ ) );
+    CEventLog::RecordName(id_, uuid);
+    return id_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetPeerCount
+/// @description Counts the peer IDs handed out so far. Peers are never
+///   removed, so every ID below the count stays valid.
+/// @pre None
+/// @post None
+/// @return The number of registered peers.
+///////////////////////////////////////////////////////////////////////////////
+std::size_t CConnectionManager::GetPeerCount() const
+{
+    return m_peerCount.load(boost::memory_order_acquire);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetPeer
+/// @description Finds a peer's entry in the table. Entries below the
+///   published count are complete and never move, so no lock is needed.
+/// @pre None
+/// @post None
+/// @param p_peer The peer ID.
+/// @return The peer, or null if p_peer was never handed out.
+///////////////////////////////////////////////////////////////////////////////
+CConnectionManager::Peer * CConnectionManager::GetPeer(PeerId p_peer) const
+{
+    if(p_peer >= m_peerCount.load(boost::memory_order_acquire))
+    {
+        return 0;
+    }
+    return &m_blocks[p_peer / BLOCK_SIZE][p_peer % BLOCK_SIZE];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetUUIDByPeerId
+/// @description Turns a peer ID back into the UUID it was interned from.
+/// @pre None
+/// @post None
+/// @param p_peer The peer ID.
+/// @return The UUID, or an empty string if p_peer was never handed out.
+///////////////////////////////////////////////////////////////////////////////
+std::string CConnectionManager::GetUUIDByPeerId(PeerId p_peer) const
+{
+    Peer *peer_ = GetPeer(p_peer);
+    return peer_ ? peer_->uuid : std::string();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::PutConnection
-/// @description Inserts a connection into the connection map.
+/// @description Inserts a connection into the peer table.
 /// @param uuid The uuid of the node the connection is to.
 /// @param c The connection pointer that goes to the node in question.
 /// @pre The connection is initialized.
-/// @post The connection has been inserted into the connection map.
+/// @post The connection has been inserted into the peer table, unless the
+///   peer already had one.
 ///////////////////////////////////////////////////////////////////////////////
 void CConnectionManager::PutConnection(std::string uuid, ConnectionPtr c)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    Peer *peer_ = GetPeer(GetPeerId(uuid));
     {  
         boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
-        m_connections.insert(connectionmap::value_type(uuid,c));
+        if(!boost::atomic_load( &peer_->connection ))
+        {
+            boost::atomic_store( &peer_->connection, c );
+        }
     }   
 }
 
@@ -104,13 +310,10 @@ void CConnectionManager::PutConnection(std::string uuid, ConnectionPtr c)
 void CConnectionManager::PutHostname(std::string u_, std::string host_, std::string port)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;  
-    {
-        boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
-        remotehost x;
-        x.hostname = host_;
-        x.port = port;
-        m_hostnames.insert(std::pair<std::string, remotehost>(u_, x));  
-    }
+    remotehost x;
+    x.hostname = host_;
+    x.port = port;
+    PutHostname(GetPeerId(u_), x);
 }
 
 
@@ -125,24 +328,52 @@ void CConnectionManager::PutHostname(std::string u_, std::string host_, std::str
 void CConnectionManager::PutHostname(std::string u_, remotehost host_)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;  
+    PutHostname(GetPeerId(u_), host_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::PutHostname
+/// @description Records where a peer listens. The first hostname given for
+///   a peer is kept, as the listener offers one with every message it
+///   receives; checking for it takes no lock.
+/// @pre p_peer was handed out by GetPeerId.
+/// @post The peer has a hostname.
+/// @param p_peer The peer.
+/// @param p_host Its hostname and port.
+///////////////////////////////////////////////////////////////////////////////
+void CConnectionManager::PutHostname(PeerId p_peer, const remotehost &p_host)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;  
+    Peer *peer_ = GetPeer(p_peer);
+    if(!peer_ || boost::atomic_load( &peer_->host ))
     {
-        boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
-        m_hostnames.insert(std::pair<std::string, remotehost>(u_, host_));  
+        return;
+    }
+    boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+    if(!boost::atomic_load( &peer_->host ))
+    {
+        boost::atomic_store( &peer_->host,
+            boost::shared_ptr<const remotehost>( new remotehost(p_host) ) );
     }
 }
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::Stop
-/// @description Stops a connection and removes it from the connections maps.
-/// @pre The connection is in the connections map.
-/// @post The connection is closed and removed from the map.
+/// @description Stops a connection and removes it from the peer table.
+/// @pre The connection is in the peer table.
+/// @post The connection is closed and removed from the table.
 /// @param c the connection pointer to stop.
 ///////////////////////////////////////////////////////////////////////////////
 void CConnectionManager::Stop (CConnection::ConnectionPtr c)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
-    if(m_connections.right.count(c))
+    Peer *peer_ = GetPeer(GetPeerId(c->GetUUID()));
     {
-        m_connections.right.erase(c);
+        boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+        if(boost::atomic_load( &peer_->connection ) == c)
+        {
+            boost::atomic_store( &peer_->connection, ConnectionPtr() );
+        }
     }
     c->Stop();
 }
@@ -163,21 +394,35 @@ void CConnectionManager::Stop (CListener::ConnectionPtr c)
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::StopAll
-/// @description Repeatedly pops a connection and stops it until the forward
-///               connection map is empty, then clears the reverse map.
+/// @description Takes every connection out of the peer table and stops it.
+///   The peers themselves stay registered.
 /// @pre None
-/// @post The forward and reverse connection maps are empty, and all
-///        connections that were contained within them are stopped.
+/// @post No peer has a connection, and all connections that were in the
+///        table are stopped.
 ///////////////////////////////////////////////////////////////////////////////
 void CConnectionManager::StopAll ()
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
-    while(m_connections.size() > 0)
+    std::vector<ConnectionPtr> connections_;
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+        for(PeerId i = 0; i < GetPeerCount(); i++)
+        {
+            Peer *peer_ = GetPeer(i);
+            ConnectionPtr c_ = boost::atomic_load( &peer_->connection );
+            if(c_)
+            {
+                connections_.push_back(c_);
+                boost::atomic_store( &peer_->connection, ConnectionPtr() );
+            }
+        }
+    }
+    for(std::size_t i = 0; i < connections_.size(); i++)
     {
-      Stop((*m_connections.left.begin()).second); //Side effect of stop should make this map smaller
+        connections_[i]->Stop();
     }
-    m_connections.clear();
     Stop(m_inchannel);
+    m_group.Close();
     Logger.Debug << "All Connections Closed" << std::endl;
 }
 
@@ -192,28 +437,51 @@ void CConnectionManager::StopAll ()
 ///////////////////////////////////////////////////////////////////////////////
 remotehost CConnectionManager::GetHostnameByUUID(std::string uuid) const
 {
-    if(m_hostnames.count(uuid))
+    PeerIdMapPtr ids_ = boost::atomic_load( &m_peerIds );
+    PeerIdMap::const_iterator it_ = ids_->find(uuid);
+
+    if(it_ == ids_->end())
     {
-        return m_hostnames.find(uuid)->second;
+        remotehost x;
+        return x;
     }
-    else
+    return GetHostnameByPeerId(it_->second);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetHostnameByPeerId
+/// @description Fetches the hostname of a peer without taking a lock.
+/// @param p_peer The peer to look up.
+/// @pre None
+/// @post No change.
+/// @return The hostname of the peer, or an empty one if it is not known.
+///////////////////////////////////////////////////////////////////////////////
+remotehost CConnectionManager::GetHostnameByPeerId(PeerId p_peer) const
+{
+    Peer *peer_ = GetPeer(p_peer);
+    boost::shared_ptr<const remotehost> host_;
+    if(peer_)
+    {
+        host_ = boost::atomic_load( &peer_->host );
+    }
+    if(!host_)
     {
         remotehost x;
         return x;
     }
+    return *host_;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CConnectionManager::GetConnectionByUUID
 /// @description Constructs or retrieves from cache a connection to a specific
-///              UUID.
+///              UUID. Callers that send repeatedly should keep the peer ID
+///              and use GetConnectionByPeerId, which skips the UUID lookup.
 /// @param uuid_ The uuid to construct a connection to
 /// @param ios The ioservice the connection will use.
 /// @param dispatch_ The dispatcher the connection will use
 /// @pre None
-/// @post If a connection has been constructed it will be put in the
-///        connections table and has been started. If the connection is not
-///        constructed there is no change to the connection table.
+/// @post As GetConnectionByPeerId, and the UUID has a peer ID.
 /// @return A pointer to the connection, or NULL if construction failed for
 ///         some reason.
 ///////////////////////////////////////////////////////////////////////////////
@@ -221,54 +489,117 @@ ConnectionPtr CConnectionManager::GetConnectionByUUID
     (std::string uuid_, boost::asio::io_service& ios,  CDispatcher &dispatch_)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    return GetConnectionByPeerId(GetPeerId(uuid_), ios, dispatch_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::GetConnectionByPeerId
+/// @description Constructs or retrieves from cache a connection to a peer.
+///              An open connection is found by index without a lock. A new
+///              connection looks its peer up in the background and holds
+///              anything sent to it until the address is known, so a slow
+///              name server never blocks the caller.
+/// @param p_peer The peer to construct a connection to
+/// @param ios The ioservice the connection will use.
+/// @param dispatch_ The dispatcher the connection will use
+/// @pre None
+/// @post If a connection has been constructed it will be put in the
+///        peer table and has been started. If the connection is not
+///        constructed there is no change to the peer table.
+/// @return A pointer to the connection, or NULL if construction failed for
+///         some reason.
+///////////////////////////////////////////////////////////////////////////////
+ConnectionPtr CConnectionManager::GetConnectionByPeerId
+    (PeerId p_peer, boost::asio::io_service& ios,  CDispatcher &dispatch_)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 
-    ConnectionPtr c_;  
-    std::string s_,port;
+    Peer *peer_ = GetPeer(p_peer);
+    if(!peer_)
+        return ConnectionPtr();
 
     // See if there is a connection in the open connections already
-    if(m_connections.left.count(uuid_))
+    ConnectionPtr c_ = boost::atomic_load( &peer_->connection );
+    if(c_ && !c_->IsStale())
     {
-        if(m_connections.left.at(uuid_)->GetSocket().is_open())
-        {
-            #ifdef CUSTOMNETWORK
-            LoadNetworkConfig();
-            #endif
-            return m_connections.left.at(uuid_);
-        }
-        else
+        #ifdef CUSTOMNETWORK
+        LoadNetworkConfig();
+        #endif
+        return c_;
+    }
+
+    // Modules and the listener look connections up from different threads,
+    // so any replacement is made under one lock.
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+        c_ = ReplaceConnection(*peer_, ios, dispatch_);
+    }
+    #ifdef CUSTOMNETWORK
+    LoadNetworkConfig();
+    #endif
+    return c_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CConnectionManager::ReplaceConnection
+/// @description Stops a peer's stale connection, if it has one, and starts
+///   a new one if the peer's hostname is known.
+/// @param p_peer The peer to connect to.
+/// @param ios The ioservice the connection will use.
+/// @param dispatch_ The dispatcher the connection will use
+/// @pre m_Mutex is held.
+/// @post The peer has a connection that is not stale, or none.
+/// @return The peer's connection, or NULL if it has none.
+///////////////////////////////////////////////////////////////////////////////
+ConnectionPtr CConnectionManager::ReplaceConnection(Peer &p_peer,
+    boost::asio::io_service& ios, CDispatcher &dispatch_)
+{
+    ConnectionPtr c_ = boost::atomic_load( &p_peer.connection );
+    if(c_)
+    {
+        if(!c_->IsStale())
         {
-            Logger.Warn <<" Connection to " << uuid_ << " has gone stale " << std::endl;
-            //The socket is not marked as open anymore, we
-            //should stop it.
-            Stop(m_connections.left.at(uuid_));
+            // Replaced by another thread while we waited.
+            return c_;
         }
+        Logger.Warn <<" Connection to " << p_peer.uuid << " has gone stale " << std::endl;
+        //The socket is not marked as open anymore, we
+        //should stop it.
+        boost::atomic_store( &p_peer.connection, ConnectionPtr() );
+        c_->Stop();
     }  
 
-    Logger.Info << "Making Fresh Connection to " << uuid_ << std::endl;
-
     // Find the requested host from the list of known hosts
-    std::map<std::string, remotehost>::iterator mapIt_;
-    mapIt_ = m_hostnames.find(uuid_);
-    if(mapIt_ == m_hostnames.end())
+    boost::shared_ptr<const remotehost> host_ =
+        boost::atomic_load( &p_peer.host );
+    if(!host_)
         return ConnectionPtr();
-    s_ = mapIt_->second.hostname;
-    port = mapIt_->second.port;
+
+    Logger.Info << "Making Fresh Connection to " << p_peer.uuid << std::endl;
 
     // Create a new CConnection object for this host	
-    c_.reset(new CConnection(ios, *this, dispatch_, uuid_));  
-   
-    // Initiate the TCP connection
-    //XXX Right now, the port is hardcoded  
-    boost::asio::ip::udp::resolver resolver(ios);
-    boost::asio::ip::udp::resolver::query query( s_, port);
-    boost::asio::ip::udp::endpoint endpoint = *resolver.resolve( query );
-    c_->GetSocket().connect( endpoint ); 
-
-    //Once the connection is built, connection manager gets a call back to register it.    
-    PutConnection(uuid_,c_);
-    #ifdef CUSTOMNETWORK
-    LoadNetworkConfig();
-    #endif
+    c_.reset(new CConnection(ios, *this, dispatch_, p_peer.uuid));  
+    c_->SetReliability(p_peer.reliability);
+
+    if(m_fabric)
+    {
+        // The fabric knows the peer by UUID; there is nothing to look up.
+        c_->UseFabric(*m_fabric);
+        boost::atomic_store( &p_peer.connection, c_ );
+        return c_;
+    }
+
+    // All peers may be written to through the listener's socket, rather
+    // than each connection opening a socket of its own.
+    if(CGlobalConfiguration::instance().GetSharedSocket() && m_inchannel)
+    {
+        c_->ShareSocket(m_inchannel->GetSocket());
+    }
+
+    // The socket is connected once the resolver answers.
+    c_->Resolve(m_resolver, host_->hostname, host_->port);
+
+    boost::atomic_store( &p_peer.connection, c_ );
     return c_;
 }
 
@@ -291,9 +622,16 @@ void CConnectionManager::LoadNetworkConfig()
     {
         std::string uuid = child.second.get<std::string>("<xmlattr>.uuid");
         int reliability = child.second.get<int>("reliability");
-        if(m_connections.left.count(uuid) != 0)
+        Peer *peer_ = GetPeer(GetPeerId(uuid));
+        ConnectionPtr c_;
+        {
+            boost::lock_guard< boost::mutex > scopedLock_( m_Mutex );
+            peer_->reliability = reliability;
+            c_ = boost::atomic_load( &peer_->connection );
+        }
+        if(c_)
         {
-            m_connections.left.at(uuid)->SetReliability(reliability);
+            c_->SetReliability(reliability);
         }
     }  
 }
@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CDatagramBatch.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the batched datagram socket helpers
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CDatagramBatch.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace freedm {
+    namespace broker {
+
+const std::size_t CDatagramBatch::MAX_DATAGRAM;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDatagramBatch::CDatagramBatch
+/// @description Allocates the receive slots and, on Linux, the recvmmsg
+///   headers that point into them.
+/// @pre None
+/// @post The batch is ready for Receive.
+/// @param p_slots The most datagrams a single Receive will return.
+///////////////////////////////////////////////////////////////////////////////
+CDatagramBatch::CDatagramBatch(std::size_t p_slots)
+    : m_storage(p_slots * MAX_DATAGRAM),
+      m_lengths(p_slots, 0)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+#ifdef __linux__
+    m_headers.resize(p_slots);
+    m_iovecs.resize(p_slots);
+    for(std::size_t i = 0; i < p_slots; i++)
+    {
+        m_iovecs[i].iov_base = &m_storage[i * MAX_DATAGRAM];
+        m_iovecs[i].iov_len = MAX_DATAGRAM;
+        memset(&m_headers[i], 0, sizeof(mmsghdr));
+        m_headers[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_headers[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDatagramBatch::Receive
+/// @description Reads as many waiting datagrams as there are slots. This
+///   never blocks; it is meant to be called once a receive has completed and
+///   the socket is known to have had data.
+/// @pre p_fd is a datagram socket.
+/// @post The first n slots hold the datagrams that were read.
+/// @param p_fd The native socket to read from.
+/// @return The number of datagrams read, 0 if none were waiting.
+///////////////////////////////////////////////////////////////////////////////
+std::size_t CDatagramBatch::Receive(int p_fd)
+{
+    std::size_t count = 0;
+    if(m_lengths.empty())
+    {
+        return 0;
+    }
+#ifdef __linux__
+    int result;
+    do
+    {
+        result = recvmmsg(p_fd, &m_headers[0], m_headers.size(),
+            MSG_DONTWAIT, NULL);
+    } while(result < 0 && errno == EINTR);
+    if(result < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            Logger.Warn << "recvmmsg failed: " << strerror(errno) << std::endl;
+        }
+        return 0;
+    }
+    count = result;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        m_lengths[i] = m_headers[i].msg_len;
+    }
+#else
+    while(count < m_lengths.size())
+    {
+        ssize_t result = recv(p_fd, &m_storage[count * MAX_DATAGRAM],
+            MAX_DATAGRAM, MSG_DONTWAIT);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        m_lengths[count++] = result;
+    }
+#endif
+    return count;
+}
+
+/// The contents of the i-th datagram read by Receive
+const char * CDatagramBatch::GetData(std::size_t i) const
+{
+    return &m_storage[i * MAX_DATAGRAM];
+}
+
+/// The length of the i-th datagram read by Receive
+std::size_t CDatagramBatch::GetLength(std::size_t i) const
+{
+    return m_lengths[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDatagramBatch::Send
+/// @description Writes a list of datagrams to a connected socket with as few
+///   system calls as the batch size allows. Given an address, every
+///   datagram is sent there instead, so one unconnected socket can serve
+///   any number of peers. A datagram the kernel refuses (for example
+///   ECONNREFUSED left over from an earlier ICMP error) is dropped, as a
+///   failed async_send would have been; the reliable protocols above will
+///   resend it.
+/// @pre p_fd is a connected datagram socket, or p_address is set.
+/// @post Every datagram has been handed to the kernel or dropped.
+/// @param p_fd The native socket to write to.
+/// @param p_datagrams The datagrams to write, in order.
+/// @param p_batch The most datagrams to pass to one system call.
+/// @param p_address Where to send the datagrams, or null for the address
+///   the socket is connected to.
+/// @param p_addressLength The size of *p_address.
+/// @return The number of datagrams the kernel accepted.
+///////////////////////////////////////////////////////////////////////////////
+std::size_t CDatagramBatch::Send(int p_fd,
+    const std::vector<std::string> &p_datagrams, std::size_t p_batch,
+    const sockaddr * p_address, socklen_t p_addressLength)
+{
+    std::size_t sent = 0, next = 0;
+    p_batch = std::max<std::size_t>(p_batch, 1);
+#ifdef __linux__
+    std::vector<mmsghdr> headers(std::min(p_batch, p_datagrams.size()));
+    std::vector<iovec> iovecs(headers.size());
+    while(next < p_datagrams.size())
+    {
+        std::size_t n = std::min(p_batch, p_datagrams.size() - next);
+        for(std::size_t i = 0; i < n; i++)
+        {
+            const std::string &d = p_datagrams[next + i];
+            iovecs[i].iov_base = const_cast<char *>(d.data());
+            iovecs[i].iov_len = d.size();
+            memset(&headers[i], 0, sizeof(mmsghdr));
+            headers[i].msg_hdr.msg_name = const_cast<sockaddr *>(p_address);
+            headers[i].msg_hdr.msg_namelen = p_addressLength;
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        int result = sendmmsg(p_fd, &headers[0], n, MSG_DONTWAIT);
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            Logger.Notice << "sendmmsg dropped a datagram: " << strerror(errno)
+                          << std::endl;
+            next++;
+            continue;
+        }
+        sent += result;
+        next += result;
+    }
+#else
+    for(; next < p_datagrams.size(); next++)
+    {
+        const std::string &d = p_datagrams[next];
+        ssize_t result;
+        do
+        {
+            result = sendto(p_fd, d.data(), d.size(), MSG_DONTWAIT,
+                p_address, p_addressLength);
+        } while(result < 0 && errno == EINTR);
+        if(result < 0)
+        {
+            Logger.Notice << "sendto dropped a datagram: " << strerror(errno)
+                          << std::endl;
+            continue;
+        }
+        sent++;
+    }
+#endif
+    return sent;
+}
+
+    } // namespace broker
+} // namespace freedm
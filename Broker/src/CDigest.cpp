@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CDigest.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the 64-bit message digest functions
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CDigest.hpp"
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+const boost::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const boost::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const boost::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const boost::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const boost::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+/// Key used for SipHash. The digest only has to agree between nodes, so
+/// any fixed key will do; it is not a secret.
+const boost::uint64_t SIP_K0 = 0x0706050403020100ULL;
+const boost::uint64_t SIP_K1 = 0x0F0E0D0C0B0A0908ULL;
+
+inline boost::uint64_t Rotl(boost::uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/// Little endian loads, whatever the host byte order
+inline boost::uint64_t Read64(const unsigned char * p)
+{
+    boost::uint64_t v = 0;
+    for(int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+inline boost::uint32_t Read32(const unsigned char * p)
+{
+    return boost::uint32_t(p[0]) | (boost::uint32_t(p[1]) << 8) |
+        (boost::uint32_t(p[2]) << 16) | (boost::uint32_t(p[3]) << 24);
+}
+
+inline boost::uint64_t XXRound(boost::uint64_t acc, boost::uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = Rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+inline boost::uint64_t XXMerge(boost::uint64_t acc, boost::uint64_t val)
+{
+    acc ^= XXRound(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+inline void SipRound(boost::uint64_t &v0, boost::uint64_t &v1,
+    boost::uint64_t &v2, boost::uint64_t &v3)
+{
+    v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+    v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+}
+
+} // unnamed namespace
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDigest::XXHash64
+/// @description Computes the XXH64 hash of a buffer, as specified by the
+///   xxHash project.
+/// @pre None
+/// @post None
+/// @param p_data The bytes to hash.
+/// @param p_length The number of bytes.
+/// @param p_seed The seed.
+/// @return The 64-bit hash.
+///////////////////////////////////////////////////////////////////////////////
+boost::uint64_t CDigest::XXHash64(const void * p_data, std::size_t p_length,
+    boost::uint64_t p_seed)
+{
+    const unsigned char * p = static_cast<const unsigned char *>(p_data);
+    const unsigned char * end = p + p_length;
+    boost::uint64_t h;
+
+    if(p_length >= 32)
+    {
+        const unsigned char * limit = end - 32;
+        boost::uint64_t v1 = p_seed + PRIME64_1 + PRIME64_2;
+        boost::uint64_t v2 = p_seed + PRIME64_2;
+        boost::uint64_t v3 = p_seed;
+        boost::uint64_t v4 = p_seed - PRIME64_1;
+        do
+        {
+            v1 = XXRound(v1, Read64(p)); p += 8;
+            v2 = XXRound(v2, Read64(p)); p += 8;
+            v3 = XXRound(v3, Read64(p)); p += 8;
+            v4 = XXRound(v4, Read64(p)); p += 8;
+        } while(p <= limit);
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = XXMerge(h, v1);
+        h = XXMerge(h, v2);
+        h = XXMerge(h, v3);
+        h = XXMerge(h, v4);
+    }
+    else
+    {
+        h = p_seed + PRIME64_5;
+    }
+    h += p_length;
+
+    while(p + 8 <= end)
+    {
+        h ^= XXRound(0, Read64(p));
+        h = Rotl(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if(p + 4 <= end)
+    {
+        h ^= boost::uint64_t(Read32(p)) * PRIME64_1;
+        h = Rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while(p < end)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = Rotl(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDigest::SipHash24
+/// @description Computes SipHash-2-4 of a buffer, as specified by Aumasson
+///   and Bernstein.
+/// @pre None
+/// @post None
+/// @param p_data The bytes to hash.
+/// @param p_length The number of bytes.
+/// @param p_k0 The first half of the key, as a little endian word.
+/// @param p_k1 The second half of the key.
+/// @return The 64-bit hash.
+///////////////////////////////////////////////////////////////////////////////
+boost::uint64_t CDigest::SipHash24(const void * p_data, std::size_t p_length,
+    boost::uint64_t p_k0, boost::uint64_t p_k1)
+{
+    const unsigned char * p = static_cast<const unsigned char *>(p_data);
+    const unsigned char * end = p + (p_length & ~std::size_t(7));
+    boost::uint64_t v0 = p_k0 ^ 0x736F6D6570736575ULL;
+    boost::uint64_t v1 = p_k1 ^ 0x646F72616E646F6DULL;
+    boost::uint64_t v2 = p_k0 ^ 0x6C7967656E657261ULL;
+    boost::uint64_t v3 = p_k1 ^ 0x7465646279746573ULL;
+    boost::uint64_t m;
+
+    for(; p != end; p += 8)
+    {
+        m = Read64(p);
+        v3 ^= m;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    m = boost::uint64_t(p_length) << 56;
+    for(std::size_t i = 0; i < (p_length & 7); i++)
+    {
+        m |= boost::uint64_t(p[i]) << (8 * i);
+    }
+    v3 ^= m;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= m;
+
+    v2 ^= 0xFF;
+    for(int i = 0; i < 4; i++)
+    {
+        SipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDigest::Compute
+/// @description Digests a buffer with the chosen algorithm. The salt is the
+///   XXH64 seed, or is folded into the SipHash key.
+/// @pre None
+/// @post None
+/// @param p_algorithm Which digest to compute.
+/// @param p_data The bytes to hash.
+/// @param p_length The number of bytes.
+/// @param p_salt A value mixed in with the bytes.
+/// @return The 64-bit digest.
+///////////////////////////////////////////////////////////////////////////////
+boost::uint64_t CDigest::Compute(Algorithm p_algorithm, const void * p_data,
+    std::size_t p_length, boost::uint64_t p_salt)
+{
+    if(p_algorithm == SIPHASH24)
+    {
+        return SipHash24(p_data, p_length, SIP_K0 ^ p_salt, SIP_K1);
+    }
+    return XXHash64(p_data, p_length, p_salt);
+}
+
+    } // namespace broker
+} // namespace freedm
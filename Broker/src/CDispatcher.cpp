@@ -34,12 +34,17 @@
 ////////////////////////////////////////////////////////////////////
 
 #include <boost/thread/locks.hpp>
+#include <boost/bind.hpp>
 
 #include "CDispatcher.hpp"
+#include "CMessage.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
+#include <vector>
+
 #define UNUSED_ARGUMENT(x) (void)x
 
 namespace freedm {
@@ -49,9 +54,10 @@ namespace freedm {
 /// @fn CDispatcher::CDispatcher
 /// @description Dispatcher constructor
 /// @pre None
-/// @post None
+/// @post The dispatcher has an empty routing table.
 ///////////////////////////////////////////////////////////////////////////////
 CDispatcher::CDispatcher()
+    : m_readTable(new ReadTable)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 
@@ -61,91 +67,59 @@ CDispatcher::CDispatcher()
 /// @fn CDispatcher::HandleRequest
 /// @description Given an input property tree determine which handlers should
 ///   be given the message out of a pool of modules and deliever the message
-///   as appropriate.
+///   as appropriate. The routing table is read without taking a lock, so
+///   dispatch never waits on a registration or on another dispatch.
 /// @pre Modules have registered their read handlers.
 /// @post Message delievered to a module
 /// @param msg The message to distribute to modules
 ///////////////////////////////////////////////////////////////////////////////
-void CDispatcher::HandleRequest(CMessage msg)
+void CDispatcher::HandleRequest(const CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
-    ptree sub_;
-    ptree::const_iterator it_;
-    std::map< std::string, IReadHandler *>::const_iterator mapIt_;
-    std::string key_;
-    ptree p_mesg = static_cast<ptree>(msg);
+    std::vector<std::string> keys_;
+    std::vector<std::string>::const_iterator it_;
+    ReadTable::KeyMap::const_iterator routes_;
+
+    // A registration publishes a new table rather than changing this one,
+    // so the snapshot stays valid for the whole dispatch.
+    ReadTablePtr table_ = boost::atomic_load( &m_readTable );
+
+    // The keys can be listed without building the submessage tree. A
+    // received message is only fully decoded once a handler wants it.
+    keys_ = msg.GetSubMessageKeys();
 
     try
     {
-        // Scoped lock, will release mutex at end of try {}
-        boost::lock_guard< boost::mutex > scopedLock_( m_rMutex );
-
         // This allows for a handler to process all messages using
         // the special keyword "any"
-        for( mapIt_ = m_readHandlers.lower_bound( "any" );
-             mapIt_ != m_readHandlers.upper_bound( "any" );
-             ++mapIt_ )
-        {
-            try
-            {
-                (mapIt_->second)->HandleRead( msg );
-            }
-            catch( boost::property_tree::ptree_bad_path &e )
-            {
-                Logger.Warn<<"Module failed to read message"<<std::endl;
-            }
-        }
-	        
-	      // Loop through all submessages of this message to call its
+        Deliver( table_->any, msg );
+
+        // Loop through all submessages of this message to call its
         // handler
-        ptree sub_ = p_mesg.get_child("message.submessages");
-        for( it_ = sub_.begin(); it_ != sub_.end(); ++it_ )
+        for( it_ = keys_.begin(); it_ != keys_.end(); ++it_ )
         {
-            Logger.Debug << "Processing " << it_->first
+            Logger.Debug << "Processing " << *it_
                     << std::endl;
 
-            // Retrieve current key and iterate through all matching
-            // handlers of that key. If the key doesn't exist in the
-            // map, lower_bound(key) == upper_bound(key).
-            key_ = it_->first;
             // Special keyword any which gives the submessage to all modules.
-            if( key_ == "any")
+            if( *it_ == "any" )
             {
-                for( mapIt_ =  m_readHandlers.begin(); 
-                     mapIt_ != m_readHandlers.end();
-                     ++mapIt_)
-                {
-                    try
-                    {
-                        (mapIt_->second)->HandleRead(msg);
-                    }
-                    catch( boost::property_tree::ptree_bad_path &e )
-                    {
-                        Logger.Warn<<"Module failed to read message (any field)"<<std::endl;
-                    }
-                }
+                Deliver( table_->all, msg );
+                continue;
             }
-            else
+            routes_ = table_->keys.find( *it_ );
+            if( routes_ == table_->keys.end() )
             {
-                for( mapIt_ = m_readHandlers.lower_bound( key_ );
-                        mapIt_ != m_readHandlers.upper_bound(key_);
-                        ++mapIt_ )
-                {
-                    // XXX Not sure if the handler needs the full message
-                    (mapIt_->second)->HandleRead(msg);
-                }
-
-                if( m_readHandlers.lower_bound( key_ ) == 
-                    m_readHandlers.upper_bound( key_)     )
-                {
-                    // Just log this for now
-                    Logger.Debug << "Submessage '" << key_ << "' had no read handlers.";
-                }
+                // Just log this for now
+                Logger.Debug << "Submessage '" << *it_ << "' had no read handlers.";
+                continue;
             }
+            // XXX Not sure if the handler needs the full message
+            Deliver( routes_->second, msg );
         }
         // XXX Should anything be done if the message didn't
         // have any submessages? 
-        if( sub_.begin() == sub_.end() )
+        if( keys_.empty() )
         {
             // Just log this for now
             Logger.Debug << "Message had no submessages.";
@@ -161,6 +135,110 @@ void CDispatcher::HandleRequest(CMessage msg)
 
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDispatcher::Deliver
+/// @description Gives a message to a list of read handlers. A handler
+///   registered with a strand gets its own copy of the message through its
+///   module's queue, which is drained on that strand. Each module sees its
+///   messages in order and never two at once, different modules run in
+///   parallel, and the caller only pays for the copy.
+/// @pre None
+/// @post Each handler has been called, or the message has been queued for
+///   its module.
+/// @param p_routes The handlers to call.
+/// @param msg The message to give them.
+///////////////////////////////////////////////////////////////////////////////
+void CDispatcher::Deliver( const ReadRoutes &p_routes, const CMessage &msg )
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    ReadRoutes::const_iterator it_;
+
+    if( p_routes.empty() )
+    {
+        return;
+    }
+    // Build the submessage tree once, before the message is copied.
+    msg.GetSubMessages();
+    for( it_ = p_routes.begin(); it_ != p_routes.end(); ++it_ )
+    {
+        if( it_->queue )
+        {
+            it_->queue->Push( msg );
+        }
+        else
+        {
+            CallReadHandler( it_->handler, msg );
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDispatcher::IsCongested
+/// @description Checks whether a module has fallen behind far enough that
+///   the listener should stop reading from the socket. Only queues using
+///   the backpressure policy report this.
+/// @pre None
+/// @post None
+/// @return true if any module's queue is full.
+///////////////////////////////////////////////////////////////////////////////
+bool CDispatcher::IsCongested() const
+{
+    ReadTablePtr table_ = boost::atomic_load( &m_readTable );
+    std::map<std::string, CReadQueue::QueuePtr>::const_iterator it_;
+
+    for( it_ = table_->queues.begin(); it_ != table_->queues.end(); ++it_ )
+    {
+        if( it_->second->IsFull() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDispatcher::GetQueueStats
+/// @description Collects the depth, drop and handler latency counters of
+///   every module's queue.
+/// @pre None
+/// @post None
+/// @return The counters, keyed by the first key each module registered.
+///////////////////////////////////////////////////////////////////////////////
+std::map<std::string, CReadQueue::Stats> CDispatcher::GetQueueStats() const
+{
+    ReadTablePtr table_ = boost::atomic_load( &m_readTable );
+    std::map<std::string, CReadQueue::QueuePtr>::const_iterator it_;
+    std::map<std::string, CReadQueue::Stats> result_;
+
+    for( it_ = table_->queues.begin(); it_ != table_->queues.end(); ++it_ )
+    {
+        result_[it_->first] = it_->second->GetStats();
+    }
+    return result_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CDispatcher::CallReadHandler
+/// @description Calls a read handler. A module that cannot find the fields
+///   it expects is logged rather than allowed to take down the thread.
+/// @pre None
+/// @post The handler has read the message.
+/// @param p_handler The handler to call.
+/// @param msg The message to give it.
+///////////////////////////////////////////////////////////////////////////////
+void CDispatcher::CallReadHandler( IReadHandler *p_handler,
+    const CMessage &msg )
+{
+    try
+    {
+        p_handler->HandleRead( msg );
+    }
+    catch( boost::property_tree::ptree_bad_path &e )
+    {
+        Logger.Warn<<"Module failed to read message"<<std::endl;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CDispatcher::HandleWrite
 /// @description Handles calling modules write handlers which allows them to
@@ -243,19 +321,65 @@ void CDispatcher::HandleWrite( ptree &p_mesg )
 /// @param p_type the tree key used to identify which messages the module
 ///   would like to recieve.
 /// @param p_handler The module which will be called to recieve the message.
+/// @param p_strand The strand the module's handlers run on, or NULL to call
+///   the handler directly on the thread that received the message. A
+///   module with a strand gets one queue, shared by all of its keys and
+///   sized by the queue-size and queue-overflow settings.
+/// @limitations Registration copies the routing table, so it is meant to
+///   happen at startup rather than per message.
 ///////////////////////////////////////////////////////////////////////////////
 void CDispatcher::RegisterReadHandler( const std::string &p_type,
-        IReadHandler *p_handler )
+        IReadHandler *p_handler, boost::asio::io_service::strand *p_strand )
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    std::map<std::string, CReadQueue::QueuePtr>::const_iterator it_;
+    CReadQueue::OverflowPolicy policy_ = CReadQueue::BACKPRESSURE;
+    ReadRoute route_;
+    route_.handler = p_handler;
+
+    CReadQueue::ParsePolicy(
+            CGlobalConfiguration::instance().GetQueueOverflow(), policy_ );
 
     {
-        // Scoped lock, will release mutex at end of {}
+        // Scoped lock, will release mutex at end of {}. Only writers take
+        // it: readers use whichever table was published last.
         boost::lock_guard< boost::mutex > scopedLock_( m_rMutex );
-        m_readHandlers.insert(
-                std::pair< const std::string, IReadHandler *>
-                    (p_type, p_handler)
-        );
+        boost::shared_ptr<ReadTable> table_(
+                new ReadTable( *boost::atomic_load( &m_readTable ) ) );
+
+        if( p_strand != 0 )
+        {
+            // A module registered under several keys keeps one queue so its
+            // messages are still handled in the order they arrived.
+            for( it_ = table_->queues.begin(); it_ != table_->queues.end();
+                    ++it_ )
+            {
+                if( it_->second->GetHandler() == p_handler )
+                {
+                    route_.queue = it_->second;
+                    break;
+                }
+            }
+            if( !route_.queue )
+            {
+                route_.queue.reset( new CReadQueue( p_type, p_handler,
+                        *p_strand,
+                        CGlobalConfiguration::instance().GetQueueSize(),
+                        policy_ ) );
+                table_->queues[p_type] = route_.queue;
+            }
+        }
+
+        if( p_type == "any" )
+        {
+            table_->any.push_back( route_ );
+        }
+        else
+        {
+            table_->keys[p_type].push_back( route_ );
+        }
+        table_->all.push_back( route_ );
+        boost::atomic_store( &m_readTable, ReadTablePtr( table_ ) );
     }
 }
 
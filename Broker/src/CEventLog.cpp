@@ -0,0 +1,397 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CEventLog.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the binary log of protocol and agent events
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CEventLog.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <vector>
+
+#include <time.h>
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+/// Records a thread holds before it writes them to the file.
+const std::size_t BUFFER_RECORDS = 128;
+
+/// The first bytes of every event log.
+const char MAGIC[8] = { 'F', 'R', 'E', 'E', 'D', 'M', 'E', 'V' };
+
+/// Little endian stores and loads, whatever the host byte order
+void Put(unsigned char *p, boost::uint64_t v, std::size_t n)
+{
+    for(std::size_t i = 0; i < n; i++, v >>= 8)
+        p[i] = static_cast<unsigned char>(v & 0xFF);
+}
+
+boost::uint64_t Get(const unsigned char *p, std::size_t n)
+{
+    boost::uint64_t v = 0;
+    for(std::size_t i = n; i > 0; i--)
+        v = (v << 8) | p[i - 1];
+    return v;
+}
+
+/// Microseconds since the epoch from the realtime clock.
+boost::uint64_t NowMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return boost::uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+} // unnamed namespace
+
+/// A thread's records waiting to be written
+struct CEventLog::Buffer
+{
+    Buffer() : owner(0), thread(0), count(0) { }
+    /// Writes what is left when the thread exits
+    ~Buffer();
+    /// The log the records are for; changed under the registry lock
+    boost::atomic<CEventLog *> owner;
+    /// Number of the thread, as written in its records
+    boost::uint16_t thread;
+    /// Records filled
+    std::size_t count;
+    /// The encoded records
+    unsigned char data[BUFFER_RECORDS * RECORD_SIZE];
+};
+
+/// Every thread's buffer
+struct CEventLog::Registry
+{
+    Registry() : next(0) { }
+    /// Guards the list, spills and the owner of each buffer
+    boost::mutex mutex;
+    /// Buffers of the threads that have recorded events
+    std::vector<Buffer *> buffers;
+    /// Number given to the next thread to record an event
+    boost::uint16_t next;
+    /// The calling thread's buffer; declared last so that it is destroyed
+    /// while the rest is still there
+    boost::thread_specific_ptr<Buffer> local;
+};
+
+const boost::uint32_t CEventLog::VERSION = 1;
+const std::size_t CEventLog::RECORD_SIZE;
+const std::size_t CEventLog::HEADER_SIZE;
+
+boost::atomic<CEventLog *> CEventLog::s_current(0);
+
+/// The registry, built on first use
+CEventLog::Registry & CEventLog::GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::Buffer::~Buffer
+/// @description Runs when a thread that recorded events exits. Writes its
+///   records to their log and drops the buffer from the registry.
+/// @pre None
+/// @post The buffer is no longer in the registry.
+///////////////////////////////////////////////////////////////////////////////
+CEventLog::Buffer::~Buffer()
+{
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+    Spill( *this );
+    registry_.buffers.erase( std::remove( registry_.buffers.begin(),
+        registry_.buffers.end(), this ), registry_.buffers.end() );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::CEventLog
+/// @description Opens an event log. An existing file is appended to, so a
+///   node that restarts keeps one timeline.
+/// @pre None
+/// @post The file is open and starts with a header. Nothing is recorded
+///   until Start is called.
+/// @param p_path The file to write.
+/// @limitations Throws std::runtime_error if the file cannot be opened.
+///////////////////////////////////////////////////////////////////////////////
+CEventLog::CEventLog(const std::string &p_path)
+    : m_file(std::fopen( p_path.c_str(), "ab" )),
+      m_running(false)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if( m_file == 0 )
+    {
+        throw std::runtime_error( "Cannot open event log " + p_path );
+    }
+    std::fseek( m_file, 0, SEEK_END );
+    if( std::ftell( m_file ) == 0 )
+    {
+        unsigned char header_[HEADER_SIZE];
+        std::memcpy( header_, MAGIC, sizeof(MAGIC) );
+        Put( header_ + 8, VERSION, 4 );
+        Put( header_ + 12, RECORD_SIZE, 4 );
+        std::fwrite( header_, 1, HEADER_SIZE, m_file );
+    }
+}
+
+/// Stops the log and closes the file
+CEventLog::~CEventLog()
+{
+    Stop();
+    std::fclose( m_file );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::Start
+/// @description Makes this the log that Record writes to. Start it before
+///   the connection manager hands out peer IDs, so that every peer is named.
+/// @pre No other log is started.
+/// @post Events are recorded into this log.
+///////////////////////////////////////////////////////////////////////////////
+void CEventLog::Start()
+{
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( GetRegistry().mutex );
+        m_running = true;
+    }
+    s_current.store( this, boost::memory_order_release );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::Stop
+/// @description Stops recording and writes the events every thread is
+///   holding, so that the file is complete.
+/// @pre The threads that record events have been joined, or at least will
+///   not record again; an event recorded as the log stops may be lost.
+/// @post Every buffered event is in the file and the file is flushed.
+///////////////////////////////////////////////////////////////////////////////
+void CEventLog::Stop()
+{
+    CEventLog *self_ = this;
+    s_current.compare_exchange_strong( self_, 0 );
+
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+    if( !m_running )
+    {
+        return;
+    }
+    for( std::size_t i = 0; i < registry_.buffers.size(); i++ )
+    {
+        Buffer &buffer_ = *registry_.buffers[i];
+        if( buffer_.owner.load( boost::memory_order_relaxed ) == this )
+        {
+            Spill( buffer_ );
+            buffer_.owner.store( 0, boost::memory_order_relaxed );
+        }
+    }
+    m_running = false;
+    std::fflush( m_file );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::RecordName
+/// @description Records the UUID behind a peer ID, eight bytes per record,
+///   so that the decoder can print it.
+/// @pre None
+/// @post PEER_NAME records for the peer are buffered, if a log is started.
+/// @param p_peer The peer ID.
+/// @param p_uuid The UUID it was handed out for.
+///////////////////////////////////////////////////////////////////////////////
+void CEventLog::RecordName(PeerId p_peer, const std::string &p_uuid)
+{
+    for( std::size_t i = 0; i * 8 < p_uuid.size(); i++ )
+    {
+        unsigned char chunk_[8] = { 0 };
+        std::size_t n_ = std::min<std::size_t>( 8, p_uuid.size() - i * 8 );
+        std::memcpy( chunk_, p_uuid.data() + i * 8, n_ );
+        Record( PEER_NAME, p_peer, i, Get( chunk_, 8 ) );
+    }
+}
+
+/// The name of an event type, as the decoder prints it
+const char * CEventLog::GetTypeName(boost::uint16_t p_type)
+{
+    switch( p_type )
+    {
+        case PEER_NAME:         return "PEER_NAME";
+        case SR_SEND:           return "SR_SEND";
+        case SR_ACK:            return "SR_ACK";
+        case SR_RESEND:         return "SR_RESEND";
+        case SR_EXPIRE:         return "SR_EXPIRE";
+        case GM_AYC_SENT:       return "GM_AYC_SENT";
+        case GM_AYC_RECEIVED:   return "GM_AYC_RECEIVED";
+        case GM_AYC_RESPONSE:   return "GM_AYC_RESPONSE";
+        case GM_AYT_SENT:       return "GM_AYT_SENT";
+        case GM_AYT_RECEIVED:   return "GM_AYT_RECEIVED";
+        case GM_AYT_RESPONSE:   return "GM_AYT_RESPONSE";
+        case GM_INVITE_SENT:    return "GM_INVITE_SENT";
+        case GM_INVITE_RECEIVED:return "GM_INVITE_RECEIVED";
+        case GM_ACCEPT_SENT:    return "GM_ACCEPT_SENT";
+        case GM_ACCEPT_RECEIVED:return "GM_ACCEPT_RECEIVED";
+        case LB_STATE:          return "LB_STATE";
+        case LB_DEMAND:         return "LB_DEMAND";
+        case LB_SUPPLY:         return "LB_SUPPLY";
+        case LB_DRAFT_REQUEST:  return "LB_DRAFT_REQUEST";
+        case LB_DRAFT_RESPONSE: return "LB_DRAFT_RESPONSE";
+        case LB_DRAFTING:       return "LB_DRAFTING";
+        case LB_DRAFT_ACCEPT:   return "LB_DRAFT_ACCEPT";
+        default:                return "UNKNOWN";
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::ReadHeader
+/// @description Reads the header at the start of an event log.
+/// @pre p_in is at the start of the file.
+/// @post p_in is at the first record.
+/// @param p_in The file to read.
+/// @return false if the file is not an event log this version can read.
+///////////////////////////////////////////////////////////////////////////////
+bool CEventLog::ReadHeader(std::istream &p_in)
+{
+    unsigned char header_[HEADER_SIZE];
+    if( !p_in.read( reinterpret_cast<char *>(header_), HEADER_SIZE ) )
+    {
+        return false;
+    }
+    return std::memcmp( header_, MAGIC, sizeof(MAGIC) ) == 0 &&
+        Get( header_ + 8, 4 ) == VERSION &&
+        Get( header_ + 12, 4 ) == RECORD_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::ReadEvent
+/// @description Reads the next record of an event log.
+/// @pre ReadHeader has been called on p_in.
+/// @post p_event holds the record if one was read.
+/// @param p_in The file to read.
+/// @param p_event Set to the record.
+/// @return false at the end of the file, or if the last record is cut short.
+///////////////////////////////////////////////////////////////////////////////
+bool CEventLog::ReadEvent(std::istream &p_in, Event &p_event)
+{
+    unsigned char record_[RECORD_SIZE];
+    if( !p_in.read( reinterpret_cast<char *>(record_), RECORD_SIZE ) )
+    {
+        return false;
+    }
+    p_event.time = Get( record_, 8 );
+    p_event.type = Get( record_ + 8, 2 );
+    p_event.thread = Get( record_ + 10, 2 );
+    p_event.peer = Get( record_ + 12, 4 );
+    p_event.a = Get( record_ + 16, 8 );
+    p_event.b = Get( record_ + 24, 8 );
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::Append
+/// @description Encodes an event into the calling thread's buffer without a
+///   lock. The lock is only taken the first time a thread records into a
+///   log, and when its buffer fills and is written out.
+/// @pre None
+/// @post The event is buffered, or in the file, if a log is started.
+/// @param p_type What happened.
+/// @param p_peer The peer it concerns.
+/// @param p_a The first value.
+/// @param p_b The second value.
+///////////////////////////////////////////////////////////////////////////////
+void CEventLog::Append(EventType p_type, PeerId p_peer, boost::int64_t p_a,
+    boost::int64_t p_b)
+{
+    CEventLog *log_ = s_current.load( boost::memory_order_acquire );
+    if( log_ == 0 )
+    {
+        return;
+    }
+    Registry &registry_ = GetRegistry();
+    Buffer *buffer_ = registry_.local.get();
+    if( buffer_ == 0 || buffer_->owner.load( boost::memory_order_relaxed )
+        != log_ )
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+        if( buffer_ == 0 )
+        {
+            buffer_ = new Buffer;
+            buffer_->thread = registry_.next++;
+            registry_.buffers.push_back( buffer_ );
+            registry_.local.reset( buffer_ );
+        }
+        buffer_->owner.store( log_, boost::memory_order_relaxed );
+        buffer_->count = 0;
+    }
+
+    unsigned char *record_ = buffer_->data + buffer_->count * RECORD_SIZE;
+    Put( record_, NowMicros(), 8 );
+    Put( record_ + 8, p_type, 2 );
+    Put( record_ + 10, buffer_->thread, 2 );
+    Put( record_ + 12, p_peer, 4 );
+    Put( record_ + 16, p_a, 8 );
+    Put( record_ + 24, p_b, 8 );
+    if( ++buffer_->count == BUFFER_RECORDS )
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+        Spill( *buffer_ );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CEventLog::Spill
+/// @description Writes a buffer's records to the file of its log.
+/// @pre The caller holds the registry lock.
+/// @post The buffer is empty.
+/// @param p_buffer The buffer to write.
+///////////////////////////////////////////////////////////////////////////////
+void CEventLog::Spill(Buffer &p_buffer)
+{
+    CEventLog *owner_ = p_buffer.owner.load( boost::memory_order_relaxed );
+    if( owner_ != 0 && owner_->m_running && p_buffer.count > 0 )
+    {
+        std::fwrite( p_buffer.data, RECORD_SIZE, p_buffer.count,
+            owner_->m_file );
+    }
+    p_buffer.count = 0;
+}
+
+    } // namespace broker
+} // namespace freedm
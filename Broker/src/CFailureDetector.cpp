@@ -0,0 +1,234 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CFailureDetector.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the phi accrual failure detector
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+
+#include "CFailureDetector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace freedm {
+    namespace broker {
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::CFailureDetector
+/// @description Creates a detector that watches no one. The gaps between
+///   heartbeats are never taken to vary by less than a quarter of the
+///   interval, so a peer that has been perfectly regular is not suspected
+///   the moment one heartbeat is a little late.
+/// @pre p_interval is positive.
+/// @post No peer is watched.
+/// @param p_interval How often the peers send heartbeats.
+/// @param p_threshold The phi past which a peer is suspected.
+///////////////////////////////////////////////////////////////////////////////
+CFailureDetector::CFailureDetector(boost::posix_time::time_duration p_interval,
+    double p_threshold)
+    : m_interval(p_interval.total_microseconds()),
+      m_mindeviation(p_interval.total_microseconds() / 4.0),
+      m_threshold(p_threshold)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::Heartbeat
+/// @description Adds the gap since the peer's last heartbeat to its
+///   history. The first heartbeat from a peer starts watching it.
+/// @pre None
+/// @post The peer is watched and its last heartbeat is p_time, unless an
+///   earlier heartbeat was recorded as arriving later.
+/// @param p_peer The UUID of the peer the heartbeat came from.
+/// @param p_time When the heartbeat arrived.
+///////////////////////////////////////////////////////////////////////////////
+void CFailureDetector::Heartbeat(const std::string &p_peer,
+    const boost::posix_time::ptime &p_time)
+{
+    std::map<std::string, History>::iterator it_ = m_peers.find(p_peer);
+    if( it_ == m_peers.end() )
+    {
+        Watch(p_peer, p_time);
+        return;
+    }
+    History &history_ = it_->second;
+    if( p_time < history_.last )
+    {
+        return;
+    }
+    AddGap(history_, (p_time - history_.last).total_microseconds());
+    history_.last = p_time;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::Watch
+/// @description Starts watching a peer that has not sent a heartbeat yet,
+///   such as a node that just joined the group. Its history is seeded with
+///   two gaps a minimum deviation either side of the interval, which is the
+///   estimate until its own heartbeats outnumber them.
+/// @pre None
+/// @post The peer is watched. A peer that was already is unchanged.
+/// @param p_peer The UUID of the peer.
+/// @param p_time When to count the time since its last heartbeat from.
+///////////////////////////////////////////////////////////////////////////////
+void CFailureDetector::Watch(const std::string &p_peer,
+    const boost::posix_time::ptime &p_time)
+{
+    if( m_peers.count(p_peer) > 0 )
+    {
+        return;
+    }
+    History &history_ = m_peers[p_peer];
+    history_.last = p_time;
+    history_.sum = 0;
+    history_.squares = 0;
+    AddGap(history_, m_interval - m_mindeviation);
+    AddGap(history_, m_interval + m_mindeviation);
+}
+
+/// Stops watching a peer
+void CFailureDetector::Forget(const std::string &p_peer)
+{
+    m_peers.erase(p_peer);
+}
+
+/// Stops watching every peer
+void CFailureDetector::Clear()
+{
+    m_peers.clear();
+}
+
+/// True if the peer is being watched
+bool CFailureDetector::IsWatching(const std::string &p_peer) const
+{
+    return m_peers.count(p_peer) > 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::Phi
+/// @description Computes how suspicious the silence of a peer is, from the
+///   mean and deviation of the gaps in its history.
+/// @pre None
+/// @post None
+/// @param p_peer The UUID of the peer.
+/// @param p_now The time to judge the peer at.
+/// @return The peer's phi, or 0 if it is not watched.
+///////////////////////////////////////////////////////////////////////////////
+double CFailureDetector::Phi(const std::string &p_peer,
+    const boost::posix_time::ptime &p_now) const
+{
+    std::map<std::string, History>::const_iterator it_ =
+        m_peers.find(p_peer);
+    if( it_ == m_peers.end() )
+    {
+        return 0;
+    }
+    const History &history_ = it_->second;
+    double count_ = history_.gaps.size();
+    double mean_ = history_.sum / count_;
+    double variance_ = history_.squares / count_ - mean_ * mean_;
+    double deviation_ = std::max(m_mindeviation,
+        std::sqrt(std::max(variance_, 0.0)));
+    double elapsed_ = (p_now - history_.last).total_microseconds();
+    return Phi(elapsed_, mean_, deviation_);
+}
+
+/// True unless the peer is watched and its phi is past the threshold
+bool CFailureDetector::IsAvailable(const std::string &p_peer,
+    const boost::posix_time::ptime &p_now) const
+{
+    return Phi(p_peer, p_now) < m_threshold;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::GetDetectionTime
+/// @description Finds the silence that makes phi reach the threshold for a
+///   peer whose gaps have always been exactly the interval, by bisection.
+/// @pre None
+/// @post None
+/// @return The time from the last heartbeat to the peer being suspected.
+///////////////////////////////////////////////////////////////////////////////
+boost::posix_time::time_duration CFailureDetector::GetDetectionTime() const
+{
+    double low_ = m_interval;
+    double high_ = m_interval + 40 * m_mindeviation;
+    for( int i = 0; i < 64; i++ )
+    {
+        double mid_ = (low_ + high_) / 2;
+        if( Phi(mid_, m_interval, m_mindeviation) < m_threshold )
+            low_ = mid_;
+        else
+            high_ = mid_;
+    }
+    return boost::posix_time::microseconds(static_cast<long>(high_));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CFailureDetector::Phi
+/// @description Computes -log10 of the chance that a gap of normally
+///   distributed length is longer than p_elapsed, using the logistic
+///   approximation of the normal distribution so that no error function is
+///   needed.
+/// @pre p_deviation is positive.
+/// @post None
+/// @param p_elapsed The time since the last heartbeat.
+/// @param p_mean The mean gap.
+/// @param p_deviation The standard deviation of the gaps.
+/// @return Phi, which is infinite once the chance is too small to represent.
+///////////////////////////////////////////////////////////////////////////////
+double CFailureDetector::Phi(double p_elapsed, double p_mean,
+    double p_deviation)
+{
+    double y_ = (p_elapsed - p_mean) / p_deviation;
+    double e_ = std::exp(-y_ * (1.5976 + 0.070566 * y_ * y_));
+    if( p_elapsed > p_mean )
+    {
+        return -std::log10(e_ / (1.0 + e_));
+    }
+    return -std::log10(1.0 - 1.0 / (1.0 + e_));
+}
+
+/// Adds a gap to a history, dropping the oldest past WINDOW
+void CFailureDetector::AddGap(History &p_history, double p_gap)
+{
+    p_history.gaps.push_back(p_gap);
+    p_history.sum += p_gap;
+    p_history.squares += p_gap * p_gap;
+    if( p_history.gaps.size() > WINDOW )
+    {
+        double old_ = p_history.gaps.front();
+        p_history.gaps.pop_front();
+        p_history.sum -= old_;
+        p_history.squares -= old_ * old_;
+    }
+}
+
+    } // namespace broker
+} // namespace freedm
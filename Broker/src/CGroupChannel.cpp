@@ -0,0 +1,495 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CGroupChannel.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the multicast channel that carries one
+///   copy of a message meant for several peers
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CGroupChannel.hpp"
+#include "CConnectionManager.hpp"
+#include "CDigest.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "CListener.hpp"
+#include "CSMConnection.hpp"
+#include "CWireCodec.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <cstdio>
+
+namespace freedm {
+    namespace broker {
+
+const std::size_t CGroupChannel::HISTORY;
+const unsigned int CGroupChannel::SYNC_DELAY;
+const unsigned int CGroupChannel::SYNC_REPEATS;
+const std::size_t CGroupChannel::HASH_DIGITS;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::CGroupChannel
+/// @description Creates a channel that is not open. The epoch is drawn
+///   from the UUID and the time, so a node that restarts is told apart
+///   from its last run by the peers that still remember its sequence.
+/// @pre None
+/// @post Sends fail until Open succeeds.
+/// @param p_manager The manager of the node the channel sends for.
+///////////////////////////////////////////////////////////////////////////////
+CGroupChannel::CGroupChannel(CConnectionManager &p_manager)
+    : m_manager(p_manager),
+      m_listener(0),
+      m_fabric(0),
+      m_open(false),
+      m_syncs(0),
+      m_epoch(0),
+      m_outseq(0),
+      m_sent(CMetrics::GetCounter("freedm_group_messages_sent_total")),
+      m_recipients(CMetrics::GetCounter("freedm_group_recipients_total"))
+{
+}
+
+/// Leaves the group
+CGroupChannel::~CGroupChannel()
+{
+    Close();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::Open
+/// @description Joins the multicast group named by the multicast-group
+///   setting, as address:port, and starts handing what arrives on it to
+///   the listener. Loopback is left on so that several brokers on one host
+///   hear each other; each ignores its own datagrams. With a fabric no
+///   socket is opened: the fabric delivers group datagrams to every node's
+///   listener itself.
+/// @pre The binary wire is enabled; receivers decode the group datagrams
+///   without negotiating.
+/// @post The channel is open, or it stays closed and the reason is logged.
+/// @param p_listener Decodes the datagrams the group socket receives.
+/// @param p_fabric The fabric to send through, or null for the socket.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::Open(CListener &p_listener, IFabric *p_fabric)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    namespace ip = boost::asio::ip;
+    std::string group_ = CGlobalConfiguration::instance().GetMulticastGroup();
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+
+    if(group_.empty() || m_open)
+    {
+        return;
+    }
+    if(!CGlobalConfiguration::instance().GetBinaryWire())
+    {
+        Logger.Warn << "multicast-group needs the binary wire; sending "
+                    << "group messages unicast" << std::endl;
+        return;
+    }
+    std::string uuid_ = m_manager.GetUUID();
+    boost::uint64_t now_ = (CClock::Now() -
+        boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1)))
+        .total_microseconds();
+    m_epoch = static_cast<boost::uint32_t>(
+        CDigest::XXHash64(uuid_.data(), uuid_.size(), now_));
+    m_listener = &p_listener;
+    m_fabric = p_fabric;
+    boost::asio::io_service &ios_ = m_listener->GetSocket().get_io_service();
+    m_sync.reset(new CClock::Timer(ios_));
+
+    if(!m_fabric)
+    {
+        boost::system::error_code error_;
+        std::size_t colon_ = group_.rfind(':');
+        ip::address address_;
+        unsigned short port_ = 0;
+        try
+        {
+            if(colon_ == std::string::npos)
+                throw boost::bad_lexical_cast();
+            address_ = ip::address::from_string(group_.substr(0, colon_));
+            port_ = boost::lexical_cast<unsigned short>(
+                group_.substr(colon_ + 1));
+        }
+        catch(std::exception &)
+        {
+            Logger.Error << "multicast-group " << group_ << " is not an "
+                         << "address:port" << std::endl;
+            return;
+        }
+        m_group = ip::udp::endpoint(address_, port_);
+        m_socket.reset(new ip::udp::socket(ios_));
+        m_socket->open(m_group.protocol(), error_);
+        if(!error_)
+            m_socket->set_option(ip::udp::socket::reuse_address(true), error_);
+        if(!error_)
+        {
+            ip::udp::endpoint any_(address_.is_v6() ?
+                ip::address(ip::address_v6::any()) :
+                ip::address(ip::address_v4::any()), port_);
+            m_socket->bind(any_, error_);
+        }
+        if(!error_)
+            m_socket->set_option(ip::multicast::join_group(address_), error_);
+        if(!error_)
+            m_socket->set_option(ip::multicast::enable_loopback(true), error_);
+        if(error_)
+        {
+            Logger.Error << "Could not join multicast group " << group_
+                         << ": " << error_.message() << std::endl;
+            m_socket.reset();
+            return;
+        }
+        Receive();
+    }
+    m_open = true;
+    Logger.Info << "Group messages go to " << group_ << " (epoch "
+                << m_epoch << ")" << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::Close
+/// @description Leaves the group and releases the socket and the sync
+///   timer while their io_service still exists. The history is kept, so
+///   resend requests that are already on their way are answered.
+/// @pre None
+/// @post The channel is closed.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::Close()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    m_open = false;
+    m_sync.reset();
+    if(m_socket)
+    {
+        boost::system::error_code ignored_;
+        m_socket->close(ignored_);
+        m_socket.reset();
+    }
+}
+
+/// True if messages can be sent to the group
+bool CGroupChannel::IsOpen() const
+{
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    return m_open;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::Send
+/// @description Signs a copy of the message for the group protocol, lists
+///   the hashes of its recipients under "smc.to", numbers it and writes it
+///   to the group once. The datagram is kept in the history for peers that
+///   ask for it again. Safe to call from any module's strand.
+/// @pre None
+/// @post The message has been written to the group and the sync timer is
+///   set, or nothing was written.
+/// @param p_peers The peers the message is for; the sending node should
+///   not be one of them.
+/// @param p_msg The message to send.
+/// @return False if the channel is closed or the message, with its
+///   recipients, does not fit in one datagram; the caller sends it unicast.
+///////////////////////////////////////////////////////////////////////////////
+bool CGroupChannel::Send(const std::vector<PeerId> &p_peers,
+    const CMessage &p_msg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(!IsOpen())
+    {
+        return false;
+    }
+    std::string to_;
+    to_.reserve(p_peers.size() * HASH_DIGITS);
+    for(std::size_t i = 0; i < p_peers.size(); i++)
+    {
+        to_ += HashUUID(m_manager.GetUUIDByPeerId(p_peers[i]));
+    }
+    // Shares the submessages with p_msg.
+    CMessage out_(p_msg);
+    out_.SetSourceUUID(m_manager.GetUUID());
+    out_.SetSourceHostname(m_manager.GetHostname());
+    out_.SetProtocol(CSMConnection::Identifier());
+    out_.SetSendTimestampNow();
+    ptree pp_;
+    pp_.put("smc.epoch", m_epoch);
+    pp_.put("smc.to", to_);
+    out_.SetProtocolProperties(pp_);
+
+    std::string datagram_;
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    if(!m_open)
+    {
+        return false;
+    }
+    out_.SetSequenceNumber(m_outseq);
+    CWireCodec::Encode(out_, datagram_, CWireCodec::VERSION);
+    if(datagram_.size() > CDatagramBatch::MAX_DATAGRAM)
+    {
+        Logger.Debug << "Group message of " << datagram_.size()
+                     << " bytes sent unicast" << std::endl;
+        return false;
+    }
+    m_outseq++;
+    m_history.push_back(datagram_);
+    if(m_history.size() > HISTORY)
+    {
+        m_history.pop_front();
+    }
+    Write(datagram_);
+    m_sent.Add();
+    m_recipients.Add(p_peers.size());
+
+    m_syncs = SYNC_REPEATS;
+    m_sync->expires_from_now(boost::posix_time::milliseconds(SYNC_DELAY));
+    m_sync->async_wait(boost::bind(&CGroupChannel::HandleSync, this,
+        boost::asio::placeholders::error));
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::GetDatagram
+/// @description Finds a sent datagram by its sequence number.
+/// @pre None
+/// @post None
+/// @param p_seq The sequence number a peer asked for.
+/// @param p_out Set to the datagram.
+/// @return False if the datagram has left the history, or was never sent.
+///////////////////////////////////////////////////////////////////////////////
+bool CGroupChannel::GetDatagram(unsigned int p_seq, std::string &p_out) const
+{
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    // How far back from the newest message p_seq is, 1 for the newest.
+    unsigned int back_ = m_outseq - p_seq;
+    if(back_ == 0 || back_ > m_history.size())
+    {
+        return false;
+    }
+    p_out = m_history[m_history.size() - back_];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::SaveCursor
+/// @description Keeps how far a peer's group messages were delivered when
+///   the connection that followed them stops. Group management stops and
+///   replaces connections as groups change, while the peer's sequence goes
+///   on; the replacement picks up here and asks for what it missed.
+/// @pre None
+/// @post GetCursor returns p_next for the peer and epoch.
+/// @param p_peer The peer that sent the messages.
+/// @param p_epoch The run of the peer's channel.
+/// @param p_next The next sequence number to deliver.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::SaveCursor(PeerId p_peer, boost::uint32_t p_epoch,
+    unsigned int p_next)
+{
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    m_cursors[p_peer] = std::make_pair(p_epoch, p_next);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::GetCursor
+/// @description Finds where an earlier connection to a peer stopped
+///   delivering its group messages.
+/// @pre None
+/// @post None
+/// @param p_peer The peer that sent the messages.
+/// @param p_epoch The run of the peer's channel a message is from.
+/// @param p_next Set to the next sequence number to deliver.
+/// @return False if no cursor was saved for this run of the peer's channel.
+///////////////////////////////////////////////////////////////////////////////
+bool CGroupChannel::GetCursor(PeerId p_peer, boost::uint32_t p_epoch,
+    unsigned int &p_next) const
+{
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    std::map<PeerId, std::pair<boost::uint32_t, unsigned int> >::
+        const_iterator it_ = m_cursors.find(p_peer);
+    if(it_ == m_cursors.end() || it_->second.first != p_epoch)
+    {
+        return false;
+    }
+    p_next = it_->second.second;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::HashUUID
+/// @description Shortens a UUID for a recipient list. Two peers with the
+///   same hash both accept a message meant for either.
+/// @pre None
+/// @post None
+/// @param p_uuid The UUID.
+/// @return HASH_DIGITS hex digits of the UUID's XXH64.
+///////////////////////////////////////////////////////////////////////////////
+std::string CGroupChannel::HashUUID(const std::string &p_uuid)
+{
+    char hex_[HASH_DIGITS + 1];
+    std::snprintf(hex_, sizeof(hex_), "%08x", static_cast<unsigned int>(
+        CDigest::XXHash64(p_uuid.data(), p_uuid.size(), 0) & 0xFFFFFFFFu));
+    return std::string(hex_, HASH_DIGITS);
+}
+
+/// True if p_hash is one of the hashes in a recipient list
+bool CGroupChannel::IsAddressedTo(const std::string &p_list,
+    const std::string &p_hash)
+{
+    for(std::size_t i = 0; i + HASH_DIGITS <= p_list.size(); i += HASH_DIGITS)
+    {
+        if(p_list.compare(i, HASH_DIGITS, p_hash) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::Write
+/// @description Writes a datagram to the group socket, or broadcasts it
+///   through the fabric.
+/// @pre m_mutex is held and the channel is open.
+/// @post The datagram has been sent, or the failure logged.
+/// @param p_datagram The encoded message.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::Write(const std::string &p_datagram)
+{
+    if(m_fabric)
+    {
+        m_fabric->Broadcast(m_manager.GetUUID(),
+            std::vector<std::string>(1, p_datagram));
+        return;
+    }
+    boost::system::error_code error_;
+    m_socket->send_to(boost::asio::buffer(p_datagram), m_group, 0, error_);
+    if(error_)
+    {
+        Logger.Warn << "Group send failed: " << error_.message() << std::endl;
+    }
+}
+
+/// Starts the next receive from the group socket
+void CGroupChannel::Receive()
+{
+    m_socket->async_receive_from(boost::asio::buffer(m_buffer), m_sender,
+        boost::bind(&CGroupChannel::HandleReceive, this,
+        boost::asio::placeholders::error,
+        boost::asio::placeholders::bytes_transferred));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::HandleReceive
+/// @description Passes a group datagram to the listener, which decodes it
+///   and posts it to the sender's connection like any other.
+/// @pre The receive was started by Receive.
+/// @post The next receive is started, unless the socket was closed.
+/// @param p_error Set if the receive failed.
+/// @param p_bytes The size of the datagram.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::HandleReceive(const boost::system::error_code &p_error,
+    std::size_t p_bytes)
+{
+    if(p_error == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+    if(!p_error)
+    {
+        m_listener->HandleDatagram(m_buffer.data(), p_bytes);
+    }
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    if(m_open)
+    {
+        Receive();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::HandleSync
+/// @description Writes the sync once no message has been sent for
+///   SYNC_DELAY, and repeats it SYNC_REPEATS times in all, doubling the
+///   wait each time. A peer that missed the last messages of a burst has
+///   nothing later to show it the gap; the sync does, unless it is lost
+///   as well, which the repeats make unlikely.
+/// @pre None
+/// @post The next sync is scheduled, or the last one has been written.
+/// @param p_error Set if a later send reset the timer.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::HandleSync(const boost::system::error_code &p_error)
+{
+    if(p_error)
+    {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock_(m_mutex);
+    if(!m_open || m_syncs == 0)
+    {
+        return;
+    }
+    std::string datagram_;
+    EncodeSync(datagram_);
+    Write(datagram_);
+    m_syncs--;
+    if(m_syncs > 0)
+    {
+        m_sync->expires_from_now(boost::posix_time::milliseconds(
+            SYNC_DELAY << (SYNC_REPEATS - m_syncs)));
+        m_sync->async_wait(boost::bind(&CGroupChannel::HandleSync, this,
+            boost::asio::placeholders::error));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CGroupChannel::EncodeSync
+/// @description Builds a sync: a message with the Created status, which no
+///   module sees, numbered like the last message sent.
+/// @pre m_mutex is held and a message has been sent.
+/// @post The datagram has been appended to p_out.
+/// @param p_out The buffer to append the datagram to.
+///////////////////////////////////////////////////////////////////////////////
+void CGroupChannel::EncodeSync(std::string &p_out)
+{
+    CMessage sync_;
+    sync_.SetSourceUUID(m_manager.GetUUID());
+    sync_.SetSourceHostname(m_manager.GetHostname());
+    sync_.SetProtocol(CSMConnection::Identifier());
+    sync_.SetStatus(CMessage::Created);
+    sync_.SetSequenceNumber(m_outseq - 1);
+    sync_.SetSendTimestampNow();
+    ptree pp_;
+    pp_.put("smc.epoch", m_epoch);
+    sync_.SetProtocolProperties(pp_);
+    CWireCodec::Encode(sync_, p_out, CWireCodec::VERSION);
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -38,12 +38,17 @@
 #include "CConnectionManager.hpp"
 #include "CMessage.hpp"
 #include "RequestParser.hpp"
+#include "CWireCodec.hpp"
+#include "IProtocol.hpp"
+#include "CSMConnection.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "config.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
 #include <vector>
+#include <algorithm>
 
 #include <boost/bind.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -51,6 +56,9 @@ using boost::property_tree::ptree;
 
 namespace freedm {
     namespace broker {
+
+const unsigned int CListener::PAUSE_MS;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CListener::CListener
 /// @description Constructor for the CConnection object. Since the change to
@@ -66,7 +74,9 @@ namespace freedm {
 ///////////////////////////////////////////////////////////////////////////////
 CListener::CListener(boost::asio::io_service& p_ioService,
   CConnectionManager& p_manager, CDispatcher& p_dispatch, std::string uuid)
-  : CReliableConnection(p_ioService,p_manager,p_dispatch,uuid)
+  : CReliableConnection(p_ioService,p_manager,p_dispatch,uuid),
+    m_batch(std::max(CGlobalConfiguration::instance().GetBatchSize(), 1u) - 1),
+    m_pauseTimer(p_ioService)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 }
@@ -88,6 +98,35 @@ void CListener::Start()
             boost::asio::placeholders::bytes_transferred));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CListener::Resume
+/// @description Starts the next receive, unless a module's queue is full.
+///   Then the socket is left alone and checked again shortly; datagrams
+///   pile up in the kernel, or are dropped there and resent by the
+///   sequenced protocol, until the module catches up.
+/// @param e Set if the pause timer was cancelled.
+/// @pre None
+/// @post A receive or a pause timer is pending.
+///////////////////////////////////////////////////////////////////////////////
+void CListener::Resume(const boost::system::error_code& e)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(e == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+    if(GetDispatcher().IsCongested())
+    {
+        Logger.Debug << "Module queue full, pausing reads" << std::endl;
+        m_pauseTimer.expires_from_now(boost::posix_time::milliseconds(
+            PAUSE_MS));
+        m_pauseTimer.async_wait(boost::bind(&CListener::Resume, this,
+            boost::asio::placeholders::error));
+        return;
+    }
+    Start();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CListener::Stop
 /// @description Stops the socket and cancels the timeout timer. Does not
@@ -105,77 +144,154 @@ void CListener::Stop()
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CListener::HandleRead
 /// @description The callback which accepts messages from the remote sender.
+///   After the datagram that completed the receive, any others already
+///   waiting on the socket are drained with a single batched read before the
+///   next receive is started. The protocols and modules run on their own
+///   strands, so the next receive does not wait for any of them.
 /// @param e The errorcode if any associated.
 /// @param bytes_transferred The size of the datagram being read.
 /// @pre The connection has had start called and some message has been placed
 ///   in the buffer by the recieve call.
-/// @post The message has been delivered. This means that write connections
-///   have been notified of ACK and standard messages have been redirected to
-///   their appropriate places by the dispatcher. The incoming sequence number
-///   for the source UUID has been incremented appropriately.
+/// @post The messages have been delivered and the next receive is started.
 ///////////////////////////////////////////////////////////////////////////////
-#pragma GCC diagnostic ignored "-Wunused-label"
 void CListener::HandleRead(const boost::system::error_code& e, 
                            std::size_t bytes_transferred)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;       
     if (!e)
     {
-        boost::tribool result_;
-        boost::tie(result_, boost::tuples::ignore) = Parse(
-            m_message, m_buffer.data(),
-            m_buffer.data() + bytes_transferred);
-        if (result_)
+        HandleDatagram(m_buffer.data(), bytes_transferred);
+
+        std::size_t count_ = m_batch.Receive(GetSocket().native_handle());
+        for(std::size_t i = 0; i < count_; i++)
         {
-            ptree x = static_cast<ptree>(m_message);
-            std::string uuid = m_message.GetSourceUUID();
-            remotehost hostname = m_message.GetSourceHostname();
-            ///Make sure the hostname is registered:
-            GetConnectionManager().PutHostname(uuid,hostname);                        
-            ///Get the pointer to the connection:
-            CConnection::ConnectionPtr conn;
-            conn = GetConnectionManager().GetConnectionByUUID(uuid,
-                GetSocket().get_io_service(), GetDispatcher());
-#ifdef CUSTOMNETWORK
-            if((rand()%100) >= GetReliability())
-            {
-                Logger.Debug<<"Dropped datagram "<<m_message.GetHash()<<":"
-                              <<m_message.GetSequenceNumber()<<std::endl;
-                goto listen;
-            }
-#endif
-            if(m_message.GetStatus() == freedm::broker::CMessage::Accepted)
-            {
-                ptree pp = m_message.GetProtocolProperties();
-                size_t hash = pp.get<size_t>("src.hash");
-                Logger.Debug<<"Recieved ACK"<<hash<<":"
-                                <<m_message.GetSequenceNumber()<<std::endl;
-                conn->RecieveACK(m_message);
-            }
-            else if(conn->Recieve(m_message))
-            {
-                Logger.Debug<<"Accepted message "<<m_message.GetHash()<<":"
-                              <<m_message.GetSequenceNumber()<<std::endl;
-                GetDispatcher().HandleRequest(m_message);
-            }
-            else if(m_message.GetStatus() != freedm::broker::CMessage::Created)
-            {
-                Logger.Notice<<"Rejected message "<<m_message.GetHash()<<":"
-                              <<m_message.GetSequenceNumber()<<std::endl;
-            }
+            HandleDatagram(m_batch.GetData(i), m_batch.GetLength(i));
+        }
+        if(count_ > 0)
+        {
+            Logger.Debug << "Drained " << count_ << " extra datagrams"
+                         << std::endl;
         }
-listen:
-        GetSocket().async_receive_from(boost::asio::buffer(m_buffer, 8192),
-                m_endpoint, boost::bind(&CListener::HandleRead, this,
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred));
+
+        Resume(boost::system::error_code());
     }
     else
     {
         GetConnectionManager().Stop(CListener::ConnectionPtr(this));	
     }
 }
-#pragma GCC diagnostic warning "-Wunused-label"
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CListener::HandleDatagram
+/// @description Decodes one datagram and hands it to the connection for the
+///   sender. A fabric delivers datagrams here in place of the socket, and
+///   the group channel those from the multicast group, from another thread
+///   than the listener's own reads.
+/// @param p_data The start of the datagram.
+/// @param p_length The size of the datagram.
+/// @pre None
+/// @post The message has been posted to the sender's connection strand,
+///   where HandleMessage delivers it.
+///////////////////////////////////////////////////////////////////////////////
+void CListener::HandleDatagram(const char * p_data, std::size_t p_length)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;       
+    boost::tribool result_;
+    CMessage message_;
+    if(CWireCodec::IsBinary(p_data, p_length))
+    {
+        // Only the header and protocol properties are decoded here; the
+        // submessages stay as bytes until the dispatcher needs them.
+        result_ = CWireCodec::Decode(p_data, p_length, message_);
+    }
+    else
+    {
+        boost::tie(result_, boost::tuples::ignore) = Parse(
+            message_, p_data, p_data + p_length);
+    }
+    if (result_)
+    {
+        PeerId peer = GetConnectionManager().GetPeerId(
+            message_.GetSourceUUID());
+        ///Make sure the hostname is registered:
+        GetConnectionManager().PutHostname(peer,
+            message_.GetSourceHostname());
+        ///Get the pointer to the connection:
+        CConnection::ConnectionPtr conn;
+        conn = GetConnectionManager().GetConnectionByPeerId(peer,
+            GetSocket().get_io_service(), GetDispatcher());
+#ifdef CUSTOMNETWORK
+        if((rand()%100) >= GetReliability())
+        {
+            Logger.Debug<<"Dropped datagram "<<message_.GetHash()<<":"
+                          <<message_.GetSequenceNumber()<<std::endl;
+            return;
+        }
+#endif
+        // Everything that touches the peer's protocol state runs on that
+        // connection's strand, so peers are handled in parallel.
+        conn->GetStrand().post(boost::bind(&CListener::HandleMessage, this,
+            conn, message_));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CListener::HandleMessage
+/// @description Passes a decoded message to the protocol of the connection
+///   it arrived for, then to the dispatcher if the protocol accepts it. An
+///   ACK riding on a data message is handed over first, the same way as one
+///   that came alone.
+/// @param p_conn The connection to the message's sender.
+/// @param p_message The decoded message.
+/// @pre Called on p_conn's strand.
+/// @post Write connections have been notified of ACK and standard messages
+///   have been redirected to their appropriate places by the dispatcher,
+///   followed by any messages the protocol was holding for this one. The
+///   incoming sequence number for the source UUID has been incremented
+///   appropriately.
+///////////////////////////////////////////////////////////////////////////////
+void CListener::HandleMessage(CConnection::ConnectionPtr p_conn,
+                              CMessage p_message)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;       
+    p_conn->SetPeerWireVersion(p_message.GetWireVersion());
+    CMessage ack_;
+    if(IProtocol::DetachACK(p_message, ack_))
+    {
+        Logger.Debug<<"Recieved ACK on message "<<ack_.GetSequenceNumber()
+                      <<std::endl;
+        p_conn->RecieveACK(ack_);
+    }
+    if(p_message.GetStatus() == freedm::broker::CMessage::Accepted)
+    {
+        const ptree &pp = p_message.GetProtocolProperties();
+        size_t hash = pp.get<size_t>("src.hash", 0);
+        Logger.Debug<<"Recieved ACK"<<hash<<":"
+                        <<p_message.GetSequenceNumber()<<std::endl;
+        p_conn->RecieveACK(p_message);
+    }
+    else if(p_conn->Recieve(p_message))
+    {
+        Logger.Debug<<"Accepted message "<<p_message.GetHash()<<":"
+                      <<p_message.GetSequenceNumber()<<std::endl;
+        GetDispatcher().HandleRequest(p_message);
+    }
+    // Syncs, and group messages meant for other members, are not rejections.
+    else if(p_message.GetStatus() != freedm::broker::CMessage::Created &&
+        p_message.GetProtocol() != CSMConnection::Identifier())
+    {
+        Logger.Notice<<"Rejected message "<<p_message.GetHash()<<":"
+                      <<p_message.GetSequenceNumber()<<std::endl;
+    }
+    // Messages held back for an earlier one follow it, in order.
+    CMessage ready_;
+    while(p_conn->TakeReady(p_message.GetProtocol(), ready_))
+    {
+        Logger.Debug<<"Accepted held message "<<ready_.GetHash()<<":"
+                      <<ready_.GetSequenceNumber()<<std::endl;
+        GetDispatcher().HandleRequest(ready_);
+    }
+}
 
     } // namespace broker
 } // namespace freedm
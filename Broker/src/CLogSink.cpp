@@ -0,0 +1,380 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CLogSink.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the background writer for log output
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CLogSink.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <cstddef>
+
+namespace {
+
+/// How long the writer sleeps before looking at the ring again when no one
+/// has woken it. Only matters if a wakeup is missed.
+const long IDLE_MILLISECONDS = 100;
+
+/// Appends a line to a batch in the format CLog has always used.
+void FormatLine(std::string &p_batch, const boost::posix_time::ptime &p_time,
+    const std::string &p_name, int p_level, const std::string &p_text)
+{
+    p_batch += boost::posix_time::to_simple_string(p_time);
+    p_batch += " : ";
+    p_batch += p_name;
+    p_batch += "(";
+    p_batch += boost::lexical_cast<std::string>(p_level);
+    p_batch += "):\t";
+    p_batch += p_text;
+}
+
+} // unnamed namespace
+
+const std::size_t CLogSink::MAX_CAPACITY = 1 << 20;
+
+boost::atomic<CLogSink *> CLogSink::s_current(0);
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::CLogSink
+/// @description Creates a sink that is not yet writing. Log lines are
+///   written synchronously until Start is called.
+/// @pre p_capacity is at most MAX_CAPACITY.
+/// @post The ring is empty.
+/// @param p_capacity Lines the ring holds, rounded up to a power of two.
+/// @param p_policy What Push does once the ring is full.
+/// @param p_out The stream the writer writes to.
+///////////////////////////////////////////////////////////////////////////////
+CLogSink::CLogSink(std::size_t p_capacity, OverflowPolicy p_policy,
+    std::ostream *p_out)
+    : m_capacity(RoundCapacity(p_capacity)),
+      m_policy(p_policy),
+      m_out(p_out),
+      m_head(0),
+      m_tail(0),
+      m_dropped(0),
+      m_reported(0),
+      m_sleeping(false),
+      m_running(false),
+      m_written(0),
+      m_batches(0)
+{
+    m_slots.reset(new Slot[m_capacity]);
+    for(std::size_t i = 0; i < m_capacity; i++)
+    {
+        m_slots[i].sequence.store(i, boost::memory_order_relaxed);
+        m_slots[i].level = 0;
+        m_slots[i].name = 0;
+    }
+}
+
+/// Stops the sink, writing whatever is left
+CLogSink::~CLogSink()
+{
+    Stop();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Start
+/// @description Starts the writer thread and makes this the sink every CLog
+///   pushes its lines into.
+/// @pre No other sink is started. Start from a thread with signals blocked
+///   if the writer should not receive them.
+/// @post Log lines are written by the writer thread.
+///////////////////////////////////////////////////////////////////////////////
+void CLogSink::Start()
+{
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        if( m_running )
+        {
+            return;
+        }
+        m_running = true;
+        m_thread.reset( new boost::thread(
+            boost::bind( &CLogSink::Run, this ) ) );
+    }
+    s_current.store( this, boost::memory_order_release );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Flush
+/// @description Waits until the writer has written every line pushed before
+///   the call, so that nothing logged so far is lost if the process ends.
+/// @pre None
+/// @post Lines pushed before the call have been written to the stream.
+///////////////////////////////////////////////////////////////////////////////
+void CLogSink::Flush()
+{
+    std::size_t target_ = m_head.load( boost::memory_order_acquire );
+    boost::unique_lock< boost::mutex > lock_( m_mutex );
+    m_wake.notify_one();
+    while( m_running && m_written < target_ )
+    {
+        m_done.wait( lock_ );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Stop
+/// @description Sends log lines back to the synchronous path, then lets the
+///   writer finish what is in the ring and joins it.
+/// @pre The threads that log through this sink have been joined, or at least
+///   will not log again; a line pushed as the sink stops may be lost.
+/// @post The writer has exited and the ring is empty.
+///////////////////////////////////////////////////////////////////////////////
+void CLogSink::Stop()
+{
+    CLogSink *self_ = this;
+    s_current.compare_exchange_strong( self_, 0 );
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        if( !m_running )
+        {
+            return;
+        }
+        m_running = false;
+        m_wake.notify_one();
+    }
+    m_thread->join();
+    m_thread.reset();
+
+    // Anything pushed between the writer's last look and the exchange above.
+    std::string batch_;
+    std::size_t count_ = Drain( batch_ );
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    m_written += count_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Push
+/// @description Puts a line in the ring without taking a lock. Each push
+///   takes a ticket from m_head; the slot for ticket t is free once its
+///   sequence equals t, and is handed to the writer by storing t + 1. The
+///   text is copied into the slot's string, which keeps its buffer between
+///   lines. If the ring is full the line is dropped or the call waits, as
+///   the policy says.
+/// @pre None
+/// @post The line is in the ring unless it was dropped.
+/// @param p_time When the line was logged.
+/// @param p_name The level's name; it must outlive the sink.
+/// @param p_level The level number.
+/// @param p_text The text of the line.
+/// @param p_length The length of the text.
+/// @return false if the line was dropped.
+///////////////////////////////////////////////////////////////////////////////
+bool CLogSink::Push(const boost::posix_time::ptime &p_time,
+    const std::string *p_name, int p_level, const char *p_text,
+    std::streamsize p_length)
+{
+    std::size_t ticket_ = m_head.load( boost::memory_order_relaxed );
+    for(;;)
+    {
+        Slot &slot_ = m_slots[ticket_ & (m_capacity - 1)];
+        std::size_t sequence_ = slot_.sequence.load( boost::memory_order_acquire );
+        std::ptrdiff_t diff_ = std::ptrdiff_t(sequence_ - ticket_);
+        if( diff_ == 0 )
+        {
+            if( m_head.compare_exchange_weak( ticket_, ticket_ + 1,
+                boost::memory_order_relaxed ) )
+            {
+                slot_.time = p_time;
+                slot_.name = p_name;
+                slot_.level = p_level;
+                slot_.text.assign( p_text, p_length );
+                slot_.sequence.store( ticket_ + 1, boost::memory_order_release );
+                break;
+            }
+        }
+        else if( diff_ < 0 )
+        {
+            // The slot still holds the line from a lap ago: the ring is full.
+            Wake();
+            if( m_policy == DROP )
+            {
+                m_dropped.fetch_add( 1, boost::memory_order_relaxed );
+                return false;
+            }
+            boost::this_thread::yield();
+            ticket_ = m_head.load( boost::memory_order_relaxed );
+        }
+        else
+        {
+            ticket_ = m_head.load( boost::memory_order_relaxed );
+        }
+    }
+    Wake();
+    return true;
+}
+
+/// A copy of the counters
+CLogSink::Stats CLogSink::GetStats() const
+{
+    Stats stats_;
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    stats_.written = m_written;
+    stats_.batches = m_batches;
+    stats_.dropped = m_dropped.load( boost::memory_order_relaxed );
+    return stats_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::ParsePolicy
+/// @description Reads an overflow policy from its configuration name: drop
+///   or block.
+/// @pre None
+/// @post p_policy is set if the name was recognized.
+/// @param p_name The name to read.
+/// @param p_policy Set to the named policy.
+/// @return true if p_name named a policy.
+///////////////////////////////////////////////////////////////////////////////
+bool CLogSink::ParsePolicy(const std::string &p_name,
+    OverflowPolicy &p_policy)
+{
+    if( p_name == "drop" )
+        p_policy = DROP;
+    else if( p_name == "block" )
+        p_policy = BLOCK;
+    else
+        return false;
+    return true;
+}
+
+/// The smallest power of two that holds p_capacity lines
+std::size_t CLogSink::RoundCapacity(std::size_t p_capacity)
+{
+    std::size_t capacity_ = 1;
+    while( capacity_ < p_capacity )
+    {
+        capacity_ <<= 1;
+    }
+    return capacity_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Run
+/// @description The writer thread. Writes lines as they arrive and sleeps on
+///   m_wake when the ring is empty. A pusher only signals if m_sleeping is
+///   set; both sides fence between their store and their load, so either
+///   the writer sees the new line or the pusher sees it sleeping.
+/// @pre Started by Start.
+/// @post Returns once Stop has been called and the ring is empty.
+///////////////////////////////////////////////////////////////////////////////
+void CLogSink::Run()
+{
+    std::string batch_;
+    for(;;)
+    {
+        std::size_t count_ = Drain( batch_ );
+        boost::unique_lock< boost::mutex > lock_( m_mutex );
+        if( count_ > 0 )
+        {
+            m_written += count_;
+            m_batches++;
+            m_done.notify_all();
+            continue;
+        }
+        if( !m_running )
+        {
+            break;
+        }
+        m_sleeping.store( true, boost::memory_order_relaxed );
+        boost::atomic_thread_fence( boost::memory_order_seq_cst );
+        Slot &slot_ = m_slots[m_tail & (m_capacity - 1)];
+        if( slot_.sequence.load( boost::memory_order_acquire ) != m_tail + 1 )
+        {
+            m_wake.timed_wait( lock_,
+                boost::posix_time::milliseconds( IDLE_MILLISECONDS ) );
+        }
+        m_sleeping.store( false, boost::memory_order_relaxed );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Drain
+/// @description Takes every line that is ready out of the ring, stopping
+///   after one lap so that a busy logger cannot keep the batch growing, and
+///   writes them to the stream with one call.
+/// @pre Called by the writer, or by Stop once the writer has exited.
+/// @post The slots taken are free for pushers again.
+/// @param p_batch Scratch space for the formatted lines.
+/// @return The number of lines written.
+///////////////////////////////////////////////////////////////////////////////
+std::size_t CLogSink::Drain(std::string &p_batch)
+{
+    std::size_t count_ = 0;
+    p_batch.clear();
+    while( count_ < m_capacity )
+    {
+        Slot &slot_ = m_slots[m_tail & (m_capacity - 1)];
+        if( slot_.sequence.load( boost::memory_order_acquire ) != m_tail + 1 )
+        {
+            break;
+        }
+        FormatLine( p_batch, slot_.time, *slot_.name, slot_.level, slot_.text );
+        slot_.sequence.store( m_tail + m_capacity, boost::memory_order_release );
+        m_tail++;
+        count_++;
+    }
+
+    unsigned long dropped_ = m_dropped.load( boost::memory_order_relaxed );
+    if( dropped_ != m_reported )
+    {
+        FormatLine( p_batch, boost::posix_time::microsec_clock::local_time(),
+            "Warn", 3, "Log sink full, dropped " +
+            boost::lexical_cast<std::string>( dropped_ - m_reported ) +
+            " lines\n" );
+        m_reported = dropped_;
+    }
+
+    if( !p_batch.empty() )
+    {
+        m_out->write( p_batch.data(), p_batch.size() );
+        m_out->flush();
+    }
+    return count_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CLogSink::Wake
+/// @description Signals the writer if it is waiting for lines.
+/// @pre The caller has just filled a slot, or found the ring full.
+/// @post The writer will look at the ring again.
+///////////////////////////////////////////////////////////////////////////////
+void CLogSink::Wake()
+{
+    boost::atomic_thread_fence( boost::memory_order_seq_cst );
+    if( m_sleeping.load( boost::memory_order_relaxed ) )
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        m_wake.notify_one();
+    }
+}
@@ -1,4 +1,9 @@
 #include "CLogger.hpp"
+#include "CLogSink.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
 
 
 CLog::CLog(CLoggerPointer p, int level_, const char * name_, std::ostream *out_) :
@@ -9,7 +14,15 @@ CLog::CLog(CLoggerPointer p, int level_, const char * name_, std::ostream *out_)
 
 std::streamsize CLog::write( const char* s, std::streamsize n)
 {
+    // CLogStream has already filtered by level; this only catches a level
+    // changed between formatting and the flush.
     if( GetOutputLevel() >= m_level ){
+        CLogSink *sink_ = CLogSink::Current();
+        if( sink_ && m_ostream == &std::clog ){
+            // The writer thread formats the time and does the I/O.
+            sink_->Push(microsec_clock::local_time(), &m_name, m_level, s, n);
+            return n;
+        }
         *m_ostream << microsec_clock::local_time() << " : "
             << m_name << "(" << m_level << "):\t";
                    
@@ -24,27 +37,28 @@ int CLog::GetOutputLevel()
 }
 
 CLocalLogger::CLocalLogger(std::string loggername)
-    : Debug(this, 7,"Debug"),
-      Info(this, 6,"Info"),
-      Notice(this,5,"Notice"),
-      Status(this,4,"Status"),
-      Warn(this, 3,"Warn"),
-      Error(this,2,"Error"),
-      Alert(this,1,"Alert"),
-      Fatal(this,0,"Fatal"),
-      m_name(loggername)
+    : Debug(this, "Debug"),
+      Info(this, "Info"),
+      Notice(this, "Notice"),
+      Status(this, "Status"),
+      Warn(this, "Warn"),
+      Error(this, "Error"),
+      Alert(this, "Alert"),
+      Fatal(this, "Fatal"),
+      m_name(loggername),
+      m_level(0)
 {
-    // Pass
+    CGlobalLogger::Register(this);
 }
 
-std::string CLocalLogger::GetName()
+CLocalLogger::~CLocalLogger()
 {
-    return m_name;
+    CGlobalLogger::Unregister(this);
 }
 
-int CLocalLogger::GetOutputLevel()
+std::string CLocalLogger::GetName()
 {
-    return CGlobalLogger::instance().GetOutputLevel(m_name);
+    return m_name;
 }
 
 void CLocalLogger::SetOutputLevel(int level)
@@ -54,35 +68,109 @@ void CLocalLogger::SetOutputLevel(int level)
 
 
 
+/// The state behind CGlobalLogger
+struct CGlobalLogger::Table
+{
+    /// What the output level is if not set specifically.
+    int m_default;
+    /// Type of containter for the output levels.
+    typedef std::map< std::string, int > OutputMap;
+    /// The map of loggers to logger levels.
+    OutputMap m_loggers;
+    /// Type of container for the registered local loggers.
+    typedef std::multimap< std::string, CLocalLogger * > LoggerMap;
+    /// Every local logger, by name.
+    LoggerMap m_registered;
+    /// Guards the tables above.
+    boost::mutex m_mutex;
+    Table() : m_default(0) { }
+};
+
+CGlobalLogger::Table & CGlobalLogger::GetTable()
+{
+    static Table table;
+    return table;
+}
+
 CGlobalLogger::CGlobalLogger()
 {
-    //Pass?
-    m_default = 0;
+    //Pass
 }
 
 void CGlobalLogger::SetGlobalLevel(int level)
 {
+    Table &t = GetTable();
+    boost::mutex::scoped_lock lock(t.m_mutex);
     //Iterate over the registered loggers and set the filter levels of each logger
-    OutputMap::iterator it;
-    for(it = m_loggers.begin(); it != m_loggers.end(); it++)
+    Table::OutputMap::iterator it;
+    for(it = t.m_loggers.begin(); it != t.m_loggers.end(); it++)
     {
         (*it).second = level;
     }
-    m_default = level;
+    Table::LoggerMap::iterator lit;
+    for(lit = t.m_registered.begin(); lit != t.m_registered.end(); lit++)
+    {
+        (*lit).second->m_level.store(level, boost::memory_order_relaxed);
+    }
+    t.m_default = level;
 }
 void CGlobalLogger::SetOutputLevel(std::string logger,int level)
 {
+    Table &t = GetTable();
+    boost::mutex::scoped_lock lock(t.m_mutex);
     //Fetch the specified logger and set its level to the one specified
-    m_loggers[logger] = level;
+    t.m_loggers[logger] = level;
+    std::pair<Table::LoggerMap::iterator, Table::LoggerMap::iterator> range =
+        t.m_registered.equal_range(logger);
+    for(; range.first != range.second; range.first++)
+    {
+        (*range.first).second->m_level.store(level,
+            boost::memory_order_relaxed);
+    }
+}
+
+void CGlobalLogger::Register(CLocalLogger *logger)
+{
+    Table &t = GetTable();
+    boost::mutex::scoped_lock lock(t.m_mutex);
+    // The logger starts at its name's level, or the default for a new name.
+    Table::OutputMap::iterator it = t.m_loggers.find(logger->m_name);
+    if(it == t.m_loggers.end())
+    {
+        it = t.m_loggers.insert(Table::OutputMap::value_type(logger->m_name,
+            t.m_default)).first;
+    }
+    logger->m_level.store((*it).second, boost::memory_order_relaxed);
+    t.m_registered.insert(Table::LoggerMap::value_type(logger->m_name, logger));
 }
 
+void CGlobalLogger::Unregister(CLocalLogger *logger)
+{
+    // The table was built before any logger that registered with it, so it
+    // is destroyed after them.
+    Table &t = GetTable();
+    boost::mutex::scoped_lock lock(t.m_mutex);
+    std::pair<Table::LoggerMap::iterator, Table::LoggerMap::iterator> range =
+        t.m_registered.equal_range(logger->m_name);
+    for(; range.first != range.second; range.first++)
+    {
+        if((*range.first).second == logger)
+        {
+            t.m_registered.erase(range.first);
+            break;
+        }
+    }
+}
 
 int CGlobalLogger::GetOutputLevel(std::string logger)
 {
-    OutputMap::iterator it = m_loggers.find(logger);
-    if(it == m_loggers.end())
+    Table &t = GetTable();
+    boost::mutex::scoped_lock lock(t.m_mutex);
+    Table::OutputMap::iterator it = t.m_loggers.find(logger);
+    if(it == t.m_loggers.end())
     {
-        m_loggers[logger] = m_default;
+        it = t.m_loggers.insert(Table::OutputMap::value_type(logger,
+            t.m_default)).first;
     }
-    return m_loggers[logger];
+    return (*it).second;
 }
@@ -31,12 +31,18 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "CDigest.hpp"
+#include "CClock.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
 #include <boost/foreach.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #define foreach BOOST_FOREACH
 
 #include <boost/property_tree/ptree.hpp>
@@ -124,26 +130,72 @@ namespace status_strings {
     }
 } // namespace status_strings
 
+///////////////////////////////////////////////////////////////////////////////
+/// @description The submessages of a message and its copies. The tree and
+///   the encoding are filled in on first use, under the mutex, since copies
+///   on different strands may both ask at once. Once both are filled in
+///   they only change through a message that holds the only reference.
+///////////////////////////////////////////////////////////////////////////////
+struct CMessage::Payload
+{
+    Payload() : decoded(true) { }
+    /// The submessages, valid once decoded is set
+    ptree tree;
+    /// The binary encoding of tree; empty until needed or after a change
+    std::string encoded;
+    /// Set unless tree still has to be built from encoded
+    bool decoded;
+    /// Guards filling in tree and encoded
+    boost::mutex mutex;
+};
+
+namespace {
+
+/// Encodes an empty submessage tree
+std::string EncodeEmptyTree()
+{
+    std::string encoded_;
+    CWireCodec::EncodeTree(ptree(), encoded_);
+    return encoded_;
+}
+
+/// The encoding of an empty submessage tree
+const std::string & EmptyEncoding()
+{
+    static const std::string encoded_ = EncodeEmptyTree();
+    return encoded_;
+}
+
+/// The tree returned for a message without submessages or properties
+const ptree & EmptyTree()
+{
+    static const ptree tree_;
+    return tree_;
+}
+
+} // unnamed namespace
 
 /// Initialize a new CMessage with a status type.
 CMessage::CMessage( CMessage::StatusType p_stat)
-    : m_status ( p_stat ), m_never_expires(false)
+    : m_sequenceno(0), m_status ( p_stat ), m_never_expires(false),
+      m_wireversion(0), m_digest(0), m_hasdigest(false)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 }
 
-/// Copy Constructor
+/// Copy Constructor; shares the header, properties and submessages
 CMessage::CMessage( const CMessage &p_m ) :
-    m_submessages( p_m.m_submessages ),
-    m_remotehost( p_m.m_remotehost ),
+    m_header( p_m.m_header ),
+    m_payload( p_m.m_payload ),
     m_sequenceno( p_m.m_sequenceno ),
-    m_srcUUID( p_m.m_srcUUID ),
     m_status( p_m.m_status ),
     m_properties( p_m.m_properties ),
-    m_protocol( p_m.m_protocol ),
     m_never_expires( p_m.m_never_expires ),
     m_sendtime( p_m.m_sendtime ),
-    m_expiretime( p_m.m_expiretime )
+    m_expiretime( p_m.m_expiretime ),
+    m_wireversion( p_m.m_wireversion ),
+    m_digest( p_m.m_digest ),
+    m_hasdigest( p_m.m_hasdigest )
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 }
@@ -151,16 +203,17 @@ CMessage::CMessage( const CMessage &p_m ) :
 /// Cmessage Equals operator
 CMessage& CMessage::operator = ( const CMessage &p_m )
 {
-    this->m_srcUUID = p_m.m_srcUUID;
+    this->m_header = p_m.m_header;
     this->m_status = p_m.m_status;
-    this->m_submessages = p_m.m_submessages;
-    this->m_remotehost = p_m.m_remotehost;
+    this->m_payload = p_m.m_payload;
     this->m_sequenceno = p_m.m_sequenceno;
     this->m_properties = p_m.m_properties;
-    this->m_protocol = p_m.m_protocol;
     this->m_sendtime = p_m.m_sendtime;
     this->m_expiretime = p_m.m_expiretime;
     this->m_never_expires = p_m.m_never_expires;
+    this->m_wireversion = p_m.m_wireversion;
+    this->m_digest = p_m.m_digest;
+    this->m_hasdigest = p_m.m_hasdigest;
     return *this;
 }
 
@@ -169,13 +222,13 @@ CMessage& CMessage::operator = ( const CMessage &p_m )
 /// Accessor for uuid
 std::string CMessage::GetSourceUUID() const
 {
-     return m_srcUUID;
+     return GetHeader().srcUUID;
 }
 
 /// Accessor for hostname
 remotehost CMessage::GetSourceHostname() const
 {
-    return m_remotehost;
+    return GetHeader().host;
 }
 
 /// Accessor for sequenceno
@@ -190,22 +243,178 @@ CMessage::StatusType CMessage::GetStatus() const
     return m_status;
 }
 
-/// Accessor for submessages
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::GetSubMessages
+/// @description Gives the caller submessages it may change. Submessages
+///   shared with another message are copied first, and the cached encoding
+///   and digest are dropped.
+/// @pre None
+/// @post This message holds the only reference to its submessages.
+/// @return The submessage tree.
+/// @limitations The reference must not be kept across a copy of the
+///   message; a change made through it afterwards would show in the copy.
+///////////////////////////////////////////////////////////////////////////////
 ptree& CMessage::GetSubMessages()
 {
-    return m_submessages;
+    if(!m_payload)
+    {
+        m_payload.reset(new Payload);
+    }
+    else if(!m_payload.unique())
+    {
+        boost::shared_ptr<Payload> payload_(new Payload);
+        payload_->tree = static_cast<const CMessage &>(*this).GetSubMessages();
+        m_payload = payload_;
+    }
+    else if(!m_payload->decoded)
+    {
+        static_cast<const CMessage &>(*this).GetSubMessages();
+    }
+    m_payload->encoded.clear();
+    m_hasdigest = false;
+    return m_payload->tree;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::GetSubMessages
+/// @description Gives read-only access to the submessages. For a received
+///   binary message the tree is built from the encoded bytes on the first
+///   call, once for the message and all of its copies.
+/// @pre None
+/// @post The tree has been built.
+/// @return The submessage tree.
+///////////////////////////////////////////////////////////////////////////////
+const ptree& CMessage::GetSubMessages() const
+{
+    if(!m_payload)
+    {
+        return EmptyTree();
+    }
+    boost::lock_guard<boost::mutex> lock_(m_payload->mutex);
+    if(!m_payload->decoded)
+    {
+        // The bytes were validated when the datagram was decoded, so this
+        // cannot fail.
+        const char * cur_ = m_payload->encoded.data();
+        CWireCodec::DecodeTree(cur_, cur_ + m_payload->encoded.size(),
+            m_payload->tree);
+        m_payload->decoded = true;
+    }
+    return m_payload->tree;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::GetSubMessageKeys
+/// @description Lists the top level submessage keys in order, duplicates
+///   included. For a received binary message the keys are read straight from
+///   the encoded bytes, so the tree is not built.
+/// @pre None
+/// @post None
+/// @return The key of each top level submessage.
+///////////////////////////////////////////////////////////////////////////////
+std::vector<std::string> CMessage::GetSubMessageKeys() const
+{
+    std::vector<std::string> keys;
+    if(!m_payload)
+    {
+        return keys;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock_(m_payload->mutex);
+        if(!m_payload->decoded)
+        {
+            CWireCodec::TreeKeys(m_payload->encoded.data(),
+                m_payload->encoded.size(), keys);
+            return keys;
+        }
+    }
+    ptree::const_iterator it;
+    for(it = m_payload->tree.begin(); it != m_payload->tree.end(); it++)
+    {
+        keys.push_back(it->first);
+    }
+    return keys;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::GetEncodedSubMessages
+/// @description Gives the binary encoding of the submessages. It is built
+///   on the first call and kept until the submessages change, so a message
+///   sent to many peers, or digested and then sent, is encoded once.
+/// @pre None
+/// @post The encoding is cached with the submessages.
+/// @return The encoded submessage tree.
+///////////////////////////////////////////////////////////////////////////////
+const std::string & CMessage::GetEncodedSubMessages() const
+{
+    if(!m_payload)
+    {
+        return EmptyEncoding();
+    }
+    boost::lock_guard<boost::mutex> lock_(m_payload->mutex);
+    if(m_payload->encoded.empty())
+    {
+        CWireCodec::EncodeTree(m_payload->tree, m_payload->encoded);
+    }
+    return m_payload->encoded;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::SetEncodedSubMessages
+/// @description Replaces the submessages with the encoding of a received
+///   tree, which is only decoded once something asks for the tree.
+/// @pre The bytes have been checked with CWireCodec::SkipTree.
+/// @post The message holds new submessages of its own.
+/// @param p_data The encoded tree
+/// @param p_length The length of the encoding
+///////////////////////////////////////////////////////////////////////////////
+void CMessage::SetEncodedSubMessages(const char * p_data, std::size_t p_length)
+{
+    m_payload.reset(new Payload);
+    m_payload->encoded.assign(p_data, p_length);
+    m_payload->decoded = false;
+    m_hasdigest = false;
+}
+
+/// The source fields, with the empty header for a new message
+const CMessage::Header & CMessage::GetHeader() const
+{
+    static const Header empty_;
+    return m_header ? *m_header : empty_;
+}
+
+/// The source fields, copied first if another message shares them
+CMessage::Header & CMessage::EditHeader()
+{
+    if(!m_header)
+    {
+        m_header.reset(new Header);
+    }
+    else if(!m_header.unique())
+    {
+        m_header.reset(new Header(*m_header));
+    }
+    return *m_header;
 }
 
-/// Setter for uuid
+/// Setter for uuid. A message stamped with the uuid it already carries
+/// keeps sharing its header.
 void CMessage::SetSourceUUID(std::string uuid)
 {
-    m_srcUUID = uuid;
+    if(GetHeader().srcUUID != uuid)
+    {
+        EditHeader().srcUUID = uuid;
+    }
 }
 
 /// Setter for hostname
 void CMessage::SetSourceHostname(remotehost hostname)
 {
-    m_remotehost = hostname;
+    const remotehost &host_ = GetHeader().host;
+    if(host_.hostname != hostname.hostname || host_.port != hostname.port)
+    {
+        EditHeader().host = hostname;
+    }
 }
 
 /// Setter for sequenceno
@@ -223,13 +432,15 @@ void CMessage::SetStatus(StatusType status)
 /// Setter for the timestamp
 void CMessage::SetSendTimestampNow()
 {
-    m_sendtime = boost::posix_time::microsec_clock::universal_time();
+    m_sendtime = CClock::Now();
+    m_hasdigest = false;
 }
 
 /// Setter b for the timestamp
 void CMessage::SetSendTimestamp(boost::posix_time::ptime p)
 {
     m_sendtime = p;
+    m_hasdigest = false;
 }
 
 /// Getter for the send time
@@ -271,7 +482,7 @@ void CMessage::SetNeverExpires(bool set)
 /// Setter b for the expiration time
 void CMessage::SetExpireTimeFromNow(boost::posix_time::time_duration t)
 {
-    m_expiretime = boost::posix_time::microsec_clock::universal_time();
+    m_expiretime = CClock::Now();
     m_expiretime += t;
 }
 
@@ -284,43 +495,92 @@ boost::posix_time::ptime CMessage::GetExpireTime() const
 ///Test to see if a message is expired.
 bool CMessage::IsExpired() const
 {
-    return (m_expiretime < boost::posix_time::microsec_clock::universal_time());
+    return (m_expiretime < CClock::Now());
 }
 
 /// Set the protocol properties
 void CMessage::SetProtocolProperties(ptree x)
 {
-    m_properties = x;
+    boost::shared_ptr<ptree> properties_(new ptree);
+    properties_->swap(x);
+    m_properties = properties_;
 }
 
 /// Get the protocol properties
-ptree CMessage::GetProtocolProperties() const
+const ptree& CMessage::GetProtocolProperties() const
 {
-    return m_properties;
+    return m_properties ? *m_properties : EmptyTree();
 }
 
 /// Getter for the protocol
 std::string CMessage::GetProtocol() const
 {
-    return m_protocol;
+    return GetHeader().protocol;
 }
 
 // Protocol Setter
 void CMessage::SetProtocol(std::string protocol)
 {
-    m_protocol = protocol;
+    if(GetHeader().protocol != protocol)
+    {
+        EditHeader().protocol = protocol;
+    }
 }
 
-/// Get the message hash!
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMessage::GetHash
+/// @description Digests the binary encoding of the submessages, salted with
+///   the send time, using the algorithm set by the message-digest option.
+///   A received binary message is digested straight from its undecoded
+///   bytes, and a message built here from the encoding it is sent with.
+///   The result is kept, so matching ACKs against a message costs an
+///   integer comparison after the first call.
+/// @pre None
+/// @post The digest is cached in the message.
+/// @return The digest, identical on every node that uses the same
+///   algorithm.
+///////////////////////////////////////////////////////////////////////////////
 size_t CMessage::GetHash() const
+{
+    if(!m_hasdigest)
+    {
+        CDigest::Algorithm algorithm_ = CDigest::XXHASH64;
+        boost::uint64_t salt_ = CWireCodec::ToMicroseconds(m_sendtime);
+        if(CGlobalConfiguration::instance().GetStrongDigest())
+        {
+            algorithm_ = CDigest::SIPHASH24;
+        }
+        const std::string &encoded_ = GetEncodedSubMessages();
+        m_digest = CDigest::Compute(algorithm_, encoded_.data(),
+            encoded_.size(), salt_);
+        m_hasdigest = true;
+    }
+    return m_digest;
+}
+
+/// Get the hash brokers before wire version 2 use: the submessages written
+/// as XML with the send time appended, through boost::hash.
+size_t CMessage::GetLegacyHash() const
 {
     std::stringstream ss;
     boost::hash<std::string> string_hash;
-    write_xml(ss,m_submessages);
+    write_xml(ss,GetSubMessages());
     ss<<GetSendTimestamp();
     return string_hash(ss.str());
 }
 
+/// Binary wire version the sender understands, 0 for XML only
+unsigned int CMessage::GetWireVersion() const
+{
+    return m_wireversion;
+}
+
+/// Setter for the advertised binary wire version
+void CMessage::SetWireVersion(unsigned int version)
+{
+    m_wireversion = version;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CMessage::Load
 /// @description From some stream source parse and load a CMessage.
@@ -353,7 +613,7 @@ bool CMessage::Load( std::istream &p_is )
     {
         Logger.Debug << "Loading pt." << std::endl;
         *this = CMessage( pt );
-        Logger.Debug << "UUID: " << m_srcUUID << std::endl
+        Logger.Debug << "UUID: " << GetSourceUUID() << std::endl
                 << "Status: "
                 << status_strings::toString( m_status )
         << std::endl;
@@ -403,16 +663,23 @@ CMessage::operator ptree ()
     using boost::property_tree::ptree;
     ptree pt;
 
-    pt.put("message.source", m_srcUUID );
-    pt.put("message.hostname", m_remotehost.hostname );
-    pt.put("message.port",m_remotehost.port );
+    const Header &header_ = GetHeader();
+    pt.put("message.source", header_.srcUUID );
+    pt.put("message.hostname", header_.host.hostname );
+    pt.put("message.port", header_.host.port );
     pt.put("message.sequenceno", m_sequenceno );
     pt.put("message.status", m_status  );
     pt.put("message.sendtime",m_sendtime );
     pt.put("message.expiretime",m_expiretime );
-    pt.put("message.protocol",m_protocol );    
-    pt.add_child("message.properties", m_properties );
-    pt.add_child("message.submessages", m_submessages );
+    pt.put("message.protocol", header_.protocol );
+    if(m_wireversion != 0)
+    {
+        // Older nodes ignore unknown header fields, so this advertisement
+        // is how a peer learns it may switch us to the binary encoding.
+        pt.put("message.wire", m_wireversion );
+    }
+    pt.add_child("message.properties", GetProtocolProperties() );
+    pt.add_child("message.submessages", GetSubMessages() );
 
     return pt;
 }
@@ -424,6 +691,8 @@ CMessage::operator ptree ()
 /// @post The CMessage has been initalized from a ptree.
 ///////////////////////////////////////////////////////////////////////////////
 CMessage::CMessage( const ptree &pt )
+    : m_header(new Header), m_never_expires(false), m_digest(0),
+      m_hasdigest(false)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     try
@@ -431,11 +700,11 @@ CMessage::CMessage( const ptree &pt )
         std::string time_tmp;
         // Get the source host's ID and store it in the m_src variable.
         // An exception is thrown if "message.source" does not exist.
-        m_srcUUID = pt.get< std::string >("message.source");
-        m_remotehost.hostname = pt.get< std::string >("message.hostname");
-        m_remotehost.port = pt.get< std::string >("message.port");
+        m_header->srcUUID = pt.get< std::string >("message.source");
+        m_header->host.hostname = pt.get< std::string >("message.hostname");
+        m_header->host.port = pt.get< std::string >("message.port");
         m_sequenceno = pt.get< unsigned int >("message.sequenceno");
-        m_protocol = pt.get< std::string >("message.protocol");
+        m_header->protocol = pt.get< std::string >("message.protocol");
         m_sendtime = pt.get< boost::posix_time::ptime >("message.sendtime");
         try
         {
@@ -451,12 +720,13 @@ CMessage::CMessage( const ptree &pt )
         }
         m_status = static_cast< StatusType >
             (pt.get< unsigned int >("message.status"));
+        m_wireversion = pt.get< unsigned int >("message.wire", 0);
 
         // Iterate over the "message.modules" section and store all found
         // in the m_modules set. These indicate sub-ptrees that algorithm
         // modules have added.
-        m_submessages = pt.get_child("message.submessages");
-        m_properties = pt.get_child("message.properties");
+        GetSubMessages() = pt.get_child("message.submessages");
+        SetProtocolProperties(pt.get_child("message.properties"));
 
     }
     catch( boost::property_tree::ptree_error &e )
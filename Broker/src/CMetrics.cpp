@@ -0,0 +1,386 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CMetrics.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the registry of runtime counters, gauges
+///   and latency histograms
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CMetrics.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <sstream>
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+/// Quantiles written for each histogram.
+const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/// Bits below the leading one that pick the sub-bucket.
+const unsigned int SUB_BITS = 3;
+
+/// Metrics of one kind: name, then labels, then the metric.
+template <typename T>
+struct Family
+{
+    typedef std::map<std::string, boost::shared_ptr<T> > ByLabels;
+    typedef std::map<std::string, ByLabels> ByName;
+};
+
+/// Finds or makes a metric; the caller holds the registry lock.
+template <typename T>
+T & Find(typename Family<T>::ByName &p_family, const std::string &p_name,
+    const std::string &p_labels)
+{
+    boost::shared_ptr<T> &metric_ = p_family[p_name][p_labels];
+    if( !metric_ )
+    {
+        metric_.reset( new T );
+    }
+    return *metric_;
+}
+
+/// Writes {labels} with an extra label, or nothing if both are empty.
+void WriteLabels(std::ostream &p_out, const std::string &p_labels,
+    const std::string &p_extra = "")
+{
+    if( p_labels.empty() && p_extra.empty() )
+    {
+        return;
+    }
+    p_out << "{" << p_labels;
+    if( !p_labels.empty() && !p_extra.empty() )
+    {
+        p_out << ",";
+    }
+    p_out << p_extra << "}";
+}
+
+} // unnamed namespace
+
+/// Every metric, by name and then labels
+struct CMetrics::Registry
+{
+    /// Guards the maps, not the metrics in them
+    boost::mutex mutex;
+    Family<Counter>::ByName counters;
+    Family<Gauge>::ByName gauges;
+    Family<Histogram>::ByName histograms;
+};
+
+const unsigned int CMetrics::Histogram::SUB_BUCKETS;
+const unsigned int CMetrics::Histogram::BUCKETS;
+
+/// The registry, built on first use
+CMetrics::Registry & CMetrics::GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+/// An empty histogram
+CMetrics::Histogram::Histogram()
+    : m_count(0),
+      m_sum(0),
+      m_max(0)
+{
+    for( unsigned int i = 0; i < BUCKETS; i++ )
+    {
+        m_buckets[i].store( 0, boost::memory_order_relaxed );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Histogram::GetBucket
+/// @description Finds the bucket for a value. Values below SUB_BUCKETS have
+///   a bucket each; above that the leading one picks the power of two and
+///   the next SUB_BITS bits the sub-bucket within it.
+/// @pre None
+/// @post None
+/// @param p_micros The value.
+/// @return The bucket index, below BUCKETS.
+///////////////////////////////////////////////////////////////////////////////
+unsigned int CMetrics::Histogram::GetBucket(boost::uint64_t p_micros)
+{
+    if( p_micros < SUB_BUCKETS )
+    {
+        return p_micros;
+    }
+    unsigned int msb_ = 0;
+    for( unsigned int step_ = 32; step_ > 0; step_ >>= 1 )
+    {
+        if( p_micros >> ( msb_ + step_ ) )
+        {
+            msb_ += step_;
+        }
+    }
+    unsigned int sub_ = ( p_micros >> ( msb_ - SUB_BITS ) ) & ( SUB_BUCKETS - 1 );
+    return ( msb_ - SUB_BITS + 1 ) * SUB_BUCKETS + sub_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Histogram::GetBucketLimit
+/// @description The largest value GetBucket puts in a bucket.
+/// @pre p_bucket is below BUCKETS.
+/// @post None
+/// @param p_bucket The bucket index.
+/// @return The bucket's upper bound, inclusive.
+///////////////////////////////////////////////////////////////////////////////
+boost::uint64_t CMetrics::Histogram::GetBucketLimit(unsigned int p_bucket)
+{
+    if( p_bucket < SUB_BUCKETS )
+    {
+        return p_bucket;
+    }
+    unsigned int shift_ = p_bucket / SUB_BUCKETS - 1;
+    boost::uint64_t first_ =
+        boost::uint64_t( SUB_BUCKETS + p_bucket % SUB_BUCKETS ) << shift_;
+    return first_ + ( ( boost::uint64_t(1) << shift_ ) - 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Histogram::Record
+/// @description Counts a value. Safe to call from any thread without a lock.
+/// @pre None
+/// @post The value is counted in its bucket, the sum and the maximum.
+/// @param p_micros The value, in microseconds.
+///////////////////////////////////////////////////////////////////////////////
+void CMetrics::Histogram::Record(boost::uint64_t p_micros)
+{
+    m_buckets[GetBucket( p_micros )].fetch_add( 1, boost::memory_order_relaxed );
+    m_count.fetch_add( 1, boost::memory_order_relaxed );
+    m_sum.fetch_add( p_micros, boost::memory_order_relaxed );
+    boost::uint64_t max_ = m_max.load( boost::memory_order_relaxed );
+    while( p_micros > max_ && !m_max.compare_exchange_weak( max_, p_micros,
+        boost::memory_order_relaxed ) )
+    {
+    }
+}
+
+/// Counts a duration in microseconds
+void CMetrics::Histogram::Record(
+    const boost::posix_time::time_duration &p_duration)
+{
+    boost::int64_t micros_ = p_duration.total_microseconds();
+    Record( static_cast<boost::uint64_t>( micros_ > 0 ? micros_ : 0 ) );
+}
+
+/// Values recorded
+boost::uint64_t CMetrics::Histogram::GetCount() const
+{
+    return m_count.load( boost::memory_order_relaxed );
+}
+
+/// Sum of the values recorded
+boost::uint64_t CMetrics::Histogram::GetSum() const
+{
+    return m_sum.load( boost::memory_order_relaxed );
+}
+
+/// Largest value recorded
+boost::uint64_t CMetrics::Histogram::GetMax() const
+{
+    return m_max.load( boost::memory_order_relaxed );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Histogram::GetQuantile
+/// @description Walks the buckets to the one holding the quantile. Values
+///   recorded during the walk may or may not be seen.
+/// @pre None
+/// @post None
+/// @param p_quantile A fraction from 0 to 1.
+/// @return The upper bound of the bucket the quantile falls in, but no more
+///   than the largest value recorded; 0 if nothing was recorded.
+///////////////////////////////////////////////////////////////////////////////
+boost::uint64_t CMetrics::Histogram::GetQuantile(double p_quantile) const
+{
+    boost::uint64_t total_ = 0;
+    for( unsigned int i = 0; i < BUCKETS; i++ )
+    {
+        total_ += m_buckets[i].load( boost::memory_order_relaxed );
+    }
+    if( total_ == 0 )
+    {
+        return 0;
+    }
+    boost::uint64_t rank_ = static_cast<boost::uint64_t>( p_quantile * total_ );
+    if( rank_ >= total_ )
+    {
+        rank_ = total_ - 1;
+    }
+    boost::uint64_t seen_ = 0;
+    for( unsigned int i = 0; i < BUCKETS; i++ )
+    {
+        seen_ += m_buckets[i].load( boost::memory_order_relaxed );
+        if( seen_ > rank_ )
+        {
+            return std::min( GetBucketLimit( i ), GetMax() );
+        }
+    }
+    return GetMax();
+}
+
+/// The counter with a name and labels, made the first time it is asked
+CMetrics::Counter & CMetrics::GetCounter(const std::string &p_name,
+    const std::string &p_labels)
+{
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+    return Find<Counter>( registry_.counters, p_name, p_labels );
+}
+
+/// The gauge with a name and labels, made the first time it is asked
+CMetrics::Gauge & CMetrics::GetGauge(const std::string &p_name,
+    const std::string &p_labels)
+{
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+    return Find<Gauge>( registry_.gauges, p_name, p_labels );
+}
+
+/// The histogram with a name and labels, made the first time it is asked
+CMetrics::Histogram & CMetrics::GetHistogram(const std::string &p_name,
+    const std::string &p_labels)
+{
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+    return Find<Histogram>( registry_.histograms, p_name, p_labels );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Label
+/// @description Formats a label, escaping the value as the text format
+///   requires. Join several with commas.
+/// @pre p_name is a valid label name.
+/// @post None
+/// @param p_name The label name.
+/// @param p_value The label value.
+/// @return The label as name="value".
+///////////////////////////////////////////////////////////////////////////////
+std::string CMetrics::Label(const std::string &p_name,
+    const std::string &p_value)
+{
+    std::string label_ = p_name + "=\"";
+    for( std::size_t i = 0; i < p_value.size(); i++ )
+    {
+        if( p_value[i] == '\\' || p_value[i] == '"' )
+            label_ += '\\';
+        if( p_value[i] == '\n' )
+            label_ += "\\n";
+        else
+            label_ += p_value[i];
+    }
+    return label_ + "\"";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetrics::Write
+/// @description Writes every metric in the Prometheus text format. Each
+///   histogram is written as a summary with a few quantiles, and its
+///   largest value as name_max.
+/// @pre None
+/// @post None
+/// @param p_out The stream to write to.
+///////////////////////////////////////////////////////////////////////////////
+void CMetrics::Write(std::ostream &p_out)
+{
+    Registry &registry_ = GetRegistry();
+    boost::lock_guard< boost::mutex > scopedLock_( registry_.mutex );
+
+    Family<Counter>::ByName::const_iterator cit_;
+    for( cit_ = registry_.counters.begin(); cit_ != registry_.counters.end();
+        ++cit_ )
+    {
+        p_out << "# TYPE " << cit_->first << " counter\n";
+        Family<Counter>::ByLabels::const_iterator it_;
+        for( it_ = cit_->second.begin(); it_ != cit_->second.end(); ++it_ )
+        {
+            p_out << cit_->first;
+            WriteLabels( p_out, it_->first );
+            p_out << " " << it_->second->Get() << "\n";
+        }
+    }
+
+    Family<Gauge>::ByName::const_iterator git_;
+    for( git_ = registry_.gauges.begin(); git_ != registry_.gauges.end();
+        ++git_ )
+    {
+        p_out << "# TYPE " << git_->first << " gauge\n";
+        Family<Gauge>::ByLabels::const_iterator it_;
+        for( it_ = git_->second.begin(); it_ != git_->second.end(); ++it_ )
+        {
+            p_out << git_->first;
+            WriteLabels( p_out, it_->first );
+            p_out << " " << it_->second->Get() << "\n";
+        }
+    }
+
+    Family<Histogram>::ByName::const_iterator hit_;
+    for( hit_ = registry_.histograms.begin();
+        hit_ != registry_.histograms.end(); ++hit_ )
+    {
+        const std::string &name_ = hit_->first;
+        p_out << "# TYPE " << name_ << " summary\n";
+        Family<Histogram>::ByLabels::const_iterator it_;
+        for( it_ = hit_->second.begin(); it_ != hit_->second.end(); ++it_ )
+        {
+            const Histogram &h_ = *it_->second;
+            for( std::size_t i = 0; i < sizeof(QUANTILES) / sizeof(double);
+                i++ )
+            {
+                std::ostringstream quantile_;
+                quantile_ << "quantile=\"" << QUANTILES[i] << "\"";
+                p_out << name_;
+                WriteLabels( p_out, it_->first, quantile_.str() );
+                p_out << " " << h_.GetQuantile( QUANTILES[i] ) << "\n";
+            }
+            p_out << name_ << "_sum";
+            WriteLabels( p_out, it_->first );
+            p_out << " " << h_.GetSum() << "\n";
+            p_out << name_ << "_count";
+            WriteLabels( p_out, it_->first );
+            p_out << " " << h_.GetCount() << "\n";
+            p_out << name_ << "_max";
+            WriteLabels( p_out, it_->first );
+            p_out << " " << h_.GetMax() << "\n";
+        }
+    }
+}
+
+    } // namespace broker
+} // namespace freedm
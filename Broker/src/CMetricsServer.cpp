@@ -0,0 +1,223 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CMetricsServer.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the loopback endpoint metrics are scraped
+///   from
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CMetricsServer.hpp"
+#include "CMetrics.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <sstream>
+#include <string>
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+/// Most bytes of request read before answering anyway.
+const std::size_t MAX_REQUEST = 8192;
+
+} // unnamed namespace
+
+/// One scrape: reads the request headers, writes the metrics and closes.
+class CMetricsServer::Session
+    : public boost::enable_shared_from_this<Session>,
+      private boost::noncopyable
+{
+public:
+    explicit Session(boost::asio::io_service &p_ios)
+        : m_socket(p_ios), m_timer(p_ios), m_request(MAX_REQUEST) { }
+    boost::asio::ip::tcp::socket & GetSocket() { return m_socket; }
+    void Start();
+private:
+    void HandleRead(const boost::system::error_code &p_error);
+    void HandleWrite(const boost::system::error_code &p_error);
+    void HandleTimeout(const boost::system::error_code &p_error);
+    boost::asio::ip::tcp::socket m_socket;
+    boost::asio::deadline_timer m_timer;
+    boost::asio::streambuf m_request;
+    std::string m_response;
+};
+
+const unsigned int CMetricsServer::REQUEST_TIMEOUT_MS;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetricsServer::Session::Start
+/// @description Reads up to the blank line that ends the request headers.
+///   The session keeps itself alive through the handlers it has pending.
+/// @pre The socket is connected.
+/// @post A read and a timeout are pending.
+///////////////////////////////////////////////////////////////////////////////
+void CMetricsServer::Session::Start()
+{
+    m_timer.expires_from_now(
+        boost::posix_time::milliseconds( REQUEST_TIMEOUT_MS ) );
+    m_timer.async_wait( boost::bind( &Session::HandleTimeout,
+        shared_from_this(), boost::asio::placeholders::error ) );
+    boost::asio::async_read_until( m_socket, m_request, "\r\n\r\n",
+        boost::bind( &Session::HandleRead, shared_from_this(),
+        boost::asio::placeholders::error ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetricsServer::Session::HandleRead
+/// @description Answers the request with the current metrics. A request
+///   that ends early or is too long is answered too, so a plain TCP client
+///   that sends anything and shuts down its side also gets the text.
+/// @pre None
+/// @post The response is being written.
+/// @param p_error Why the read finished.
+///////////////////////////////////////////////////////////////////////////////
+void CMetricsServer::Session::HandleRead(const boost::system::error_code &)
+{
+    m_timer.cancel();
+    std::ostringstream body_;
+    CMetrics::Write( body_ );
+    std::ostringstream response_;
+    response_ << "HTTP/1.0 200 OK\r\n"
+              << "Content-Type: text/plain; version=0.0.4\r\n"
+              << "Content-Length: " << body_.str().size() << "\r\n"
+              << "Connection: close\r\n\r\n" << body_.str();
+    m_response = response_.str();
+    boost::asio::async_write( m_socket, boost::asio::buffer( m_response ),
+        boost::bind( &Session::HandleWrite, shared_from_this(),
+        boost::asio::placeholders::error ) );
+}
+
+/// Closes the connection once the response is out
+void CMetricsServer::Session::HandleWrite(const boost::system::error_code &)
+{
+    boost::system::error_code ignored_;
+    m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ignored_ );
+    m_socket.close( ignored_ );
+}
+
+/// Gives up on a scraper that never finishes its request
+void CMetricsServer::Session::HandleTimeout(
+    const boost::system::error_code &p_error)
+{
+    if( !p_error )
+    {
+        boost::system::error_code ignored_;
+        m_socket.close( ignored_ );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetricsServer::CMetricsServer
+/// @description Binds the loopback port. Only the local host can connect.
+/// @pre None
+/// @post The port is bound; nothing is accepted until Start.
+/// @param p_ios The io_service the sessions run on.
+/// @param p_port The TCP port, or 0 to pick a free one.
+/// @limitations Throws boost::system::system_error if the port is taken.
+///////////////////////////////////////////////////////////////////////////////
+CMetricsServer::CMetricsServer(boost::asio::io_service &p_ios,
+    unsigned short p_port)
+    : m_ios(p_ios),
+      m_acceptor(p_ios, boost::asio::ip::tcp::endpoint(
+          boost::asio::ip::address_v4::loopback(), p_port)),
+      m_strand(p_ios)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+}
+
+/// Starts accepting scrapes
+void CMetricsServer::Start()
+{
+    Logger.Info << "Serving metrics on 127.0.0.1:" << GetPort() << std::endl;
+    m_strand.dispatch( boost::bind( &CMetricsServer::Accept, this ) );
+}
+
+/// Stops accepting; scrapes in progress finish on their own
+void CMetricsServer::Stop()
+{
+    m_strand.dispatch( boost::bind( &CMetricsServer::HandleStop, this ) );
+}
+
+/// Closes the listening socket, on the strand
+void CMetricsServer::HandleStop()
+{
+    boost::system::error_code ignored_;
+    m_acceptor.close( ignored_ );
+}
+
+/// The port being listened on
+unsigned short CMetricsServer::GetPort() const
+{
+    return m_acceptor.local_endpoint().port();
+}
+
+/// Waits for the next scraper
+void CMetricsServer::Accept()
+{
+    SessionPtr session_( new Session( m_ios ) );
+    m_acceptor.async_accept( session_->GetSocket(), m_strand.wrap(
+        boost::bind( &CMetricsServer::HandleAccept, this, session_,
+        boost::asio::placeholders::error ) ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CMetricsServer::HandleAccept
+/// @description Starts the accepted session and waits for another.
+/// @pre None
+/// @post Another accept is pending unless the server was stopped.
+/// @param p_session The session whose socket was accepted into.
+/// @param p_error Whether the accept worked.
+///////////////////////////////////////////////////////////////////////////////
+void CMetricsServer::HandleAccept(SessionPtr p_session,
+    const boost::system::error_code &p_error)
+{
+    if( p_error == boost::asio::error::operation_aborted ||
+        !m_acceptor.is_open() )
+    {
+        return;
+    }
+    if( !p_error )
+    {
+        p_session->Start();
+    }
+    else
+    {
+        Logger.Warn << "Metrics accept failed: " << p_error.message()
+                    << std::endl;
+    }
+    Accept();
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -0,0 +1,251 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CReadQueue.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the bounded queue of messages waiting for
+///   a module
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CReadQueue.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/property_tree/exceptions.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+/// Messages handled per drain before the strand is given back, so the
+/// module's timers are not starved by a long queue.
+const std::size_t DRAIN_BATCH = 16;
+
+} // unnamed namespace
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReadQueue::CReadQueue
+/// @description Creates an empty queue for a module.
+/// @pre None
+/// @post The queue is empty and no drain is scheduled.
+/// @param p_module The name the module registered under, to label its
+///   metrics.
+/// @param p_handler The module's read handler.
+/// @param p_strand The strand the module's handlers run on.
+/// @param p_capacity Messages at which the overflow policy applies, or 0 to
+///   let the queue grow without limit.
+/// @param p_policy What Push does once the queue is at capacity.
+///////////////////////////////////////////////////////////////////////////////
+CReadQueue::CReadQueue(const std::string &p_module, IReadHandler *p_handler,
+    boost::asio::io_service::strand &p_strand, std::size_t p_capacity,
+    OverflowPolicy p_policy)
+    : m_handler(p_handler),
+      m_strand(p_strand),
+      m_capacity(p_capacity),
+      m_policy(p_policy),
+      m_scheduled(false),
+      m_waitTime(CMetrics::GetHistogram("freedm_dispatch_wait_microseconds",
+          CMetrics::Label("module", p_module))),
+      m_handlerTime(CMetrics::GetHistogram(
+          "freedm_dispatch_handler_microseconds",
+          CMetrics::Label("module", p_module))),
+      m_dropped(CMetrics::GetCounter("freedm_dispatch_dropped_total",
+          CMetrics::Label("module", p_module)))
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_stats.depth = 0;
+    m_stats.maxDepth = 0;
+    m_stats.handled = 0;
+    m_stats.dropped = 0;
+    m_stats.handlerMicros = 0;
+    m_stats.maxHandlerMicros = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReadQueue::Push
+/// @description Adds a message for the module. Only the first message pushed
+///   into an idle queue posts to the module's strand; the rest are picked up
+///   by the drain already pending.
+/// @pre p_msg's submessages have been built, so copies share nothing that
+///   is changed later.
+/// @post The message is queued unless the policy discarded it.
+/// @param p_msg The message to queue.
+/// @return false if the DROP_NEWEST policy discarded p_msg.
+///////////////////////////////////////////////////////////////////////////////
+bool CReadQueue::Push(const CMessage &p_msg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    bool post_ = false;
+
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        if( m_capacity != 0 && m_messages.size() >= m_capacity )
+        {
+            if( m_policy == DROP_NEWEST )
+            {
+                m_stats.dropped++;
+                m_dropped.Add();
+                Logger.Notice << "Module queue full, dropped newest message"
+                              << std::endl;
+                return false;
+            }
+            else if( m_policy == DROP_OLDEST )
+            {
+                m_messages.pop_front();
+                m_stats.dropped++;
+                m_dropped.Add();
+                Logger.Notice << "Module queue full, dropped oldest message"
+                              << std::endl;
+            }
+        }
+        Waiting waiting_;
+        waiting_.msg = p_msg;
+        waiting_.queued = boost::posix_time::microsec_clock::universal_time();
+        m_messages.push_back( waiting_ );
+        m_stats.depth = m_messages.size();
+        m_stats.maxDepth = std::max( m_stats.maxDepth, m_stats.depth );
+        if( !m_scheduled )
+        {
+            m_scheduled = true;
+            post_ = true;
+        }
+    }
+    if( post_ )
+    {
+        m_strand.post( boost::bind( &CReadQueue::Drain, shared_from_this() ) );
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReadQueue::IsFull
+/// @description Tells the listener whether to hold off reading. Only a
+///   BACKPRESSURE queue is ever full; the other policies make room instead.
+/// @pre None
+/// @post None
+/// @return true if the queue holds its capacity or more messages.
+///////////////////////////////////////////////////////////////////////////////
+bool CReadQueue::IsFull() const
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    return m_policy == BACKPRESSURE && m_capacity != 0 &&
+        m_messages.size() >= m_capacity;
+}
+
+/// A copy of the counters
+CReadQueue::Stats CReadQueue::GetStats() const
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    return m_stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReadQueue::ParsePolicy
+/// @description Reads an overflow policy from its configuration name:
+///   backpressure, drop-oldest or drop-newest.
+/// @pre None
+/// @post p_policy is set if the name was recognized.
+/// @param p_name The name to read.
+/// @param p_policy Set to the named policy.
+/// @return true if p_name named a policy.
+///////////////////////////////////////////////////////////////////////////////
+bool CReadQueue::ParsePolicy(const std::string &p_name,
+    OverflowPolicy &p_policy)
+{
+    if( p_name == "backpressure" )
+        p_policy = BACKPRESSURE;
+    else if( p_name == "drop-oldest" )
+        p_policy = DROP_OLDEST;
+    else if( p_name == "drop-newest" )
+        p_policy = DROP_NEWEST;
+    else
+        return false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReadQueue::Drain
+/// @description Gives waiting messages to the read handler, timing each
+///   call. After DRAIN_BATCH messages the rest are left for another drain
+///   posted behind whatever else is waiting on the strand.
+/// @pre Called on the module's strand with m_scheduled set.
+/// @post The queue is empty and m_scheduled is clear, or another drain has
+///   been posted.
+///////////////////////////////////////////////////////////////////////////////
+void CReadQueue::Drain()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    using namespace boost::posix_time;
+
+    for( std::size_t i = 0; i < DRAIN_BATCH; i++ )
+    {
+        CMessage msg_;
+        ptime queued_;
+        {
+            boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+            if( m_messages.empty() )
+            {
+                m_scheduled = false;
+                return;
+            }
+            msg_ = m_messages.front().msg;
+            queued_ = m_messages.front().queued;
+            m_messages.pop_front();
+            m_stats.depth = m_messages.size();
+        }
+
+        ptime start_ = microsec_clock::universal_time();
+        m_waitTime.Record( start_ - queued_ );
+        try
+        {
+            m_handler->HandleRead( msg_ );
+        }
+        catch( boost::property_tree::ptree_bad_path &e )
+        {
+            Logger.Warn<<"Module failed to read message"<<std::endl;
+        }
+        unsigned long micros_ =
+            (microsec_clock::universal_time() - start_).total_microseconds();
+        m_handlerTime.Record( micros_ );
+
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        m_stats.handled++;
+        m_stats.handlerMicros += micros_;
+        m_stats.maxHandlerMicros = std::max( m_stats.maxHandlerMicros, micros_ );
+    }
+    m_strand.post( boost::bind( &CReadQueue::Drain, shared_from_this() ) );
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -38,6 +38,8 @@
 #include "CConnectionManager.hpp"
 #include "CMessage.hpp"
 #include "RequestParser.hpp"
+#include "CDatagramBatch.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
@@ -51,11 +53,22 @@ using boost::property_tree::ptree;
 
 namespace freedm {
     namespace broker {
+
+namespace {
+
+/// Datagrams held for a peer whose address is still being looked up. The
+/// protocols resend anything dropped past this once the socket connects.
+const std::size_t MAX_HELD_DATAGRAMS = 1024;
+
+} // unnamed namespace
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @fn CReliableConnection::CReliableConnection
 /// @description: Constructor for the CGenericConnection object.
 /// @pre: An initialized socket is ready to be converted to a connection.
 /// @post: A new CConnection object is initialized.
+/// @limitations: Interns uuid with p_manager, which takes the manager's lock
+///   unless uuid already has a peer ID.
 /// @param p_ioService: The socket to use for the connection.
 /// @param p_manager: The related connection manager that tracks this object.
 /// @param p_dispatch: The dispatcher responsible for applying read/write 
@@ -65,9 +78,15 @@ namespace freedm {
 CReliableConnection::CReliableConnection(boost::asio::io_service& p_ioService,
   CConnectionManager& p_manager, CDispatcher& p_dispatch, std::string uuid)
   : m_socket(p_ioService),
+    m_shared(0),
+    m_fabric(0),
+    m_strand(p_ioService),
     m_connManager(p_manager),
     m_dispatch(p_dispatch),
-    m_uuid(uuid)
+    m_uuid(uuid),
+    m_peerid(p_manager.GetPeerId(uuid)),
+    m_flushQueued(false),
+    m_resolving(false)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     m_reliability = 100;
@@ -86,5 +105,227 @@ boost::asio::ip::udp::socket& CReliableConnection::GetSocket()
 
     return m_socket;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::QueueDatagram
+/// @description Adds a datagram to the outbox. The first datagram queued
+///   after a flush posts the next flush, so everything written to this peer
+///   while the current handlers run goes out together.
+/// @pre The socket is connected to the remote endpoint.
+/// @post The datagram will be written by FlushDatagrams.
+/// @param p_datagram The encoded message to write.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::QueueDatagram(const std::string &p_datagram)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    boost::mutex::scoped_lock lock(m_outboxMutex);
+    m_outbox.push_back(p_datagram);
+    if(!m_flushQueued)
+    {
+        m_flushQueued = true;
+        m_strand.post(boost::bind(
+            &CReliableConnection::FlushDatagrams, shared_from_this()));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::ShareSocket
+/// @description Makes the connection write through another socket, naming
+///   the peer on each send, rather than opening a socket of its own. With
+///   every connection sharing the listener's socket the broker uses one
+///   file descriptor however many peers it has.
+/// @pre Resolve has not been called. p_socket is open and outlives the
+///   connection.
+/// @post Datagrams are sent through p_socket once the peer is resolved.
+/// @param p_socket The unconnected socket to send through.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::ShareSocket(boost::asio::ip::udp::socket &p_socket)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_shared = &p_socket;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::UseFabric
+/// @description Makes the connection hand its datagrams to a fabric, which
+///   knows the peer by UUID, so it needs neither a socket nor an address.
+/// @pre Resolve has not been called. p_fabric outlives the connection.
+/// @post Datagrams are flushed to p_fabric.
+/// @param p_fabric The fabric to send through.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::UseFabric(IFabric &p_fabric)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_fabric = &p_fabric;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::Resolve
+/// @description Starts looking up the peer's address. Datagrams queued
+///   before the answer arrives are held rather than dropped.
+/// @pre The socket has not been connected.
+/// @post The connection is resolving until HandleResolve or CancelResolve
+///   runs on its strand.
+/// @param p_resolver The resolver to ask.
+/// @param p_host The peer's hostname or address.
+/// @param p_port The port the peer listens on.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::Resolve(CResolver &p_resolver,
+    const std::string &p_host, const std::string &p_port)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    {
+        boost::mutex::scoped_lock lock(m_outboxMutex);
+        m_resolving = true;
+    }
+    p_resolver.Resolve(m_socket.get_io_service(), p_host, p_port,
+        m_strand.wrap(boost::bind(&CReliableConnection::HandleResolve,
+        shared_from_this(), _1, _2)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::IsStale
+/// @description Tells the connection manager whether to replace this
+///   connection. A connection still looking up its peer is not stale even
+///   though it has nowhere to send yet, and one using a fabric is stale
+///   only once it is stopped.
+/// @pre None
+/// @post None
+/// @return true if the connection has no socket or address to send to and
+///   no lookup will provide one.
+///////////////////////////////////////////////////////////////////////////////
+bool CReliableConnection::IsStale()
+{
+    boost::mutex::scoped_lock lock(m_outboxMutex);
+    if(m_resolving || m_fabric)
+        return false;
+    if(m_shared)
+        return m_remote == boost::asio::ip::udp::endpoint();
+    return !m_socket.is_open();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::Disconnect
+/// @description Closes the connection's own socket, or lets go of its
+///   fabric, and forgets the peer's address. A lookup in progress is left
+///   to finish, since others may be waiting on it, but its answer will be
+///   ignored.
+/// @pre Called on the connection's strand.
+/// @post The connection is stale and holds no datagrams.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::Disconnect()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    boost::system::error_code ignored_;
+    boost::mutex::scoped_lock lock(m_outboxMutex);
+    m_resolving = false;
+    m_outbox.clear();
+    m_remote = boost::asio::ip::udp::endpoint();
+    m_fabric = 0;
+    m_socket.close(ignored_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::HandleResolve
+/// @description Connects the socket to the address that was found, or
+///   just remembers the address if the socket is shared, and posts a flush
+///   for the datagrams held meanwhile. If the lookup or the connect failed
+///   the datagrams are dropped and the connection left stale, so the next
+///   GetConnectionByUUID replaces it and tries again.
+/// @pre Called on the connection's strand by the resolver.
+/// @post The connection is no longer resolving.
+/// @param p_error The result of the lookup.
+/// @param p_endpoint The address of the peer, if the lookup worked.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::HandleResolve(const boost::system::error_code &p_error,
+    const boost::asio::ip::udp::endpoint &p_endpoint)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    boost::system::error_code error_ = p_error;
+    {
+        boost::mutex::scoped_lock lock(m_outboxMutex);
+        if(!m_resolving)
+        {
+            // Stopped while the lookup was running.
+            return;
+        }
+    }
+    if(!error_ && !m_shared)
+    {
+        m_socket.connect(p_endpoint, error_);
+    }
+
+    boost::mutex::scoped_lock lock(m_outboxMutex);
+    m_resolving = false;
+    if(!error_ && m_shared)
+    {
+        m_remote = p_endpoint;
+    }
+    if(error_)
+    {
+        Logger.Warn << "Could not connect to " << m_uuid << ": "
+                    << error_.message() << ", dropped " << m_outbox.size()
+                    << " datagrams" << std::endl;
+        boost::system::error_code ignored_;
+        m_socket.close(ignored_);
+        m_outbox.clear();
+        return;
+    }
+    if(!m_outbox.empty() && !m_flushQueued)
+    {
+        m_flushQueued = true;
+        m_strand.post(boost::bind(
+            &CReliableConnection::FlushDatagrams, shared_from_this()));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CReliableConnection::FlushDatagrams
+/// @description Writes the outbox with sendmmsg, batch-size datagrams per
+///   system call, addressed to the peer if the socket is shared, or hands
+///   it to the fabric if the connection uses one. Runs on
+///   the connection's strand, so flushes to different peers can run on
+///   different threads.
+/// @pre A flush was posted by QueueDatagram.
+/// @post The outbox is empty and a new flush may be posted.
+///////////////////////////////////////////////////////////////////////////////
+void CReliableConnection::FlushDatagrams()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    std::vector<std::string> outbox;
+    {
+        boost::mutex::scoped_lock lock(m_outboxMutex);
+        outbox.swap(m_outbox);
+        m_flushQueued = false;
+    }
+    if(m_fabric)
+    {
+        m_fabric->Send(m_connManager.GetUUID(), m_uuid, outbox);
+        return;
+    }
+    if(m_shared)
+    {
+        // m_remote only changes on this strand.
+        if(m_remote == boost::asio::ip::udp::endpoint() || !m_shared->is_open())
+        {
+            Logger.Debug << "Dropped " << outbox.size() << " datagrams for "
+                         << m_uuid << ": not connected" << std::endl;
+            return;
+        }
+        CDatagramBatch::Send(m_shared->native_handle(), outbox,
+            CGlobalConfiguration::instance().GetBatchSize(), m_remote.data(),
+            m_remote.size());
+        return;
+    }
+    if(!m_socket.is_open())
+    {
+        Logger.Debug << "Dropped " << outbox.size() << " datagrams for "
+                     << m_uuid << ": socket closed" << std::endl;
+        return;
+    }
+    CDatagramBatch::Send(m_socket.native_handle(), outbox,
+        CGlobalConfiguration::instance().GetBatchSize());
+}
+
     } // namespace broker
 } // namespace freedm
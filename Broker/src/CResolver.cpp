@@ -0,0 +1,240 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CResolver.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the asynchronous, caching peer name
+///   resolver
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CResolver.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+
+namespace freedm {
+    namespace broker {
+
+const unsigned int CResolver::NEGATIVE_TTL;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CResolver::CResolver
+/// @description Creates a resolver with an empty cache.
+/// @pre None
+/// @post The cache is empty and the counters are zero.
+/// @param p_ttl Seconds an answer is kept, 0 to look names up every time.
+///////////////////////////////////////////////////////////////////////////////
+CResolver::CResolver(unsigned int p_ttl)
+    : m_ttl(p_ttl)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    m_stats.lookups = 0;
+    m_stats.hits = 0;
+    m_stats.failures = 0;
+    m_stats.pending = 0;
+    m_stats.resolveMicros = 0;
+    m_stats.maxResolveMicros = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CResolver::Resolve
+/// @description Finds the endpoint for a host and port. A numeric address or
+///   a cached answer is handed back straight away; otherwise the name is
+///   given to the system resolver in the background, unless a lookup for it
+///   is already running, in which case p_callback waits on that one.
+/// @pre p_ios is being run, or will be.
+/// @post p_callback has been posted to p_ios, or will be called by the
+///   io_service thread that finishes the lookup. It is never called from
+///   inside Resolve.
+/// @param p_ios The io_service the lookup and the callback run on.
+/// @param p_host The hostname or address to look up.
+/// @param p_port The port or service name.
+/// @param p_callback Called with the endpoint, or with the error the lookup
+///   failed with.
+///////////////////////////////////////////////////////////////////////////////
+void CResolver::Resolve(boost::asio::io_service &p_ios,
+    const std::string &p_host, const std::string &p_port,
+    Callback p_callback)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    using boost::asio::ip::udp;
+    using namespace boost::posix_time;
+
+    // Addresses written as numbers need no lookup at all.
+    boost::system::error_code error_;
+    boost::asio::ip::address address_ =
+        boost::asio::ip::address::from_string(p_host, error_);
+    if( !error_ )
+    {
+        try
+        {
+            udp::endpoint endpoint_(address_,
+                boost::lexical_cast<unsigned short>(p_port));
+            {
+                boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+                m_stats.lookups++;
+                m_stats.hits++;
+            }
+            p_ios.post( boost::bind( p_callback, error_, endpoint_ ) );
+            return;
+        }
+        catch( boost::bad_lexical_cast &e )
+        {
+            // A service name; let the system resolver deal with it.
+        }
+    }
+
+    std::string key_ = p_host + ":" + p_port;
+    ptime now_ = microsec_clock::universal_time();
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        m_stats.lookups++;
+        Entry &entry_ = m_cache[key_];
+        if( !entry_.pending && now_ < entry_.expires )
+        {
+            m_stats.hits++;
+            p_ios.post( boost::bind( p_callback, entry_.error,
+                entry_.endpoint ) );
+            return;
+        }
+        entry_.waiting.push_back( p_callback );
+        if( entry_.pending )
+        {
+            return;
+        }
+        entry_.pending = true;
+        entry_.started = now_;
+        m_stats.pending++;
+    }
+
+    Logger.Info << "Resolving " << key_ << std::endl;
+    ResolverPtr resolver_(new udp::resolver(p_ios));
+    udp::resolver::query query_(p_host, p_port);
+    resolver_->async_resolve( query_, boost::bind( &CResolver::HandleResolve,
+        this, key_, resolver_, boost::asio::placeholders::error,
+        boost::asio::placeholders::iterator ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CResolver::HandleResolve
+/// @description Caches the first address the system resolver gave back, or
+///   the failure for NEGATIVE_TTL seconds so an unreachable name server is
+///   not asked again for every message, then answers the waiting callers.
+/// @pre A lookup for p_key was started by Resolve.
+/// @post The entry for p_key is no longer pending and its callers have been
+///   called.
+/// @param p_key The hostname:port that was looked up.
+/// @param p_resolver The resolver that made the lookup, kept alive until now.
+/// @param p_error The result of the lookup.
+/// @param p_it The addresses found.
+///////////////////////////////////////////////////////////////////////////////
+void CResolver::HandleResolve(const std::string &p_key,
+    ResolverPtr /* p_resolver */, const boost::system::error_code &p_error,
+    boost::asio::ip::udp::resolver::iterator p_it)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    using namespace boost::posix_time;
+
+    boost::system::error_code error_ = p_error;
+    boost::asio::ip::udp::endpoint endpoint_;
+    if( !error_ && p_it == boost::asio::ip::udp::resolver::iterator() )
+    {
+        error_ = boost::asio::error::host_not_found;
+    }
+    else if( !error_ )
+    {
+        endpoint_ = *p_it;
+    }
+
+    std::vector<Callback> waiting_;
+    ptime now_ = microsec_clock::universal_time();
+    {
+        boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+        Entry &entry_ = m_cache[p_key];
+        unsigned long micros_ = (now_ - entry_.started).total_microseconds();
+        m_stats.pending--;
+        m_stats.resolveMicros += micros_;
+        m_stats.maxResolveMicros = std::max( m_stats.maxResolveMicros, micros_ );
+        if( error_ )
+        {
+            m_stats.failures++;
+        }
+        entry_.pending = false;
+        entry_.error = error_;
+        entry_.endpoint = endpoint_;
+        entry_.expires = now_ + seconds( error_ ? NEGATIVE_TTL : m_ttl );
+        waiting_.swap( entry_.waiting );
+    }
+
+    if( error_ )
+    {
+        Logger.Warn << "Could not resolve " << p_key << ": "
+                    << error_.message() << std::endl;
+    }
+    for( std::size_t i = 0; i < waiting_.size(); i++ )
+    {
+        waiting_[i]( error_, endpoint_ );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CResolver::Clear
+/// @description Forgets every answer, so the next request for each name
+///   goes to the system resolver. Lookups in progress are left alone.
+/// @pre None
+/// @post Only pending entries remain in the cache.
+///////////////////////////////////////////////////////////////////////////////
+void CResolver::Clear()
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    std::map<std::string, Entry>::iterator it_ = m_cache.begin();
+    while( it_ != m_cache.end() )
+    {
+        if( it_->second.pending )
+            ++it_;
+        else
+            m_cache.erase( it_++ );
+    }
+}
+
+/// A copy of the counters
+CResolver::Stats CResolver::GetStats() const
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    return m_stats;
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CRttEstimator.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the per-peer round trip time estimator
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+
+#include "CRttEstimator.hpp"
+
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace freedm {
+    namespace broker {
+
+namespace {
+
+/// Most times the timeout is doubled in a row.
+const unsigned int MAX_BACKOFF = 6;
+
+} // unnamed namespace
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CRttEstimator::CRttEstimator
+/// @description Creates an estimator that has not measured anything yet.
+/// @pre p_min is no more than p_max.
+/// @post The RTO is p_initial, clamped to the bounds.
+/// @param p_initial The timeout to use until the first sample.
+/// @param p_min The smallest timeout ever used.
+/// @param p_max The largest timeout ever used, backoff included.
+///////////////////////////////////////////////////////////////////////////////
+CRttEstimator::CRttEstimator(boost::posix_time::time_duration p_initial,
+    boost::posix_time::time_duration p_min,
+    boost::posix_time::time_duration p_max)
+    : m_initial(p_initial.total_microseconds()),
+      m_min(p_min.total_microseconds()),
+      m_max(p_max.total_microseconds()),
+      m_backoff(0)
+{
+    m_stats.srtt = 0;
+    m_stats.rttvar = 0;
+    m_stats.rto = 0;
+    m_stats.samples = 0;
+    m_stats.timeouts = 0;
+    m_stats.retransmits = 0;
+    UpdateRTO();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CRttEstimator::Sample
+/// @description Updates the smoothed round trip time and its deviation with
+///   gains of 1/8 and 1/4. The first sample seeds both. A sample also ends
+///   any backoff, since it shows the peer is answering again.
+/// @pre p_rtt was measured on a message written only once.
+/// @post The RTO is SRTT + 4 RTTVAR, within the bounds.
+/// @param p_rtt The time from writing a message to its ACK.
+///////////////////////////////////////////////////////////////////////////////
+void CRttEstimator::Sample(boost::posix_time::time_duration p_rtt)
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    long rtt_ = std::max(0L, long(p_rtt.total_microseconds()));
+    if( m_stats.samples == 0 )
+    {
+        m_stats.srtt = rtt_;
+        m_stats.rttvar = rtt_ / 2;
+    }
+    else
+    {
+        long err_ = rtt_ - m_stats.srtt;
+        m_stats.srtt += err_ / 8;
+        m_stats.rttvar += ( std::labs(err_) - m_stats.rttvar ) / 4;
+    }
+    m_stats.samples++;
+    m_backoff = 0;
+    UpdateRTO();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CRttEstimator::Backoff
+/// @description Doubles the timeout, up to the maximum, after a message
+///   went unacknowledged for a whole RTO.
+/// @pre None
+/// @post The RTO has doubled unless it was already at the bound.
+///////////////////////////////////////////////////////////////////////////////
+void CRttEstimator::Backoff()
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    m_stats.timeouts++;
+    if( m_backoff < MAX_BACKOFF )
+    {
+        m_backoff++;
+    }
+    UpdateRTO();
+}
+
+/// Counts messages written again
+void CRttEstimator::CountRetransmits(unsigned long p_count)
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    m_stats.retransmits += p_count;
+}
+
+/// How long to wait for an ACK before writing a message again
+boost::posix_time::time_duration CRttEstimator::GetRTO() const
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    return boost::posix_time::microseconds(m_stats.rto);
+}
+
+/// A copy of the estimate and counters
+CRttEstimator::Stats CRttEstimator::GetStats() const
+{
+    boost::lock_guard< boost::mutex > scopedLock_( m_mutex );
+    return m_stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CRttEstimator::UpdateRTO
+/// @description Recomputes the timeout from the estimate, or the initial
+///   timeout before the first sample, then applies the backoff.
+/// @pre m_mutex is held.
+/// @post m_stats.rto is within the bounds.
+///////////////////////////////////////////////////////////////////////////////
+void CRttEstimator::UpdateRTO()
+{
+    long base_ = m_initial;
+    if( m_stats.samples > 0 )
+    {
+        base_ = m_stats.srtt + 4 * m_stats.rttvar;
+    }
+    base_ = std::max(m_min, std::min(m_max, base_));
+    m_stats.rto = std::min(m_max, base_ << m_backoff);
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -0,0 +1,429 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CSMConnection.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the sequenced multicast protocol
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CSMConnection.hpp"
+#include "CConnectionManager.hpp"
+#include "CGroupChannel.hpp"
+#include "CDispatcher.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/tokenizer.hpp>
+
+#include <vector>
+
+namespace freedm {
+    namespace broker {
+
+const unsigned int CSMConnection::MAX_NACKS;
+const std::size_t CSMConnection::MAX_HELD;
+const unsigned int CSMConnection::MAX_NACK_RANGE;
+const unsigned int CSMConnection::NACK_TIME;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::CSMConnection
+/// @description Prepares to follow the peer's group channel. The sequence
+///   is fixed by the first group message the peer sends.
+/// @pre None
+/// @post Nothing is held and no NACK is pending.
+/// @param conn The connection to the peer.
+///////////////////////////////////////////////////////////////////////////////
+CSMConnection::CSMConnection(CConnection * conn)
+    : IProtocol(conn, Identifier(),
+          boost::posix_time::milliseconds(NACK_TIME)),
+      m_selfhash(CGroupChannel::HashUUID(
+          conn->GetConnectionManager().GetUUID())),
+      m_synced(false),
+      m_epoch(0),
+      m_inseq(0),
+      m_highest(0),
+      m_nacks(0),
+      m_nackpending(false),
+      m_nacktimer(conn->GetSocket().get_io_service())
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::Send
+/// @description Writes a message addressed to this peer alone to the group.
+///   Modules reach the group through CConnectionManager::SendToGroup; this
+///   only serves a message that names this protocol itself.
+/// @pre Called on the connection's strand.
+/// @post The message was written to the group, or dropped and logged if
+///   the group channel is closed.
+/// @param msg The message to send.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::Send(const CMessage &msg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    std::vector<PeerId> peers_(1, GetConnection()->GetPeerId());
+    if(!GetConnection()->GetConnectionManager().GetGroupChannel().Send(
+        peers_, msg))
+    {
+        Logger.Warn << "Dropped group message for " << GetConnection()->
+            GetUUID() << ": no group channel" << std::endl;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::RecieveACK
+/// @description Answers a NACK from the peer by writing the group messages
+///   it lists again, to the peer alone. Messages that have left the history
+///   are not sent; the peer gives up on them after MAX_NACKS.
+/// @pre Called on the connection's strand.
+/// @post The datagrams still in the history are queued for the peer.
+/// @param msg The NACK.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::RecieveACK(const CMessage &msg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    CGroupChannel &group_ = GetConnection()->GetConnectionManager().
+        GetGroupChannel();
+    const ptree &pp_ = msg.GetProtocolProperties();
+    if(pp_.get<boost::uint32_t>("smc.epoch", 0) != group_.GetEpoch())
+    {
+        // Asked of an earlier run of this node.
+        return;
+    }
+    std::string list_ = pp_.get<std::string>("smc.nack", "");
+    boost::char_separator<char> comma_(",");
+    boost::tokenizer<boost::char_separator<char> > seqs_(list_, comma_);
+    boost::tokenizer<boost::char_separator<char> >::iterator it_;
+    unsigned long resent_ = 0;
+    for(it_ = seqs_.begin(); it_ != seqs_.end(); ++it_)
+    {
+        std::string datagram_;
+        unsigned int seq_;
+        try
+        {
+            seq_ = boost::lexical_cast<unsigned int>(*it_);
+        }
+        catch(boost::bad_lexical_cast &)
+        {
+            continue;
+        }
+        if(group_.GetDatagram(seq_, datagram_))
+        {
+            GetConnection()->QueueDatagram(datagram_);
+            resent_++;
+        }
+    }
+    GetMetrics().resent.Add(resent_);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::Recieve
+/// @description Places a group message from the peer in its sequence. The
+///   next message in sequence is delivered if it lists this node; a later
+///   one is held and the gap before it asked for. A sync, which carries the
+///   last number the peer sent, only reveals a gap. The first message from
+///   a run of the peer's channel fixes the sequence, unless an earlier
+///   connection to the peer left its place; nothing before that, or before
+///   the message a first sync repeats the number of, can be recovered. Expired messages fill their place but are not delivered.
+/// @pre Called on the connection's strand.
+/// @post The sequence, held messages and NACK state are updated.
+/// @param msg The message from the peer.
+/// @return True if the message should be given to the dispatcher.
+///////////////////////////////////////////////////////////////////////////////
+bool CSMConnection::Recieve(const CMessage &msg)
+{
+    if(GetConnection()->GetUUID() ==
+        GetConnection()->GetConnectionManager().GetUUID())
+    {
+        // This node's own group messages, looped back by the network.
+        return false;
+    }
+    const ptree &pp_ = msg.GetProtocolProperties();
+    boost::uint32_t epoch_ = pp_.get<boost::uint32_t>("smc.epoch", 0);
+    unsigned int seq_ = msg.GetSequenceNumber();
+    bool sync_ = (msg.GetStatus() == CMessage::Created);
+
+    if(!m_synced || epoch_ != m_epoch)
+    {
+        unsigned int next_;
+        if(!m_synced && GetConnection()->GetConnectionManager().
+            GetGroupChannel().GetCursor(GetConnection()->GetPeerId(), epoch_,
+            next_))
+        {
+            // An earlier connection followed this run; carry on after it.
+            m_inseq = next_;
+            m_highest = next_ - 1;
+        }
+        else
+        {
+            // A sync heard first may follow a message that was lost; it
+            // is asked for, but nothing before it.
+            m_inseq = seq_;
+            m_highest = seq_;
+        }
+        m_synced = true;
+        m_epoch = epoch_;
+        m_held.clear();
+        m_ready.clear();
+        m_nacks = 0;
+        m_nackpending = false;
+        m_nacktimer.cancel();
+    }
+    if(static_cast<int>(seq_ - m_highest) > 0)
+    {
+        m_highest = seq_;
+    }
+    if(sync_)
+    {
+        if(HasGap())
+        {
+            RequestMissing();
+        }
+        return false;
+    }
+
+    int ahead_ = static_cast<int>(seq_ - m_inseq);
+    if(ahead_ < 0)
+    {
+        // Delivered already, or given up on.
+        return false;
+    }
+    if(ahead_ > 0)
+    {
+        if(m_held.size() < MAX_HELD)
+        {
+            m_held.insert(std::make_pair(seq_, msg));
+        }
+        RequestMissing();
+        return false;
+    }
+
+    m_inseq++;
+    Advance();
+    if(!HasGap())
+    {
+        if(m_nackpending && m_nacks == 1)
+        {
+            // Karn: a gap asked for more than once gives no sample.
+            GetRtt().Sample(CClock::Now() - m_nacksent);
+        }
+        m_nacks = 0;
+        m_nackpending = false;
+        m_nacktimer.cancel();
+    }
+    return IsDeliverable(msg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::TakeReady
+/// @description Hands over the held messages that became deliverable, in
+///   sequence order.
+/// @pre Called on the connection's strand.
+/// @post The returned message is no longer held.
+/// @param msg Set to the next deliverable message.
+/// @return True if a message was returned.
+///////////////////////////////////////////////////////////////////////////////
+bool CSMConnection::TakeReady(CMessage &msg)
+{
+    if(m_ready.empty())
+    {
+        return false;
+    }
+    msg = m_ready.front();
+    m_ready.pop_front();
+    GetMetrics().received.Add();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::Stop
+/// @description Stops the NACK timer and leaves the place in the peer's
+///   sequence with the group channel, so the connection that replaces this
+///   one asks for what arrives in between rather than passing it over.
+/// @pre Called on the connection's strand.
+/// @post No timer is pending.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::Stop()
+{
+    m_nacktimer.cancel();
+    CancelHeldACK();
+    if(m_synced)
+    {
+        GetConnection()->GetConnectionManager().GetGroupChannel().SaveCursor(
+            GetConnection()->GetPeerId(), m_epoch, m_inseq);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::Advance
+/// @description Releases the held messages that follow m_inseq without a
+///   gap. Those for other members are passed over.
+/// @pre None
+/// @post m_inseq is not held.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::Advance()
+{
+    std::map<unsigned int, CMessage>::iterator it_;
+    while((it_ = m_held.find(m_inseq)) != m_held.end())
+    {
+        if(IsDeliverable(it_->second))
+        {
+            m_ready.push_back(it_->second);
+        }
+        m_held.erase(it_);
+        m_inseq++;
+    }
+}
+
+/// True if a message the peer has sent has not been received
+bool CSMConnection::HasGap() const
+{
+    return static_cast<int>(m_highest - m_inseq) >= 0;
+}
+
+/// True if a message in sequence lists this node and has not expired
+bool CSMConnection::IsDeliverable(const CMessage &msg) const
+{
+    return CGroupChannel::IsAddressedTo(msg.GetProtocolProperties().
+        get<std::string>("smc.to", ""), m_selfhash) && !msg.IsExpired();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::RequestMissing
+/// @description Writes a NACK listing the missing sequence numbers from
+///   m_inseq on, up to MAX_NACK_RANGE of them, unless one is already
+///   waiting to be answered.
+/// @pre Called on the connection's strand. There is a gap.
+/// @post A NACK is pending and its timer is set.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::RequestMissing()
+{
+    if(m_nackpending)
+    {
+        return;
+    }
+    std::string list_;
+    unsigned int seq_ = m_inseq;
+    for(unsigned int i = 0; i < MAX_NACK_RANGE &&
+        static_cast<int>(m_highest - seq_) >= 0; i++, seq_++)
+    {
+        if(m_held.count(seq_) == 0)
+        {
+            if(!list_.empty())
+                list_ += ",";
+            list_ += boost::lexical_cast<std::string>(seq_);
+        }
+    }
+    CMessage nack_;
+    nack_.SetSourceUUID(GetConnection()->GetConnectionManager().GetUUID());
+    nack_.SetSourceHostname(
+        GetConnection()->GetConnectionManager().GetHostname());
+    nack_.SetStatus(CMessage::Accepted);
+    nack_.SetSequenceNumber(m_inseq);
+    nack_.SetProtocol(GetIdentifier());
+    nack_.SetSendTimestampNow();
+    ptree pp_;
+    pp_.put("smc.epoch", m_epoch);
+    pp_.put("smc.nack", list_);
+    nack_.SetProtocolProperties(pp_);
+    Logger.Debug << "NACK " << list_ << " to " << GetConnection()->GetUUID()
+                 << std::endl;
+    Write(nack_);
+
+    if(m_nacks == 0)
+    {
+        m_nacksent = CClock::Now();
+    }
+    m_nacks++;
+    m_nackpending = true;
+    m_nacktimer.expires_from_now(GetRtt().GetRTO());
+    m_nacktimer.async_wait(GetConnection()->GetStrand().wrap(
+        boost::bind(&CSMConnection::HandleNackTimeout, this,
+        boost::asio::placeholders::error)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CSMConnection::HandleNackTimeout
+/// @description Asks for a gap that is still open again, with a longer
+///   wait, or after MAX_NACKS gives it up: the sequence moves to the first
+///   held message, and what follows it is delivered here since no received
+///   message will collect it.
+/// @pre None
+/// @post A NACK is pending, or the gap is closed.
+/// @param err Set if the gap closed and the timer was cancelled.
+///////////////////////////////////////////////////////////////////////////////
+void CSMConnection::HandleNackTimeout(const boost::system::error_code& err)
+{
+    if(err)
+    {
+        return;
+    }
+    m_nackpending = false;
+    if(!HasGap())
+    {
+        m_nacks = 0;
+        return;
+    }
+    if(m_nacks < MAX_NACKS)
+    {
+        GetRtt().Backoff();
+        RequestMissing();
+        return;
+    }
+
+    unsigned int next_ = m_highest + 1;
+    std::map<unsigned int, CMessage>::iterator it_;
+    for(it_ = m_held.begin(); it_ != m_held.end(); it_++)
+    {
+        if(static_cast<int>(it_->first - next_) < 0)
+        {
+            next_ = it_->first;
+        }
+    }
+    Logger.Notice << "Gave up on group messages " << m_inseq << " to "
+                  << next_ - 1 << " from " << GetConnection()->GetUUID()
+                  << std::endl;
+    GetMetrics().expired.Add(next_ - m_inseq);
+    m_inseq = next_;
+    m_nacks = 0;
+    Advance();
+    CMessage ready_;
+    while(TakeReady(ready_))
+    {
+        GetConnection()->GetDispatcher().HandleRequest(ready_);
+    }
+    if(HasGap())
+    {
+        RequestMissing();
+    }
+}
+
+    }
+}
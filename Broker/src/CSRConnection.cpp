@@ -33,7 +33,11 @@
 #include "CSRConnection.hpp"
 #include "CMessage.hpp"
 #include "CConnectionManager.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "IProtocol.hpp"
+#include "CWireCodec.hpp"
+#include "CClock.hpp"
+#include "CEventLog.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
@@ -44,12 +48,20 @@ static CLocalLogger Logger(__FILE__);
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
+#include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+
+#include <algorithm>
 #include <iomanip>
 #include <set>
+#include <sstream>
 
 namespace freedm {
     namespace broker {
 
+const unsigned int CSRConnection::MAX_WINDOW;
+const unsigned int CSRConnection::REFIRE_TIME;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// CSRConnection::CSRConnection
 /// @description Constructor for the CSRConnection class.
@@ -57,10 +69,12 @@ namespace freedm {
 /// @post The object is initialized: m_killwindow is empty, the connection is
 ///       marked as unsynced, It won't be sending kill statuses. Its first
 ///       message will be numbered as 0 for outgoing and the timer is not set.
+///       The window size is read from the src-window setting.
 /// @param conn The underlying connection object this protocol writes to
 /////////////////////////////////////////////////////////////////////////////// 
 CSRConnection::CSRConnection(CConnection *  conn)
-    : IProtocol(conn), 
+    : IProtocol(conn, Identifier(),
+          boost::posix_time::milliseconds(REFIRE_TIME)),
       m_timeout(conn->GetSocket().get_io_service())
 {
     //Sequence Numbers
@@ -75,26 +89,28 @@ CSRConnection::CSRConnection(CConnection *  conn)
     // Message killing (SEND)
     m_sendkills = false;
     m_sendkill = 0;
+    // Sliding window
+    m_windowsize = std::max(1u, std::min(MAX_WINDOW,
+        CGlobalConfiguration::instance().GetSRWindow()));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// CSRConnection::CSRConnection
 /// @description Send function for the CSRConnection. Sending using this
-///   protocol involves an alternating bit scheme. Messages can expire and 
-///   delivery won't be attempted after the deadline is passed. Killed messages
-///   are noted in the next outgoing message. The reciever tracks the killed
-///   messages and uses them to help maintain ordering.
+///   protocol involves a selective repeat sliding window. Up to the window
+///   size of messages are in the channel at once, each with its own resend
+///   deadline. Messages can expire and delivery won't be attempted after the
+///   deadline is passed. Killed messages are noted in the next outgoing
+///   message. The reciever tracks the killed messages and uses them to help
+///   maintain ordering.
 /// @pre The protocol is intialized.
-/// @post At least one message is in the channel and actively being resent.
-///     The send window is greater than or equal to one. The timer for the
-///     resend is freshly set or is currently running for a resend. 
-///     If a message is written to the channel, the m_killable flag is set.
+/// @post The message is in the send window. If the window had room, it has
+///     been written to the channel and the timer for its resend is set.
 /// @param msg The message to write to the channel.
 ///////////////////////////////////////////////////////////////////////////////
-void CSRConnection::Send(CMessage msg)
+void CSRConnection::Send(const CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
-    ptree x = static_cast<ptree>(msg);
     unsigned int msgseq;
 
     if(m_outsync == false)
@@ -102,7 +118,11 @@ void CSRConnection::Send(CMessage msg)
         SendSYN();
     }
 
-    CMessage outmsg(x);
+    // Shares the submessages with msg and every other copy sent with it.
+    CMessage outmsg(msg);
+    // Protocol properties belong to one hop. A message passed on after it
+    // was received would otherwise carry its ACK back to the sender.
+    outmsg.SetProtocolProperties(ptree());
     
     msgseq = m_outseq;
     outmsg.SetSequenceNumber(msgseq);
@@ -117,34 +137,49 @@ void CSRConnection::Send(CMessage msg)
         Logger.Notice<<"Set Expire time"<<std::endl;
         outmsg.SetExpireTimeFromNow(boost::posix_time::milliseconds(3000));
     }
-    m_window.push_back(outmsg);
+    QueueItem q;
+    q.msg = outmsg;
+    q.sent = false;
+    q.resent = false;
+    q.sacked = false;
+    q.delivered = false;
+    m_window.push_back(q);
+    GetMetrics().window.Set(m_window.size());
     
-    if(m_window.size() == 1)
+    if(m_window.size() <= GetFlightSize())
     {
-        Write(outmsg);
         boost::system::error_code x;
         Resend(x);
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// CSRConnection::CSRConnection
-/// @description Handles refiring ACKs and Sent Messages.
+/// CSRConnection::Resend
+/// @description Handles refiring sent messages. ACKs are not refired; a
+///       sender that missed one writes the message again, and that draws the
+///       ACK out a second time.
 /// @pre The connection has received or sent at least one message.
 /// @post One of the following conditions or combination of states is 
 ///       upheld:
-///       1) An ack for a message that has not yet expired has been resent and
-///          a timer to call resend has been set.
-///       2) Message(s) has/have expired and are removed from the queue. The
-///          flag to send kills is set.
-///       3) The window is empty and no message is set to the channel, the
+///       1) Message(s) has/have expired and are removed from the front of
+///          the queue. The flag to send kills is set.
+///       2) The window is empty and no message is set to the channel, the
 ///          timer is not re-set.
-///       4) A message expired and then next message will cause the sequence
+///       3) A message expired and then next message will cause the sequence
 ///          numbers to wrap, (or they have wrapped since the last time a message
 ///          was successfully sent) so a sync is inserted at the front of the queue
 ///          to skip that case on the receiver side. The sendkill flag is cleared
 ///          and the sendkill value is cleared.
-///       5) If there is still a message to resend, the timer is reset.
+///       4) Every message in the window that has not been written, or whose
+///          refire time has passed without an ACK, is written. The head of
+///          the window is written until it is delivered, since it may be
+///          carrying a kill; later messages stop once they are selectively
+///          ACKed. Resends, and the last message the window admits while
+///          more wait behind it, are marked src.urgent so their ACK is not
+///          held. The refire time is one RTO away; if a resend was due, the
+///          RTO has first been doubled.
+///       5) If there is still a message to resend, the timer is set for the
+///          earliest refire time.
 /// @param err The timer error code. If the err is 0 then the timer expired
 ///////////////////////////////////////////////////////////////////////////////
 void CSRConnection::Resend(const boost::system::error_code& err)
@@ -153,32 +188,28 @@ void CSRConnection::Resend(const boost::system::error_code& err)
     if(!err)
     {
         boost::posix_time::ptime now;
-        now = boost::posix_time::microsec_clock::universal_time();
-        CMessage ack;
-        // Check if the front of the queue is an ACK
-        if(m_currentack.GetStatus() == freedm::broker::CMessage::Accepted)
-        {
-            if(!m_currentack.IsExpired())
-            {
-                Write(m_currentack);
-                m_timeout.cancel();
-                m_timeout.expires_from_now(boost::posix_time::milliseconds(REFIRE_TIME));
-                m_timeout.async_wait(boost::bind(&CSRConnection::Resend,this,
-                    boost::asio::placeholders::error));
-            }
-        }
-        while(m_window.size() > 0 && m_window.front().IsExpired())
+        boost::posix_time::time_duration refire;
+        bool expired = false;
+        unsigned long retransmits = 0;
+        now = CClock::Now();
+        while(m_window.size() > 0 && m_window.front().msg.IsExpired())
         {
-            //First message in the window should be the only one
-            //ever to have been written.
             m_sendkills = true;
-            Logger.Notice<<"Message Expired: "<<m_window.front().GetHash()
-                          <<":"<<m_window.front().GetSequenceNumber()<<std::endl;
+            expired = true;
+            Logger.Notice<<"Message Expired: "<<m_window.front().msg.GetHash()
+                          <<":"<<m_window.front().msg.GetSequenceNumber()
+                          <<std::endl;
+            CEventLog::Record(CEventLog::SR_EXPIRE,
+                GetConnection()->GetPeerId(),
+                m_window.front().msg.GetSequenceNumber());
+            GetMetrics().expired.Add();
             m_window.pop_front();
         }
+        GetMetrics().window.Set(m_window.size());
         if(m_window.size() > 0)
         {
-            if(m_sendkills &&  m_sendkill > m_window.front().GetSequenceNumber())
+            CMessage &front = m_window.front().msg;
+            if(m_sendkills &&  m_sendkill > front.GetSequenceNumber())
             {
                 // If we have expired a message and caused the seqnos
                 // to wrap, we resync the connection. This shouldn't
@@ -187,34 +218,148 @@ void CSRConnection::Resend(const boost::system::error_code& err)
                 m_sendkills = false;
                 m_sendkill = 0;
                 SendSYN();
+                return;
             }
-            if(m_sendkills)
+            if(m_sendkills && front.GetStatus() != CMessage::Created)
             {
                 // kill will be set to the last message accepted by receiver
                 // (and whose ack has been received)
                 ptree x;
                 x.put("src.kill",m_sendkill);
-                m_window.front().SetProtocolProperties(x);
+                front.SetProtocolProperties(x);
             }
-            Write(m_window.front());
-            // Head of window can be killed.
-            m_timeout.cancel();
-            m_timeout.expires_from_now(boost::posix_time::milliseconds(REFIRE_TIME));
-            m_timeout.async_wait(boost::bind(&CSRConnection::Resend,this,
-                boost::asio::placeholders::error));
         }
+        unsigned int flight = std::min<std::size_t>(GetFlightSize(),
+            m_window.size());
+        for(unsigned int i = 0; i < flight; i++)
+        {
+            const QueueItem &q = m_window[i];
+            if(q.sent && q.refire <= now && !q.delivered &&
+                (i == 0 || !q.sacked))
+            {
+                // A resend timed out, so the peer or the path is slower
+                // than estimated.
+                GetRtt().Backoff();
+                break;
+            }
+        }
+        refire = GetRtt().GetRTO();
+        for(unsigned int i = 0; i < flight; i++)
+        {
+            QueueItem &q = m_window[i];
+            if(q.delivered || (i > 0 && (q.sacked || q.msg.IsExpired())))
+            {
+                continue;
+            }
+            // A new head is written at once so its kill goes out.
+            if(!q.sent || q.refire <= now || (i == 0 && expired))
+            {
+                // The receiver may hold its ACK a little, unless this is a
+                // resend or the last message the window lets out; then the
+                // window cannot move until the ACK comes.
+                if(q.sent || (i == flight-1 && m_window.size() > flight))
+                {
+                    CMessage urgent = q.msg;
+                    ptree pp = urgent.GetProtocolProperties();
+                    pp.put("src.urgent",true);
+                    urgent.SetProtocolProperties(pp);
+                    Write(urgent);
+                }
+                else
+                {
+                    Write(q.msg);
+                }
+                if(q.sent)
+                {
+                    q.resent = true;
+                    retransmits++;
+                    CEventLog::Record(CEventLog::SR_RESEND,
+                        GetConnection()->GetPeerId(),
+                        q.msg.GetSequenceNumber(),
+                        refire.total_microseconds());
+                }
+                else
+                {
+                    q.written = now;
+                    CEventLog::Record(CEventLog::SR_SEND,
+                        GetConnection()->GetPeerId(),
+                        q.msg.GetSequenceNumber(), GetFlightSize());
+                }
+                q.sent = true;
+                q.refire = now + refire;
+            }
+        }
+        if(retransmits > 0)
+        {
+            GetRtt().CountRetransmits(retransmits);
+            GetMetrics().resent.Add(retransmits);
+        }
+        ScheduleResend();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// CSRConnection::ScheduleResend
+/// @description Sets the resend timer for the soonest refire of every
+///   message in flight that still needs one.
+/// @pre None
+/// @post The timer is set, or cancelled if nothing needs resending.
+///////////////////////////////////////////////////////////////////////////////
+void CSRConnection::ScheduleResend()
+{
+    boost::posix_time::ptime next(boost::posix_time::pos_infin);
+    unsigned int flight = std::min<std::size_t>(GetFlightSize(),
+        m_window.size());
+    for(unsigned int i = 0; i < flight; i++)
+    {
+        const QueueItem &q = m_window[i];
+        if(q.sent && !q.delivered && (i == 0 || !q.sacked))
+        {
+            next = std::min(next, q.refire);
+        }
+    }
+    m_timeout.cancel();
+    if(!next.is_special())
+    {
+        m_timeout.expires_at(next);
+        m_timeout.async_wait(GetConnection()->GetStrand().wrap(
+            boost::bind(&CSRConnection::Resend, this,
+            boost::asio::placeholders::error)));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// CSRConnection::GetFlightSize
+/// @description The number of messages at the front of the window that may
+///   be in the channel. While a SYN heads the window only the SYN is sent,
+///   since the receiver would refuse everything after it until it is synced.
+/// @pre None
+/// @post None
+/// @return The number of messages that may be in flight.
+///////////////////////////////////////////////////////////////////////////////
+unsigned int CSRConnection::GetFlightSize()
+{
+    if(m_window.size() > 0 &&
+        m_window.front().msg.GetStatus() == CMessage::Created)
+    {
+        return 1;
     }
+    return m_windowsize;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// CSRConnection::RecieveACK
-/// @description Marks a message as acknowledged by the reciever and moves to
-///     transmit the next message.
+/// @description Marks messages as acknowledged by the reciever and moves to
+///     transmit the next messages.
 /// @pre A message has been sent.
-/// @post If the ACK corresponds to the head of window by a match of sequence
-///       number and the message hash, the the message is popped and the
-///       killable flag is set to false, since the head of the window has never
-///       been sent.
+/// @post The message the ACK names is marked by sequence number and hash.
+///       An ACK with src.cum marks it as selectively acknowledged, and every
+///       message up to src.cum and each sequence number listed in src.sack
+///       are marked as well. The ACK gives a round trip sample if the
+///       message it names was written only once. An ACK without src.cum
+///       comes from a receiver that only accepts in order, so it marks
+///       everything up to it as delivered. Delivered messages are popped from the head of the
+///       window and the last one becomes the kill value.
 ///       If the there is still an message in the window to send, the
 ///       resend function is called.
 ///////////////////////////////////////////////////////////////////////////////
@@ -222,19 +367,69 @@ void CSRConnection::RecieveACK(const CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     unsigned int seq = msg.GetSequenceNumber();
-    ptree pp = msg.GetProtocolProperties();
+    const ptree &pp = msg.GetProtocolProperties();
     size_t hash = pp.get<size_t>("src.hash");
-    if(m_window.size() > 0)
+    boost::optional<unsigned int> cum = pp.get_optional<unsigned int>("src.cum");
+    std::string sack = pp.get<std::string>("src.sack", "");
+    std::set<unsigned int> sacks;
+    unsigned int flight = std::min<std::size_t>(GetFlightSize(),
+        m_window.size());
+
+    if(!sack.empty())
     {
+        std::stringstream ss(sack);
+        std::string item;
+        while(std::getline(ss, item, ','))
+        {
+            sacks.insert(boost::lexical_cast<unsigned int>(item));
+        }
+    }
+    for(unsigned int i = 0; i < flight; i++)
+    {
+        QueueItem &q = m_window[i];
+        unsigned int fseq = q.msg.GetSequenceNumber();
         // Assuming hash collisions are small, we will check the hash
-        // of the front message. On hit, we can accept the acknowledge.
-        unsigned int fseq = m_window.front().GetSequenceNumber();
-        if(fseq == seq && m_window.front().GetHash() == hash)
+        // of the message. On hit, we can accept the acknowledge. A peer that
+        // has not shown it reads DIGEST_VERSION may answer with the old hash.
+        if(fseq == seq && (q.msg.GetHash() == hash ||
+            (GetConnection()->GetWireVersion() < CWireCodec::DIGEST_VERSION &&
+             q.msg.GetLegacyHash() == hash)))
         {
-            m_sendkill = fseq; 
-            m_window.pop_front();
+            // Karn: only a message written once tells which copy the ACK
+            // answers.
+            boost::posix_time::time_duration rtt(0, 0, 0);
+            if(q.sent && !q.resent && !q.sacked && !q.delivered)
+            {
+                rtt = CClock::Now() -
+                    q.written;
+                GetRtt().Sample(rtt);
+            }
+            CEventLog::Record(CEventLog::SR_ACK, GetConnection()->GetPeerId(),
+                seq, rtt.total_microseconds());
+            if(!cum)
+            {
+                for(unsigned int j = 0; j <= i; j++)
+                {
+                    m_window[j].delivered = true;
+                }
+            }
+            q.sacked = true;
+        }
+        if(cum && Distance(fseq, *cum) < MAX_WINDOW)
+        {
+            q.delivered = true;
+        }
+        if(sacks.count(fseq))
+        {
+            q.sacked = true;
         }
     }
+    while(m_window.size() > 0 && m_window.front().delivered)
+    {
+        m_sendkill = m_window.front().msg.GetSequenceNumber();
+        m_window.pop_front();
+    }
+    GetMetrics().window.Set(m_window.size());
     if(m_window.size() > 0)
     {
         boost::system::error_code x;
@@ -248,7 +443,8 @@ void CSRConnection::RecieveACK(const CMessage &msg)
 ///   be accepted. If this function returns true, the message is passed to
 ///   the dispatcher. Since this message accepts SYNs there might be times
 ///   when processing and state changes but the message is marked as "rejected"
-///   this is normal.
+///   this is normal. Messages that arrive ahead of a gap are held until the
+///   gap is filled or killed; they are then handed out by TakeReady.
 /// @pre Accept logic can be complicated, there are several scenarios that
 ///      should be addressed.
 ///      1) A bad request has been recieved
@@ -265,19 +461,28 @@ void CSRConnection::RecieveACK(const CMessage &msg)
 ///      8) A message has been received with a kill flag. The kill is less than
 ///         the expected sequence number and the message's sequence number is
 ///         greater than the expected sequence number.
+///      9) A message has been recieved within the window after the expected
+///         sequence number, without a usable kill.
+///      10) A message has been recieved from before the expected sequence
+///         number.
 /// @post Cases are handled as follows:
 ///      1) The connection is resynced.
-///      2) The message is ACKed, the send time of the sync is noted, and the
-///         connection is synced.
-///      3) The SYN is ignored.
+///      2) The message is ACKed, the send time of the sync is noted, the held
+///         messages are discarded and the connection is synced.
+///      3) The SYN is not accepted again, but the current ACK is written.
 ///      4) A bad request message is generated and sent to the source.
-///      5) The message is accepted.
+///      5) The message is accepted. Held messages that follow it are made
+///         ready.
 ///      6) The message is rejected. Kills should only ever be less than the
 ///         expected sequence number unless the message is arrived out of order
 ///      7) The message is simply old but still arriving at the socket, and can
 ///         be rejected.
 ///      8) The message should be accepted because one or more message expired
-///         in the gap of sequence numbers.
+///         in the gap of sequence numbers. Any held messages in the gap are
+///         made ready ahead of it, and those that follow it after.
+///      9) The message is held and selectively ACKed.
+///      10) The message is rejected and the current ACK is written again,
+///         since the sender has evidently not seen it.
 /// @return True if the message is accepted, false otherwise.
 ///////////////////////////////////////////////////////////////////////////////
 bool CSRConnection::Recieve(const CMessage &msg)
@@ -285,10 +490,12 @@ bool CSRConnection::Recieve(const CMessage &msg)
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     unsigned int kill = 0;
     bool usekill = false; //If true, we should accept any inseq
+    unsigned int seq = msg.GetSequenceNumber();
     if(msg.GetStatus() == freedm::broker::CMessage::BadRequest)
     {
         //See if we are already trying to sync:
-        if(m_window.front().GetStatus() != freedm::broker::CMessage::Created)
+        if(m_window.size() > 0 &&
+            m_window.front().msg.GetStatus() != freedm::broker::CMessage::Created)
         {
             if(m_outsynctime != msg.GetSendTimestamp())
             {
@@ -307,14 +514,21 @@ bool CSRConnection::Recieve(const CMessage &msg)
         //Check to see if we've already seen this SYN:
         if(msg.GetSendTimestamp() == m_insynctime)
         {
-            return false;
             Logger.Notice<<"Duplicate Sync"<<std::endl;
+            // The sender missed the ACK; the current one covers the SYN.
+            if(m_currentack.GetStatus() == freedm::broker::CMessage::Accepted
+                && !m_currentack.IsExpired())
+            {
+                HoldACK(m_currentack, true);
+            }
+            return false;
         }
         Logger.Notice<<"Got Sync"<<std::endl;
-        m_inseq = (msg.GetSequenceNumber()+1)%SEQUENCE_MODULO;
+        m_inseq = (seq+1)%SEQUENCE_MODULO;
         m_insynctime = msg.GetSendTimestamp();
         m_inresyncs++;
         m_insync = true;
+        m_inbuffer.clear();
         SendACK(msg);
         return false;
     }
@@ -338,49 +552,128 @@ bool CSRConnection::Recieve(const CMessage &msg)
     // we should use it. 
     try
     {
-        ptree pp = msg.GetProtocolProperties();
+        const ptree &pp = msg.GetProtocolProperties();
         kill = pp.get<unsigned int>("src.kill");
         usekill = true;
     }
     catch(std::exception &e)
     {
-        kill = msg.GetSequenceNumber();
+        kill = seq;
         usekill = false;
     }
     //Consider the window you expect to see
     // If the killed message is the one immediately preceeding this
     // message in terms of sequence number we should accept it
-    if(msg.GetSequenceNumber() == m_inseq)
+    if(seq == m_inseq)
     {
         //m_insync = true;
         m_inseq = (m_inseq+1)%SEQUENCE_MODULO;
+        m_inbuffer.erase(seq);
+        PromoteBuffered();
         return true;
     }
-    else if(usekill == true && kill< m_inseq
-            && msg.GetSequenceNumber() > m_inseq)
+    else if(usekill == true && kill< m_inseq && seq > m_inseq)
     {
+        // Anything held from inside the gap was sent before this message
+        // and is handed out first.
+        for(unsigned int d = 1; d < Distance(m_inseq, seq); d++)
+        {
+            std::map<unsigned int, CMessage>::iterator it = m_inbuffer.find(
+                (m_inseq+d)%SEQUENCE_MODULO);
+            if(it != m_inbuffer.end())
+            {
+                m_ready.push_back(it->second);
+                m_inbuffer.erase(it);
+            }
+        }
+        m_inbuffer.erase(m_inseq);
+        m_inbuffer.erase(seq);
         //m_inseq will be right for the next expected message.
-        m_inseq = (msg.GetSequenceNumber()+1)%SEQUENCE_MODULO;
-        return true;
+        m_inseq = (seq+1)%SEQUENCE_MODULO;
+        if(m_ready.empty())
+        {
+            PromoteBuffered();
+            return true;
+        }
+        m_ready.push_back(msg);
+        PromoteBuffered();
+        SendACK(msg);
+        return false;
     }
     else if(usekill == true)
     {
         Logger.Notice<<"KILL: "<<kill<<" INSEQ "<<m_inseq<<" SEQ: "
-                      <<msg.GetSequenceNumber()<<std::endl;
+                      <<seq<<std::endl;
+    }
+    if(Distance(m_inseq, seq) < MAX_WINDOW)
+    {
+        // Ahead of a gap: hold it and tell the sender to stop resending it.
+        if(m_inbuffer.find(seq) == m_inbuffer.end())
+        {
+            m_inbuffer.insert(std::make_pair(seq, msg));
+        }
+        SendACK(msg);
+        return false;
+    }
+    if(m_currentack.GetStatus() == freedm::broker::CMessage::Accepted
+        && !m_currentack.IsExpired())
+    {
+        HoldACK(m_currentack, true);
     }
     // Justin case.
     return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// CSRConnection::PromoteBuffered
+/// @description Moves held messages that continue the sequence from the
+///   expected sequence number to the ready queue.
+/// @pre None
+/// @post m_inseq is past every held message that is now in order.
+///////////////////////////////////////////////////////////////////////////////
+void CSRConnection::PromoteBuffered()
+{
+    std::map<unsigned int, CMessage>::iterator it;
+    while((it = m_inbuffer.find(m_inseq)) != m_inbuffer.end())
+    {
+        m_ready.push_back(it->second);
+        m_inbuffer.erase(it);
+        m_inseq = (m_inseq+1)%SEQUENCE_MODULO;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// CSRConnection::TakeReady
+/// @description Hands out the messages that Recieve made deliverable, in
+///   order, after the message it accepted (if any).
+/// @pre Called after Recieve, on the connection's strand.
+/// @post The returned message is removed from the ready queue.
+/// @param msg Set to the next ready message.
+/// @return True if a message was returned.
+///////////////////////////////////////////////////////////////////////////////
+bool CSRConnection::TakeReady(CMessage &msg)
+{
+    if(m_ready.empty())
+    {
+        return false;
+    }
+    msg = m_ready.front();
+    m_ready.pop_front();
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// CSRConnection::SendACK
-/// @description Composes an ack and writes it to the channel. ACKS are saved
-///     to the protocol's state and are written again during resends to try and
-///     maximize througput.
+/// @description Composes an ack and hands it to HoldACK. Besides the hash of
+///     the message, each ACK carries the last sequence number delivered in
+///     order (src.cum) and the held sequence numbers (src.sack), so one ACK
+///     covers the whole window and a later ACK can stand in for an earlier
+///     one that was still held. An ACK that reports a gap, or answers a
+///     message marked src.urgent, is written at once.
 /// @param The message to ACK.
-/// @pre A message has been accepted.
-/// @post The m_currentack member is set to the ack and the message will
-///     be resent during resend until it expires.
+/// @pre A message has been accepted or held.
+/// @post The m_currentack member is set to the ack, which is written now,
+///     held for the ack-delay, or carried by the next data message.
 ///////////////////////////////////////////////////////////////////////////////
 void CSRConnection::SendACK(const CMessage &msg)
 {
@@ -388,7 +681,27 @@ void CSRConnection::SendACK(const CMessage &msg)
     unsigned int seq = msg.GetSequenceNumber();
     freedm::broker::CMessage outmsg;
     ptree pp;
-    pp.put("src.hash",msg.GetHash());
+    // Brokers before DIGEST_VERSION only know the XML hash. Whether the
+    // sender is one of them shows in the version its message advertised.
+    if(msg.GetWireVersion() >= CWireCodec::DIGEST_VERSION)
+    {
+        pp.put("src.hash",msg.GetHash());
+    }
+    else
+    {
+        pp.put("src.hash",msg.GetLegacyHash());
+    }
+    pp.put("src.cum",(m_inseq+SEQUENCE_MODULO-1)%SEQUENCE_MODULO);
+    if(!m_inbuffer.empty())
+    {
+        std::stringstream ss;
+        std::map<unsigned int, CMessage>::const_iterator it;
+        for(it = m_inbuffer.begin(); it != m_inbuffer.end(); ++it)
+        {
+            ss<<(it == m_inbuffer.begin() ? "" : ",")<<it->first;
+        }
+        pp.put("src.sack",ss.str());
+    }
     // Presumably, if we are here, the connection is registered 
     outmsg.SetSourceUUID(GetConnection()->GetConnectionManager().GetUUID());
     outmsg.SetSourceHostname(GetConnection()->GetConnectionManager().GetHostname());
@@ -399,13 +712,9 @@ void CSRConnection::SendACK(const CMessage &msg)
     outmsg.SetProtocolProperties(pp);
     Logger.Notice<<"Generating ACK. Source exp time "<<msg.GetExpireTime()<<std::endl;
     outmsg.SetExpireTime(msg.GetExpireTime());
-    Write(outmsg);
     m_currentack = outmsg;
-    /// Hook into resend until the message expires.
-    m_timeout.cancel();
-    m_timeout.expires_from_now(boost::posix_time::milliseconds(REFIRE_TIME));
-    m_timeout.async_wait(boost::bind(&CSRConnection::Resend,this,
-        boost::asio::placeholders::error));
+    HoldACK(outmsg, !m_inbuffer.empty() ||
+        msg.GetProtocolProperties().get<bool>("src.urgent", false));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -413,7 +722,9 @@ void CSRConnection::SendACK(const CMessage &msg)
 /// @description Composes an SYN and writes it to the channel.
 /// @param The message to SYN.
 /// @pre A message has been accepted.
-/// @post A syn has been written to the channel
+/// @post A syn has been written to the channel. Messages already in the
+///     window will be sent again once it is ACKed, since the receiver drops
+///     whatever it was holding when it syncs.
 ///////////////////////////////////////////////////////////////////////////////
 void CSRConnection::SendSYN()
 {
@@ -427,12 +738,12 @@ void CSRConnection::SendSYN()
     else
     {
         //Don't bother if front of queue is already a SYN
-        if(m_window.front().GetStatus() == CMessage::Created)
+        if(m_window.front().msg.GetStatus() == CMessage::Created)
         {
             return;
         }
         //Set it as the seq before the front of queue
-        seq = m_window.front().GetSequenceNumber();
+        seq = m_window.front().msg.GetSequenceNumber();
         if(seq == 0)
         {
             seq = SEQUENCE_MODULO-1;
@@ -442,6 +753,14 @@ void CSRConnection::SendSYN()
             seq--;
         }
     }
+    std::deque<QueueItem>::iterator it;
+    for(it = m_window.begin(); it != m_window.end(); ++it)
+    {
+        // Copies already in the channel make any ACK ambiguous.
+        it->resent = it->resent || it->sent;
+        it->sent = false;
+        it->sacked = false;
+    }
     // Presumably, if we are here, the connection is registered 
     outmsg.SetSourceUUID(GetConnection()->GetConnectionManager().GetUUID());
     outmsg.SetSourceHostname(GetConnection()->GetConnectionManager().GetHostname());
@@ -449,8 +768,13 @@ void CSRConnection::SendSYN()
     outmsg.SetSequenceNumber(seq);
     outmsg.SetSendTimestampNow();
     outmsg.SetProtocol(GetIdentifier());
-    Write(outmsg);
-    m_window.push_front(outmsg);
+    QueueItem q;
+    q.msg = outmsg;
+    q.sent = false;
+    q.resent = false;
+    q.sacked = false;
+    q.delivered = false;
+    m_window.push_front(q);
     m_outsync = true;
     /// Hook into resend until the message expires.
     boost::system::error_code x;
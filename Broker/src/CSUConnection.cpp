@@ -35,6 +35,7 @@
 #include "CMessage.hpp"
 #include "CConnectionManager.hpp"
 #include "IProtocol.hpp"
+#include "CClock.hpp"
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
@@ -51,8 +52,11 @@ static CLocalLogger Logger(__FILE__);
 namespace freedm {
     namespace broker {
 
+const unsigned int CSUConnection::RESEND_TIME;
+
 CSUConnection::CSUConnection(CConnection *  conn)
-    : IProtocol(conn),
+    : IProtocol(conn, Identifier(),
+          boost::posix_time::milliseconds(RESEND_TIME)),
       m_timeout(conn->GetSocket().get_io_service())
 {
     m_outseq = 0;
@@ -60,12 +64,15 @@ CSUConnection::CSUConnection(CConnection *  conn)
     m_acceptmod = SEQUENCE_MODULO/WINDOW_SIZE;
 }
 
-void CSUConnection::Send(CMessage msg)
+void CSUConnection::Send(const CMessage &msg)
 {
-    ptree x = static_cast<ptree>(msg);
     unsigned int msgseq;
 
-    CMessage outmsg(x);
+    // Shares the submessages with msg and every other copy sent with it.
+    CMessage outmsg(msg);
+    // Protocol properties belong to one hop. A message passed on after it
+    // was received would otherwise carry its ACK back to the sender.
+    outmsg.SetProtocolProperties(ptree());
     
     msgseq = m_outseq;
     outmsg.SetSequenceNumber(msgseq);
@@ -83,14 +90,19 @@ void CSUConnection::Send(CMessage msg)
     q.msg = outmsg;
 
     m_window.push_back(q);
+    GetMetrics().window.Set(m_window.size());
     
     if(m_window.size() < WINDOW_SIZE)
     {
         Write(outmsg);
+        m_window.back().ret--;
+        m_window.back().written =
+            CClock::Now();
         m_timeout.cancel();
-        m_timeout.expires_from_now(boost::posix_time::milliseconds(50));
-        m_timeout.async_wait(boost::bind(&CSUConnection::Resend,this,
-            boost::asio::placeholders::error)); 
+        m_timeout.expires_from_now(GetRtt().GetRTO());
+        m_timeout.async_wait(GetConnection()->GetStrand().wrap(
+            boost::bind(&CSUConnection::Resend, this,
+            boost::asio::placeholders::error))); 
     }
 }
 
@@ -98,36 +110,57 @@ void CSUConnection::Resend(const boost::system::error_code& err)
 {
     if(!err)
     {
-        int ws = m_window.size();
-        int writes = 0;
-        for(int i=0; i < ws; i++)
-        {
-            QueueItem f = m_window.front();
-            m_window.pop_front();
-            if(f.ret > 0 && writes < static_cast<int>(WINDOW_SIZE))
-            {        
-                Write(f.msg);
-                writes++;
-                f.ret--;
-            }
-            if(f.ret > 0)
+        // Nothing was acknowledged for a whole timeout.
+        GetRtt().Backoff();
+        WriteWindow();
+    }
+}
+
+void CSUConnection::WriteWindow()
+{
+    int ws = m_window.size();
+    int writes = 0;
+    unsigned long retransmits = 0;
+    for(int i=0; i < ws; i++)
+    {
+        QueueItem f = m_window.front();
+        m_window.pop_front();
+        if(f.ret > 0 && writes < static_cast<int>(WINDOW_SIZE))
+        {        
+            Write(f.msg);
+            writes++;
+            if(f.ret == static_cast<int>(MAX_RETRIES))
             {
-                 m_window.push_back(f);
+                f.written = CClock::Now();
             }
             else
             {
-                Logger.Notice<<"Gave Up Sending (No Retries) "<<f.msg.GetHash()
-                              <<":"<<f.msg.GetSequenceNumber()<<std::endl;
+                retransmits++;
             }
+            f.ret--;
         }
-        if(m_window.size() > 0)
+        if(f.ret > 0)
         {
-            m_timeout.cancel();
-            m_timeout.expires_from_now(boost::posix_time::milliseconds(50));
-            m_timeout.async_wait(boost::bind(&CSUConnection::Resend,this,
-                boost::asio::placeholders::error));
+             m_window.push_back(f);
+        }
+        else
+        {
+            Logger.Notice<<"Gave Up Sending (No Retries) "<<f.msg.GetHash()
+                          <<":"<<f.msg.GetSequenceNumber()<<std::endl;
+            GetMetrics().expired.Add();
         }
     }
+    GetRtt().CountRetransmits(retransmits);
+    GetMetrics().resent.Add(retransmits);
+    GetMetrics().window.Set(m_window.size());
+    if(m_window.size() > 0)
+    {
+        m_timeout.cancel();
+        m_timeout.expires_from_now(GetRtt().GetRTO());
+        m_timeout.async_wait(GetConnection()->GetStrand().wrap(
+            boost::bind(&CSUConnection::Resend, this,
+            boost::asio::placeholders::error)));
+    }
 }
 
 void CSUConnection::RecieveACK(const CMessage &msg)
@@ -140,6 +173,14 @@ void CSUConnection::RecieveACK(const CMessage &msg)
         unsigned int boundb = (fseq+WINDOW_SIZE)%SEQUENCE_MODULO;
         if(bounda <= seq || (seq < boundb and boundb < bounda))
         {
+            // Karn: a message written more than once gives no sample.
+            if(fseq == seq &&
+                m_window.front().ret == static_cast<int>(MAX_RETRIES) - 1)
+            {
+                GetRtt().Sample(
+                    CClock::Now() -
+                    m_window.front().written);
+            }
             m_window.pop_front();
         }
         else
@@ -147,10 +188,10 @@ void CSUConnection::RecieveACK(const CMessage &msg)
             break;
         }
     }
+    GetMetrics().window.Set(m_window.size());
     if(m_window.size() > 0)
     {
-        boost::system::error_code x;
-        Resend(x);
+        WriteWindow();
     }
 }
 
@@ -185,7 +226,8 @@ void CSUConnection::SendACK(const CMessage &msg)
     outmsg.SetSequenceNumber(seq);
     outmsg.SetProtocol(GetIdentifier());
     outmsg.SetSendTimestampNow();
-    Write(outmsg);
+    // A later ACK pops everything this one would, so it may be held.
+    HoldACK(outmsg);
 }
 
     }
@@ -0,0 +1,571 @@
+////////////////////////////////////////////////////////////////////
+/// @file      CWireCodec.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Implementation of the compact binary datagram encoding
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CWireCodec.hpp"
+#include "CLogger.hpp"
+
+static CLocalLogger Logger(__FILE__);
+
+#include <boost/integer_traits.hpp>
+
+namespace freedm {
+    namespace broker {
+
+const unsigned char CWireCodec::MAGIC;
+const unsigned char CWireCodec::VERSION;
+const unsigned char CWireCodec::DIGEST_VERSION;
+const unsigned char CWireCodec::PIGGYBACK_VERSION;
+const std::size_t CWireCodec::PREAMBLE_SIZE;
+const unsigned char CWireCodec::FLAG_NEVER_EXPIRES;
+const unsigned char CWireCodec::FLAG_EXPIRES;
+const unsigned char CWireCodec::FLAG_RAW_UUID;
+
+namespace {
+
+/// Protocols that are sent as a one byte index. Index 0 is an inline string.
+const char * const PROTOCOL_TABLE[] = { "", "SRC", "SUC" };
+const std::size_t PROTOCOL_COUNT =
+    sizeof(PROTOCOL_TABLE) / sizeof(PROTOCOL_TABLE[0]);
+
+/// Deepest ptree nesting accepted from the wire.
+const unsigned int MAX_TREE_DEPTH = 64;
+
+/// Sentinels for the special time values that have no epoch offset.
+const boost::int64_t TIME_NOT_A_DATE = boost::integer_traits<boost::int64_t>::const_min;
+const boost::int64_t TIME_NEG_INFIN = TIME_NOT_A_DATE + 1;
+const boost::int64_t TIME_POS_INFIN = boost::integer_traits<boost::int64_t>::const_max;
+
+void PutU8(std::string &p_out, unsigned char p_v)
+{
+    p_out.push_back(static_cast<char>(p_v));
+}
+
+void PutU16(std::string &p_out, boost::uint16_t p_v)
+{
+    PutU8(p_out, p_v & 0xFF);
+    PutU8(p_out, (p_v >> 8) & 0xFF);
+}
+
+void PutU32(std::string &p_out, boost::uint32_t p_v)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        PutU8(p_out, (p_v >> (8*i)) & 0xFF);
+    }
+}
+
+void PutI64(std::string &p_out, boost::int64_t p_v)
+{
+    boost::uint64_t v = static_cast<boost::uint64_t>(p_v);
+    for(int i = 0; i < 8; i++)
+    {
+        PutU8(p_out, (v >> (8*i)) & 0xFF);
+    }
+}
+
+void PutVarint(std::string &p_out, std::size_t p_v)
+{
+    while(p_v >= 0x80)
+    {
+        PutU8(p_out, (p_v & 0x7F) | 0x80);
+        p_v >>= 7;
+    }
+    PutU8(p_out, p_v);
+}
+
+void PutString(std::string &p_out, const std::string &p_s)
+{
+    PutVarint(p_out, p_s.size());
+    p_out.append(p_s);
+}
+
+bool GetU8(const char *&p_cur, const char * p_end, unsigned char &p_v)
+{
+    if(p_cur >= p_end)
+        return false;
+    p_v = static_cast<unsigned char>(*p_cur++);
+    return true;
+}
+
+bool GetU16(const char *&p_cur, const char * p_end, boost::uint16_t &p_v)
+{
+    if(p_end - p_cur < 2)
+        return false;
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p_cur);
+    p_v = b[0] | (b[1] << 8);
+    p_cur += 2;
+    return true;
+}
+
+bool GetU32(const char *&p_cur, const char * p_end, boost::uint32_t &p_v)
+{
+    if(p_end - p_cur < 4)
+        return false;
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p_cur);
+    p_v = 0;
+    for(int i = 3; i >= 0; i--)
+    {
+        p_v = (p_v << 8) | b[i];
+    }
+    p_cur += 4;
+    return true;
+}
+
+bool GetI64(const char *&p_cur, const char * p_end, boost::int64_t &p_v)
+{
+    if(p_end - p_cur < 8)
+        return false;
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p_cur);
+    boost::uint64_t v = 0;
+    for(int i = 7; i >= 0; i--)
+    {
+        v = (v << 8) | b[i];
+    }
+    p_v = static_cast<boost::int64_t>(v);
+    p_cur += 8;
+    return true;
+}
+
+bool GetVarint(const char *&p_cur, const char * p_end, std::size_t &p_v)
+{
+    unsigned char b;
+    p_v = 0;
+    for(unsigned int shift = 0; shift < 8*sizeof(std::size_t); shift += 7)
+    {
+        if(!GetU8(p_cur, p_end, b))
+            return false;
+        p_v |= static_cast<std::size_t>(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool GetString(const char *&p_cur, const char * p_end, std::string &p_s)
+{
+    std::size_t len;
+    if(!GetVarint(p_cur, p_end, len) || len > std::size_t(p_end - p_cur))
+        return false;
+    p_s.assign(p_cur, len);
+    p_cur += len;
+    return true;
+}
+
+int HexValue(char p_c)
+{
+    if(p_c >= '0' && p_c <= '9')
+        return p_c - '0';
+    if(p_c >= 'a' && p_c <= 'f')
+        return p_c - 'a' + 10;
+    return -1;
+}
+
+/// Packs a canonical lower case uuid string into 16 bytes. Anything else
+/// (including upper case) is refused so the string survives the round trip.
+bool PackUUID(const std::string &p_s, unsigned char p_raw[16])
+{
+    if(p_s.size() != 36)
+        return false;
+    std::size_t j = 0;
+    for(std::size_t i = 0; i < 36; i++)
+    {
+        if(i == 8 || i == 13 || i == 18 || i == 23)
+        {
+            if(p_s[i] != '-')
+                return false;
+            continue;
+        }
+        int hi = HexValue(p_s[i]), lo = HexValue(p_s[i+1]);
+        if(hi < 0 || lo < 0)
+            return false;
+        p_raw[j++] = (hi << 4) | lo;
+        i++;
+    }
+    return true;
+}
+
+std::string UnpackUUID(const unsigned char p_raw[16])
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(36);
+    for(std::size_t i = 0; i < 16; i++)
+    {
+        if(i == 4 || i == 6 || i == 8 || i == 10)
+            s.push_back('-');
+        s.push_back(digits[p_raw[i] >> 4]);
+        s.push_back(digits[p_raw[i] & 0x0F]);
+    }
+    return s;
+}
+
+bool DecodeNode(const char *&p_cur, const char * p_end, ptree &p_tree,
+    unsigned int p_depth)
+{
+    std::string data;
+    std::size_t children;
+    if(p_depth > MAX_TREE_DEPTH || !GetString(p_cur, p_end, data) ||
+       !GetVarint(p_cur, p_end, children))
+        return false;
+    // Each child needs at least a key length and a node, so a count larger
+    // than the remaining bytes can only come from a corrupt datagram.
+    if(children > std::size_t(p_end - p_cur))
+        return false;
+    p_tree.data().swap(data);
+    for(std::size_t i = 0; i < children; i++)
+    {
+        std::string key;
+        if(!GetString(p_cur, p_end, key))
+            return false;
+        ptree &child = p_tree.push_back(ptree::value_type(key, ptree()))->second;
+        if(!DecodeNode(p_cur, p_end, child, p_depth + 1))
+            return false;
+    }
+    return true;
+}
+
+bool SkipNode(const char *&p_cur, const char * p_end, unsigned int p_depth)
+{
+    std::size_t len, children;
+    if(p_depth > MAX_TREE_DEPTH || !GetVarint(p_cur, p_end, len) ||
+       len > std::size_t(p_end - p_cur))
+        return false;
+    p_cur += len;
+    if(!GetVarint(p_cur, p_end, children) ||
+       children > std::size_t(p_end - p_cur))
+        return false;
+    for(std::size_t i = 0; i < children; i++)
+    {
+        if(!GetVarint(p_cur, p_end, len) || len > std::size_t(p_end - p_cur))
+            return false;
+        p_cur += len;
+        if(!SkipNode(p_cur, p_end, p_depth + 1))
+            return false;
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::IsBinary
+/// @description Looks at the preamble of a datagram to decide which decoder
+///   it belongs to.
+/// @pre None
+/// @post None
+/// @param p_data The start of the datagram
+/// @param p_length The number of bytes in the datagram
+/// @return True if the datagram starts with the binary magic byte.
+///////////////////////////////////////////////////////////////////////////////
+bool CWireCodec::IsBinary(const char * p_data, std::size_t p_length)
+{
+    return p_length > 0 && static_cast<unsigned char>(p_data[0]) == MAGIC;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::Encode
+/// @description Writes the binary form of a message, preamble included.
+/// @pre None
+/// @post The datagram has been appended to p_out.
+/// @param p_msg The message to encode
+/// @param p_out The buffer to append the datagram to
+/// @param p_version The version to stamp on the datagram, so that a peer
+///   running older code is told which hash its ACKs should carry.
+///////////////////////////////////////////////////////////////////////////////
+void CWireCodec::Encode(const CMessage &p_msg, std::string &p_out,
+    unsigned char p_version)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    std::size_t start = p_out.size();
+    unsigned char flags = 0;
+    unsigned char protocol = 0;
+    unsigned char raw[16];
+    const CMessage::Header &header = p_msg.GetHeader();
+
+    if(p_msg.m_never_expires)
+        flags |= FLAG_NEVER_EXPIRES;
+    if(!p_msg.m_expiretime.is_not_a_date_time())
+        flags |= FLAG_EXPIRES;
+    if(PackUUID(header.srcUUID, raw))
+        flags |= FLAG_RAW_UUID;
+    for(std::size_t i = 1; i < PROTOCOL_COUNT; i++)
+    {
+        if(header.protocol == PROTOCOL_TABLE[i])
+            protocol = i;
+    }
+
+    PutU8(p_out, MAGIC);
+    PutU8(p_out, p_version);
+    PutU32(p_out, 0); // Length, patched below
+    PutU8(p_out, flags);
+    PutU8(p_out, protocol);
+    PutU16(p_out, p_msg.m_status);
+    PutU32(p_out, p_msg.m_sequenceno);
+    PutI64(p_out, ToMicroseconds(p_msg.m_sendtime));
+    if(flags & FLAG_EXPIRES)
+        PutI64(p_out, ToMicroseconds(p_msg.m_expiretime));
+    if(flags & FLAG_RAW_UUID)
+        p_out.append(reinterpret_cast<const char *>(raw), 16);
+    else
+        PutString(p_out, header.srcUUID);
+    PutString(p_out, header.host.hostname);
+    PutString(p_out, header.host.port);
+    if(protocol == 0)
+        PutString(p_out, header.protocol);
+    EncodeTree(p_msg.GetProtocolProperties(), p_out);
+    p_out.append(p_msg.GetEncodedSubMessages());
+
+    boost::uint32_t length = p_out.size() - start;
+    for(int i = 0; i < 4; i++)
+    {
+        p_out[start + 2 + i] = static_cast<char>((length >> (8*i)) & 0xFF);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::Decode
+/// @description Parses a binary datagram. Every read is bounds checked, so a
+///   truncated or corrupt datagram is rejected rather than read past.
+/// @pre IsBinary is true for the buffer
+/// @post On success p_msg holds the decoded message and its wire version is
+///   set to the version of the datagram.
+/// @param p_data The start of the datagram
+/// @param p_length The number of bytes in the datagram
+/// @param p_msg The message to decode into
+/// @return True if the datagram was complete and well formed.
+///////////////////////////////////////////////////////////////////////////////
+bool CWireCodec::Decode(const char * p_data, std::size_t p_length,
+    CMessage &p_msg)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    const char * cur = p_data;
+    const char * end = p_data + p_length;
+    const char * submessages;
+    unsigned char magic, version, flags, protocol;
+    boost::uint16_t status;
+    boost::uint32_t length, seq;
+    boost::int64_t sendtime, expiretime = TIME_NOT_A_DATE;
+    boost::shared_ptr<CMessage::Header> header(new CMessage::Header);
+    boost::shared_ptr<ptree> properties(new ptree);
+
+    if(!GetU8(cur, end, magic) || magic != MAGIC ||
+       !GetU8(cur, end, version) || !GetU32(cur, end, length))
+        return false;
+    if(version == 0 || version > VERSION)
+    {
+        Logger.Warn << "Unsupported wire version " << int(version)
+                    << std::endl;
+        return false;
+    }
+    if(length != p_length)
+    {
+        Logger.Warn << "Datagram length mismatch: header " << length
+                    << " received " << p_length << std::endl;
+        return false;
+    }
+    if(!GetU8(cur, end, flags) || !GetU8(cur, end, protocol) ||
+       !GetU16(cur, end, status) || !GetU32(cur, end, seq) ||
+       !GetI64(cur, end, sendtime))
+        return false;
+    if((flags & FLAG_EXPIRES) && !GetI64(cur, end, expiretime))
+        return false;
+    if(flags & FLAG_RAW_UUID)
+    {
+        if(end - cur < 16)
+            return false;
+        header->srcUUID = UnpackUUID(reinterpret_cast<const unsigned char *>(cur));
+        cur += 16;
+    }
+    else if(!GetString(cur, end, header->srcUUID))
+    {
+        return false;
+    }
+    if(!GetString(cur, end, header->host.hostname) ||
+       !GetString(cur, end, header->host.port))
+        return false;
+    if(protocol == 0)
+    {
+        if(!GetString(cur, end, header->protocol))
+            return false;
+    }
+    else if(protocol < PROTOCOL_COUNT)
+    {
+        header->protocol = PROTOCOL_TABLE[protocol];
+    }
+    else
+    {
+        return false;
+    }
+    // The protocol properties drive the accept/ACK decision, so they are
+    // decoded now. The submessages are only checked and kept as bytes until
+    // something asks for them.
+    if(!DecodeTree(cur, end, *properties))
+        return false;
+    submessages = cur;
+    if(!SkipTree(cur, end) || cur != end)
+        return false;
+
+    p_msg.m_header = header;
+    p_msg.m_properties = properties;
+    p_msg.SetEncodedSubMessages(submessages, end - submessages);
+    p_msg.m_status = static_cast<CMessage::StatusType>(status);
+    p_msg.m_sequenceno = seq;
+    p_msg.m_never_expires = flags & FLAG_NEVER_EXPIRES;
+    p_msg.m_sendtime = FromMicroseconds(sendtime);
+    p_msg.m_expiretime = FromMicroseconds(expiretime);
+    p_msg.m_wireversion = version;
+    p_msg.m_hasdigest = false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::EncodeTree
+/// @description Writes a property tree depth first.
+/// @pre None
+/// @post The tree has been appended to p_out.
+/// @param p_tree The tree to write
+/// @param p_out The buffer to append to
+///////////////////////////////////////////////////////////////////////////////
+void CWireCodec::EncodeTree(const ptree &p_tree, std::string &p_out)
+{
+    PutString(p_out, p_tree.data());
+    PutVarint(p_out, p_tree.size());
+    for(ptree::const_iterator it = p_tree.begin(); it != p_tree.end(); it++)
+    {
+        PutString(p_out, it->first);
+        EncodeTree(it->second, p_out);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::DecodeTree
+/// @description Reads a property tree written by EncodeTree.
+/// @pre p_cursor points at an encoded tree
+/// @post On success p_cursor has been moved past the tree.
+/// @param p_cursor The read position
+/// @param p_end One past the last readable byte
+/// @param p_tree The tree to fill
+/// @return False if the tree is truncated, corrupt or nested too deeply.
+///////////////////////////////////////////////////////////////////////////////
+bool CWireCodec::DecodeTree(const char *&p_cursor, const char * p_end,
+    ptree &p_tree)
+{
+    p_tree.clear();
+    return DecodeNode(p_cursor, p_end, p_tree, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::SkipTree
+/// @description Checks an encoded property tree against the same limits as
+///   DecodeTree without building it.
+/// @pre p_cursor points at an encoded tree
+/// @post On success p_cursor has been moved past the tree.
+/// @param p_cursor The read position
+/// @param p_end One past the last readable byte
+/// @return False if DecodeTree would fail on the same bytes.
+///////////////////////////////////////////////////////////////////////////////
+bool CWireCodec::SkipTree(const char *&p_cursor, const char * p_end)
+{
+    return SkipNode(p_cursor, p_end, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::TreeKeys
+/// @description Reads the keys of the root's children, skipping over
+///   everything below them.
+/// @pre None
+/// @post The keys have been appended to p_keys in order.
+/// @param p_data The encoded tree
+/// @param p_length The number of bytes in the encoded tree
+/// @param p_keys The list to append the keys to
+/// @return False if the tree is malformed.
+///////////////////////////////////////////////////////////////////////////////
+bool CWireCodec::TreeKeys(const char * p_data, std::size_t p_length,
+    std::vector<std::string> &p_keys)
+{
+    const char * cur = p_data;
+    const char * end = p_data + p_length;
+    std::size_t len, children;
+    if(!GetVarint(cur, end, len) || len > std::size_t(end - cur))
+        return false;
+    cur += len;
+    if(!GetVarint(cur, end, children))
+        return false;
+    for(std::size_t i = 0; i < children; i++)
+    {
+        std::string key;
+        if(!GetString(cur, end, key) || !SkipNode(cur, end, 1))
+            return false;
+        p_keys.push_back(key);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::ToMicroseconds
+/// @description Converts a timestamp to an epoch offset. The special values
+///   (not a date time and the infinities) map to reserved sentinels.
+/// @param p_t The timestamp to convert
+/// @return Microseconds since 1970-01-01 00:00:00 UTC
+///////////////////////////////////////////////////////////////////////////////
+boost::int64_t CWireCodec::ToMicroseconds(const boost::posix_time::ptime &p_t)
+{
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970,1,1));
+    if(p_t.is_not_a_date_time())
+        return TIME_NOT_A_DATE;
+    if(p_t.is_pos_infinity())
+        return TIME_POS_INFIN;
+    if(p_t.is_neg_infinity())
+        return TIME_NEG_INFIN;
+    return (p_t - epoch).total_microseconds();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn CWireCodec::FromMicroseconds
+/// @description Inverse of ToMicroseconds.
+/// @param p_us Microseconds since the epoch or a sentinel
+/// @return The timestamp
+///////////////////////////////////////////////////////////////////////////////
+boost::posix_time::ptime CWireCodec::FromMicroseconds(boost::int64_t p_us)
+{
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970,1,1));
+    if(p_us == TIME_NOT_A_DATE)
+        return boost::posix_time::ptime(boost::date_time::not_a_date_time);
+    if(p_us == TIME_POS_INFIN)
+        return boost::posix_time::ptime(boost::date_time::pos_infin);
+    if(p_us == TIME_NEG_INFIN)
+        return boost::posix_time::ptime(boost::date_time::neg_infin);
+    return epoch + boost::posix_time::microseconds(p_us);
+}
+
+    } // namespace broker
+} // namespace freedm
@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////
+/// @file      EventLogDecoder.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Prints the records of broker event logs as CSV or as JSON
+///   lines, in time order, with peer IDs replaced by their UUIDs
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, MO 65409 (ff@mst.edu).
+////////////////////////////////////////////////////////////////////
+
+#include "CEventLog.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace po = boost::program_options;
+using freedm::broker::CEventLog;
+
+namespace {
+
+/// A record and the log it came from. Peer IDs are only meaningful within
+/// the log of the node that handed them out.
+struct Entry
+{
+    CEventLog::Event event;
+    std::size_t log;
+};
+
+/// Orders entries by time, names first within a microsecond; a stable sort
+/// keeps each thread's own order.
+bool Earlier(const Entry &p_lhs, const Entry &p_rhs)
+{
+    if(p_lhs.event.time != p_rhs.event.time)
+        return p_lhs.event.time < p_rhs.event.time;
+    return p_lhs.event.type == CEventLog::PEER_NAME &&
+        p_rhs.event.type != CEventLog::PEER_NAME;
+}
+
+/// The time of a record as an ISO 8601 string with microseconds.
+std::string FormatTime(boost::uint64_t p_micros)
+{
+    using namespace boost::posix_time;
+    ptime epoch_(boost::gregorian::date(1970, 1, 1));
+    return to_iso_extended_string(epoch_ +
+        seconds(static_cast<long>(p_micros / 1000000)) +
+        microseconds(static_cast<long>(p_micros % 1000000)));
+}
+
+/// Quotes a string for JSON or CSV. UUIDs are host names and hex, so only
+/// quotes and backslashes need escaping.
+std::string Quote(const std::string &p_text, bool p_json)
+{
+    std::string out_ = "\"";
+    for(std::size_t i = 0; i < p_text.size(); i++)
+    {
+        if(p_text[i] == '"')
+            out_ += p_json ? "\\\"" : "\"\"";
+        else if(p_text[i] == '\\' && p_json)
+            out_ += "\\\\";
+        else
+            out_ += p_text[i];
+    }
+    return out_ + "\"";
+}
+
+/// Reads every record of one log into p_entries.
+bool ReadLog(const std::string &p_path, std::size_t p_log,
+    std::vector<Entry> &p_entries)
+{
+    std::ifstream in_(p_path.c_str(), std::ios::binary);
+    if(!in_ || !CEventLog::ReadHeader(in_))
+    {
+        std::cerr << p_path << ": not an event log" << std::endl;
+        return false;
+    }
+    Entry entry_;
+    entry_.log = p_log;
+    while(CEventLog::ReadEvent(in_, entry_.event))
+    {
+        p_entries.push_back(entry_);
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+/// Decoder entry point
+int main(int argc, char* argv[])
+{
+    po::options_description opts_("Options");
+    po::positional_options_description pos_;
+    po::variables_map vm_;
+    std::vector<std::string> files_;
+    std::string format_;
+    bool names_;
+
+    opts_.add_options()
+        ("help,h", "print usage help (this screen)")
+        ("format,f", po::value<std::string>(&format_)->default_value("csv"),
+         "output format: csv, or json for one object per line")
+        ("names,n", po::bool_switch(&names_),
+         "also print the PEER_NAME records")
+        ("input", po::value<std::vector<std::string> >(&files_),
+         "event logs to read; several are merged into one timeline");
+    pos_.add("input", -1);
+
+    try
+    {
+        po::store(po::command_line_parser(argc, argv)
+            .options(opts_).positional(pos_).run(), vm_);
+        po::notify(vm_);
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if(vm_.count("help") || files_.empty() ||
+        (format_ != "csv" && format_ != "json"))
+    {
+        std::cerr << "Usage: " << argv[0] << " [options] LOG..." << std::endl
+                  << opts_ << std::endl;
+        return vm_.count("help") ? 0 : 1;
+    }
+    bool json_ = format_ == "json";
+
+    std::vector<Entry> entries_;
+    for(std::size_t i = 0; i < files_.size(); i++)
+    {
+        if(!ReadLog(files_[i], i, entries_))
+            return 1;
+    }
+    std::stable_sort(entries_.begin(), entries_.end(), Earlier);
+
+    // A peer is named before any event about it is recorded, so the names
+    // are complete by the time they are needed. IDs are reused when a node
+    // restarts, so chunk 0 starts the name over.
+    typedef std::pair<std::size_t, boost::uint32_t> PeerKey;
+    std::map<PeerKey, std::string> uuids_;
+
+    if(!json_)
+        std::cout << "time,micros,log,type,thread,peer,uuid,a,b" << std::endl;
+    for(std::size_t i = 0; i < entries_.size(); i++)
+    {
+        const CEventLog::Event &e_ = entries_[i].event;
+        PeerKey key_(entries_[i].log, e_.peer);
+        if(e_.type == CEventLog::PEER_NAME)
+        {
+            std::string &uuid_ = uuids_[key_];
+            if(e_.a == 0)
+                uuid_.clear();
+            for(int j = 0; j < 8; j++)
+            {
+                char c_ = static_cast<char>((e_.b >> (8 * j)) & 0xFF);
+                if(c_ == 0)
+                    break;
+                uuid_ += c_;
+            }
+            if(!names_)
+                continue;
+        }
+        const std::string &uuid_ = uuids_[key_];
+        if(json_)
+        {
+            std::cout << "{\"time\":" << Quote(FormatTime(e_.time), true)
+                      << ",\"micros\":" << e_.time
+                      << ",\"log\":" << Quote(files_[entries_[i].log], true)
+                      << ",\"type\":\"" << CEventLog::GetTypeName(e_.type)
+                      << "\",\"thread\":" << e_.thread
+                      << ",\"peer\":" << e_.peer
+                      << ",\"uuid\":" << Quote(uuid_, true)
+                      << ",\"a\":" << e_.a
+                      << ",\"b\":" << e_.b << "}" << std::endl;
+        }
+        else
+        {
+            std::cout << FormatTime(e_.time) << "," << e_.time << ","
+                      << Quote(files_[entries_[i].log], false) << ","
+                      << CEventLog::GetTypeName(e_.type) << ","
+                      << e_.thread << "," << e_.peer << ","
+                      << Quote(uuid_, false) << "," << e_.a << ","
+                      << e_.b << std::endl;
+        }
+    }
+    return 0;
+}
@@ -57,6 +57,7 @@ namespace freedm {
 /// @description Prepares a peer node. Takes in a connection
 ///   manager, io_service and dispatcher. Provides node status
 ///   and sending functions to the agent in a very clean manner.
+///   The uuid is interned here, so sends never look it up.
 /// @param uuid The uuid of the node
 /// @param connmgr The module managing the connections
 /// @param ios The related ioservice used for scheduling
@@ -65,6 +66,7 @@ namespace freedm {
 IPeerNode::IPeerNode(std::string uuid, ConnManagerPtr connmgr,
     boost::asio::io_service& ios, freedm::broker::CDispatcher& dispatch)
     : m_uuid(uuid),
+      m_peerid(connmgr.GetPeerId(uuid)),
       m_connmgr(connmgr),
       m_ios(ios),
       m_dispatch(dispatch)
@@ -99,7 +101,7 @@ void IPeerNode::SetStatus(int status)
 /////////////////////////////////////////////////////////////
 broker::ConnectionPtr IPeerNode::GetConnection()
 {
-    return m_connmgr.GetConnectionByUUID(m_uuid,m_ios,m_dispatch);
+    return m_connmgr.GetConnectionByPeerId(m_peerid,m_ios,m_dispatch);
 }
 
 /////////////////////////////////////////////////////////////
@@ -115,7 +117,7 @@ broker::ConnectionPtr IPeerNode::GetConnection()
 /// @param msg The message to write to channel
 /// @return True if the message was sent.
 /////////////////////////////////////////////////////////////
-bool IPeerNode::Send(freedm::broker::CMessage msg)
+bool IPeerNode::Send(const freedm::broker::CMessage &msg)
 {
     try
     {
@@ -145,7 +147,7 @@ bool IPeerNode::Send(freedm::broker::CMessage msg)
 /// @description Calls send. This function is depreciated by
 ///   our change to UDP. 
 /////////////////////////////////////////////////////////////
-void IPeerNode::AsyncSend(freedm::broker::CMessage msg)
+void IPeerNode::AsyncSend(const freedm::broker::CMessage &msg)
 {
     //Depcreciated by UDP.
     Send(msg);
@@ -7,7 +7,7 @@
 ///
 /// @project   FREEDM DGI
 ///
-/// @description Declare CConnection class
+/// @description Implements the parts of IProtocol shared by the protocols
 ///
 /// @license
 /// These source code files were created at as part of the
@@ -32,22 +32,110 @@
 
 #include "IProtocol.hpp"
 #include "CConnection.hpp"
+#include "CWireCodec.hpp"
+#include "CDatagramBatch.hpp"
+#include "CGlobalConfiguration.hpp"
 #include "config.hpp"
 #include "CLogger.hpp"
 
+#include <boost/bind.hpp>
+#include <boost/optional.hpp>
+
+#include <algorithm>
+
 static CLocalLogger Logger(__FILE__);
 
 namespace freedm {
     namespace broker {
 
+const unsigned int IProtocol::MAX_ACK_DELAY;
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::IProtocol
+/// @description Binds the protocol to its connection.
+/// @pre None
+/// @post No ACK is held. The hold time is read from the ack-delay setting.
+///   The resend timeout starts at p_initialRTO and stays between rto-min,
+///   plus the time the peer may hold its ACK, and rto-max.
+/// @param conn The connection the protocol writes to
+/// @param p_identifier The protocol's identifier, to label its metrics
+/// @param p_initialRTO The resend timeout to use before any round trip has
+///   been measured
+///////////////////////////////////////////////////////////////////////////////
+IProtocol::IProtocol(CConnection * conn, const std::string &p_identifier,
+    boost::posix_time::time_duration p_initialRTO)
+    : m_conn(conn),
+      m_acktimer(conn->GetSocket().get_io_service()),
+      m_ackheld(false),
+      m_ackdelay(std::min(MAX_ACK_DELAY,
+          CGlobalConfiguration::instance().GetAckDelay())),
+      m_rtt(p_initialRTO,
+          boost::posix_time::milliseconds(m_ackdelay +
+              CGlobalConfiguration::instance().GetMinRTO()),
+          boost::posix_time::milliseconds(std::max(m_ackdelay +
+              CGlobalConfiguration::instance().GetMinRTO(),
+              CGlobalConfiguration::instance().GetMaxRTO()))),
+      m_metrics(CMetrics::Label("peer", conn->GetUUID()) + "," +
+          CMetrics::Label("protocol", p_identifier))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::Metrics::Metrics
+/// @description Finds the counters of one protocol to one peer. A new
+///   connection to the same peer picks up the same counters.
+/// @pre None
+/// @post The references are bound to registered metrics.
+/// @param p_labels The peer and protocol labels.
+///////////////////////////////////////////////////////////////////////////////
+IProtocol::Metrics::Metrics(const std::string &p_labels)
+    : sent(CMetrics::GetCounter("freedm_messages_sent_total", p_labels)),
+      received(CMetrics::GetCounter("freedm_messages_received_total",
+          p_labels)),
+      resent(CMetrics::GetCounter("freedm_messages_resent_total", p_labels)),
+      expired(CMetrics::GetCounter("freedm_messages_expired_total",
+          p_labels)),
+      window(CMetrics::GetGauge("freedm_window_messages", p_labels))
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::Write
+/// @description Encodes a message for the peer and queues the datagram on
+///   the connection. A data message also carries the held ACK, if there is
+///   one, under the "ack" protocol property, which saves the peer a
+///   datagram.
+/// @pre Called on the connection's strand.
+/// @post The datagram is queued for the next flush and no ACK is held if
+///   msg was not itself an ACK.
+/// @param msg The message to write
+///////////////////////////////////////////////////////////////////////////////
 void IProtocol::Write(CMessage msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     boost::tribool result_;
-    boost::array<char, 8192>::iterator it_;
+    boost::array<char, CDatagramBatch::MAX_DATAGRAM> buffer_;
+    boost::array<char, CDatagramBatch::MAX_DATAGRAM>::iterator it_;
+    unsigned int wire_ = GetConnection()->GetWireVersion();
+
+    if(wire_ == 0 && CGlobalConfiguration::instance().GetBinaryWire())
+    {
+        // Until the peer answers with a version of its own, write XML and
+        // tell it which binary version it may switch to.
+        msg.SetWireVersion(CWireCodec::VERSION);
+    }
+
+    if(m_ackheld && msg.GetStatus() != CMessage::Accepted)
+    {
+        ptree pp_ = msg.GetProtocolProperties();
+        pp_.put("ack.seq", m_heldack.GetSequenceNumber());
+        pp_.put_child("ack.props", m_heldack.GetProtocolProperties());
+        msg.SetProtocolProperties(pp_);
+        CancelHeldACK();
+    }
 
-    it_ = m_buffer.begin();
-    boost::tie(result_, it_)=Synthesize(msg, it_, m_buffer.end() - it_ );
+    it_ = buffer_.begin();
+    boost::tie(result_, it_)=Synthesize(msg, it_, buffer_.end() - it_, wire_);
 
     #ifdef CUSTOMNETWORK
     if((rand()%100) >= GetConnection()->GetReliability()) 
@@ -58,10 +146,99 @@ void IProtocol::Write(CMessage msg)
     }
     #endif
 
-    GetConnection()->GetSocket().async_send(boost::asio::buffer(m_buffer,
-            (it_ - m_buffer.begin()) * sizeof(char) ), 
-            boost::bind(&IProtocol::WriteCallback, this,
-            boost::asio::placeholders::error));
+    // The datagram is written by the connection's next flush, batched with
+    // anything else queued for this peer in the meantime.
+    GetConnection()->QueueDatagram(std::string(buffer_.begin(), it_));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::HoldACK
+/// @description Delays an ACK by up to the ack-delay so that it can ride on
+///   a data message to the same peer, or be replaced by a later ACK that
+///   covers it too. Peers before PIGGYBACK_VERSION would never see an ACK
+///   that rode on data, so theirs are written at once.
+/// @pre p_ack is cumulative: it acknowledges whatever an ACK held before it
+///   did.
+/// @post p_ack has been written, or is held and the timer is set.
+/// @param p_ack The ACK to write
+/// @param p_now Write it without delay, e.g. to report a gap quickly
+///////////////////////////////////////////////////////////////////////////////
+void IProtocol::HoldACK(const CMessage &p_ack, bool p_now)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(p_now || m_ackdelay == 0 ||
+        GetConnection()->GetWireVersion() < CWireCodec::PIGGYBACK_VERSION)
+    {
+        CancelHeldACK();
+        Write(p_ack);
+        return;
+    }
+    m_heldack = p_ack;
+    if(!m_ackheld)
+    {
+        m_ackheld = true;
+        m_acktimer.expires_from_now(
+            boost::posix_time::milliseconds(m_ackdelay));
+        m_acktimer.async_wait(GetConnection()->GetStrand().wrap(
+            boost::bind(&IProtocol::FlushACK, this,
+            boost::asio::placeholders::error)));
+    }
+}
+
+/// Drops the held ACK and stops its timer
+void IProtocol::CancelHeldACK()
+{
+    m_ackheld = false;
+    m_acktimer.cancel();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::FlushACK
+/// @description Writes the held ACK on its own, since no data message went
+///   to the peer in time to carry it.
+/// @pre None
+/// @post No ACK is held.
+/// @param p_err The timer's error code, set if it was cancelled
+///////////////////////////////////////////////////////////////////////////////
+void IProtocol::FlushACK(const boost::system::error_code &p_err)
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(!p_err && m_ackheld)
+    {
+        m_ackheld = false;
+        Write(m_heldack);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @fn IProtocol::DetachACK
+/// @description Rebuilds the ACK a data message carries, as if it had come
+///   in its own datagram.
+/// @pre None
+/// @post None
+/// @param p_carrier The message that may be carrying an ACK
+/// @param p_ack Set to the ACK
+/// @return True if p_carrier carried an ACK
+///////////////////////////////////////////////////////////////////////////////
+bool IProtocol::DetachACK(const CMessage &p_carrier, CMessage &p_ack)
+{
+    const ptree &pp_ = p_carrier.GetProtocolProperties();
+    boost::optional<unsigned int> seq_ = pp_.get_optional<unsigned int>(
+        "ack.seq");
+    if(p_carrier.GetStatus() == CMessage::Accepted || !seq_)
+    {
+        return false;
+    }
+    p_ack = CMessage(CMessage::Accepted);
+    p_ack.SetSourceUUID(p_carrier.GetSourceUUID());
+    p_ack.SetSourceHostname(p_carrier.GetSourceHostname());
+    p_ack.SetProtocol(p_carrier.GetProtocol());
+    p_ack.SetSequenceNumber(*seq_);
+    p_ack.SetSendTimestamp(p_carrier.GetSendTimestamp());
+    p_ack.SetProtocolProperties(pp_.get_child("ack.props", ptree()));
+    p_ack.SetWireVersion(p_carrier.GetWireVersion());
+    return true;
 }
 
     }
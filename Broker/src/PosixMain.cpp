@@ -33,9 +33,11 @@
 #include <boost/asio/ip/host_name.hpp> //for ip::host_name()
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <set>
 #include <boost/program_options.hpp>
 #include <vector>
+#include <algorithm>
 namespace po = boost::program_options;
 
 #include "CDispatcher.hpp"
@@ -44,6 +46,7 @@ namespace po = boost::program_options;
 #include "lb/LoadBalance.hpp"
 #include "sc/CStateCollection.hpp"
 #include "CConnectionManager.hpp"
+#include "CSRConnection.hpp"
 #include "device/CPhysicalDeviceManager.hpp"
 #include "device/CDeviceFactory.hpp"
 #include "device/PhysicalDeviceTypes.hpp"
@@ -55,6 +58,9 @@ using namespace freedm;
 #include "uuid.hpp"
 #include "version.h"
 #include "CLogger.hpp"
+#include "CLogSink.hpp"
+#include "CEventLog.hpp"
+#include "CMetricsServer.hpp"
 
 static CLocalLogger Logger(__FILE__);
 
@@ -92,6 +98,30 @@ int main(int argc, char* argv[])
     std::string interHost;
     std::string interPort;
     std::string xml;
+    std::string wireFormat_;
+    unsigned int batchSize_;
+    unsigned int threads_;
+    unsigned int queueSize_;
+    std::string queueOverflow_;
+    unsigned int srWindow_;
+    std::string messageDigest_;
+    unsigned int ackDelay_;
+    unsigned int minRTO_;
+    unsigned int maxRTO_;
+    unsigned int resolveTTL_;
+    bool sharedSocket_;
+    std::string multicastGroup_;
+    std::string failureDetector_;
+    unsigned int heartbeat_;
+    double phiThreshold_;
+    unsigned int checkInterval_;
+    unsigned int responseTimeout_;
+    unsigned int mergeBackoff_;
+    unsigned int maxMergeBackoff_;
+    unsigned int logBuffer_;
+    std::string logOverflow_;
+    std::string eventLogFile_;
+    unsigned int metricsPort_;
     int verbose_;
     bool cliVerbose_(false); // CLI options override verbosity
     uuid u_;
@@ -126,6 +156,85 @@ int main(int argc, char* argv[])
          default_value("4001"),"The port to use for the lineclient/RTDSclient to connect.")
         ("xml,x", po::value<std::string>(&xml)->default_value("FPGA.xml"),
          "filename of FPGA message specification")
+        ("wire-format", po::value<std::string>(&wireFormat_)->
+         default_value("binary"), "datagram encoding offered to peers "
+         "(binary or xml). XML is always used with peers that don't "
+         "advertise the binary encoding.")
+        ("batch-size", po::value<unsigned int>(&batchSize_)->
+         default_value(32), "most datagrams read or written per socket "
+         "system call (1 disables batching)")
+        ("threads", po::value<unsigned int>(&threads_)->
+         default_value(1), "threads running the broker's io_service "
+         "(0 for one per processor core)")
+        ("queue-size", po::value<unsigned int>(&queueSize_)->
+         default_value(1024), "most received messages waiting for one "
+         "module (0 for no limit)")
+        ("queue-overflow", po::value<std::string>(&queueOverflow_)->
+         default_value("backpressure"), "what happens once a module's queue "
+         "is full: backpressure, drop-oldest or drop-newest")
+        ("src-window", po::value<unsigned int>(&srWindow_)->
+         default_value(8), "sequenced reliable messages in flight to one "
+         "peer at once (1 is stop-and-wait)")
+        ("message-digest", po::value<std::string>(&messageDigest_)->
+         default_value("xxhash"), "hash acknowledgements are matched by "
+         "(xxhash or siphash); must be the same on every node")
+        ("ack-delay", po::value<unsigned int>(&ackDelay_)->
+         default_value(2), "milliseconds an acknowledgement may wait to be "
+         "combined with later ones or carried by data (0 sends at once)")
+        ("rto-min", po::value<unsigned int>(&minRTO_)->
+         default_value(10), "least milliseconds a reliable message waits for "
+         "its ACK before it is resent (ack-delay is added)")
+        ("rto-max", po::value<unsigned int>(&maxRTO_)->
+         default_value(1000), "most milliseconds a reliable message waits "
+         "for its ACK, after backing off")
+        ("resolve-ttl", po::value<unsigned int>(&resolveTTL_)->
+         default_value(300), "seconds a peer's looked up address is reused "
+         "before its hostname is resolved again (0 resolves every time)")
+        ("shared-socket", po::value<bool>(&sharedSocket_)->
+         default_value(false), "send to every peer from the listening "
+         "socket instead of opening a connected socket per peer")
+        ("multicast-group", po::value<std::string>(&multicastGroup_)->
+         default_value(""), "address:port a message for several peers is "
+         "multicast to once, with lost copies resent on request (empty "
+         "sends one copy per peer); must be the same on every node")
+        ("failure-detector", po::value<std::string>(&failureDetector_)->
+         default_value("phi"), "how group management finds failed nodes: "
+         "phi (accrual over heartbeats) or poll (AreYouCoordinator and "
+         "AreYouThere rounds); must be the same on every node")
+        ("heartbeat-interval", po::value<unsigned int>(&heartbeat_)->
+         default_value(2000), "milliseconds between the heartbeats group "
+         "members send with the phi detector; shorter finds failures "
+         "sooner for more datagrams")
+        ("phi-threshold", po::value<double>(&phiThreshold_)->
+         default_value(8), "suspicion at which a silent node is taken to "
+         "have failed; each step of 1 waits longer and makes a wrong "
+         "suspicion ten times less likely")
+        ("check-interval", po::value<unsigned int>(&checkInterval_)->
+         default_value(10000), "milliseconds between a group leader's "
+         "searches for other groups to merge with")
+        ("response-timeout", po::value<unsigned int>(&responseTimeout_)->
+         default_value(5000), "milliseconds a group leader waits on the "
+         "answers to its search, and on the accepts to its invitations, "
+         "from nodes that do not answer")
+        ("merge-backoff", po::value<unsigned int>(&mergeBackoff_)->
+         default_value(250), "milliseconds a group leader leaves, for each "
+         "higher ranked leader it found, for that one to merge the groups "
+         "before it merges them itself; doubles each time it defers again")
+        ("merge-backoff-max", po::value<unsigned int>(&maxMergeBackoff_)->
+         default_value(4000), "the longest a group leader defers a merge, "
+         "in milliseconds")
+        ("log-buffer", po::value<unsigned int>(&logBuffer_)->
+         default_value(4096), "log lines held for the background writer "
+         "thread (0 writes them from the thread that logs)")
+        ("log-overflow", po::value<std::string>(&logOverflow_)->
+         default_value("drop"), "what happens once the log buffer is full: "
+         "drop or block")
+        ("event-log", po::value<std::string>(&eventLogFile_)->
+         default_value(""), "file protocol and agent events are appended "
+         "to in binary, for EventLogDecoder (empty to record none)")
+        ("metrics-port", po::value<unsigned int>(&metricsPort_)->
+         default_value(0), "localhost TCP port serving counters and latency "
+         "histograms in the Prometheus text format (0 for none)")
         ("verbose,v", po::value<int>(&verbose_)->
          implicit_value(5)->default_value(7),
          "enable verbose output (optionally specify level)");
@@ -246,6 +355,126 @@ int main(int argc, char* argv[])
         CGlobalConfiguration::instance().SetUUID(uuidstr2);
         CGlobalConfiguration::instance().SetListenPort(port_);
         CGlobalConfiguration::instance().SetListenAddress(listenIP_);
+        if (wireFormat_ != "binary" && wireFormat_ != "xml")
+        {
+            Logger.Error << "Unknown wire-format: " << wireFormat_
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetBinaryWire(wireFormat_ == "binary");
+        if (batchSize_ < 1 || batchSize_ > 1024)
+        {
+            Logger.Error << "batch-size must be between 1 and 1024"
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetBatchSize(batchSize_);
+        if (threads_ == 0)
+        {
+            threads_ = std::max(boost::thread::hardware_concurrency(), 1u);
+        }
+        CGlobalConfiguration::instance().SetThreadCount(threads_);
+        broker::CReadQueue::OverflowPolicy policy_;
+        if (!broker::CReadQueue::ParsePolicy(queueOverflow_, policy_))
+        {
+            Logger.Error << "Unknown queue-overflow: " << queueOverflow_
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetQueueSize(queueSize_);
+        CGlobalConfiguration::instance().SetQueueOverflow(queueOverflow_);
+        if (srWindow_ < 1 || srWindow_ > broker::CSRConnection::MAX_WINDOW)
+        {
+            Logger.Error << "src-window must be between 1 and "
+                    << broker::CSRConnection::MAX_WINDOW << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetSRWindow(srWindow_);
+        if (messageDigest_ != "xxhash" && messageDigest_ != "siphash")
+        {
+            Logger.Error << "Unknown message-digest: " << messageDigest_
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetStrongDigest(
+            messageDigest_ == "siphash");
+        if (ackDelay_ > broker::IProtocol::MAX_ACK_DELAY)
+        {
+            Logger.Error << "ack-delay must be at most "
+                    << broker::IProtocol::MAX_ACK_DELAY << " ms" << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetAckDelay(ackDelay_);
+        if (minRTO_ < 1 || minRTO_ > maxRTO_)
+        {
+            Logger.Error << "rto-min must be at least 1 and at most rto-max"
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetMinRTO(minRTO_);
+        CGlobalConfiguration::instance().SetMaxRTO(maxRTO_);
+        CGlobalConfiguration::instance().SetResolveTTL(resolveTTL_);
+        CGlobalConfiguration::instance().SetSharedSocket(sharedSocket_);
+        CGlobalConfiguration::instance().SetMulticastGroup(multicastGroup_);
+        if (failureDetector_ != "phi" && failureDetector_ != "poll")
+        {
+            Logger.Error << "Unknown failure-detector: " << failureDetector_
+                    << std::endl;
+            return -1;
+        }
+        if (heartbeat_ < 10 || phiThreshold_ <= 0)
+        {
+            Logger.Error << "heartbeat-interval must be at least 10 and "
+                    << "phi-threshold above 0" << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetFailureDetector(failureDetector_);
+        CGlobalConfiguration::instance().SetHeartbeatInterval(heartbeat_);
+        CGlobalConfiguration::instance().SetPhiThreshold(phiThreshold_);
+        if (checkInterval_ < 10 || responseTimeout_ < 10 ||
+            mergeBackoff_ > maxMergeBackoff_)
+        {
+            Logger.Error << "check-interval and response-timeout must be at "
+                    << "least 10 and merge-backoff at most merge-backoff-max"
+                    << std::endl;
+            return -1;
+        }
+        CGlobalConfiguration::instance().SetCheckInterval(checkInterval_);
+        CGlobalConfiguration::instance().SetResponseTimeout(responseTimeout_);
+        CGlobalConfiguration::instance().SetMergeBackoff(mergeBackoff_);
+        CGlobalConfiguration::instance().SetMaxMergeBackoff(maxMergeBackoff_);
+        CLogSink::OverflowPolicy logPolicy_;
+        if (!CLogSink::ParsePolicy(logOverflow_, logPolicy_))
+        {
+            Logger.Error << "Unknown log-overflow: " << logOverflow_
+                    << std::endl;
+            return -1;
+        }
+        if (metricsPort_ > 65535)
+        {
+            Logger.Error << "metrics-port must be at most 65535" << std::endl;
+            return -1;
+        }
+        if (logBuffer_ > CLogSink::MAX_CAPACITY)
+        {
+            Logger.Error << "log-buffer must be at most "
+                    << CLogSink::MAX_CAPACITY << std::endl;
+            return -1;
+        }
+        // Declared ahead of everything that logs, so that it is destroyed
+        // after them and writes out their last lines.
+        boost::scoped_ptr<CLogSink> logSink_;
+        if (logBuffer_ > 0)
+        {
+            logSink_.reset(new CLogSink(logBuffer_, logPolicy_));
+        }
+        // Started before the connection manager so every peer ID is named.
+        boost::scoped_ptr<broker::CEventLog> eventLog_;
+        if (!eventLogFile_.empty())
+        {
+            eventLog_.reset(new broker::CEventLog(eventLogFile_));
+            eventLog_->Start();
+        }
         //constructors for initial mapping
         broker::CConnectionManager m_conManager;
         broker::device::CPhysicalDeviceManager m_phyManager;
@@ -340,15 +569,23 @@ int main(int argc, char* argv[])
         ss >> uuidstr;
         // Instantiate and register the group management module
         GMAgent GM_(uuidstr, broker_.GetIOService(), dispatch_, m_conManager);
-        dispatch_.RegisterReadHandler("gm", &GM_);
+        dispatch_.RegisterReadHandler("gm", &GM_, &GM_.GetStrand());
         // Instantiate and register the power management module
         lbAgent LB_(uuidstr, broker_.GetIOService(), dispatch_, m_conManager,
                 m_phyManager);
-        dispatch_.RegisterReadHandler("lb", &LB_);
+        dispatch_.RegisterReadHandler("lb", &LB_, &LB_.GetStrand());
         // Instantiate and register the state collection module
         SCAgent SC_(uuidstr, broker_.GetIOService(), dispatch_, m_conManager,
                 m_phyManager);
-        dispatch_.RegisterReadHandler("any", &SC_);
+        dispatch_.RegisterReadHandler("any", &SC_, &SC_.GetStrand());
+        // Serve the metrics to scrapers on this host
+        boost::scoped_ptr<broker::CMetricsServer> metrics_;
+        if (metricsPort_ != 0)
+        {
+            metrics_.reset(new broker::CMetricsServer(broker_.GetIOService(),
+                    metricsPort_));
+            metrics_->Start();
+        }
 
         // The peerlist should be passed into constructors as references or
         // pointers to each submodule to allow sharing peers. NOTE this requires
@@ -389,21 +626,25 @@ int main(int argc, char* argv[])
 
         // Add the local connection to the hostname list
         m_conManager.PutHostname(uuidstr, "localhost", port_);
-        // Block all signals for background thread.
+        // Start the modules on their strands; they run once the broker's
+        // threads pick them up.
+        LB_.GetStrand().post(boost::bind(&lbAgent::LB, &LB_));
+        GM_.GetStrand().post(boost::bind(&GMAgent::Run, &GM_));
+        // Block all signals for background threads. The broker's pool threads
+        // are started from this one and inherit the mask.
         sigset_t new_mask;
         sigfillset(&new_mask);
         sigset_t old_mask;
         pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
+        if (logSink_)
+        {
+            logSink_->Start();
+        }
         Logger.Info << "Starting CBroker thread" << std::endl;
         boost::thread thread_
                 (boost::bind(&broker::CBroker::Run, &broker_));
         // Restore previous signals.
         pthread_sigmask(SIG_SETMASK, &old_mask, 0);
-        Logger.Debug << "Starting thread of Modules" << std::endl;
-        boost::thread thread2_( boost::bind(&GMAgent::Run, &GM_)
-                                , boost::bind(&lbAgent::LB, &LB_)
-                                //, boost::bind(&SCAgent::SC, &SC_)
-                              );
         // Wait for signal indicating time to shut down.
         sigset_t wait_mask;
         sigemptyset(&wait_mask);
@@ -413,14 +654,30 @@ int main(int argc, char* argv[])
         pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
         int sig = 0;
         sigwait(&wait_mask, &sig);
+        // Write out what was logged before the signal in case shutdown hangs.
+        if (logSink_)
+        {
+            logSink_->Flush();
+        }
         std::cout << "Shutting down cleanly." << std::endl;
         // Stop the modules
         GM_.Stop();
+        if (metrics_)
+        {
+            metrics_->Stop();
+        }
         // Stop the server.
         broker_.Stop();
         // Bring in threads.
         thread_.join();
-        thread2_.join();
+        if (eventLog_)
+        {
+            eventLog_->Stop();
+        }
+        if (logSink_)
+        {
+            logSink_->Stop();
+        }
         std::cout << "Goodbye..." << std::endl;
     }
     catch (std::exception& e)
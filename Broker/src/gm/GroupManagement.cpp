@@ -32,11 +32,6 @@
 /// Technology, Rolla, MO    65409 (ff@mst.edu).
 /////////////////////////////////////////////////////////
 
-
-// !!!!!!!!!!!!!!!!!!!
-// This turns on random Premerge time!
-// !!!!!!!!!!!!!!!!!!!
-
 #include "GroupManagement.hpp"
 #include "GMPeerNode.hpp"
 
@@ -75,11 +70,16 @@
 #include <boost/serialization/shared_ptr.hpp>
 
 #include "CConnection.hpp"
+#include "CSUConnection.hpp"
 #include "CBroker.hpp"
+#include "CGlobalConfiguration.hpp"
 
 #include <boost/property_tree/ptree.hpp>
 using boost::property_tree::ptree;
 
+#include "CEventLog.hpp"
+using freedm::broker::CEventLog;
+
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
@@ -120,6 +120,24 @@ void GMAgent::StartMonitor( const boost::system::error_code& err )
 }
 #pragma GCC diagnostic pop
 
+///////////////////////////////////////////////////////////////////////////////
+/// Priority
+/// @description: Ranks a node for the merges of the Coordinators. The
+///                             Coordinator with the highest priority it knows
+///                             of merges the groups; the rest wait for it.
+/// @pre: None
+/// @post: None
+/// @param uuid: The node to rank
+/// @return: The priority of the node
+///////////////////////////////////////////////////////////////////////////////
+unsigned int GMAgent::Priority(const std::string &uuid)
+{
+    //This uses appleby's MurmurHash2 to make a unsigned int of the uuid
+    //This becomes that nodes priority.
+    boost::hash<std::string> string_hash;
+    return string_hash(uuid);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// GMAgent
 /// @description: Constructor for the group management module.
@@ -135,15 +153,38 @@ GMAgent::GMAgent(std::string p_uuid, boost::asio::io_service &p_ios,
     freedm::broker::CDispatcher &p_dispatch,
     freedm::broker::CConnectionManager &p_conManager)
     : GMPeerNode(p_uuid,p_conManager,p_ios,p_dispatch),
+    IAgent< boost::shared_ptr<GMPeerNode> >(p_ios),
     m_timer(p_ios),
     m_transient(p_ios),
-    m_electiontimer(),
-    m_ingrouptimer(),
-    CHECK_TIMEOUT(boost::posix_time::seconds(10)),
+    m_electiontimer(&broker::CMetrics::GetHistogram(
+        "freedm_gm_election_microseconds")),
+    m_ingrouptimer(&broker::CMetrics::GetHistogram(
+        "freedm_gm_ingroup_microseconds")),
+    CHECK_TIMEOUT(boost::posix_time::milliseconds(
+        CGlobalConfiguration::instance().GetCheckInterval())),
     TIMEOUT_TIMEOUT(boost::posix_time::seconds(10)),
-    GLOBAL_TIMEOUT(boost::posix_time::seconds(5))
+    GLOBAL_TIMEOUT(boost::posix_time::milliseconds(
+        CGlobalConfiguration::instance().GetResponseTimeout())),
+    HEARTBEAT_TIMEOUT(boost::posix_time::milliseconds(
+        CGlobalConfiguration::instance().GetHeartbeatInterval())),
+    MERGE_BACKOFF(boost::posix_time::milliseconds(
+        CGlobalConfiguration::instance().GetMergeBackoff())),
+    MERGE_BACKOFF_MAX(boost::posix_time::milliseconds(
+        CGlobalConfiguration::instance().GetMaxMergeBackoff())),
+    m_backoffs(0),
+    m_heartbeat(p_ios),
+    m_detector(HEARTBEAT_TIMEOUT,
+        CGlobalConfiguration::instance().GetPhiThreshold()),
+    m_usedetector(CGlobalConfiguration::instance().GetFailureDetector() ==
+        "phi"),
+    m_watchedgroup(0)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if(m_usedetector)
+    {
+        Logger.Info << "Silent nodes are suspected after "
+                    << m_detector.GetDetectionTime() << std::endl;
+    }
     AddPeer(GetUUID());
     m_groupsformed = 0;
     m_groupsbroken = 0;
@@ -151,9 +192,6 @@ GMAgent::GMAgent(std::string p_uuid, boost::asio::io_service &p_ios,
     m_groupsjoined = 0;
     m_membership = 0;
     m_membershipchecks = 0;
-    #ifdef RANDOM_PREMERGE
-        srand(time(0)); 
-    #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -183,8 +221,8 @@ GMAgent::~GMAgent()
 freedm::broker::CMessage GMAgent::AreYouCoordinator()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm","AreYouCoordinator");
-    m_.m_submessages.put("gm.source",GetUUID());
+    m_.GetSubMessages().put("gm","AreYouCoordinator");
+    m_.GetSubMessages().put("gm.source",GetUUID());
     m_.SetExpireTimeFromNow(GLOBAL_TIMEOUT);
     return m_;
 }
@@ -200,10 +238,10 @@ freedm::broker::CMessage GMAgent::AreYouCoordinator()
 freedm::broker::CMessage GMAgent::Invitation()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm", "Invite");
-    m_.m_submessages.put("gm.source", m_GroupLeader);
-    m_.m_submessages.put("gm.groupid",m_GroupID);
-    m_.m_submessages.put("gm.groupleader",m_GroupLeader);
+    m_.GetSubMessages().put("gm", "Invite");
+    m_.GetSubMessages().put("gm.source", m_GroupLeader);
+    m_.GetSubMessages().put("gm.groupid",m_GroupID);
+    m_.GetSubMessages().put("gm.groupleader",m_GroupLeader);
     m_.SetExpireTimeFromNow(GLOBAL_TIMEOUT);
     return m_;
 }
@@ -218,10 +256,10 @@ freedm::broker::CMessage GMAgent::Invitation()
 freedm::broker::CMessage GMAgent::Ready()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm","Ready");
-    m_.m_submessages.put("gm.source", GetUUID());
-    m_.m_submessages.put("gm.groupid",m_GroupID);
-    m_.m_submessages.put("gm.groupleader",m_GroupLeader);
+    m_.GetSubMessages().put("gm","Ready");
+    m_.GetSubMessages().put("gm.source", GetUUID());
+    m_.GetSubMessages().put("gm.groupid",m_GroupID);
+    m_.GetSubMessages().put("gm.groupleader",m_GroupLeader);
     m_.SetNeverExpires();
     return m_;
 }
@@ -239,10 +277,10 @@ freedm::broker::CMessage GMAgent::Response(std::string payload,std::string type,
     const boost::posix_time::ptime& exp)
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm","Response");
-    m_.m_submessages.put("gm.source", GetUUID());
-    m_.m_submessages.put("gm.payload", payload);
-    m_.m_submessages.put("gm.type",type);
+    m_.GetSubMessages().put("gm","Response");
+    m_.GetSubMessages().put("gm.source", GetUUID());
+    m_.GetSubMessages().put("gm.payload", payload);
+    m_.GetSubMessages().put("gm.type",type);
     m_.SetExpireTime(exp);
     return m_;
 }
@@ -257,10 +295,10 @@ freedm::broker::CMessage GMAgent::Response(std::string payload,std::string type,
 freedm::broker::CMessage GMAgent::Accept()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm", "Accept");
-    m_.m_submessages.put("gm.source", GetUUID());
-    m_.m_submessages.put("gm.groupid",m_GroupID);
-    m_.m_submessages.put("gm.groupleader",m_GroupLeader);
+    m_.GetSubMessages().put("gm", "Accept");
+    m_.GetSubMessages().put("gm.source", GetUUID());
+    m_.GetSubMessages().put("gm.groupid",m_GroupID);
+    m_.GetSubMessages().put("gm.groupleader",m_GroupLeader);
     m_.SetExpireTimeFromNow(TIMEOUT_TIMEOUT);
     return m_;
 }
@@ -275,14 +313,35 @@ freedm::broker::CMessage GMAgent::Accept()
 freedm::broker::CMessage GMAgent::AreYouThere()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("gm", "AreYouThere");
-    m_.m_submessages.put("gm.source", GetUUID());
-    m_.m_submessages.put("gm.groupid",m_GroupID);
-    m_.m_submessages.put("gm.groupleader",m_GroupLeader);
+    m_.GetSubMessages().put("gm", "AreYouThere");
+    m_.GetSubMessages().put("gm.source", GetUUID());
+    m_.GetSubMessages().put("gm.groupid",m_GroupID);
+    m_.GetSubMessages().put("gm.groupleader",m_GroupLeader);
     m_.SetExpireTimeFromNow(TIMEOUT_TIMEOUT);
     return m_;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Heartbeat
+/// @description: Creates a new Heartbeat message from this node
+/// @pre: This node is in a group.
+/// @post: No Change.
+/// @return: A CMessage with the contents of a Heartbeat message
+///////////////////////////////////////////////////////////////////////////////
+freedm::broker::CMessage GMAgent::Heartbeat()
+{
+    freedm::broker::CMessage m_;
+    m_.GetSubMessages().put("gm", "Heartbeat");
+    m_.GetSubMessages().put("gm.source", GetUUID());
+    m_.GetSubMessages().put("gm.groupid",m_GroupID);
+    m_.GetSubMessages().put("gm.groupleader",m_GroupLeader);
+    // The next heartbeat says everything this one would, so a lost one is
+    // not worth holding up the ones after it.
+    m_.SetProtocol(broker::CSUConnection::Identifier());
+    m_.SetExpireTimeFromNow(HEARTBEAT_TIMEOUT);
+    return m_;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// peer_list
 /// @description: Packs the group list (Up_Nodes) in CMessage
@@ -296,15 +355,15 @@ freedm::broker::CMessage GMAgent::PeerList()
 	std::stringstream ss_;
 	ss_.clear();
 	ss_ << GetUUID();
-	m_.m_submessages.put("any.source", ss_.str());
-    m_.m_submessages.put("any.coordinator",GetUUID());
-	m_.m_submessages.put("any","PeerList");
+	m_.GetSubMessages().put("any.source", ss_.str());
+    m_.GetSubMessages().put("any.coordinator",GetUUID());
+	m_.GetSubMessages().put("any","PeerList");
 	ss_.clear();
 	foreach( PeerNodePtr peer_, m_UpNodes | boost::adaptors::map_values)
     {
-        m_.m_submessages.add("any.peers.peer",peer_->GetUUID());
+        m_.GetSubMessages().add("any.peers.peer",peer_->GetUUID());
     }
-    m_.m_submessages.add("any.peers.peer",GetUUID());
+    m_.GetSubMessages().add("any.peers.peer",GetUUID());
     m_.SetNeverExpires();
     return m_;
 }
@@ -370,8 +429,8 @@ void GMAgent::PushPeerList()
     {
         Logger.Debug<<"Send group list to all members of this group containing "
                                  << peer_->GetUUID() << std::endl;             
-        peer_->AsyncSend(m_);                
     }
+    SendToPeerSet(m_UpNodes, m_);
     GetPeer(GetUUID())->AsyncSend(m_);
     Logger.Debug << __PRETTY_FUNCTION__ << "FINISH" <<    std::endl;
 }
@@ -413,11 +472,12 @@ void GMAgent::Recovery()
     SetStatus(GMPeerNode::NORMAL);
     Logger.Notice << "+ State Change NORMAL : "<<__LINE__<<std::endl;
     PushPeerList();
-    // Go to work
+    // Go to work. A node alone looks for a group to join at once rather
+    // than after CHECK_TIMEOUT.
     Logger.Info << "TIMER: Setting CheckTimer (Check): " << __LINE__ << std::endl;
     m_timerMutex.lock();
-    m_timer.expires_from_now( CHECK_TIMEOUT );
-    m_timer.async_wait( boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error));
+    m_timer.expires_from_now( boost::posix_time::seconds(0) );
+    m_timer.async_wait( GetStrand().wrap(boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error)));
     m_timerMutex.unlock();
 }
 
@@ -448,7 +508,7 @@ void GMAgent::Recovery( const boost::system::error_code& err )
             // We are not the Coordinator, we must run Timeout()
             m_timerMutex.lock();
             m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-            m_timer.async_wait(boost::bind(&GMAgent::Timeout, this, boost::asio::placeholders::error));
+            m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Timeout, this, boost::asio::placeholders::error)));
             m_timerMutex.unlock();
         }
     }
@@ -487,15 +547,22 @@ void GMAgent::Check( const boost::system::error_code& err )
             {
                 if( peer_->GetUUID() == GetUUID())
                     continue;
-                peer_->AsyncSend(m_);
+                // The failure detector already watches the group members,
+                // and they are not Coordinators.
+                if( m_usedetector && CountInPeerSet(m_UpNodes,peer_) )
+                    continue;
+                CEventLog::Record(CEventLog::GM_AYC_SENT, peer_->GetPeerId(),
+                    m_GroupID);
                 InsertInPeerSet(m_AYCResponse,peer_);
             }
+            // Everyone asked is waited on, so the set is the recipients.
+            SendToPeerSet(m_AYCResponse, m_);
             // Wait for responses
             Logger.Info << "TIMER: Setting GlobalTimer (Premerge): " << __LINE__ << std::endl;
             m_timerMutex.lock();
             m_timer.expires_from_now( GLOBAL_TIMEOUT );
-            m_timer.async_wait(boost::bind(&GMAgent::Premerge, this,
-                boost::asio::placeholders::error));
+            m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Premerge, this,
+                boost::asio::placeholders::error)));
             m_timerMutex.unlock();
         } // End if
     }
@@ -512,17 +579,27 @@ void GMAgent::Check( const boost::system::error_code& err )
 }
 ///////////////////////////////////////////////////////////////////////////////
 /// Premerge
-/// @description: Handles a proportional wait prior to calling Merge
+/// @description: Handles the wait prior to calling Merge. The Coordinator
+///                             with the highest priority merges at once; the
+///                             others back off to give it the time to invite
+///                             them, and merge themselves only if it has not.
 /// @pre: Check has been called and responses have been collected from other
 ///             nodes. This node is a Coordinator.
-/// @post: A timer has been set based on this node's UUID to break up ties
-///                before merging.
+/// @post: A timer has been set based on this node's rank among the
+///                Coordinators to break up ties before merging.
 /// @param err: An error associated with the clling timer.
 /// @citation: GroupManagement (Merge)
 ///////////////////////////////////////////////////////////////////////////////
 void GMAgent::Premerge( const boost::system::error_code &err )
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if((GMPeerNode::NORMAL != GetStatus()) || !IsCoordinator())
+    {
+        // An invitation was accepted or a merge begun while the responses
+        // were awaited; that set the timer for what comes next.
+        Logger.Notice << "Skipping Premerge(): No longer a Coordinator." << std::endl;
+        return;
+    }
     if( !err || (boost::asio::error::operation_aborted == err ))
     { 
         // Timer expired
@@ -555,37 +632,36 @@ void GMAgent::Premerge( const boost::system::error_code &err )
         if( 0 < m_Coordinators.size() )
         {
             m_groupselection++;
-            //This uses appleby's MurmurHash2 to make a unsigned int of the uuid
-            //This becomes that nodes priority.
-            boost::hash<std::string> string_hash;
-            unsigned int myPriority = string_hash(GetUUID());
-            unsigned int maxPeer_ = 0;
+            // Each Coordinator that outranks this one should invite it within
+            // a few round trips, so it waits MERGE_BACKOFF for every one of
+            // them. The wait doubles each time it defers again without having
+            // been invited, up to MERGE_BACKOFF_MAX.
+            unsigned int myPriority = Priority(GetUUID());
+            unsigned int rank_ = 0;
             foreach( PeerNodePtr peer_, m_Coordinators | boost::adaptors::map_values)
             {
-                unsigned int temp = string_hash(peer_->GetUUID());
-                if(temp > maxPeer_)
+                if(Priority(peer_->GetUUID()) > myPriority)
                 {
-                    maxPeer_ = temp;
+                    rank_++;
                 }
             }
-            float wait_val_;
-            int maxWait = 30; /* The longest a node would have to wait to Merge */
-            int minWait = 10;
-            int granularity = 10; /* How finely it can slip in */
-            int delta = ((maxWait-minWait)*1.0)/(granularity*1.0);
-            if( myPriority < maxPeer_ )
-                wait_val_ = (((maxPeer_ - myPriority)%(granularity+1))*1.0)*delta+minWait;
-            else
-                wait_val_ = 0;
-            #ifdef RANDOM_PREMERGE
-            wait_val_ = (rand() % 20) + 10;
-            #endif
-            boost::posix_time::seconds proportional_Timeout( wait_val_ );
+            boost::posix_time::time_duration wait_ = MERGE_BACKOFF_MAX;
+            if( rank_ == 0 )
+            {
+                wait_ = boost::posix_time::seconds(0);
+                m_backoffs = 0;
+            }
+            else if( m_backoffs < 16 && MERGE_BACKOFF * rank_ * (1 << m_backoffs)
+                < MERGE_BACKOFF_MAX )
+            {
+                wait_ = MERGE_BACKOFF * rank_ * (1 << m_backoffs);
+                m_backoffs++;
+            }
             /* Set deadline timer to call Merge() */
-            Logger.Notice << "TIMER: Waiting for Merge(): " << wait_val_ << " seconds." << std::endl;
+            Logger.Notice << "TIMER: Waiting for Merge(): " << wait_ << std::endl;
             m_timerMutex.lock();
-            m_timer.expires_from_now( proportional_Timeout );
-            m_timer.async_wait( boost::bind(&GMAgent::Merge, this, boost::asio::placeholders::error ));
+            m_timer.expires_from_now( wait_ );
+            m_timer.async_wait( GetStrand().wrap(boost::bind(&GMAgent::Merge, this, boost::asio::placeholders::error )));
             m_timerMutex.unlock();
         }
         else
@@ -593,7 +669,7 @@ void GMAgent::Premerge( const boost::system::error_code &err )
             Logger.Info << "TIMER: Setting CheckTimer (Check): " << __LINE__ << std::endl;
             m_timerMutex.lock();
             m_timer.expires_from_now( CHECK_TIMEOUT );
-            m_timer.async_wait( boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error));
+            m_timer.async_wait( GetStrand().wrap(boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error)));
             m_timerMutex.unlock();
         }
     }
@@ -652,11 +728,27 @@ void GMAgent::Merge( const boost::system::error_code& err )
         freedm::broker::CMessage m_ = Invitation();
         Logger.Info <<"SEND: Sending out Invites (Invite Coordinators)"<<std::endl;
         Logger.Debug <<"Tempset is "<<tempSet_.size()<<" Nodes (IC)"<<std::endl;
+        PeerSet invited_;
         foreach( PeerNodePtr peer_, m_Coordinators | boost::adaptors::map_values)
         {
             if( peer_->GetUUID() == GetUUID())
                 continue;
-            peer_->AsyncSend(m_);
+            InsertInPeerSet(invited_, peer_);
+            CEventLog::Record(CEventLog::GM_INVITE_SENT, peer_->GetPeerId(),
+                m_GroupID);
+        }
+        SendToPeerSet(invited_, m_);
+        // Reorganize runs as soon as everyone invited has accepted. Those who
+        // follow the Coordinators invited here are named in their Accepts.
+        m_expected.clear();
+        foreach( PeerNodePtr peer_, invited_ | boost::adaptors::map_values)
+        {
+            m_expected.insert(peer_->GetUUID());
+        }
+        foreach( PeerNodePtr peer_, tempSet_ | boost::adaptors::map_values)
+        {
+            if( peer_->GetUUID() != GetUUID())
+                m_expected.insert(peer_->GetUUID());
         }
         // Previously, this set the global timer and waited for GLOBAL_TIMEOUT
         // Before inviting group nodes. However, looking at the original text of the
@@ -699,19 +791,23 @@ void GMAgent::InviteGroupNodes( const boost::system::error_code& err, PeerSet p_
         freedm::broker::CMessage m_ = Invitation();
         Logger.Info <<"SEND: Sending out Invites (Invite Group Nodes):"<<std::endl;
         Logger.Debug <<"Tempset is "<<p_tempSet.size()<<" Nodes (IGN)"<<std::endl;
+        PeerSet invited_;
         foreach( PeerNodePtr peer_, p_tempSet | boost::adaptors::map_values)
         {
             if( peer_->GetUUID() == GetUUID())
                 continue;
-            peer_->AsyncSend(m_);
+            InsertInPeerSet(invited_, peer_);
+            CEventLog::Record(CEventLog::GM_INVITE_SENT, peer_->GetPeerId(),
+                m_GroupID);
         }
+        SendToPeerSet(invited_, m_);
         if(IsCoordinator())
         {     // We only call Reorganize if we are the new leader
             Logger.Info << "TIMER: Setting GlobalTimer (Reorganize) : " << __LINE__ << std::endl;
             m_timerMutex.lock();
             m_timer.expires_from_now( GLOBAL_TIMEOUT );
-            m_timer.async_wait(boost::bind(&GMAgent::Reorganize, this, 
-                boost::asio::placeholders::error));
+            m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Reorganize, this, 
+                boost::asio::placeholders::error)));
             m_timerMutex.unlock();
         }
     }
@@ -765,7 +861,7 @@ void GMAgent::Reorganize( const boost::system::error_code& err )
         Logger.Info << "TIMER: Setting CheckTimer (Check): " << __LINE__ << std::endl;
         m_timerMutex.lock();
         m_timer.expires_from_now( CHECK_TIMEOUT );
-        m_timer.async_wait( boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error));
+        m_timer.async_wait( GetStrand().wrap(boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error)));
         m_timerMutex.unlock();
     }
     else
@@ -790,8 +886,9 @@ void GMAgent::Timeout( const boost::system::error_code& err )
     if( !err )
     {
         SystemState(); 
-        /* If we are the group leader, we don't need to run this */
-        if(!IsCoordinator())
+        /* If we are the group leader, we don't need to run this.
+         * Neither do we if the failure detector is watching the leader. */
+        if(!IsCoordinator() && !m_usedetector)
         {
             std::string line_ = Coordinator();
             Logger.Info << "SEND: Sending AreYouThere messages." << std::endl;
@@ -809,14 +906,16 @@ void GMAgent::Timeout( const boost::system::error_code& err )
             if( false != peer_ && peer_->GetUUID() != GetUUID())
             {
                 peer_->AsyncSend(m_);
+                CEventLog::Record(CEventLog::GM_AYT_SENT, peer_->GetPeerId(),
+                    m_GroupID);
                 Logger.Info << "Expecting response from "<<peer_->GetUUID()<<std::endl;
                 InsertInPeerSet(m_AYTResponse,peer_);
             }
             Logger.Info << "TIMER: Setting TimeoutTimer (Recovery):" << __LINE__ << std::endl;
             m_timerMutex.lock();
             m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-            m_timer.async_wait(boost::bind(&GMAgent::Recovery, this,
-                boost::asio::placeholders::error));
+            m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Recovery, this,
+                boost::asio::placeholders::error)));
             m_timerMutex.unlock();
         }
     }
@@ -832,7 +931,90 @@ void GMAgent::Timeout( const boost::system::error_code& err )
     }
 }
  
-void GMAgent::HandleRead(broker::CMessage msg)
+///////////////////////////////////////////////////////////////////////////////
+/// Heartbeat
+/// @description: Replaces the AYC/AYT rounds as the way failures are found
+///               within a group. The leader sends a heartbeat to its members
+///               and each member answers it with one of its own; the failure
+///               detector turns the silence of each into a suspicion. A
+///               leader drops the members it suspects, and a member that
+///               suspects its leader goes into Recovery.
+/// @pre: The failure detector is in use.
+/// @post: Suspected nodes have been removed from the group, heartbeats have
+///        been sent and the timer is set to do this again.
+/// @param err: The error associated with the calling timer.
+///////////////////////////////////////////////////////////////////////////////
+void GMAgent::Heartbeat( const boost::system::error_code& err )
+{
+    Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
+    if( !err )
+    {
+        boost::posix_time::ptime now_ = broker::CClock::Now();
+        if(m_watchedgroup != m_GroupID || m_watchedleader != m_GroupLeader)
+        {
+            // Heartbeats from the old group say nothing about the new one
+            m_detector.Clear();
+            m_watchedgroup = m_GroupID;
+            m_watchedleader = m_GroupLeader;
+        }
+        if(GetStatus() == GMPeerNode::NORMAL && IsCoordinator())
+        {
+            PeerSet failed_;
+            foreach( PeerNodePtr peer_, m_UpNodes | boost::adaptors::map_values)
+            {
+                m_detector.Watch(peer_->GetUUID(), now_);
+                if(!m_detector.IsAvailable(peer_->GetUUID(), now_))
+                {
+                    InsertInPeerSet(failed_,peer_);
+                }
+            }
+            foreach( PeerNodePtr peer_, failed_ | boost::adaptors::map_values)
+            {
+                Logger.Info << "No heartbeat from peer: "<<peer_->GetUUID()<<std::endl;
+                EraseInPeerSet(m_UpNodes,peer_);
+                m_detector.Forget(peer_->GetUUID());
+                peer_->GetConnection()->Stop();
+            }
+            if(failed_.size() > 0)
+            {
+                if(m_UpNodes.size() == 0)
+                {
+                    Logger.Notice << "Stopping in group timer "<<__LINE__<<std::endl;
+                    m_ingrouptimer.Stop();
+                }
+                PushPeerList();
+                m_membership += m_UpNodes.size()+1;
+                m_membershipchecks++;
+            }
+            SendToPeerSet(m_UpNodes, Heartbeat());
+        }
+        else if(GetStatus() == GMPeerNode::NORMAL)
+        {
+            m_detector.Watch(Coordinator(), now_);
+            if(!m_detector.IsAvailable(Coordinator(), now_))
+            {
+                Logger.Notice << "No heartbeat from leader: "<<Coordinator()<<std::endl;
+                m_groupsbroken++;
+                Recovery();
+            }
+        }
+        m_heartbeat.expires_from_now( HEARTBEAT_TIMEOUT );
+        m_heartbeat.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Heartbeat,
+            this, boost::asio::placeholders::error)));
+    }
+    else if(boost::asio::error::operation_aborted == err )
+    {
+
+    }
+    else
+    {
+        /* An error occurred */
+        Logger.Error << err << std::endl;
+        throw boost::system::system_error(err);
+    }
+}
+
+void GMAgent::HandleRead(const broker::CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 
@@ -843,7 +1025,7 @@ void GMAgent::HandleRead(broker::CMessage msg)
     std::stringstream ss_;
     PeerNodePtr peer_;
     std::string msg_source = msg.GetSourceUUID();
-    ptree pt = msg.GetSubMessages();
+    const ptree &pt = msg.GetSubMessages();
     
     line_ = msg_source;
     if(line_ != GetUUID())
@@ -859,6 +1041,8 @@ void GMAgent::HandleRead(broker::CMessage msg)
             peer_ = AddPeer(line_);
         }
     }
+    // Our own messages come back without a peer node
+    broker::PeerId from_ = peer_ ? peer_->GetPeerId() : GetPeerId();
         
     try
     {
@@ -880,12 +1064,12 @@ void GMAgent::HandleRead(broker::CMessage msg)
                 // We used to set a timeout timer here but cancelling the
                 // timer should accomplish the same thing.
                 m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-                m_timer.async_wait(boost::bind(&GMAgent::Timeout, this,
-                    boost::asio::placeholders::error));
+                m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Timeout, this,
+                    boost::asio::placeholders::error)));
                 m_timerMutex.unlock();
             }
             m_UpNodes.clear();
-            foreach(ptree::value_type &v, pt.get_child("any.peers"))
+            foreach(const ptree::value_type &v, pt.get_child("any.peers"))
             {
                 if(v.second.data() != GetUUID())
                 {
@@ -915,13 +1099,37 @@ void GMAgent::HandleRead(broker::CMessage msg)
     {
         unsigned int msg_group = pt.get<unsigned int>("gm.groupid");
         Logger.Info << "RECV: Accept Message from " << msg_source << std::endl;
-        if(GetStatus() == GMPeerNode::ELECTION && msg_group == m_GroupID && IsCoordinator())
+        bool added = GetStatus() == GMPeerNode::ELECTION &&
+            msg_group == m_GroupID && IsCoordinator();
+        CEventLog::Record(CEventLog::GM_ACCEPT_RECEIVED, from_,
+            msg_group, added);
+        if(added)
         {
             // We are holding an election, the remote peer wants to join
             // this group, and I am its leader: Add it to the Up set
             InsertInPeerSet(m_UpNodes,peer_);
             // XXX I am not sure if the client should get some sort of ACK
             // or perhaps this comes in the means of the Ready msg
+            m_expected.erase(msg_source);
+            // A Coordinator names the members it forwarded the invite to.
+            if(pt.get_child_optional("gm.members"))
+            {
+                foreach(const ptree::value_type &v, pt.get_child("gm.members"))
+                {
+                    PeerNodePtr member_ = GetPeer(v.second.data());
+                    if(!member_ || !CountInPeerSet(m_UpNodes,member_))
+                        m_expected.insert(v.second.data());
+                }
+            }
+            if(m_expected.empty())
+            {
+                // Everyone invited has accepted. Reorganize takes the
+                // canceled timer as its cue, so it runs now.
+                Logger.Info << "TIMER: Canceling GlobalTimer (Reorganize) : " << __LINE__ << std::endl;
+                m_timerMutex.lock();
+                m_timer.cancel();
+                m_timerMutex.unlock();
+            }
         }
         else
         {
@@ -931,12 +1139,27 @@ void GMAgent::HandleRead(broker::CMessage msg)
     else if(pt.get<std::string>("gm") == "AreYouCoordinator")
     {
         Logger.Info << "RECV: AreYouCoordinator message from "<< msg_source << std::endl;
-        if(GetStatus() == GMPeerNode::NORMAL && IsCoordinator())
+        bool coordinator = GetStatus() == GMPeerNode::NORMAL && IsCoordinator();
+        CEventLog::Record(CEventLog::GM_AYC_RECEIVED, from_,
+            m_GroupID, coordinator);
+        if(coordinator)
         {
             // We are the group Coordinator AND we are at normal operation
             Logger.Info << "SEND: AYC Response (YES) to "<<msg_source<<std::endl;
             freedm::broker::CMessage m_ = Response("yes","AreYouCoordinator",msg.GetExpireTime());
             peer_->AsyncSend(m_);
+            // The asker is a Coordinator that will wait for this one to
+            // invite it. Unless a search is under way already, start one now
+            // instead of at the next CHECK_TIMEOUT, so the groups merge
+            // within a few round trips of finding each other.
+            if(m_AYCResponse.size() == 0 && Priority(msg_source) < Priority(GetUUID()))
+            {
+                Logger.Info << "TIMER: Setting CheckTimer (Check): " << __LINE__ << std::endl;
+                m_timerMutex.lock();
+                m_timer.expires_from_now( boost::posix_time::seconds(0) );
+                m_timer.async_wait( GetStrand().wrap(boost::bind(&GMAgent::Check, this, boost::asio::placeholders::error)));
+                m_timerMutex.unlock();
+            }
         }
         else
         {
@@ -951,6 +1174,8 @@ void GMAgent::HandleRead(broker::CMessage msg)
         Logger.Info << "RECV: AreYouThere message from " << msg_source << std::endl;
         unsigned int msg_group = pt.get<unsigned int>("gm.groupid");
         bool ingroup = CountInPeerSet(m_UpNodes,peer_);
+        CEventLog::Record(CEventLog::GM_AYT_RECEIVED, from_,
+            msg_group, IsCoordinator() && msg_group == m_GroupID && ingroup);
         if(IsCoordinator() && msg_group == m_GroupID && ingroup)
         {
             Logger.Info << "SEND: AYT Response (YES) to "<<msg_source<<std::endl;
@@ -967,14 +1192,37 @@ void GMAgent::HandleRead(broker::CMessage msg)
             peer_->AsyncSend(m_);
         }
     }
+    else if(pt.get<std::string>("gm") == "Heartbeat")
+    {
+        Logger.Debug << "RECV: Heartbeat message from " << msg_source << std::endl;
+        // Only heartbeats within this group count: from the leader, or to
+        // the leader from one of its members.
+        bool ingroup = pt.get<unsigned int>("gm.groupid") == m_GroupID &&
+            pt.get<std::string>("gm.groupleader") == m_GroupLeader;
+        if(ingroup && peer_ && (IsCoordinator() ?
+            CountInPeerSet(m_UpNodes,peer_) > 0 : msg_source == Coordinator()))
+        {
+            m_detector.Heartbeat(msg_source, broker::CClock::Now());
+            if(!IsCoordinator())
+            {
+                // Answered at once, the heartbeat carries the ACK for the
+                // leader's instead of it taking a datagram of its own.
+                peer_->AsyncSend(Heartbeat());
+            }
+        }
+    }
     else if(pt.get<std::string>("gm") == "Invite")
     {
         Logger.Info << "RECV: Invite message from " <<msg_source << std::endl;
+        CEventLog::Record(CEventLog::GM_INVITE_RECEIVED, from_,
+            pt.get<unsigned int>("gm.groupid"),
+            GetStatus() == GMPeerNode::NORMAL);
         if(GetStatus() == GMPeerNode::NORMAL)
         {
             // STOP ALL JOBS.
             coord_ = Coordinator();
             tempSet_ = m_UpNodes;
+            m_backoffs = 0;
             SetStatus(GMPeerNode::ELECTION);
             Logger.Notice << "+ State Change ELECTION : "<<__LINE__<<std::endl;
             Logger.Notice << "Stopping group timer "<<__LINE__<<std::endl;
@@ -985,6 +1233,7 @@ void GMAgent::HandleRead(broker::CMessage msg)
             m_GroupID = pt.get<unsigned int>("gm.groupid");
             m_GroupLeader = pt.get<std::string>("gm.groupleader");
             Logger.Notice << "Changed group: " << m_GroupID << " (" << m_GroupLeader << ") " << std::endl;
+            PeerSet invited_;
             if(coord_ == GetUUID())
             {
                 Logger.Info << "SEND: Sending invitations to former group members" << std::endl;
@@ -996,22 +1245,32 @@ void GMAgent::HandleRead(broker::CMessage msg)
                 {
                     if( peer_->GetUUID() == GetUUID())
                         continue;
-                    peer_->AsyncSend(m_);
+                    InsertInPeerSet(invited_, peer_);
+                    CEventLog::Record(CEventLog::GM_INVITE_SENT,
+                        peer_->GetPeerId(), m_GroupID);
                 }
+                SendToPeerSet(invited_, m_);
             }
             freedm::broker::CMessage m_ = Accept();
+            // Name the forwarded invitees, so the leader knows to wait on them
+            foreach(PeerNodePtr peer_, invited_ | boost::adaptors::map_values)
+            {
+                m_.GetSubMessages().add("gm.members.peer", peer_->GetUUID());
+            }
             Logger.Info << "SEND: Invitation accept to "<<msg_source<< std::endl;
             //Send Accept
             //If this is a forwarded invite, the source may not be where I want
             //send my accept to. Instead, we will generate it based on the groupleader
             GetPeer(m_GroupLeader)->AsyncSend(m_);
+            CEventLog::Record(CEventLog::GM_ACCEPT_SENT,
+                GetPeer(m_GroupLeader)->GetPeerId(), m_GroupID);
             SetStatus(GMPeerNode::REORGANIZATION);
             Logger.Notice << "+ State Change REORGANIZATION : "<<__LINE__<<std::endl;
             Logger.Info << "TIMER: Setting TimeoutTimer (Recovery) : " << __LINE__ << std::endl;
             m_timerMutex.lock();
             m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-            m_timer.async_wait(boost::bind(&GMAgent::Recovery, 
-                this, boost::asio::placeholders::error));        
+            m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Recovery, 
+                this, boost::asio::placeholders::error)));        
             m_timerMutex.unlock();
         }
         else
@@ -1030,22 +1289,14 @@ void GMAgent::HandleRead(broker::CMessage msg)
         if(pt.get<std::string>("gm.type") == "AreYouCoordinator")
         {
             Logger.Info << "RECV: Response (AYC) ("<<answer<<") from " <<msg_source << std::endl;
+            CEventLog::Record(CEventLog::GM_AYC_RESPONSE, from_,
+                m_GroupID, answer == "yes");
             Logger.Debug << "Checking expected responses." << std::endl;
             bool expected = CountInPeerSet(m_AYCResponse,peer_);
             EraseInPeerSet(m_AYCResponse,peer_);
             if(expected == true && pt.get<std::string>("gm.payload") == "yes")
             {
                 InsertInPeerSet(m_Coordinators,peer_);
-                if(m_AYCResponse.size() == 0)
-                {
-                    Logger.Info << "TIMER: Canceling GlobalTimer : " << __LINE__ << std::endl;
-                    m_timerMutex.lock();
-                    //Before, we just cleared this timer. Now I'm going to set it to start another check cycle
-                    m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-                    m_timer.async_wait(boost::bind(&GMAgent::Check, this,
-                                                                        boost::asio::placeholders::error));
-                    m_timerMutex.unlock();
-                }
             }
             else if(pt.get<std::string>("gm.payload") == "no")
             {
@@ -1055,10 +1306,24 @@ void GMAgent::HandleRead(broker::CMessage msg)
             {
                 Logger.Warn<< "Unsolicited AreYouCoordinator response from "<<msg_source<< std::endl;
             }
+            if(expected == true && m_AYCResponse.size() == 0)
+            {
+                // Everyone answered, whether yes or no: Premerge takes the
+                // canceled timer as its cue, so it runs now.
+                Logger.Info << "TIMER: Canceling GlobalTimer : " << __LINE__ << std::endl;
+                m_timerMutex.lock();
+                //Before, we just cleared this timer. Now I'm going to set it to start another check cycle
+                m_timer.expires_from_now( TIMEOUT_TIMEOUT );
+                m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Check, this,
+                                                                    boost::asio::placeholders::error)));
+                m_timerMutex.unlock();
+            }
         }
         else if(pt.get<std::string>("gm.type") == "AreYouThere")
         {
             Logger.Info << "RECV: Response (AYT) ("<<answer<<") from " <<msg_source << std::endl;
+            CEventLog::Record(CEventLog::GM_AYT_RESPONSE, from_,
+                m_GroupID, answer == "yes");
             Logger.Debug << "Checking expected responses." << std::endl;
             bool expected = CountInPeerSet(m_AYTResponse,peer_);
             EraseInPeerSet(m_AYTResponse,peer_);
@@ -1067,8 +1332,8 @@ void GMAgent::HandleRead(broker::CMessage msg)
                 m_timerMutex.lock();
                 Logger.Info << "TIMER: Setting TimeoutTimer (Timeout): " << __LINE__ << std::endl;
                 m_timer.expires_from_now( TIMEOUT_TIMEOUT );
-                m_timer.async_wait(boost::bind(&GMAgent::Timeout, this,
-                                                                        boost::asio::placeholders::error));
+                m_timer.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Timeout, this,
+                                                                        boost::asio::placeholders::error)));
                 m_timerMutex.unlock();
             }
             else if(pt.get<std::string>("gm.payload") == "no")
@@ -1139,13 +1404,17 @@ int GMAgent::Run()
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
 
-    std::map<std::string, broker::remotehost>::iterator mapIt_;
+    broker::CConnectionManager &connmgr_ = GetConnectionManager();
 
-    for( mapIt_ = GetConnectionManager().GetHostnamesBegin();
-        mapIt_ != GetConnectionManager().GetHostnamesEnd(); ++mapIt_ )
+    // Every peer with a known hostname, in the order they were registered
+    for( broker::PeerId id_ = 0; id_ < connmgr_.GetPeerCount(); id_++ )
     {
-        std::string host_ = mapIt_->first;
-        AddPeer(const_cast<std::string&>(mapIt_->first));
+        if( connmgr_.GetHostnameByPeerId(id_).hostname.empty() )
+        {
+            continue;
+        }
+        std::string uuid_ = connmgr_.GetUUIDByPeerId(id_);
+        AddPeer(uuid_);
     }
 
     foreach( PeerNodePtr p_,    m_AllPeers | boost::adaptors::map_values)
@@ -1153,10 +1422,16 @@ int GMAgent::Run()
         Logger.Notice << "! " <<p_->GetUUID() << " added to peer set" <<std::endl;
     }
     Recovery();
+    if(m_usedetector)
+    {
+        m_heartbeat.expires_from_now( HEARTBEAT_TIMEOUT );
+        m_heartbeat.async_wait(GetStrand().wrap(boost::bind(&GMAgent::Heartbeat,
+            this, boost::asio::placeholders::error)));
+    }
     //m_localservice.post(boost::bind(&GMAgent::Recovery,this));
     //m_localservice.run();
     m_transient.expires_from_now( boost::posix_time::seconds(60) );
-    m_transient.async_wait( boost::bind(&GMAgent::StartMonitor, this, boost::asio::placeholders::error));
+    m_transient.async_wait( GetStrand().wrap(boost::bind(&GMAgent::StartMonitor, this, boost::asio::placeholders::error)));
     return 0;
 }
 
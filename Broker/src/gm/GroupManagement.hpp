@@ -56,6 +56,8 @@ using boost::property_tree::ptree;
 #include "CDispatcher.hpp"
 #include "CConnectionManager.hpp"
 #include "CConnection.hpp"
+#include "CClock.hpp"
+#include "CFailureDetector.hpp"
 #include "types/remotehost.hpp"
 
 #include "Stopwatch.hpp"
@@ -93,10 +95,15 @@ class GMAgent
     void Recovery();
     /// Returns true if this node considers itself a coordinator
     bool IsCoordinator() const { return (Coordinator() == GetUUID()); };
+    /// Returns the coordinators uuid.
+    std::string Coordinator() const { return m_GroupLeader; }
+    /// Returns true if the node is a member of this node's group
+    bool IsGroupMember(const std::string &uuid) const
+        { return m_UpNodes.count(uuid) > 0; }
 
     // Handlers
     /// Handles receiving incoming messages.
-    virtual void HandleRead(broker::CMessage msg );
+    virtual void HandleRead(const broker::CMessage &msg);
     
     //Routines
     /// Checks for other up leaders
@@ -111,6 +118,8 @@ class GMAgent
     void Merge( const boost::system::error_code& err );
     /// Sends the peer list to all group members.
     void PushPeerList();
+    /// Sends heartbeats and drops the nodes that stopped sending them
+    void Heartbeat( const boost::system::error_code& err );
     
     // Messages
     /// Creates AYC Message.
@@ -128,6 +137,8 @@ class GMAgent
     freedm::broker::CMessage AreYouThere();
     /// Generates a peer list
     freedm::broker::CMessage PeerList();
+    /// Creates a Heartbeat message
+    freedm::broker::CMessage Heartbeat();
  
     // This is the main loop of the algorithm
     /// Called to start the system
@@ -155,8 +166,8 @@ class GMAgent
     void SystemState();
     /// Start the monitor after transient is over
     void StartMonitor(const boost::system::error_code& err);
-    /// Returns the coordinators uuid.
-    std::string Coordinator() const { return m_GroupLeader; }
+    /// The rank of a node when Coordinators compete to lead a merge
+    static unsigned int Priority(const std::string &uuid);
     
     /// Nodes In My Group
     PeerSet	m_UpNodes;
@@ -185,9 +196,9 @@ class GMAgent
     /// A mutex to make the timers threadsafe
     boost::interprocess::interprocess_mutex m_timerMutex;
     /// A timer for stepping through the election process
-    deadline_timer m_timer;
+    broker::CClock::Timer m_timer;
     /// What I like to call the TRANSIENT ELIMINATOR
-    deadline_timer m_transient;
+    broker::CClock::Timer m_transient;
     
     // Testing Functionality:
     /// Counts the number of elections
@@ -211,6 +222,27 @@ class GMAgent
     boost::posix_time::time_duration CHECK_TIMEOUT;
     boost::posix_time::time_duration TIMEOUT_TIMEOUT;
     boost::posix_time::time_duration GLOBAL_TIMEOUT;
+    boost::posix_time::time_duration HEARTBEAT_TIMEOUT;
+    boost::posix_time::time_duration MERGE_BACKOFF;
+    boost::posix_time::time_duration MERGE_BACKOFF_MAX;
+
+    // Merging
+    /// Premerge rounds in a row that deferred to a higher Coordinator
+    unsigned int m_backoffs;
+    /// The nodes whose Accept the new group is still waiting for
+    std::set<std::string> m_expected;
+
+    // Failure detection
+    /// A timer for sending heartbeats
+    broker::CClock::Timer m_heartbeat;
+    /// Judges the leader, or the members if this node leads
+    broker::CFailureDetector m_detector;
+    /// Set if heartbeats are used instead of AYC/AYT rounds to find failures
+    bool m_usedetector;
+    /// The group the detector is watching
+    unsigned int m_watchedgroup;
+    /// The leader of the group the detector is watching
+    std::string m_watchedleader;
 };
 
   }
@@ -2,29 +2,34 @@
 #define STOPWATCH_HPP
 
 #include "boost/date_time/posix_time/posix_time.hpp"
+#include "CMetrics.hpp"
+#include "CClock.hpp"
 #include <iostream>
 
 class Stopwatch
 {
     public:
-        Stopwatch()
+        /// Each run from Start to Stop is also added to runs, if given
+        Stopwatch(freedm::broker::CMetrics::Histogram *runs = 0)
         {
             timer_running = false;
             elapsed = boost::posix_time::time_duration(0,0,0,0);
+            run_times = runs;
         }
         void Start()
         {
             if(timer_running == true) return;
-            timer_start = boost::posix_time::microsec_clock::universal_time();
+            timer_start = freedm::broker::CClock::Now();
             timer_running = true;
         }
         void Stop()
         {
             if(timer_running == false) return;
             boost::posix_time::time_duration x;
-            x = boost::posix_time::microsec_clock::universal_time()-timer_start;
+            x = freedm::broker::CClock::Now()-timer_start;
             elapsed += x;
             timer_running = false;
+            if(run_times != 0) run_times->Record(x);
         }
         bool IsRunning()
         {
@@ -43,6 +48,7 @@ class Stopwatch
         boost::posix_time::ptime timer_start;
         bool timer_running;
         boost::posix_time::time_duration elapsed;
+        freedm::broker::CMetrics::Histogram *run_times;
 };
 
 #endif
@@ -80,6 +80,9 @@
 #include <boost/property_tree/ptree.hpp>
 using boost::property_tree::ptree;
 
+#include "CEventLog.hpp"
+using freedm::broker::CEventLog;
+
 #include "CLogger.hpp"
 
 static CLocalLogger Logger(__FILE__);
@@ -104,6 +107,7 @@ lbAgent::lbAgent(std::string uuid_, boost::asio::io_service &ios,
                  broker::CConnectionManager &m_conManager,
                  broker::device::CPhysicalDeviceManager &m_phyManager):
     LPeerNode(uuid_, m_conManager, ios, p_dispatch),
+    IAgent< boost::shared_ptr<LPeerNode> >(ios),
     m_phyDevManager(m_phyManager),
     m_GlobalTimer(ios),
     m_StateTimer(ios)
@@ -195,28 +199,12 @@ void lbAgent::SendMsg(std::string msg, PeerSet peerSet_)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     broker::CMessage m_;
-    m_.m_submessages.put("lb.source", GetUUID());
-    m_.m_submessages.put("lb", msg);
+    m_.GetSubMessages().put("lb.source", GetUUID());
+    m_.GetSubMessages().put("lb", msg);
     Logger.Notice << "Sending '" << msg << "' from: "
-                   << m_.m_submessages.get<std::string>("lb.source") <<std::endl;
-    foreach( PeerNodePtr peer_, peerSet_ | boost::adaptors::map_values)
-    {
-        if( peer_->GetUUID() == GetUUID())
-        {
-            continue;
-        }
-        else
-        {
-            try
-            {
-                peer_->Send(m_);
-            }
-            catch (boost::system::system_error& e)
-            {
-                Logger.Info << "Couldn't Send Message To Peer" << std::endl;
-            }
-        }
-    }
+                   << m_.GetSubMessages().get<std::string>("lb.source") <<std::endl;
+    peerSet_.erase(GetUUID());
+    SendToPeerSet(peerSet_, m_);
 }
 
 ////////////////////////////////////////////////////////////
@@ -240,20 +228,10 @@ void lbAgent::SendNormal(double Normal)
     {
         Logger.Info <<"Sending Computed Normal to the group members" <<std::endl;
         broker::CMessage m_;
-        m_.m_submessages.put("lb.source", GetUUID());
-        m_.m_submessages.put("lb", "ComputedNormal");
-        m_.m_submessages.put("lb.cnorm", boost::lexical_cast<std::string>(Normal));
-        foreach( PeerNodePtr peer_, m_AllPeers | boost::adaptors::map_values)
-        {
-            try
-            {
-                peer_->Send(m_);
-            }
-            catch (boost::system::system_error& e)
-            {
-                Logger.Info << "Couldn't Send Message To Peer" << std::endl;
-            }
-        }//end foreach
+        m_.GetSubMessages().put("lb.source", GetUUID());
+        m_.GetSubMessages().put("lb", "ComputedNormal");
+        m_.GetSubMessages().put("lb.cnorm", boost::lexical_cast<std::string>(Normal));
+        SendToPeerSet(m_AllPeers, m_);
     }
 }
 
@@ -274,9 +252,9 @@ void lbAgent::CollectState()
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     freedm::broker::CMessage m_cs;
-    m_cs.m_submessages.put("sc", "request");
-    m_cs.m_submessages.put("sc.source", GetUUID());
-    m_cs.m_submessages.put("sc.module", "lb");
+    m_cs.GetSubMessages().put("sc", "request");
+    m_cs.GetSubMessages().put("sc.source", GetUUID());
+    m_cs.GetSubMessages().put("sc.module", "lb");
     try
     {
        get_peer(GetUUID())->Send(m_cs);
@@ -307,6 +285,7 @@ void lbAgent::LoadManage()
     m_prevStatus = m_Status;
     //Call LoadTable to update load state of the system as observed by this node
     LoadTable();
+    CEventLog::Record(CEventLog::LB_STATE, GetPeerId(), m_Status, m_prevStatus);
 
     //Send Demand message when the current state is Demand
     //NOTE: (changing the original architecture in which Demand broadcast is done
@@ -332,8 +311,8 @@ void lbAgent::LoadManage()
     //Start the timer; on timeout, this function is called again
     //TODO: Change in Real time version
     m_GlobalTimer.expires_from_now( boost::posix_time::seconds(LOAD_TIMEOUT) );
-    m_GlobalTimer.async_wait( boost::bind(&lbAgent::LoadManage, this,
-                                          boost::asio::placeholders::error));
+    m_GlobalTimer.async_wait( GetStrand().wrap(boost::bind(&lbAgent::LoadManage, this,
+                                          boost::asio::placeholders::error)));
 }//end LoadManage
 
 ////////////////////////////////////////////////////////////
@@ -559,7 +538,7 @@ void lbAgent::SendDraftRequest()
 /// @peers The members of the group or a subset of, from whom message was received
 /// @limitations: 
 /////////////////////////////////////////////////////////
-void lbAgent::HandleRead(broker::CMessage msg)
+void lbAgent::HandleRead(const broker::CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     PeerSet tempSet_;
@@ -568,7 +547,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
     std::stringstream ss_;
     PeerNodePtr peer_;
     line_ = msg.GetSourceUUID();
-    ptree pt = msg.GetSubMessages();
+    const ptree &pt = msg.GetSubMessages();
     Logger.Debug << "Message '" <<pt.get<std::string>("lb","NOEXECPTION")<<"' received from "<< line_<<std::endl;
     
     // Evaluate the identity of the message source
@@ -609,7 +588,9 @@ void lbAgent::HandleRead(broker::CMessage msg)
         //Update the PeerNode lists accordingly
         //TODO:Not sure if similar loop is needed to erase each peerset 
         //individually. peerset.clear() doesn`t work for obvious reasons
-        foreach( PeerNodePtr p_, m_AllPeers | boost::adaptors::map_values)
+        //Walk a copy, since erasing invalidates the loop's iterator
+        PeerSet oldpeers_ = m_AllPeers;
+        foreach( PeerNodePtr p_, oldpeers_ | boost::adaptors::map_values)
         {
             if( p_->GetUUID() == GetUUID())
             {
@@ -623,7 +604,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
         }
 
         // Tokenize the peer list string
-        foreach(ptree::value_type &v, pt.get_child("any.peers"))
+        foreach(const ptree::value_type &v, pt.get_child("any.peers"))
         {
             peer_ = get_peer(v.second.data());
 
@@ -655,6 +636,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
     {
         Logger.Notice << "Demand message received from: "
                        << pt.get<std::string>("lb.source") <<std::endl;
+        CEventLog::Record(CEventLog::LB_DEMAND, peer_->GetPeerId());
         EraseInPeerSet(m_HiNodes,peer_);
         EraseInPeerSet(m_NoNodes,peer_);
         EraseInPeerSet(m_LoNodes,peer_);
@@ -682,6 +664,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
     {
         Logger.Notice << "Supply message received from: "
                        << pt.get<std::string>("lb.source") <<std::endl;
+        CEventLog::Record(CEventLog::LB_SUPPLY, peer_->GetPeerId());
         EraseInPeerSet(m_LoNodes,peer_);
         EraseInPeerSet(m_HiNodes,peer_);
         EraseInPeerSet(m_NoNodes,peer_);
@@ -694,6 +677,8 @@ void lbAgent::HandleRead(broker::CMessage msg)
     else if(pt.get<std::string>("lb") == "request"  && peer_->GetUUID() != GetUUID())
     {
         Logger.Notice << "Request message received from: " << peer_->GetUUID() << std::endl;
+        CEventLog::Record(CEventLog::LB_DRAFT_REQUEST, peer_->GetPeerId(), 0,
+            LPeerNode::DEMAND == m_Status);
         // Just not to duplicate the peer, erase the existing entries of it
         EraseInPeerSet(m_LoNodes,peer_);
         EraseInPeerSet(m_HiNodes,peer_);
@@ -702,7 +687,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
         InsertInPeerSet(m_LoNodes,peer_);
         // Create your response to the Draft request sent by the source
         broker::CMessage m_;
-        m_.m_submessages.put("lb.source", GetUUID());
+        m_.GetSubMessages().put("lb.source", GetUUID());
         std::stringstream ss_;
 
         // If you are in Demand State, accept the request with a 'yes'
@@ -710,7 +695,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
         {
             ss_.clear();
             ss_.str("yes");
-            m_.m_submessages.put("lb", ss_.str());
+            m_.GetSubMessages().put("lb", ss_.str());
         }
         // Otherwise, inform the source that you are not interested
         // NOTE: This may change in future when we incorporate advanced economics
@@ -718,7 +703,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
         {
             ss_.clear();
             ss_.str("no");
-            m_.m_submessages.put("lb", ss_.str());
+            m_.GetSubMessages().put("lb", ss_.str());
         }
 
         // Send your response
@@ -741,6 +726,8 @@ void lbAgent::HandleRead(broker::CMessage msg)
     else if(((pt.get<std::string>("lb") == "yes") ||
              (pt.get<std::string>("lb") == "no")) && peer_->GetUUID() != GetUUID())
     {
+        CEventLog::Record(CEventLog::LB_DRAFT_RESPONSE, peer_->GetPeerId(), 0,
+            pt.get<std::string>("lb") == "yes");
         // The response is a 'yes'
         if((pt.get<std::string>("lb") == "yes"))
         {
@@ -749,11 +736,11 @@ void lbAgent::HandleRead(broker::CMessage msg)
             //TODO: Selection of node that you are drafting with needs to be performed
             //      Currently, whoever responds to draft request gets the slice
             broker::CMessage m_;
-            m_.m_submessages.put("lb.source", GetUUID());
+            m_.GetSubMessages().put("lb.source", GetUUID());
             std::stringstream ss_;
             ss_.clear();
             ss_.str("drafting");
-            m_.m_submessages.put("lb", ss_.str());
+            m_.GetSubMessages().put("lb", ss_.str());
 
             //Its better to check your status again before initiating drafting
             if( peer_->GetUUID() != GetUUID() && LPeerNode::SUPPLY == m_Status )
@@ -782,20 +769,22 @@ void lbAgent::HandleRead(broker::CMessage msg)
     else if(pt.get<std::string>("lb") == "drafting" && peer_->GetUUID() != GetUUID())
     {
         Logger.Notice << "Drafting message received from: " << peer_->GetUUID() << std::endl;
+        CEventLog::Record(CEventLog::LB_DRAFTING, peer_->GetPeerId(), 0,
+            LPeerNode::DEMAND == m_Status);
         
         if(LPeerNode::DEMAND == m_Status)
         {
             broker::CMessage m_;
-            m_.m_submessages.put("lb.source", GetUUID());
+            m_.GetSubMessages().put("lb.source", GetUUID());
             std::stringstream ss_;
             ss_.clear();
             ss_.str("accept");
-            m_.m_submessages.put("lb", ss_.str());
+            m_.GetSubMessages().put("lb", ss_.str());
             ss_.clear();
             //TODO: Demand cost should be sent with draft response (yes/no) so
             //      that the supply node can select
             ss_ << m_DemandVal;
-            m_.m_submessages.put("lb.value", ss_.str());
+            m_.GetSubMessages().put("lb.value", ss_.str());
 
             if( peer_->GetUUID() != GetUUID() && LPeerNode::DEMAND == m_Status )
             {
@@ -830,6 +819,9 @@ void lbAgent::HandleRead(broker::CMessage msg)
         ss_ >> DemValue;
         Logger.Notice << " Draft Accept message received from: " << peer_->GetUUID()
                        << " with demand of "<< DemValue << std::endl;
+        CEventLog::Record(CEventLog::LB_DRAFT_ACCEPT, peer_->GetPeerId(),
+            static_cast<boost::int64_t>(DemValue * 1000),
+            LPeerNode::SUPPLY == m_Status);
 
         if( LPeerNode::SUPPLY == m_Status)
         {
@@ -851,7 +843,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
     {
         int peer_count=0;
         double agg_gateway=0;
-	foreach(ptree::value_type &v, pt.get_child("CollectedState.gateway"))
+	foreach(const ptree::value_type &v, pt.get_child("CollectedState.gateway"))
 	{
 	    Logger.Notice << "SC module returned gateway values: "
 			  << v.second.data() << std::endl;
@@ -862,7 +854,7 @@ void lbAgent::HandleRead(broker::CMessage msg)
 	//Consider any intransit "accept" messages in agg_gateway calculation
         if(pt.get_child_optional("CollectedState.intransit"))
         {
-          foreach(ptree::value_type &v, pt.get_child("CollectedState.intransit"))
+          foreach(const ptree::value_type &v, pt.get_child("CollectedState.intransit"))
           {
 	     Logger.Status << "SC module returned intransit messages: "
 	                   << v.second.data() << std::endl;
@@ -1062,8 +1054,8 @@ void lbAgent::StartStateTimer( unsigned int delay )
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     m_StateTimer.expires_from_now( boost::posix_time::seconds(delay) );
-    m_StateTimer.async_wait( boost::bind(&lbAgent::HandleStateTimer,
-                                         this, boost::asio::placeholders::error) );
+    m_StateTimer.async_wait( GetStrand().wrap(boost::bind(&lbAgent::HandleStateTimer,
+                                         this, boost::asio::placeholders::error) ));
 }
 
 ////////////////////////////////////////////////////////////
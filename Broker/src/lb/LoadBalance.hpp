@@ -66,6 +66,7 @@ using boost::property_tree::ptree;
 #include "uuid.hpp"
 #include "CDispatcher.hpp"
 #include "CConnectionManager.hpp"
+#include "CClock.hpp"
 #include "device/CPhysicalDeviceManager.hpp"
 #include "device/PhysicalDeviceTypes.hpp"
 
@@ -136,7 +137,7 @@ class lbAgent
 
         // Handlers
         /// Handles the incoming messages according to the message label
-        virtual void HandleRead(broker::CMessage msg);
+        virtual void HandleRead(const broker::CMessage &msg);
         /// Adds a new node to the list of known peers using its UUID
         PeerNodePtr add_peer(std::string uuid);
         /// Returns a pointer to the peer based on its UUID
@@ -190,9 +191,9 @@ class lbAgent
 
         // IO and Timers 
         /// Timer until check of demand state change
-        deadline_timer     m_GlobalTimer;
+        broker::CClock::Timer m_GlobalTimer;
         /// Timer until next periodic state collection
-        deadline_timer      m_StateTimer;
+        broker::CClock::Timer m_StateTimer;
 };
 
 }
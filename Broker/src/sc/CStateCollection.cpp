@@ -127,6 +127,7 @@ SCAgent::SCAgent(std::string uuid, boost::asio::io_service &ios,
                  freedm::broker::CConnectionManager &m_connManager,
                  freedm::broker::device::CPhysicalDeviceManager &m_phyManager):
     SCPeerNode(uuid, m_connManager, ios, p_dispatch),
+    IAgent< boost::shared_ptr<SCPeerNode> >(ios),
     m_countstate(0),
     m_NotifyToSave(false),
     m_curversion("default", 0),
@@ -161,9 +162,9 @@ SCAgent::~SCAgent()
 freedm::broker::CMessage SCAgent::marker()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("sc", "marker");
-    m_.m_submessages.put("sc.source", GetUUID());
-    m_.m_submessages.put("sc.id", m_curversion.second);
+    m_.GetSubMessages().put("sc", "marker");
+    m_.GetSubMessages().put("sc.source", GetUUID());
+    m_.GetSubMessages().put("sc.id", m_curversion.second);
     return m_;
 }
 
@@ -179,7 +180,12 @@ freedm::broker::CMessage SCAgent::marker()
 void SCAgent::SendDoneBack()
 {
     freedm::broker::CMessage m_;
-    m_.m_submessages.put("sc", "done");
+    m_.GetSubMessages().put("sc", "done");
+    if (!GetPeer(m_curversion.first))
+    {
+        Logger.Warn << "Initiator " << m_curversion.first << " is no longer a peer" << std::endl;
+        return;
+    }
     GetPeer(m_curversion.first)->AsyncSend(m_);
 }
 
@@ -263,18 +269,18 @@ void SCAgent::StateResponse()
     {
         //send collect states to the requested module
         Logger.Info << "Sending requested state back to " << m_module << " module" << std::endl;
-        m_.m_submessages.put(m_module, "CollectedState");
+        m_.GetSubMessages().put(m_module, "CollectedState");
         for (it = collectstate.begin(); it != collectstate.end(); it++)
         {
             if((*it).first == m_curversion)
             {
                 if((*it).second.get<std::string>("sc.type")== "gateway")
                 {
-        	    m_.m_submessages.add("CollectedState.gateway.value", (*it).second.get<std::string>("sc.gateway"));
+        	    m_.GetSubMessages().add("CollectedState.gateway.value", (*it).second.get<std::string>("sc.gateway"));
                 }
                 else if((*it).second.get<std::string>("sc.type")== "Message")
                 {
-        	    m_.m_submessages.add("CollectedState.intransit.value", (*it).second.get<std::string>("sc.transit.value"));
+        	    m_.GetSubMessages().add("CollectedState.intransit.value", (*it).second.get<std::string>("sc.transit.value"));
                 }
             }
         }//end for
@@ -355,6 +361,11 @@ void SCAgent::SendStateBack()
     freedm::broker::CMessage m_;
     freedm::broker::CMessage m_done;
     Logger.Notice << "(Peer)The number of collected states is " << int(collectstate.size()) << std::endl;
+    if (!GetPeer(m_curversion.first))
+    {
+        Logger.Warn << "Initiator " << m_curversion.first << " is no longer a peer" << std::endl;
+        return;
+    }
     
     //send collected states to initiator
     for (it = collectstate.begin(); it != collectstate.end(); it++)
@@ -363,30 +374,30 @@ void SCAgent::SendStateBack()
         {
             if((*it).second.get<std::string>("sc.type")== "gateway")
             {
-                m_.m_submessages.put("sc", "state");
-                m_.m_submessages.put("sc.type", (*it).second.get<std::string>("sc.type"));
-                m_.m_submessages.put("sc.gateway", (*it).second.get<std::string>("sc.gateway"));
-                m_.m_submessages.put("sc.source", (*it).second.get<std::string>("sc.source"));
+                m_.GetSubMessages().put("sc", "state");
+                m_.GetSubMessages().put("sc.type", (*it).second.get<std::string>("sc.type"));
+                m_.GetSubMessages().put("sc.gateway", (*it).second.get<std::string>("sc.gateway"));
+                m_.GetSubMessages().put("sc.source", (*it).second.get<std::string>("sc.source"));
                 GetPeer(m_curversion.first)->AsyncSend(m_);
                 //Logger.Notice << "SendStateBack(): gateway "<< (*it).second.get<std::string>("sc.gateway") << std::endl;
                 //Logger.Notice << "Sending state back to initiator: " << m_curversion.first << std::endl;
             }
             else if((*it).second.get<std::string>("sc.type")== "Message")
             {
-                m_.m_submessages.put("sc", "state");
-                m_.m_submessages.put("sc.type", (*it).second.get<std::string>("sc.type"));
-                m_.m_submessages.put("sc.transit.value", (*it).second.get<std::string>("sc.transit.value"));
-                //m_.m_submessages.put("sc.transit.source", (*it).second.get<std::string>("sc.transit.source"));
-                //m_.m_submessages.put("sc.transit.destin", (*it).second.get<std::string>("sc.transit.destin"));
+                m_.GetSubMessages().put("sc", "state");
+                m_.GetSubMessages().put("sc.type", (*it).second.get<std::string>("sc.type"));
+                m_.GetSubMessages().put("sc.transit.value", (*it).second.get<std::string>("sc.transit.value"));
+                //m_.GetSubMessages().put("sc.transit.source", (*it).second.get<std::string>("sc.transit.source"));
+                //m_.GetSubMessages().put("sc.transit.destin", (*it).second.get<std::string>("sc.transit.destin"));
                 GetPeer(m_curversion.first)->AsyncSend(m_);
             }
         }
     }//end for
     
     //send state done to initiator
-    m_done.m_submessages.put("sc", "state");
-    m_done.m_submessages.put("sc.type", "done");
-    m_done.m_submessages.put("sc.source", GetUUID());
+    m_done.GetSubMessages().put("sc", "state");
+    m_done.GetSubMessages().put("sc.type", "done");
+    m_done.GetSubMessages().put("sc.source", GetUUID());
     GetPeer(m_curversion.first)->AsyncSend(m_done);
 }
 
@@ -405,13 +416,13 @@ void SCAgent::SendStateBack()
 /// @Real_Time: time of longest code segment
 //////////////////////////////////////////////////////////////////
 
-void SCAgent::HandleRead(broker::CMessage msg)
+void SCAgent::HandleRead(const broker::CMessage &msg)
 {
     Logger.Debug << __PRETTY_FUNCTION__ << std::endl;
     std::string line_;
     std::stringstream ss_;
     PeerNodePtr peer_;
-    ptree pt = msg.GetSubMessages();
+    const ptree &pt = msg.GetSubMessages();
     //incomingVer_ records the coming version of the marker
     StateVersion incomingVer_;
     //check the coming peer node
@@ -437,13 +448,15 @@ void SCAgent::HandleRead(broker::CMessage msg)
     if(pt.get<std::string>("any","NOEXCEPTION") == "PeerList")
     {
         Logger.Info << "Peer List received from Group Leader: " << line_ <<std::endl;
-        foreach(PeerNodePtr peer_, m_AllPeers | boost::adaptors::map_values)
+        // Walk a copy, since erasing invalidates the loop's iterator
+        PeerSet oldpeers_ = m_AllPeers;
+        foreach(PeerNodePtr peer_, oldpeers_ | boost::adaptors::map_values)
         {
             if (peer_->GetUUID() != GetUUID())
                 EraseInPeerSet(m_AllPeers,peer_);
         }
         
-        foreach(ptree::value_type &v, pt.get_child("any.peers"))
+        foreach(const ptree::value_type &v, pt.get_child("any.peers"))
         {
             peer_ = GetPeer(v.second.data());
             
@@ -586,10 +599,13 @@ void SCAgent::HandleRead(broker::CMessage msg)
             if (m_AllPeers.size()==2)
                 //only two nodes, peer finish collecting states: send marker then state back
             {
-                //send marker back to initiator
-                GetPeer(m_curversion.first)->AsyncSend(msg);
-                //send collected states to initiator
-                SendStateBack();
+                //send marker and collected states back to initiator, unless
+                //it has left the peer set since it sent the marker
+                if (GetPeer(m_curversion.first))
+                {
+                    GetPeer(m_curversion.first)->AsyncSend(msg);
+                    SendStateBack();
+                }
                 m_curversion.first = "default";
                 m_curversion.second = 0;
                 m_countmarker = 0;
@@ -641,8 +657,11 @@ void SCAgent::HandleRead(broker::CMessage msg)
                 collectstate.clear();
             }
         }
-        else if (incomingVer_ != m_curversion && m_curversion.first != "default")
-            //receive a new marker from other peer
+        else if (incomingVer_ != m_curversion && m_curversion.first != "default"
+            && m_curversion < incomingVer_)
+            //receive a new marker from other peer. When two collections run
+            //at once the greater version wins; switching to whichever marker
+            //came last has every node forward both markers back and forth
         {
 	    Logger.Info << "===================================================" << std::endl;
             Logger.Info << "Receive a new marker different from current one." << std::endl;
@@ -662,10 +681,13 @@ void SCAgent::HandleRead(broker::CMessage msg)
             if (m_AllPeers.size()==2)
                 //only two nodes, peer finish collecting states: send marker then state back
             {
-                //send marker back to initiator
-                GetPeer(m_curversion.first)->AsyncSend(msg);
-                //send collected states to initiator
-                SendStateBack();
+                //send marker and collected states back to initiator, unless
+                //it has left the peer set since it sent the marker
+                if (GetPeer(m_curversion.first))
+                {
+                    GetPeer(m_curversion.first)->AsyncSend(msg);
+                    SendStateBack();
+                }
                 m_curversion.first = "default";
                 m_curversion.second = 0;
                 m_countmarker = 0;
@@ -57,6 +57,7 @@ using boost::property_tree::ptree;
 #include "CDispatcher.hpp"
 #include "CConnectionManager.hpp"
 #include "CConnection.hpp"
+#include "CClock.hpp"
 
 #include "device/CPhysicalDeviceManager.hpp"
 #include "device/PhysicalDeviceTypes.hpp"
@@ -97,7 +98,7 @@ class SCAgent : public IReadHandler, public SCPeerNode, public Templates::Single
     ~SCAgent();
     //Handler
     ///Handle receiving messages      
-    virtual void HandleRead(broker::CMessage msg);
+    virtual void HandleRead(const broker::CMessage &msg);
 
   private:
     //Marker structure
@@ -155,7 +156,7 @@ class SCAgent : public IReadHandler, public SCPeerNode, public Templates::Single
     PeerSet m_AllPeers;
 
     //IO and Timers
-    deadline_timer      m_TimeoutTimer;
+    broker::CClock::Timer m_TimeoutTimer;
         
 };
 
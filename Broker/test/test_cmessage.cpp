@@ -63,7 +63,7 @@ void test_message_save()
     {
         child_.add("type", str[0] );
         child_.add("value", str[1] );
-        m.m_submessages.add_child( "submessage", child_ );
+        m.GetSubMessages().add_child( "submessage", child_ );
         child_.clear();
     }
     m.m_status = freedm::broker::CMessage::OK;
@@ -95,7 +95,7 @@ void test_message_load()
         std::string( "00000000-0000-0000-0000-000000000000"),
         m.m_srcUUID );
     BOOST_CHECK_EQUAL( freedm::broker::CMessage::OK, m.m_status );
-    BOOST_CHECK_MESSAGE( m.m_submessages == submessages_,
+    BOOST_CHECK_MESSAGE( m.GetSubMessages() == submessages_,
         "ptree check between m and submessages_ failed." );
 
 }
@@ -122,7 +122,7 @@ void test_message_save_load()
     {
         child_.add("type", str[0] );
         child_.add("value", str[1] );
-        m1.m_submessages.add_child( "submessage", child_ );
+        m1.GetSubMessages().add_child( "submessage", child_ );
         child_.clear();
     }
 
@@ -136,12 +136,12 @@ void test_message_save_load()
 
     // Check against static values
     BOOST_CHECK_EQUAL( std::string( "00000000-0000-0000-0000-000000000000"), m2.m_srcUUID );
-    BOOST_CHECK_MESSAGE( m2.m_submessages == submessages_, "ptree static checks failed.");
+    BOOST_CHECK_MESSAGE( m2.GetSubMessages() == submessages_, "ptree static checks failed.");
     BOOST_CHECK_EQUAL( freedm::broker::CMessage::OK, m2.m_status );
 
     // Check against other values
     BOOST_CHECK_EQUAL( m1.m_srcUUID, m2.m_srcUUID );
-    BOOST_CHECK_MESSAGE( m1.m_submessages == m2.m_submessages, "ptree check between m1 and m2 failed." );
+    BOOST_CHECK_MESSAGE( m1.GetSubMessages() == m2.GetSubMessages(), "ptree check between m1 and m2 failed." );
     BOOST_CHECK_EQUAL( m1.m_status, m2.m_status );
 
 
@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_digest.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the message digests
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "CDigest.hpp"
+#include "CGlobalConfiguration.hpp"
+#include "unit_test.hpp"
+
+#include <sstream>
+#include <string>
+
+using namespace freedm::broker;
+using freedm::CGlobalConfiguration;
+
+static CMessage make_message()
+{
+    CMessage m_;
+    m_.SetSourceUUID("36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.SetSequenceNumber(17);
+    m_.SetProtocol("SRC");
+    m_.SetSendTimestampNow();
+    m_.SetExpireTimeFromNow(boost::posix_time::milliseconds(3000));
+    m_.GetSubMessages().put("gm", "AreYouCoordinator");
+    m_.GetSubMessages().add("gm.peer", "a");
+    m_.GetSubMessages().put("gm.groupid", 7);
+    return m_;
+}
+
+/// Reference values from the xxHash and SipHash distributions
+void test_digest_vectors()
+{
+    unsigned char bytes_[15];
+    for(int i = 0; i < 15; i++)
+        bytes_[i] = i;
+
+    BOOST_CHECK( CDigest::XXHash64("", 0, 0) == 0xEF46DB3751D8E999ULL );
+    BOOST_CHECK( CDigest::XXHash64("a", 1, 0) == 0xD24EC4F1A98C6E5BULL );
+    BOOST_CHECK( CDigest::XXHash64("abc", 3, 0) == 0x44BC2CF5AD770999ULL );
+    BOOST_CHECK( CDigest::SipHash24("", 0, 0x0706050403020100ULL,
+        0x0F0E0D0C0B0A0908ULL) == 0x726FDB47DD0E0E31ULL );
+    BOOST_CHECK( CDigest::SipHash24(bytes_, 15, 0x0706050403020100ULL,
+        0x0F0E0D0C0B0A0908ULL) == 0xA129CA6149BE45E5ULL );
+}
+
+/// The sender digests its tree, the receiver the bytes it was sent
+void test_digest_binary_roundtrip()
+{
+    CMessage in_ = make_message(), out_;
+    std::string buf_;
+
+    CWireCodec::Encode(in_, buf_);
+    BOOST_CHECK( CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+    BOOST_CHECK_EQUAL( out_.GetHash(), in_.GetHash() );
+
+    CGlobalConfiguration::instance().SetStrongDigest(true);
+    CMessage strong_ = make_message();
+    strong_.SetSendTimestamp(in_.GetSendTimestamp());
+    out_ = CMessage();
+    BOOST_CHECK( CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+    BOOST_CHECK_EQUAL( out_.GetHash(), strong_.GetHash() );
+    BOOST_CHECK( strong_.GetHash() != in_.GetHash() );
+    CGlobalConfiguration::instance().SetStrongDigest(false);
+}
+
+void test_digest_xml_roundtrip()
+{
+    CMessage in_ = make_message(), out_;
+    std::stringstream ss_;
+
+    in_.Save(ss_);
+    BOOST_CHECK( out_.Load(ss_) );
+    BOOST_CHECK_EQUAL( out_.GetHash(), in_.GetHash() );
+    BOOST_CHECK_EQUAL( out_.GetLegacyHash(), in_.GetLegacyHash() );
+}
+
+/// A cached digest must not outlive the fields it covers
+void test_digest_invalidated()
+{
+    CMessage m_ = make_message();
+    size_t first_ = m_.GetHash();
+
+    m_.SetSendTimestamp(m_.GetSendTimestamp() +
+        boost::posix_time::microseconds(1));
+    size_t second_ = m_.GetHash();
+    BOOST_CHECK( second_ != first_ );
+
+    m_.GetSubMessages().put("gm.groupid", 8);
+    BOOST_CHECK( m_.GetHash() != second_ );
+
+    CMessage copy_ = m_;
+    BOOST_CHECK_EQUAL( copy_.GetHash(), m_.GetHash() );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CDigest Tests");
+
+    test->add(BOOST_TEST_CASE(&test_digest_vectors));
+    test->add(BOOST_TEST_CASE(&test_digest_binary_roundtrip));
+    test->add(BOOST_TEST_CASE(&test_digest_xml_roundtrip));
+    test->add(BOOST_TEST_CASE(&test_digest_invalidated));
+
+    return test;
+}
@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_eventlog.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the binary event log
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "CEventLog.hpp"
+#include "unit_test.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+using freedm::broker::CEventLog;
+
+namespace {
+
+/// A log file in the working directory, removed when the test is done
+struct TempLog
+{
+    TempLog(const char *p_path) : path(p_path) { std::remove( p_path ); }
+    ~TempLog() { std::remove( path.c_str() ); }
+    std::string path;
+};
+
+/// Every record in a log, or none if the header is bad
+std::vector<CEventLog::Event> read_all(const std::string &p_path)
+{
+    std::vector<CEventLog::Event> events_;
+    std::ifstream in_( p_path.c_str(), std::ios::binary );
+    if( CEventLog::ReadHeader( in_ ) )
+    {
+        CEventLog::Event e_;
+        while( CEventLog::ReadEvent( in_, e_ ) )
+        {
+            events_.push_back( e_ );
+        }
+    }
+    return events_;
+}
+
+void record_sends(unsigned int p_count)
+{
+    for( unsigned int i = 0; i < p_count; i++ )
+    {
+        CEventLog::Record( CEventLog::SR_SEND, 7, i, -1 );
+    }
+}
+
+} // unnamed namespace
+
+/// Records written by one thread read back with every field intact
+void test_eventlog_roundtrip()
+{
+    TempLog file_( "test_eventlog_roundtrip.bin" );
+    {
+        CEventLog log_( file_.path );
+        log_.Start();
+        record_sends( 300 );
+        CEventLog::Record( CEventLog::GM_AYC_RESPONSE, 4294967295U,
+            -9223372036854775807LL, 1 );
+        log_.Stop();
+        CEventLog::Record( CEventLog::SR_EXPIRE, 1 );
+    }
+    std::vector<CEventLog::Event> events_ = read_all( file_.path );
+    BOOST_REQUIRE_EQUAL( events_.size(), 301U );
+    for( unsigned int i = 0; i < 300; i++ )
+    {
+        BOOST_CHECK_EQUAL( events_[i].type, CEventLog::SR_SEND );
+        BOOST_CHECK_EQUAL( events_[i].peer, 7U );
+        BOOST_CHECK_EQUAL( events_[i].a, boost::int64_t(i) );
+        BOOST_CHECK_EQUAL( events_[i].b, -1 );
+        BOOST_CHECK( i == 0 || events_[i].time >= events_[i-1].time );
+    }
+    BOOST_CHECK_EQUAL( events_[300].peer, 4294967295U );
+    BOOST_CHECK_EQUAL( events_[300].a, -9223372036854775807LL );
+    BOOST_CHECK_EQUAL( std::string(
+        CEventLog::GetTypeName( events_[300].type ) ), "GM_AYC_RESPONSE" );
+}
+
+/// A thread's buffered records are written when it exits, and a second
+/// run appends to the file without another header
+void test_eventlog_threads()
+{
+    TempLog file_( "test_eventlog_threads.bin" );
+    for( int run = 0; run < 2; run++ )
+    {
+        CEventLog log_( file_.path );
+        log_.Start();
+        boost::thread worker_( boost::bind( &record_sends, 5 ) );
+        worker_.join();
+        record_sends( 3 );
+        log_.Stop();
+    }
+    std::vector<CEventLog::Event> events_ = read_all( file_.path );
+    BOOST_REQUIRE_EQUAL( events_.size(), 16U );
+    BOOST_CHECK( events_[0].thread != events_[15].thread );
+}
+
+/// Names are split into PEER_NAME records that reassemble to the UUID
+void test_eventlog_names()
+{
+    TempLog file_( "test_eventlog_names.bin" );
+    const std::string uuid_ = "0d95c1e4-82b1-5e0e-a36c-8dcb1e3d7b8c:node:1870";
+    {
+        CEventLog log_( file_.path );
+        log_.Start();
+        CEventLog::RecordName( 3, uuid_ );
+        log_.Stop();
+    }
+    std::vector<CEventLog::Event> events_ = read_all( file_.path );
+    BOOST_REQUIRE_EQUAL( events_.size(), ( uuid_.size() + 7 ) / 8 );
+    std::string name_;
+    for( std::size_t i = 0; i < events_.size(); i++ )
+    {
+        BOOST_CHECK_EQUAL( events_[i].type, CEventLog::PEER_NAME );
+        BOOST_CHECK_EQUAL( events_[i].peer, 3U );
+        BOOST_CHECK_EQUAL( events_[i].a, boost::int64_t(i) );
+        for( int j = 0; j < 8; j++ )
+        {
+            char c_ = static_cast<char>( ( events_[i].b >> ( 8 * j ) ) & 0xFF );
+            if( c_ != 0 )
+                name_ += c_;
+        }
+    }
+    BOOST_CHECK_EQUAL( name_, uuid_ );
+}
+
+/// Nothing is recorded before a log is started
+void test_eventlog_idle()
+{
+    TempLog file_( "test_eventlog_idle.bin" );
+    record_sends( 10 );
+    {
+        CEventLog log_( file_.path );
+        record_sends( 10 );
+    }
+    std::vector<CEventLog::Event> events_ = read_all( file_.path );
+    BOOST_CHECK_EQUAL( events_.size(), 0U );
+    std::ifstream in_( file_.path.c_str(), std::ios::binary );
+    BOOST_CHECK( CEventLog::ReadHeader( in_ ) );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CEventLog Tests");
+
+    test->add(BOOST_TEST_CASE(&test_eventlog_roundtrip));
+    test->add(BOOST_TEST_CASE(&test_eventlog_threads));
+    test->add(BOOST_TEST_CASE(&test_eventlog_names));
+    test->add(BOOST_TEST_CASE(&test_eventlog_idle));
+
+    return test;
+}
@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_failuredetector.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the phi accrual failure detector
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#include "CFailureDetector.hpp"
+#include "unit_test.hpp"
+
+using namespace freedm::broker;
+using boost::posix_time::milliseconds;
+using boost::posix_time::ptime;
+
+static const ptime EPOCH(boost::gregorian::date(2000, 1, 1));
+
+/// Sends p_count heartbeats from p_peer, p_gap apart, and returns when the
+/// last one arrived
+static ptime beat(CFailureDetector &p_fd, const std::string &p_peer,
+    int p_count, long p_gap)
+{
+    ptime t_ = EPOCH;
+    for(int i = 0; i < p_count; i++)
+    {
+        t_ += milliseconds(p_gap);
+        p_fd.Heartbeat(p_peer, t_);
+    }
+    return t_;
+}
+
+void test_fd_unwatched()
+{
+    CFailureDetector fd_(milliseconds(1000), 8);
+    BOOST_CHECK( !fd_.IsWatching("a") );
+    BOOST_CHECK_EQUAL( fd_.Phi("a", EPOCH), 0.0 );
+    BOOST_CHECK( fd_.IsAvailable("a", EPOCH + milliseconds(60000)) );
+}
+
+/// With the least deviation a quarter of the interval, phi 8 is reached
+/// about 2.3 intervals after the last heartbeat
+void test_fd_detection_time()
+{
+    CFailureDetector fd_(milliseconds(1000), 8);
+    BOOST_CHECK( fd_.GetDetectionTime() > milliseconds(2200) );
+    BOOST_CHECK( fd_.GetDetectionTime() < milliseconds(2400) );
+
+    CFailureDetector strict_(milliseconds(1000), 3);
+    BOOST_CHECK( strict_.GetDetectionTime() < fd_.GetDetectionTime() );
+}
+
+/// A regular peer is trusted for a little past its interval, and
+/// suspected once it has been silent for the detection time
+void test_fd_regular()
+{
+    CFailureDetector fd_(milliseconds(1000), 8);
+    ptime last_ = beat(fd_, "a", 50, 1000);
+    BOOST_CHECK( fd_.Phi("a", last_ + milliseconds(500)) < 0.1 );
+    BOOST_CHECK( fd_.Phi("a", last_ + milliseconds(1000)) < 1 );
+    BOOST_CHECK( fd_.IsAvailable("a", last_ + milliseconds(2000)) );
+    BOOST_CHECK( !fd_.IsAvailable("a", last_ + milliseconds(2500)) );
+    BOOST_CHECK( fd_.Phi("a", last_ + milliseconds(2000)) <
+        fd_.Phi("a", last_ + milliseconds(2200)) );
+}
+
+/// A peer whose heartbeats have been irregular is given longer
+void test_fd_jitter()
+{
+    CFailureDetector fd_(milliseconds(1000), 8);
+    ptime t_ = EPOCH;
+    for(int i = 0; i < 50; i++)
+    {
+        t_ += milliseconds(i % 2 ? 300 : 1700);
+        fd_.Heartbeat("a", t_);
+    }
+    BOOST_CHECK( fd_.IsAvailable("a", t_ + milliseconds(2500)) );
+    BOOST_CHECK( !fd_.IsAvailable("a", t_ + milliseconds(6000)) );
+}
+
+/// Watching starts the clock once; a late heartbeat is ignored
+void test_fd_watch()
+{
+    CFailureDetector fd_(milliseconds(1000), 8);
+    fd_.Watch("a", EPOCH);
+    BOOST_CHECK( fd_.IsWatching("a") );
+    fd_.Watch("a", EPOCH + milliseconds(2000));
+    BOOST_CHECK( !fd_.IsAvailable("a", EPOCH + milliseconds(2500)) );
+
+    fd_.Heartbeat("a", EPOCH + milliseconds(3000));
+    fd_.Heartbeat("a", EPOCH + milliseconds(1000));
+    BOOST_CHECK( fd_.IsAvailable("a", EPOCH + milliseconds(4000)) );
+
+    fd_.Watch("b", EPOCH);
+    fd_.Forget("a");
+    BOOST_CHECK( !fd_.IsWatching("a") );
+    BOOST_CHECK( fd_.IsWatching("b") );
+    fd_.Clear();
+    BOOST_CHECK( !fd_.IsWatching("b") );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CFailureDetector Tests");
+
+    test->add(BOOST_TEST_CASE(&test_fd_unwatched));
+    test->add(BOOST_TEST_CASE(&test_fd_detection_time));
+    test->add(BOOST_TEST_CASE(&test_fd_regular));
+    test->add(BOOST_TEST_CASE(&test_fd_jitter));
+    test->add(BOOST_TEST_CASE(&test_fd_watch));
+
+    return test;
+}
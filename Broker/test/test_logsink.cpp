@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_logsink.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the background log writer
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CLogSink.hpp"
+#include "CLogger.hpp"
+#include "unit_test.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <sstream>
+#include <streambuf>
+
+using boost::posix_time::microsec_clock;
+
+namespace {
+
+const std::string NAME = "Notice";
+
+/// A stream buffer the writer blocks in until the test opens it
+class GateBuffer : public std::streambuf
+{
+public:
+    GateBuffer() : m_open(false) { }
+    void Open()
+    {
+        boost::lock_guard< boost::mutex > lock_( m_mutex );
+        m_open = true;
+        m_changed.notify_all();
+    }
+    std::string Text()
+    {
+        boost::lock_guard< boost::mutex > lock_( m_mutex );
+        return m_text;
+    }
+protected:
+    int overflow(int c)
+    {
+        char ch = c;
+        xsputn( &ch, 1 );
+        return c;
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        boost::unique_lock< boost::mutex > lock_( m_mutex );
+        while( !m_open )
+        {
+            m_changed.wait( lock_ );
+        }
+        m_text.append( s, n );
+        return n;
+    }
+private:
+    boost::mutex m_mutex;
+    boost::condition_variable m_changed;
+    bool m_open;
+    std::string m_text;
+};
+
+void push(CLogSink &p_sink, unsigned int p_line)
+{
+    std::string text_ = "line " + boost::lexical_cast<std::string>(p_line)
+        + "\n";
+    p_sink.Push( microsec_clock::local_time(), &NAME, 5, text_.data(),
+        text_.size() );
+}
+
+void push_range(CLogSink *p_sink, unsigned int p_first, unsigned int p_last)
+{
+    for( unsigned int i = p_first; i <= p_last; i++ )
+    {
+        push( *p_sink, i );
+    }
+}
+
+/// True if lines first..last appear in p_text in order
+bool in_order(const std::string &p_text, unsigned int p_first,
+    unsigned int p_last)
+{
+    std::size_t at_ = 0;
+    for( unsigned int i = p_first; i <= p_last; i++ )
+    {
+        at_ = p_text.find( "):\tline " + boost::lexical_cast<std::string>(i)
+            + "\n", at_ );
+        if( at_ == std::string::npos )
+            return false;
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+/// Lines come out whole and in the order they were pushed
+void test_logsink_order()
+{
+    std::ostringstream out_;
+    CLogSink sink_( 16, CLogSink::BLOCK, &out_ );
+    sink_.Start();
+    push_range( &sink_, 1, 100 );
+    sink_.Flush();
+    BOOST_CHECK( in_order( out_.str(), 1, 100 ) );
+    BOOST_CHECK( out_.str().find( "Notice(5):\tline 1\n" ) != std::string::npos );
+    CLogSink::Stats stats_ = sink_.GetStats();
+    BOOST_CHECK_EQUAL( stats_.written, 100UL );
+    BOOST_CHECK_EQUAL( stats_.dropped, 0UL );
+    BOOST_CHECK( stats_.batches >= 1UL && stats_.batches <= 100UL );
+    sink_.Stop();
+}
+
+/// A full ring drops lines, counts them and says so in the log
+void test_logsink_drop()
+{
+    GateBuffer gate_;
+    std::ostream out_( &gate_ );
+    CLogSink sink_( 4, CLogSink::DROP, &out_ );
+    sink_.Start();
+    push_range( &sink_, 1, 21 );
+    gate_.Open();
+    sink_.Flush();
+    CLogSink::Stats stats_ = sink_.GetStats();
+    BOOST_CHECK( stats_.dropped > 0UL );
+    BOOST_CHECK_EQUAL( stats_.written + stats_.dropped, 21UL );
+    sink_.Stop();
+    BOOST_CHECK( gate_.Text().find( "dropped" ) != std::string::npos );
+}
+
+/// A full ring holds the pusher until the writer makes room
+void test_logsink_block()
+{
+    GateBuffer gate_;
+    std::ostream out_( &gate_ );
+    CLogSink sink_( 4, CLogSink::BLOCK, &out_ );
+    sink_.Start();
+    boost::thread pusher_( boost::bind( &push_range, &sink_, 1, 50 ) );
+    boost::this_thread::sleep( boost::posix_time::milliseconds( 50 ) );
+    gate_.Open();
+    pusher_.join();
+    sink_.Flush();
+    BOOST_CHECK( in_order( gate_.Text(), 1, 50 ) );
+    BOOST_CHECK_EQUAL( sink_.GetStats().dropped, 0UL );
+    sink_.Stop();
+}
+
+/// Loggers go through the started sink and write directly once it stops
+void test_logsink_logger()
+{
+    CLocalLogger logger_( "test_logsink" );
+    logger_.SetOutputLevel( 5 );
+    std::ostringstream out_;
+    CLogSink sink_( 16, CLogSink::DROP, &out_ );
+    BOOST_CHECK( CLogSink::Current() == 0 );
+    sink_.Start();
+    BOOST_CHECK( CLogSink::Current() == &sink_ );
+    logger_.Notice << "through the sink" << std::endl;
+    logger_.Info << "filtered" << std::endl;
+    sink_.Flush();
+    BOOST_CHECK( out_.str().find( "Notice(5):\tthrough the sink\n" )
+        != std::string::npos );
+    BOOST_CHECK( out_.str().find( "filtered" ) == std::string::npos );
+    sink_.Stop();
+    BOOST_CHECK( CLogSink::Current() == 0 );
+    BOOST_CHECK_EQUAL( sink_.GetStats().written, 1UL );
+}
+
+/// Policy names as written in the configuration
+void test_logsink_policy()
+{
+    CLogSink::OverflowPolicy policy_ = CLogSink::BLOCK;
+    BOOST_CHECK( CLogSink::ParsePolicy( "drop", policy_ ) );
+    BOOST_CHECK( policy_ == CLogSink::DROP );
+    BOOST_CHECK( CLogSink::ParsePolicy( "block", policy_ ) );
+    BOOST_CHECK( policy_ == CLogSink::BLOCK );
+    BOOST_CHECK( !CLogSink::ParsePolicy( "wait", policy_ ) );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CLogSink Tests");
+
+    test->add(BOOST_TEST_CASE(&test_logsink_order));
+    test->add(BOOST_TEST_CASE(&test_logsink_drop));
+    test->add(BOOST_TEST_CASE(&test_logsink_block));
+    test->add(BOOST_TEST_CASE(&test_logsink_logger));
+    test->add(BOOST_TEST_CASE(&test_logsink_policy));
+
+    return test;
+}
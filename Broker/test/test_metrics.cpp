@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_metrics.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the metrics registry and its scrape endpoint
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "CMetrics.hpp"
+#include "CMetricsServer.hpp"
+#include "unit_test.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <sstream>
+#include <string>
+
+using freedm::broker::CMetrics;
+using freedm::broker::CMetricsServer;
+
+namespace {
+
+void add_many(CMetrics::Counter *p_counter, CMetrics::Histogram *p_histogram)
+{
+    for( unsigned int i = 0; i < 10000; i++ )
+    {
+        p_counter->Add();
+        p_histogram->Record( i % 100 );
+    }
+}
+
+/// Sends a request and reads until the server closes the connection
+std::string scrape(unsigned short p_port)
+{
+    using boost::asio::ip::tcp;
+    boost::asio::io_service ios_;
+    tcp::socket socket_( ios_ );
+    socket_.connect( tcp::endpoint(
+        boost::asio::ip::address_v4::loopback(), p_port ) );
+    boost::asio::write( socket_,
+        boost::asio::buffer( std::string( "GET /metrics HTTP/1.0\r\n\r\n" ) ) );
+    boost::asio::streambuf response_;
+    boost::system::error_code error_;
+    boost::asio::read( socket_, response_, error_ );
+    std::ostringstream out_;
+    out_ << &response_;
+    return out_.str();
+}
+
+} // unnamed namespace
+
+/// Every value lands in a bucket whose limit is within 1/8 above it
+void test_metrics_buckets()
+{
+    unsigned int last_ = 0;
+    boost::uint64_t values_[] = { 0, 1, 7, 8, 9, 15, 16, 17, 100, 1000,
+        123456, 4294967296ULL, 18446744073709551615ULL };
+    for( std::size_t i = 0; i < sizeof(values_) / sizeof(values_[0]); i++ )
+    {
+        unsigned int bucket_ = CMetrics::Histogram::GetBucket( values_[i] );
+        BOOST_CHECK( bucket_ < CMetrics::Histogram::BUCKETS );
+        BOOST_CHECK( bucket_ >= last_ );
+        last_ = bucket_;
+        boost::uint64_t limit_ = CMetrics::Histogram::GetBucketLimit( bucket_ );
+        BOOST_CHECK( limit_ >= values_[i] );
+        BOOST_CHECK( limit_ - values_[i] <= values_[i] / 8 );
+        BOOST_CHECK( bucket_ == 0 ||
+            CMetrics::Histogram::GetBucketLimit( bucket_ - 1 ) < values_[i] );
+    }
+    BOOST_CHECK_EQUAL( CMetrics::Histogram::GetBucket(
+        18446744073709551615ULL ), CMetrics::Histogram::BUCKETS - 1 );
+}
+
+/// Quantiles come from the buckets and never exceed the largest value
+void test_metrics_quantiles()
+{
+    CMetrics::Histogram &h_ = CMetrics::GetHistogram( "test_quantiles" );
+    BOOST_CHECK_EQUAL( h_.GetQuantile( 0.5 ), 0U );
+    for( unsigned int i = 1; i <= 1000; i++ )
+    {
+        h_.Record( i );
+    }
+    BOOST_CHECK_EQUAL( h_.GetCount(), 1000U );
+    BOOST_CHECK_EQUAL( h_.GetSum(), 500500U );
+    BOOST_CHECK_EQUAL( h_.GetMax(), 1000U );
+    boost::uint64_t p50_ = h_.GetQuantile( 0.5 );
+    BOOST_CHECK( p50_ >= 500 && p50_ <= 500 + 500 / 8 );
+    BOOST_CHECK_EQUAL( h_.GetQuantile( 1.0 ), 1000U );
+    h_.Record( boost::posix_time::milliseconds( -5 ) );
+    BOOST_CHECK_EQUAL( h_.GetCount(), 1001U );
+}
+
+/// The same name and labels find the same metric, from any thread
+void test_metrics_registry()
+{
+    std::string labels_ = CMetrics::Label( "peer", "a\"b" );
+    BOOST_CHECK_EQUAL( labels_, "peer=\"a\\\"b\"" );
+    CMetrics::Counter &c_ = CMetrics::GetCounter( "test_total", labels_ );
+    BOOST_CHECK( &c_ == &CMetrics::GetCounter( "test_total", labels_ ) );
+    BOOST_CHECK( &c_ != &CMetrics::GetCounter( "test_total" ) );
+    CMetrics::Histogram &h_ = CMetrics::GetHistogram( "test_threads" );
+    boost::thread a_( boost::bind( &add_many, &c_, &h_ ) );
+    boost::thread b_( boost::bind( &add_many, &c_, &h_ ) );
+    a_.join();
+    b_.join();
+    BOOST_CHECK_EQUAL( c_.Get(), 20000UL );
+    BOOST_CHECK_EQUAL( h_.GetCount(), 20000U );
+    BOOST_CHECK_EQUAL( h_.GetMax(), 99U );
+
+    CMetrics::GetGauge( "test_gauge" ).Set( -3 );
+    std::ostringstream out_;
+    CMetrics::Write( out_ );
+    BOOST_CHECK( out_.str().find( "# TYPE test_total counter\n" )
+        != std::string::npos );
+    BOOST_CHECK( out_.str().find( "test_total{peer=\"a\\\"b\"} 20000\n" )
+        != std::string::npos );
+    BOOST_CHECK( out_.str().find( "test_gauge -3\n" ) != std::string::npos );
+    BOOST_CHECK( out_.str().find( "test_threads{quantile=\"0.5\"} " )
+        != std::string::npos );
+    BOOST_CHECK( out_.str().find( "test_threads_count 20000\n" )
+        != std::string::npos );
+}
+
+/// A scraper on the loopback address gets the text over HTTP
+void test_metrics_server()
+{
+    boost::asio::io_service ios_;
+    CMetricsServer server_( ios_, 0 );
+    server_.Start();
+    boost::thread runner_( boost::bind( &boost::asio::io_service::run,
+        &ios_ ) );
+    CMetrics::GetCounter( "test_scraped_total" ).Add( 7 );
+    std::string first_ = scrape( server_.GetPort() );
+    std::string second_ = scrape( server_.GetPort() );
+    server_.Stop();
+    runner_.join();
+    BOOST_CHECK( first_.find( "HTTP/1.0 200 OK\r\n" ) == 0 );
+    BOOST_CHECK( first_.find( "\r\n\r\n" ) != std::string::npos );
+    BOOST_CHECK( first_.find( "test_scraped_total 7\n" )
+        != std::string::npos );
+    BOOST_CHECK( second_.find( "test_scraped_total 7\n" )
+        != std::string::npos );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CMetrics Tests");
+
+    test->add(BOOST_TEST_CASE(&test_metrics_buckets));
+    test->add(BOOST_TEST_CASE(&test_metrics_quantiles));
+    test->add(BOOST_TEST_CASE(&test_metrics_registry));
+    test->add(BOOST_TEST_CASE(&test_metrics_server));
+
+    return test;
+}
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_resolver.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the caching peer name resolver
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CResolver.hpp"
+#include "unit_test.hpp"
+
+#include <boost/bind.hpp>
+
+using namespace freedm::broker;
+using boost::asio::ip::udp;
+
+/// Remembers what the resolver answered
+struct Answer
+{
+    Answer() : calls(0) { }
+    void Set(const boost::system::error_code &p_error,
+        const udp::endpoint &p_endpoint)
+    {
+        error = p_error;
+        endpoint = p_endpoint;
+        calls++;
+    }
+    boost::system::error_code error;
+    udp::endpoint endpoint;
+    int calls;
+};
+
+static void resolve(CResolver &p_resolver, const std::string &p_host,
+    const std::string &p_port, Answer &p_answer)
+{
+    boost::asio::io_service ios_;
+    int calls_ = p_answer.calls;
+    p_resolver.Resolve(ios_, p_host, p_port,
+        boost::bind(&Answer::Set, &p_answer, _1, _2));
+    // Never called from inside Resolve
+    BOOST_CHECK_EQUAL( p_answer.calls, calls_ );
+    ios_.run();
+}
+
+/// Numeric addresses are parsed without a lookup
+void test_resolver_numeric()
+{
+    CResolver resolver_(300);
+    Answer answer_;
+    resolve(resolver_, "127.0.0.1", "1870", answer_);
+    BOOST_CHECK_EQUAL( answer_.calls, 1 );
+    BOOST_CHECK( !answer_.error );
+    BOOST_CHECK( answer_.endpoint == udp::endpoint(
+        boost::asio::ip::address::from_string("127.0.0.1"), 1870) );
+
+    CResolver::Stats stats_ = resolver_.GetStats();
+    BOOST_CHECK_EQUAL( stats_.lookups, 1UL );
+    BOOST_CHECK_EQUAL( stats_.hits, 1UL );
+    BOOST_CHECK_EQUAL( stats_.pending, 0U );
+}
+
+/// A name is looked up once and then answered from the cache
+void test_resolver_cache()
+{
+    CResolver resolver_(300);
+    Answer first_, second_;
+    resolve(resolver_, "localhost", "1870", first_);
+    resolve(resolver_, "localhost", "1870", second_);
+    BOOST_CHECK_EQUAL( first_.calls, 1 );
+    BOOST_CHECK_EQUAL( second_.calls, 1 );
+    BOOST_CHECK( !first_.error );
+    BOOST_CHECK( first_.endpoint == second_.endpoint );
+    BOOST_CHECK_EQUAL( first_.endpoint.port(), 1870 );
+
+    CResolver::Stats stats_ = resolver_.GetStats();
+    BOOST_CHECK_EQUAL( stats_.lookups, 2UL );
+    BOOST_CHECK_EQUAL( stats_.hits, 1UL );
+
+    // A different port is a different entry
+    Answer other_;
+    resolve(resolver_, "localhost", "1871", other_);
+    BOOST_CHECK_EQUAL( resolver_.GetStats().hits, 1UL );
+
+    // Clearing forgets the answers
+    resolver_.Clear();
+    resolve(resolver_, "localhost", "1870", second_);
+    BOOST_CHECK_EQUAL( resolver_.GetStats().hits, 1UL );
+}
+
+/// With no TTL every request goes to the system resolver
+void test_resolver_no_ttl()
+{
+    CResolver resolver_(0);
+    Answer answer_;
+    resolve(resolver_, "localhost", "1870", answer_);
+    resolve(resolver_, "localhost", "1870", answer_);
+    BOOST_CHECK_EQUAL( answer_.calls, 2 );
+    BOOST_CHECK_EQUAL( resolver_.GetStats().hits, 0UL );
+}
+
+/// Requests made while a lookup runs share it
+void test_resolver_shared()
+{
+    CResolver resolver_(300);
+    boost::asio::io_service ios_;
+    Answer first_, second_;
+    resolver_.Resolve(ios_, "localhost", "1870",
+        boost::bind(&Answer::Set, &first_, _1, _2));
+    resolver_.Resolve(ios_, "localhost", "1870",
+        boost::bind(&Answer::Set, &second_, _1, _2));
+    BOOST_CHECK_EQUAL( resolver_.GetStats().pending, 1U );
+    ios_.run();
+    BOOST_CHECK_EQUAL( first_.calls, 1 );
+    BOOST_CHECK_EQUAL( second_.calls, 1 );
+    BOOST_CHECK( first_.endpoint == second_.endpoint );
+    BOOST_CHECK_EQUAL( resolver_.GetStats().pending, 0U );
+}
+
+/// Failures are reported, counted and remembered
+void test_resolver_failure()
+{
+    CResolver resolver_(300);
+    Answer first_, second_;
+    resolve(resolver_, "localhost", "no-such-service", first_);
+    BOOST_CHECK_EQUAL( first_.calls, 1 );
+    BOOST_CHECK( first_.error );
+    BOOST_CHECK_EQUAL( resolver_.GetStats().failures, 1UL );
+
+    resolve(resolver_, "localhost", "no-such-service", second_);
+    BOOST_CHECK( second_.error );
+    BOOST_CHECK_EQUAL( resolver_.GetStats().failures, 1UL );
+    BOOST_CHECK_EQUAL( resolver_.GetStats().hits, 1UL );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CResolver Tests");
+
+    test->add(BOOST_TEST_CASE(&test_resolver_numeric));
+    test->add(BOOST_TEST_CASE(&test_resolver_cache));
+    test->add(BOOST_TEST_CASE(&test_resolver_no_ttl));
+    test->add(BOOST_TEST_CASE(&test_resolver_shared));
+    test->add(BOOST_TEST_CASE(&test_resolver_failure));
+
+    return test;
+}
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_rttestimator.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the round trip time estimator
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "CRttEstimator.hpp"
+#include "unit_test.hpp"
+
+using namespace freedm::broker;
+using boost::posix_time::milliseconds;
+
+static CRttEstimator::Stats sample_once(long p_ms)
+{
+    CRttEstimator rtt_(milliseconds(25), milliseconds(10), milliseconds(1000));
+    rtt_.Sample(milliseconds(p_ms));
+    return rtt_.GetStats();
+}
+
+void test_rtt_initial()
+{
+    CRttEstimator rtt_(milliseconds(25), milliseconds(10), milliseconds(1000));
+    BOOST_CHECK( rtt_.GetRTO() == milliseconds(25) );
+    BOOST_CHECK_EQUAL( rtt_.GetStats().samples, 0UL );
+
+    CRttEstimator low_(milliseconds(1), milliseconds(10), milliseconds(1000));
+    BOOST_CHECK( low_.GetRTO() == milliseconds(10) );
+}
+
+/// The first sample seeds SRTT = R and RTTVAR = R/2, so RTO = 3R
+void test_rtt_first_sample()
+{
+    CRttEstimator::Stats stats_ = sample_once(40);
+    BOOST_CHECK_EQUAL( stats_.srtt, 40000L );
+    BOOST_CHECK_EQUAL( stats_.rttvar, 20000L );
+    BOOST_CHECK_EQUAL( stats_.rto, 120000L );
+
+    // Bounded from below and above
+    BOOST_CHECK_EQUAL( sample_once(1).rto, 10000L );
+    BOOST_CHECK_EQUAL( sample_once(900).rto, 1000000L );
+}
+
+/// Steady samples shrink the deviation towards zero
+void test_rtt_converges()
+{
+    CRttEstimator rtt_(milliseconds(25), milliseconds(10), milliseconds(1000));
+    for(int i = 0; i < 100; i++)
+        rtt_.Sample(milliseconds(40));
+    CRttEstimator::Stats stats_ = rtt_.GetStats();
+    BOOST_CHECK_EQUAL( stats_.srtt, 40000L );
+    BOOST_CHECK( stats_.rttvar < 1000 );
+    BOOST_CHECK( stats_.rto >= 40000 && stats_.rto < 45000 );
+}
+
+/// Each timeout doubles the RTO up to the maximum; a sample ends it
+void test_rtt_backoff()
+{
+    CRttEstimator rtt_(milliseconds(25), milliseconds(10), milliseconds(300));
+    rtt_.Backoff();
+    BOOST_CHECK( rtt_.GetRTO() == milliseconds(50) );
+    rtt_.Backoff();
+    BOOST_CHECK( rtt_.GetRTO() == milliseconds(100) );
+    rtt_.Backoff();
+    rtt_.Backoff();
+    BOOST_CHECK( rtt_.GetRTO() == milliseconds(300) );
+    BOOST_CHECK_EQUAL( rtt_.GetStats().timeouts, 4UL );
+
+    rtt_.Sample(milliseconds(20));
+    BOOST_CHECK( rtt_.GetRTO() == milliseconds(60) );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CRttEstimator Tests");
+
+    test->add(BOOST_TEST_CASE(&test_rtt_initial));
+    test->add(BOOST_TEST_CASE(&test_rtt_first_sample));
+    test->add(BOOST_TEST_CASE(&test_rtt_converges));
+    test->add(BOOST_TEST_CASE(&test_rtt_backoff));
+
+    return test;
+}
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+/// @file      test_wirecodec.cpp
+///
+/// @author    Stephen Jackson <scj7t4@mst.edu>
+///
+/// @compiler  C++
+///
+/// @project   FREEDM DGI
+///
+/// @description Unit tests for the binary datagram encoding
+///
+/// @license
+/// These source code files were created at as part of the
+/// FREEDM DGI Subthrust, and are
+/// intended for use in teaching or research.  They may be
+/// freely copied, modified and redistributed as long
+/// as modified versions are clearly marked as such and
+/// this notice is not removed.
+///
+/// Neither the authors nor the FREEDM Project nor the
+/// National Science Foundation
+/// make any warranty, express or implied, nor assumes
+/// any legal responsibility for the accuracy,
+/// completeness or usefulness of these codes or any
+/// information distributed with these codes.
+///
+/// Suggested modifications or questions about these codes
+/// can be directed to Dr. Bruce McMillin, Department of
+/// Computer Science, Missour University of Science and
+/// Technology, Rolla, /// MO  65409 (ff@mst.edu).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CMessage.hpp"
+#include "CWireCodec.hpp"
+#include "RequestParser.hpp"
+#include "unit_test.hpp"
+
+#include <string>
+#include <vector>
+
+#include <boost/logic/tribool.hpp>
+#include <boost/tuple/tuple.hpp>
+
+using namespace freedm::broker;
+
+static CMessage make_message()
+{
+    CMessage m_;
+    m_.SetSourceUUID("36f3585e-f78c-4c52-af8d-c6a78a27c831");
+    m_.SetSourceHostname(remotehost());
+    m_.SetSequenceNumber(1023);
+    m_.SetProtocol("SRC");
+    m_.SetSendTimestampNow();
+    m_.SetExpireTimeFromNow(boost::posix_time::milliseconds(3000));
+    m_.GetSubMessages().put("gm", "AreYouCoordinator");
+    m_.GetSubMessages().add("gm.peer", "a");
+    m_.GetSubMessages().add("gm.peer", "b");
+    m_.GetSubMessages().put("gm.groupid", 7);
+    ptree pp_;
+    pp_.put("src.hash", 12345);
+    m_.SetProtocolProperties(pp_);
+    return m_;
+}
+
+void test_wirecodec_roundtrip()
+{
+    CMessage in_ = make_message(), out_;
+    std::string buf_;
+
+    CWireCodec::Encode(in_, buf_);
+    BOOST_CHECK( CWireCodec::IsBinary(buf_.data(), buf_.size()) );
+    BOOST_CHECK( CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+
+    BOOST_CHECK_EQUAL( out_.GetSourceUUID(), in_.GetSourceUUID() );
+    BOOST_CHECK_EQUAL( out_.GetSequenceNumber(), in_.GetSequenceNumber() );
+    BOOST_CHECK_EQUAL( out_.GetStatus(), in_.GetStatus() );
+    BOOST_CHECK_EQUAL( out_.GetProtocol(), in_.GetProtocol() );
+    BOOST_CHECK( out_.GetSendTimestamp() == in_.GetSendTimestamp() );
+    BOOST_CHECK( out_.GetExpireTime() == in_.GetExpireTime() );
+    BOOST_CHECK( out_.GetSubMessages() == in_.GetSubMessages() );
+    BOOST_CHECK( out_.GetProtocolProperties() == in_.GetProtocolProperties() );
+    BOOST_CHECK_EQUAL( out_.GetWireVersion(), CWireCodec::VERSION );
+    BOOST_CHECK_EQUAL( out_.GetHash(), in_.GetHash() );
+}
+
+void test_wirecodec_special_values()
+{
+    CMessage in_(CMessage::Accepted), out_;
+    std::string buf_;
+    // Not a canonical uuid, so it has to travel as a string.
+    in_.SetSourceUUID("36F3585E-F78C-4C52-AF8D-C6A78A27C831");
+    in_.SetSequenceNumber(0);
+    in_.SetProtocol("custom");
+
+    CWireCodec::Encode(in_, buf_);
+    BOOST_CHECK( CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+    BOOST_CHECK_EQUAL( out_.GetSourceUUID(), in_.GetSourceUUID() );
+    BOOST_CHECK_EQUAL( out_.GetProtocol(), "custom" );
+    BOOST_CHECK_EQUAL( out_.GetStatus(), CMessage::Accepted );
+    BOOST_CHECK( out_.GetSendTimestamp().is_not_a_date_time() );
+    BOOST_CHECK( out_.GetExpireTime().is_not_a_date_time() );
+}
+
+void test_wirecodec_truncated()
+{
+    CMessage in_ = make_message(), out_;
+    std::string buf_;
+    CWireCodec::Encode(in_, buf_);
+
+    for(std::size_t i = 0; i < buf_.size(); i++)
+    {
+        BOOST_CHECK( !CWireCodec::Decode(buf_.data(), i, out_) );
+    }
+    // A future version is refused rather than misread.
+    buf_[1] = CWireCodec::VERSION + 1;
+    BOOST_CHECK( !CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+}
+
+void test_wirecodec_lazy_submessages()
+{
+    CMessage in_ = make_message(), out_;
+    std::string buf_, again_;
+    in_.GetSubMessages().put("lb", "demand");
+    CWireCodec::Encode(in_, buf_);
+    BOOST_CHECK( CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+
+    // Keys come from the undecoded bytes, in order.
+    std::vector<std::string> keys_ = out_.GetSubMessageKeys();
+    BOOST_REQUIRE_EQUAL( keys_.size(), 2u );
+    BOOST_CHECK_EQUAL( keys_[0], "gm" );
+    BOOST_CHECK_EQUAL( keys_[1], "lb" );
+
+    // Forwarding an undecoded message reproduces the same datagram.
+    CWireCodec::Encode(out_, again_);
+    BOOST_CHECK( again_ == buf_ );
+
+    BOOST_CHECK( out_.GetSubMessages() == in_.GetSubMessages() );
+    BOOST_CHECK( out_.GetSubMessageKeys() == keys_ );
+
+    // A corrupt submessage tree is refused up front, not when it's read.
+    buf_[buf_.size() - 1] = 0x7F;
+    BOOST_CHECK( !CWireCodec::Decode(buf_.data(), buf_.size(), out_) );
+}
+
+void test_wirecodec_parse_detects_format()
+{
+    CMessage in_ = make_message(), xml_, bin_;
+    boost::array<char, 8192> buf_;
+    boost::array<char, 8192>::iterator it_;
+    boost::tribool result_;
+
+    // XML still parses and carries the advertisement.
+    in_.SetWireVersion(CWireCodec::VERSION);
+    boost::tie(result_, it_) = Synthesize(in_, buf_.begin(), buf_.size());
+    BOOST_CHECK( result_ == true );
+    BOOST_CHECK_EQUAL( buf_[0], '<' );
+    boost::tie(result_, boost::tuples::ignore) = Parse(xml_, buf_.data(), &*it_);
+    BOOST_CHECK( result_ == true );
+    BOOST_CHECK_EQUAL( xml_.GetWireVersion(), CWireCodec::VERSION );
+    std::size_t xmlsize_ = it_ - buf_.begin();
+
+    boost::tie(result_, it_) = Synthesize(in_, buf_.begin(), buf_.size(),
+        CWireCodec::VERSION);
+    BOOST_CHECK( result_ == true );
+    BOOST_CHECK( std::size_t(it_ - buf_.begin()) < xmlsize_ );
+    boost::tie(result_, boost::tuples::ignore) = Parse(bin_, buf_.data(), &*it_);
+    BOOST_CHECK( result_ == true );
+    BOOST_CHECK( bin_.GetSubMessages() == xml_.GetSubMessages() );
+    BOOST_CHECK_EQUAL( bin_.GetSequenceNumber(), xml_.GetSequenceNumber() );
+}
+
+test_suite* init_unit_test_suite( int, char*[] )
+{
+    test_suite* test = BOOST_TEST_SUITE("broker/CWireCodec Tests");
+
+    test->add(BOOST_TEST_CASE(&test_wirecodec_roundtrip));
+    test->add(BOOST_TEST_CASE(&test_wirecodec_special_values));
+    test->add(BOOST_TEST_CASE(&test_wirecodec_truncated));
+    test->add(BOOST_TEST_CASE(&test_wirecodec_lazy_submessages));
+    test->add(BOOST_TEST_CASE(&test_wirecodec_parse_detects_format));
+
+    return test;
+}